@@ -5,6 +5,8 @@
 
 #cmakedefine GPERF_SIZE_TYPE @GPERF_SIZE_TYPE@
 #cmakedefine HAVE_EPOLL 1
+#cmakedefine HAVE_RECVMMSG 1
+#cmakedefine HAVE_SENDMMSG 1
 #cmakedefine USE_MYSQL
 #cmakedefine USE_POSTGRESQL
 #cmakedefine USE_MAXMIND_GEOIP
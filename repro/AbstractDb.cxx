@@ -216,6 +216,15 @@ AbstractDb::getUserAuthInfo(  const AbstractDb::Key& key ) const
 }
 
 
+bool
+AbstractDb::lookupUserAuthInfo( const AbstractDb::Key& key, Data& a1 ) const
+{
+   // The local stores only fail to read records that are not there
+   a1 = getUserAuthInfo(key);
+   return true;
+}
+
+
 AbstractDb::Key 
 AbstractDb::firstUserKey()
 {
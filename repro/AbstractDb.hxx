@@ -118,6 +118,9 @@ class AbstractDb
       virtual void eraseUser(const Key& key);
       virtual UserRecord getUser(const Key& key) const;
       virtual resip::Data getUserAuthInfo(const Key& key) const;
+      // As getUserAuthInfo, but returns false if the database could not be
+      // read, so that a1 is only left empty for users that do not exist
+      virtual bool lookupUserAuthInfo(const Key& key, resip::Data& a1) const;
       virtual Key firstUserKey();// return empty if no more
       virtual Key nextUserKey(); // return empty if no more 
 
@@ -108,6 +108,10 @@ CommandServer::handleRequest(unsigned int connectionId, unsigned int requestId,
       {
          handleClearDnsCacheRequest(connectionId, requestId, xml);
       }
+      else if(isEqualNoCase(xml.getTag(), "FlushUserAuthCache"))
+      {
+         handleFlushUserAuthCacheRequest(connectionId, requestId, xml);
+      }
       else if(isEqualNoCase(xml.getTag(), "GetDnsCache"))
       {
          handleGetDnsCacheRequest(connectionId, requestId, xml);
@@ -231,6 +235,15 @@ CommandServer::handleClearDnsCacheRequest(unsigned int connectionId, unsigned in
    sendResponse(connectionId, requestId, Data::Empty, 200, "DNS cache cleared.");
 }
 
+void 
+CommandServer::handleFlushUserAuthCacheRequest(unsigned int connectionId, unsigned int requestId, XMLCursor& xml)
+{
+   InfoLog(<< "CommandServer::handleFlushUserAuthCacheRequest");
+
+   mReproRunner.getProxy()->getUserStore().flushAuthInfoCache();
+   sendResponse(connectionId, requestId, Data::Empty, 200, "User authentication cache flushed.");
+}
+
 void 
 CommandServer::handleGetDnsCacheRequest(unsigned int connectionId, unsigned int requestId, XMLCursor& xml)
 {
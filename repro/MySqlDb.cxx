@@ -16,6 +16,7 @@
 #include "rutil/Data.hxx"
 #include "rutil/DataStream.hxx"
 #include "rutil/Logger.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/ParseBuffer.hxx"
 
 #include "repro/AbstractDb.hxx"
@@ -80,16 +81,20 @@ MySqlDb::MySqlDb(const resip::ConfigParse& config,
    mDBPassword(password),
    mDBName(databaseName),
    mDBPort(port),
-   mCustomUserAuthQuery(customUserAuthQuery),
-   mConn(0)
+   mCustomUserAuthQuery(customUserAuthQuery)
 { 
-   InfoLog( << "Using MySQL DB with server=" << server << ", user=" << user << ", dbName=" << databaseName << ", port=" << port);
+   InfoLog( << "Using MySQL DB with server=" << server << ", user=" << user << ", dbName=" << databaseName << ", port=" << port << ", connections=" << mConnectionPoolSize);
 
    for (int i=0;i<MaxTable;i++)
    {
       mResult[i]=0;
    }
 
+   for (unsigned int i=0;i<mConnectionPoolSize;i++)
+   {
+      mConnections.push_back(std::unique_ptr<Connection>(new Connection(i)));
+   }
+
    mysql_library_init(0, 0, 0);
    if(!mysql_thread_safe())
    {
@@ -97,14 +102,27 @@ MySqlDb::MySqlDb(const resip::ConfigParse& config,
    }
    else
    {
-      connectToDatabase();
+      // Remaining pool connections are opened by the first thread to use them
+      connectToDatabase(*mConnections[0]);
    }
 }
 
 
 MySqlDb::~MySqlDb()
 {
-   disconnectFromDatabase();
+   for (int i=0;i<MaxTable;i++)
+   {
+      if (mResult[i])
+      {  
+         mysql_free_result(mResult[i]); 
+         mResult[i]=0;
+      }
+   }
+
+   for (unsigned int i=0;i<mConnections.size();i++)
+   {
+      disconnectFromDatabase(*mConnections[i]);
+   }
 }
 
 void
@@ -117,44 +135,48 @@ MySqlDb::initialize() const
    }
 }
 
+MySqlDb::Connection&
+MySqlDb::connection() const
+{
+   return *mConnections[connectionIndex()];
+}
+
 void
-MySqlDb::disconnectFromDatabase() const
+MySqlDb::disconnectFromDatabase(Connection& connection) const
 {
-   if(mConn)
+   for (std::map<Data, MYSQL_STMT*>::iterator it = connection.mStatements.begin(); it != connection.mStatements.end(); it++)
    {
-      for (int i=0;i<MaxTable;i++)
+      if (it->second)
       {
-         if (mResult[i])
-         {  
-            mysql_free_result(mResult[i]); 
-            mResult[i]=0;
-         }
+         mysql_stmt_close(it->second);
       }
-   
-      mysql_close(mConn);
-      mConn = 0;
-      setConnected(false);
+   }
+   connection.mStatements.clear();
+
+   if(connection.mConn)
+   {
+      mysql_close(connection.mConn);
+      connection.mConn = 0;
    }
 }
 
 int 
-MySqlDb::connectToDatabase() const
+MySqlDb::connectToDatabase(Connection& connection) const
 {
    // Disconnect from database first (if required)
-   disconnectFromDatabase();
+   disconnectFromDatabase(connection);
 
    // Now try to connect
-   resip_assert(mConn == 0);
-   resip_assert(isConnected() == false);
+   resip_assert(connection.mConn == 0);
 
-   mConn = mysql_init(0);
-   if(mConn == 0)
+   connection.mConn = mysql_init(0);
+   if(connection.mConn == 0)
    {
       ErrLog( << "MySQL init failed: insufficient memory.");
       return CR_OUT_OF_MEMORY;
    }
 
-   MYSQL* ret = mysql_real_connect(mConn,
+   MYSQL* ret = mysql_real_connect(connection.mConn,
                                    mDBServer.c_str(),   // hostname
                                    mDBUser.c_str(),     // user
                                    mDBPassword.c_str(), // password
@@ -165,16 +187,16 @@ MySqlDb::connectToDatabase() const
 
    if (ret == 0)
    { 
-      int rc = mysql_errno(mConn);
-      ErrLog( << "MySQL connect failed: error=" << rc << ": " << mysql_error(mConn));
-      mysql_close(mConn); 
-      mConn = 0;
-      setConnected(false);
+      int rc = mysql_errno(connection.mConn);
+      ErrLog( << "MySQL connect failed: error=" << rc << ": " << mysql_error(connection.mConn));
+      mysql_close(connection.mConn); 
+      connection.mConn = 0;
+      setConnected(connection.mIndex, false);
       return rc;
    }
    else
    {
-      setConnected(true);
+      setConnected(connection.mIndex, true);
       return 0;
    }
 }
@@ -188,37 +210,37 @@ MySqlDb::query(const Data& queryCommand, MYSQL_RES** result) const
 
    DebugLog( << "MySqlDb::query: executing query: " << queryCommand);
 
-   Lock lock(mMutex);
-   if(mConn == 0 || !isConnected())
+   Connection& conn = connection();
+   Lock lock(conn.mMutex);
+   if(conn.mConn == 0)
    {
-      rc = connectToDatabase();
+      rc = connectToDatabase(conn);
    }
    if(rc == 0)
    {
-      resip_assert(mConn!=0);
-      resip_assert(isConnected());
-      rc = mysql_query(mConn,queryCommand.c_str());
+      resip_assert(conn.mConn!=0);
+      rc = mysql_query(conn.mConn,queryCommand.c_str());
       if(rc != 0)
       {
-         rc = mysql_errno(mConn);
+         rc = mysql_errno(conn.mConn);
          if(rc == CR_SERVER_GONE_ERROR ||
             rc == CR_SERVER_LOST)
          {
             // First failure is a connection error - try to re-connect and then try again
-            rc = connectToDatabase();
+            rc = connectToDatabase(conn);
             if(rc == 0)
             {
                // OK - we reconnected - try query again
-               rc = mysql_query(mConn,queryCommand.c_str());
+               rc = mysql_query(conn.mConn,queryCommand.c_str());
                if( rc != 0)
                {
-                  ErrLog( << "MySQL query failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+                  ErrLog( << "MySQL query failed: error=" << mysql_errno(conn.mConn) << ": " << mysql_error(conn.mConn));
                }
             }
          }
          else
          {
-            ErrLog( << "MySQL query failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+            ErrLog( << "MySQL query failed: error=" << mysql_errno(conn.mConn) << ": " << mysql_error(conn.mConn));
          }
       }
    }
@@ -226,13 +248,13 @@ MySqlDb::query(const Data& queryCommand, MYSQL_RES** result) const
    // Now store result - if pointer to result pointer was supplied and no errors
    if(rc == 0 && result)
    {
-      *result = mysql_store_result(mConn);
+      *result = mysql_store_result(conn.mConn);
       if(*result == 0)
       {
-         rc = mysql_errno(mConn);
+         rc = mysql_errno(conn.mConn);
          if(rc != 0)
          {
-            ErrLog( << "MySQL store result failed: error=" << rc << ": " << mysql_error(mConn));
+            ErrLog( << "MySQL store result failed: error=" << rc << ": " << mysql_error(conn.mConn));
          }
       }
    }
@@ -250,6 +272,142 @@ MySqlDb::query(const Data& queryCommand) const
    return query(queryCommand, 0);
 }
 
+int
+MySqlDb::query(const Statement& statement, std::vector<Data>* fields) const
+{
+   initialize();
+
+   DebugLog( << "MySqlDb::query: executing prepared statement " << statement.mName);
+
+   Connection& conn = connection();
+   Lock lock(conn.mMutex);
+   int rc = execute(conn, statement, fields);
+   if(rc == CR_SERVER_GONE_ERROR ||
+      rc == CR_SERVER_LOST)
+   {
+      // The connection was lost - re-connect and try again
+      rc = connectToDatabase(conn);
+      if(rc == 0)
+      {
+         rc = execute(conn, statement, fields);
+      }
+   }
+
+   if(rc != 0)
+   {
+      ErrLog( << " SQL Command was: " << statement.mCommand);
+   }
+   return rc;
+}
+
+int
+MySqlDb::execute(Connection& connection, const Statement& statement, std::vector<Data>* fields) const
+{
+   if(connection.mConn == 0)
+   {
+      int rc = connectToDatabase(connection);
+      if(rc != 0)
+      {
+         return rc;
+      }
+   }
+
+   MYSQL_STMT*& stmt = connection.mStatements[statement.mName];
+   if(stmt == 0)
+   {
+      stmt = mysql_stmt_init(connection.mConn);
+      if(stmt == 0)
+      {
+         ErrLog( << "MySQL statement init failed: insufficient memory.");
+         return CR_OUT_OF_MEMORY;
+      }
+      if(mysql_stmt_prepare(stmt, statement.mCommand.data(), statement.mCommand.size()) != 0)
+      {
+         int rc = mysql_stmt_errno(stmt);
+         ErrLog( << "MySQL prepare failed: error=" << rc << ": " << mysql_stmt_error(stmt));
+         mysql_stmt_close(stmt);
+         stmt = 0;
+         return rc;
+      }
+   }
+
+   // Parameters are all bound as strings, the server converts them as needed
+   std::vector<MYSQL_BIND> params(statement.mParams.size());
+   std::vector<unsigned long> paramLengths(statement.mParams.size());
+   for(unsigned int i = 0; i < params.size(); i++)
+   {
+      paramLengths[i] = statement.mParams[i].size();
+      params[i].buffer_type = MYSQL_TYPE_STRING;
+      params[i].buffer = (void*)statement.mParams[i].data();
+      params[i].buffer_length = paramLengths[i];
+      params[i].length = &paramLengths[i];
+   }
+   if((!params.empty() && mysql_stmt_bind_param(stmt, &params[0])) ||
+      mysql_stmt_execute(stmt) != 0)
+   {
+      int rc = mysql_stmt_errno(stmt);
+      ErrLog( << "MySQL query failed: error=" << rc << ": " << mysql_stmt_error(stmt));
+      return rc;
+   }
+
+   unsigned int count = mysql_stmt_field_count(stmt);
+   if(count == 0)
+   {
+      return 0;
+   }
+
+   int rc = 0;
+   if(fields)
+   {
+      // Bind no buffers so the fetch reports each column's length, then fetch
+      // the columns individually into buffers of the right size
+      std::vector<MYSQL_BIND> columns(count);
+      std::vector<unsigned long> columnLengths(count);
+      for(unsigned int i = 0; i < count; i++)
+      {
+         columns[i].buffer_type = MYSQL_TYPE_STRING;
+         columns[i].length = &columnLengths[i];
+      }
+      if(mysql_stmt_bind_result(stmt, &columns[0]) ||
+         mysql_stmt_store_result(stmt) != 0)
+      {
+         rc = mysql_stmt_errno(stmt);
+         ErrLog( << "MySQL store result failed: error=" << rc << ": " << mysql_stmt_error(stmt));
+      }
+      else
+      {
+         int fetched = mysql_stmt_fetch(stmt);
+         if(fetched == 0 || fetched == MYSQL_DATA_TRUNCATED)
+         {
+            for(unsigned int i = 0; i < count && rc == 0; i++)
+            {
+               Data value;
+               if(columnLengths[i] > 0)
+               {
+                  MYSQL_BIND column = MYSQL_BIND();
+                  column.buffer_type = MYSQL_TYPE_STRING;
+                  column.buffer = value.getBuf((Data::size_type)columnLengths[i]);
+                  column.buffer_length = columnLengths[i];
+                  if(mysql_stmt_fetch_column(stmt, &column, i, 0) != 0)
+                  {
+                     rc = mysql_stmt_errno(stmt);
+                     ErrLog( << "MySQL fetch column failed: error=" << rc << ": " << mysql_stmt_error(stmt));
+                  }
+               }
+               fields->push_back(value);
+            }
+         }
+         else if(fetched != MYSQL_NO_DATA)
+         {
+            rc = mysql_stmt_errno(stmt);
+            ErrLog( << "MySQL fetch row failed: error=" << rc << ": " << mysql_stmt_error(stmt));
+         }
+      }
+   }
+   mysql_stmt_free_result(stmt);
+   return rc;
+}
+
 int
 MySqlDb::singleResultQuery(const Data& queryCommand, std::vector<Data>& fields) const
 {
@@ -274,10 +432,10 @@ MySqlDb::singleResultQuery(const Data& queryCommand, std::vector<Data>& fields)
       }
       else
       {
-         rc = mysql_errno(mConn);
+         rc = mysql_errno(connection().mConn);
          if(rc != 0)
          {
-            ErrLog( << "MySQL fetch row failed: error=" << rc << ": " << mysql_error(mConn));
+            ErrLog( << "MySQL fetch row failed: error=" << rc << ": " << mysql_error(connection().mConn));
          }
          else
          {
@@ -292,7 +450,19 @@ MySqlDb::singleResultQuery(const Data& queryCommand, std::vector<Data>& fields)
 resip::Data& 
 MySqlDb::escapeString(const resip::Data& str, resip::Data& escapedStr) const
 {
-   escapedStr.truncate2(mysql_real_escape_string(mConn, (char*)escapedStr.getBuf(str.size()*2+1), str.c_str(), str.size()));
+   Connection& conn = connection();
+   Lock lock(conn.mMutex);
+   if(conn.mConn == 0)
+   {
+      connectToDatabase(conn);
+   }
+   if(conn.mConn == 0)
+   {
+      // Not connected, so escape for the library's default character set
+      escapedStr.truncate2(mysql_escape_string((char*)escapedStr.getBuf(str.size()*2+1), str.c_str(), str.size()));
+      return escapedStr;
+   }
+   escapedStr.truncate2(mysql_real_escape_string(conn.mConn, (char*)escapedStr.getBuf(str.size()*2+1), str.c_str(), str.size()));
    return escapedStr;
 }
 
@@ -347,7 +517,7 @@ MySqlDb::getUser( const AbstractDb::Key& key ) const
    
    if (result==0)
    {
-      ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+      ErrLog( << "MySQL store result failed: error=" << mysql_errno(connection().mConn) << ": " << mysql_error(connection().mConn));
       return ret;
    }
 
@@ -374,35 +544,66 @@ MySqlDb::getUser( const AbstractDb::Key& key ) const
 resip::Data 
 MySqlDb::getUserAuthInfo(  const AbstractDb::Key& key ) const
 { 
+   Data a1;
+   lookupUserAuthInfo(key, a1);
+   return a1;
+}
+
+
+bool
+MySqlDb::lookupUserAuthInfo( const AbstractDb::Key& key, Data& a1 ) const
+{
    std::vector<Data> ret;
+   a1.clear();
 
-   Data command;
+   Data user;
+   Data domain;
+   UserStore::getUserAndDomainFromKey(key, user, domain);
+
+   // Note: domain is empty when querying for HTTP admin user - for this special user, 
+   // we will only check the repro db, by not adding the UNION statement below
+   if(!mCustomUserAuthQuery.empty() && !domain.empty())  
    {
-      DataStream ds(command);
-      Data user;
-      Data domain;
-      UserStore::getUserAndDomainFromKey(key, user, domain);
-      ds << "SELECT passwordHash FROM " << tableName(UserTable) << " WHERE user = '" << user << "' AND domain = '" << domain << "' ";
-   
-      // Note: domain is empty when querying for HTTP admin user - for this special user, 
-      // we will only check the repro db, by not adding the UNION statement below
-      if(!mCustomUserAuthQuery.empty() && !domain.empty())  
+      Data command;
       {
+         DataStream ds(command);
+         ds << "SELECT passwordHash FROM " << tableName(UserTable) << " WHERE user = '" << user << "' AND domain = '" << domain << "' ";
          ds << " UNION " << mCustomUserAuthQuery;
-         ds.flush();
-         command.replace("$user", user);
-         command.replace("$domain", domain);
+      }
+      command.replace("$user", user);
+      command.replace("$domain", domain);
+
+      if(singleResultQuery(command, ret) != 0)
+      {
+         return false;
+      }
+   }
+   else
+   {
+      Statement statement;
+      statement.mName = "userAuthInfo";
+      {
+         DataStream ds(statement.mCommand);
+         ds << "SELECT passwordHash FROM " << tableName(UserTable) << " WHERE user = ? AND domain = ?";
+      }
+      statement.mParams.push_back(user);
+      statement.mParams.push_back(domain);
+
+      if(query(statement, &ret) != 0)
+      {
+         return false;
       }
    }
 
-   if(singleResultQuery(command, ret) != 0 || ret.size() == 0)
+   if(ret.size() == 0)
    {
-      return Data::Empty;
+      return true;
    }
    
    DebugLog( << "Auth password is " << ret.front());
    
-   return ret.front();
+   a1 = ret.front();
+   return true;
 }
 
 
@@ -429,7 +630,7 @@ MySqlDb::firstUserKey()
 
    if(mResult[UserTable] == 0)
    {
-      ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+      ErrLog( << "MySQL store result failed: error=" << mysql_errno(connection().mConn) << ": " << mysql_error(connection().mConn));
       return Data::Empty;
    }
    
@@ -498,7 +699,7 @@ MySqlDb::getTlsPeerIdentity( const AbstractDb::Key& key ) const
 
    if (result==0)
    {
-      ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+      ErrLog( << "MySQL store result failed: error=" << mysql_errno(connection().mConn) << ": " << mysql_error(connection().mConn));
       return ret;
    }
 
@@ -539,7 +740,7 @@ MySqlDb::firstTlsPeerIdentityKey()
 
    if(mResult[TlsPeerIdentityTable] == 0)
    {
-      ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+      ErrLog( << "MySQL store result failed: error=" << mysql_errno(connection().mConn) << ": " << mysql_error(connection().mConn));
       return Data::Empty;
    }
 
@@ -574,33 +775,36 @@ MySqlDb::dbWriteRecord(const Table table,
                        const resip::Data& pKey, 
                        const resip::Data& pData)
 {
-   Data command;
+   Statement statement;
 
    // Check if there is a secondary key or not and get it's value
    char* secondaryKey;
    unsigned int secondaryKeyLen;
-   Data escapedKey;
    if(AbstractDb::getSecondaryKey(table, pKey, pData, (void**)&secondaryKey, &secondaryKeyLen) == 0)
    {
-      Data escapedSKey;
-      Data sKey(Data::Share, secondaryKey, secondaryKeyLen);
-      DataStream ds(command);
-      ds << "REPLACE INTO " << tableName(table)
-         << " SET attr='" << escapeString(pKey, escapedKey)
-         << "', attr2='" << escapeString(sKey, escapedSKey)
-         << "', value='"  << pData.base64encode()
-         << "'";
+      statement.mName = Data("recordWrite2_") + Data((int)table);
+      {
+         DataStream ds(statement.mCommand);
+         ds << "REPLACE INTO " << tableName(table)
+            << " SET attr=?, attr2=?, value=?";
+      }
+      statement.mParams.push_back(pKey);
+      statement.mParams.push_back(Data(secondaryKey, secondaryKeyLen));
+      statement.mParams.push_back(pData.base64encode());
    }
    else
    {
-      DataStream ds(command);
-      ds << "REPLACE INTO " << tableName(table) 
-         << " SET attr='" << escapeString(pKey, escapedKey)
-         << "', value='"  << pData.base64encode()
-         << "'";
+      statement.mName = Data("recordWrite_") + Data((int)table);
+      {
+         DataStream ds(statement.mCommand);
+         ds << "REPLACE INTO " << tableName(table) 
+            << " SET attr=?, value=?";
+      }
+      statement.mParams.push_back(pKey);
+      statement.mParams.push_back(pData.base64encode());
    }
 
-   return query(command, 0) == 0;
+   return query(statement, 0) == 0;
 }
 
 bool 
@@ -608,38 +812,23 @@ MySqlDb::dbReadRecord(const Table table,
                       const resip::Data& pKey, 
                       resip::Data& pData) const
 { 
-   Data command;
-   Data escapedKey;
+   Statement statement;
+   statement.mName = Data("recordRead_") + Data((int)table);
    {
-      DataStream ds(command);
+      DataStream ds(statement.mCommand);
       ds << "SELECT value FROM " << tableName(table) 
-         << " WHERE attr='" << escapeString(pKey, escapedKey)
-         << "'";
+         << " WHERE attr=?";
    }
+   statement.mParams.push_back(pKey);
 
-   MYSQL_RES* result = 0;
-   if(query(command, &result) != 0)
+   std::vector<Data> fields;
+   if(query(statement, &fields) != 0 || fields.empty())
    {
       return false;
    }
 
-   if (result == 0)
-   {
-      ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
-      return false;
-   }
-   else
-   {
-      bool success = false;
-      MYSQL_ROW row=mysql_fetch_row(result);
-      if(row)
-      {
-         pData = Data(Data::Share, row[0], (Data::size_type)strlen(row[0])).base64decode();
-         success = true;
-      }
-      mysql_free_result(result);
-      return success;
-   }
+   pData = fields.front().base64decode();
+   return true;
 }
 
 
@@ -668,7 +857,7 @@ MySqlDb::dbNextKey(const Table table, bool first)
 
       if (mResult[table] == 0)
       {
-         ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+         ErrLog( << "MySQL store result failed: error=" << mysql_errno(connection().mConn) << ": " << mysql_error(connection().mConn));
          return Data::Empty;
       }
    }
@@ -732,7 +921,7 @@ MySqlDb::dbNextRecord(const Table table,
 
       if (mResult[table] == 0)
       {
-         ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+         ErrLog( << "MySQL store result failed: error=" << mysql_errno(connection().mConn) << ": " << mysql_error(connection().mConn));
          return false;
       }
    }
@@ -7,6 +7,10 @@
 #include <mysql/mysql.h>
 #endif
 
+#include <map>
+#include <memory>
+#include <vector>
+
 #include "rutil/Data.hxx"
 #include "repro/SqlDb.hxx"
 
@@ -34,6 +38,7 @@ class MySqlDb: public SqlDb
       virtual bool addUser( const Key& key, const UserRecord& rec );
       virtual UserRecord getUser( const Key& key ) const;
       virtual resip::Data getUserAuthInfo(  const Key& key ) const;
+      virtual bool lookupUserAuthInfo( const Key& key, resip::Data& a1 ) const;
       virtual Key firstUserKey();// return empty if no more
       virtual Key nextUserKey(); // return empty if no more 
 
@@ -62,11 +67,36 @@ class MySqlDb: public SqlDb
                                 bool first=false);  // return false if no more
       virtual bool dbBeginTransaction(const Table table);
 
+      // One pooled connection, and the statements prepared on it
+      class Connection
+      {
+         public:
+            explicit Connection(unsigned int index) : mIndex(index), mConn(0) {}
+            const unsigned int mIndex;  // in the pool
+            resip::Mutex mMutex;
+            MYSQL* mConn;
+            std::map<resip::Data, MYSQL_STMT*> mStatements;
+      };
+
+      // A statement that is prepared once per connection under mName and then
+      // executed with mParams bound to its ? placeholders
+      class Statement
+      {
+         public:
+            resip::Data mName;
+            resip::Data mCommand;
+            std::vector<resip::Data> mParams;
+      };
+
       void initialize() const;
-      void disconnectFromDatabase() const;
-      int connectToDatabase() const;
+      Connection& connection() const;
+      void disconnectFromDatabase(Connection& connection) const;
+      int connectToDatabase(Connection& connection) const;
       int query(const resip::Data& queryCommand, MYSQL_RES** result) const;
       virtual int query(const resip::Data& queryCommand) const;
+      // Executes a prepared statement, storing the first row returned (if any) in fields
+      int query(const Statement& statement, std::vector<resip::Data>* fields) const;
+      int execute(Connection& connection, const Statement& statement, std::vector<resip::Data>* fields) const;
       resip::Data& escapeString(const resip::Data& str, resip::Data& escapedStr) const;
 
       resip::Data mDBServer;
@@ -76,7 +106,7 @@ class MySqlDb: public SqlDb
       unsigned int mDBPort;
       resip::Data mCustomUserAuthQuery;
 
-      mutable MYSQL* mConn;
+      std::vector<std::unique_ptr<Connection> > mConnections;
       mutable MYSQL_RES* mResult[MaxTable];
 
       void userWhereClauseToDataStream(const Key& key, resip::DataStream& ds) const;
@@ -11,7 +11,9 @@
 #include "rutil/Data.hxx"
 #include "rutil/DataStream.hxx"
 #include "rutil/Logger.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/ParseBuffer.hxx"
+#include "rutil/Socket.hxx"
 
 #include "repro/AbstractDb.hxx"
 #include "repro/PostgreSqlDb.hxx"
@@ -76,10 +78,9 @@ PostgreSqlDb::PostgreSqlDb(const resip::ConfigParse& config,
    mDBPassword(password),
    mDBName(databaseName),
    mDBPort(port),
-   mCustomUserAuthQuery(customUserAuthQuery),
-   mConn(0)
+   mCustomUserAuthQuery(customUserAuthQuery)
 { 
-   InfoLog( << "Using PostgreSQL DB with server=" << server << ", user=" << user << ", dbName=" << databaseName << ", port=" << port);
+   InfoLog( << "Using PostgreSQL DB with server=" << server << ", user=" << user << ", dbName=" << databaseName << ", port=" << port << ", connections=" << mConnectionPoolSize);
 
    for (int i=0;i<MaxTable;i++)
    {
@@ -87,20 +88,39 @@ PostgreSqlDb::PostgreSqlDb(const resip::ConfigParse& config,
       mRow[i]=0;
    }
 
+   for (unsigned int i=0;i<mConnectionPoolSize;i++)
+   {
+      mConnections.push_back(std::unique_ptr<Connection>(new Connection(i)));
+   }
+
    if(!PQisthreadsafe())
    {
       ErrLog( << "Repro uses PostgreSQL from multiple threads - you MUST link with a thread safe version of the PostgreSQL client library (libpq)!");
    }
    else
    {
-      connectToDatabase();
+      // Remaining pool connections are opened by the first thread to use them
+      connectToDatabase(*mConnections[0]);
    }
 }
 
 
 PostgreSqlDb::~PostgreSqlDb()
 {
-   disconnectFromDatabase();
+   for (int i=0;i<MaxTable;i++)
+   {
+      if (mResult[i])
+      {  
+         PQclear(mResult[i]); 
+         mResult[i]=0;
+         mRow[i]=0;
+      }
+   }
+
+   for (unsigned int i=0;i<mConnections.size();i++)
+   {
+      disconnectFromDatabase(*mConnections[i]);
+   }
 }
 
 void
@@ -113,36 +133,31 @@ PostgreSqlDb::initialize() const
    }
 }
 
+PostgreSqlDb::Connection&
+PostgreSqlDb::connection() const
+{
+   return *mConnections[connectionIndex()];
+}
+
 void
-PostgreSqlDb::disconnectFromDatabase() const
+PostgreSqlDb::disconnectFromDatabase(Connection& connection) const
 {
-   if(mConn)
+   if(connection.mConn)
    {
-      for (int i=0;i<MaxTable;i++)
-      {
-         if (mResult[i])
-         {  
-            PQclear(mResult[i]); 
-            mResult[i]=0;
-            mRow[i]=0;
-         }
-      }
-   
-      PQfinish(mConn);
-      mConn = 0;
-      setConnected(false);
+      PQfinish(connection.mConn);
+      connection.mConn = 0;
+      connection.mPrepared.clear();
    }
 }
 
 int 
-PostgreSqlDb::connectToDatabase() const
+PostgreSqlDb::connectToDatabase(Connection& connection) const
 {
    // Disconnect from database first (if required)
-   disconnectFromDatabase();
+   disconnectFromDatabase(connection);
 
    // Now try to connect
-   resip_assert(mConn == 0);
-   resip_assert(isConnected() == false);
+   resip_assert(connection.mConn == 0);
 
    Data connInfo(mDBConnInfo);
    if(!mDBServer.empty())
@@ -169,19 +184,20 @@ PostgreSqlDb::connectToDatabase() const
    }
 
    DebugLog(<<"Trying to connect to PostgreSQL server with conninfo string: " << connInfoLogString);
-   mConn = PQconnectdb(connInfo.c_str());
+   connection.mConn = PQconnectdb(connInfo.c_str());
 
-   int rc = PQstatus(mConn);
+   int rc = PQstatus(connection.mConn);
    if (rc != CONNECTION_OK)
    { 
-      ErrLog( << "PostgreSQL connect failed: " << PQerrorMessage(mConn));
-      mConn = 0;
-      setConnected(false);
+      ErrLog( << "PostgreSQL connect failed: " << PQerrorMessage(connection.mConn));
+      PQfinish(connection.mConn);
+      connection.mConn = 0;
+      setConnected(connection.mIndex, false);
       return -1;
    }
    else
    {
-      setConnected(true);
+      setConnected(connection.mIndex, true);
       return 0;
    }
 }
@@ -202,46 +218,54 @@ PostgreSqlDb::query(const Data& queryCommand, PGresult** result) const
 
    DebugLog( << "PostgreSqlDb::query: executing query: " << queryCommand);
 
-   Lock lock(mMutex);
-   if(mConn == 0 || !isConnected())
+   Connection& conn = connection();
+   Lock lock(conn.mMutex);
+   if(conn.mConn == 0)
    {
-      rc = connectToDatabase();
+      rc = connectToDatabase(conn);
    }
    if(rc == 0)
    {
-      resip_assert(mConn!=0);
-      resip_assert(isConnected());
-      _result = PQexec(mConn, queryCommand.c_str());
+      resip_assert(conn.mConn!=0);
+      _result = PQexec(conn.mConn, queryCommand.c_str());
       rc = pqOK(_result);
       if(rc != 0)
       {
          PQclear(_result);
-         if(rc == PGRES_FATAL_ERROR)
+         if(PQstatus(conn.mConn) == CONNECTION_BAD)
          {
             // First failure may be a connection error - try to re-connect and then try again
-            rc = connectToDatabase();
+            rc = connectToDatabase(conn);
             if(rc == 0)
             {
                // OK - we reconnected - try query again
-               _result = PQexec(mConn,queryCommand.c_str());
+               _result = PQexec(conn.mConn,queryCommand.c_str());
                rc = pqOK(_result);
                if( rc != 0)
                {
-                  ErrLog( << "PostgreSQL query failed (twice): " << PQerrorMessage(mConn));
+                  ErrLog( << "PostgreSQL query failed (twice): " << PQerrorMessage(conn.mConn));
+                  PQclear(_result);
                }
             }
          }
          else
          {
-            ErrLog( << "PostgreSQL query failed: " << PQerrorMessage(mConn));
+            ErrLog( << "PostgreSQL query failed: " << PQerrorMessage(conn.mConn));
          }
       }
    }
 
    // Now store result - if pointer to result pointer was supplied and no errors
-   if(rc == 0 && result)
+   if(rc == 0)
    {
-      *result = _result;
+      if(result)
+      {
+         *result = _result;
+      }
+      else
+      {
+         PQclear(_result);
+      }
    }
 
    if(rc != 0)
@@ -257,6 +281,260 @@ PostgreSqlDb::query(const Data& queryCommand) const
    return query(queryCommand, 0);
 }
 
+int
+PostgreSqlDb::query(const Statement& statement, PGresult** result) const
+{
+   initialize();
+
+   DebugLog( << "PostgreSqlDb::query: executing prepared statement " << statement.mName);
+
+   Connection& conn = connection();
+   Lock lock(conn.mMutex);
+   int rc = execute(conn, statement, result);
+   if(rc != 0 && (conn.mConn == 0 || PQstatus(conn.mConn) == CONNECTION_BAD))
+   {
+      // The connection was lost - re-connect and try again
+      rc = connectToDatabase(conn);
+      if(rc == 0)
+      {
+         rc = execute(conn, statement, result);
+      }
+   }
+
+   if(rc != 0)
+   {
+      ErrLog( << " SQL Command was: " << statement.mCommand);
+   }
+   return rc;
+}
+
+int
+PostgreSqlDb::query(const std::vector<Statement>& statements) const
+{
+   initialize();
+
+   DebugLog( << "PostgreSqlDb::query: executing " << statements.size() << " pipelined statements");
+
+   Connection& conn = connection();
+   Lock lock(conn.mMutex);
+   int rc = executePipeline(conn, statements);
+   if(rc != 0 && (conn.mConn == 0 || PQstatus(conn.mConn) == CONNECTION_BAD))
+   {
+      // The connection was lost - re-connect and try again
+      rc = connectToDatabase(conn);
+      if(rc == 0)
+      {
+         rc = executePipeline(conn, statements);
+      }
+   }
+
+   if(rc != 0)
+   {
+      for(std::vector<Statement>::const_iterator it = statements.begin(); it != statements.end(); it++)
+      {
+         ErrLog( << " SQL Command was: " << it->mCommand);
+      }
+   }
+   return rc;
+}
+
+int
+PostgreSqlDb::prepare(Connection& connection, const Statement& statement) const
+{
+   if(connection.mPrepared.count(statement.mName))
+   {
+      return 0;
+   }
+
+   PGresult* result = PQprepare(connection.mConn, statement.mName.c_str(), statement.mCommand.c_str(), (int)statement.mParams.size(), 0);
+   int rc = pqOK(result);
+   PQclear(result);
+   if(rc != 0)
+   {
+      ErrLog( << "PostgreSQL prepare failed: " << PQerrorMessage(connection.mConn));
+      return rc;
+   }
+   connection.mPrepared.insert(statement.mName);
+   return 0;
+}
+
+int
+PostgreSqlDb::execute(Connection& connection, const Statement& statement, PGresult** result) const
+{
+   if(connection.mConn == 0 && connectToDatabase(connection) != 0)
+   {
+      return -1;
+   }
+   int rc = prepare(connection, statement);
+   if(rc != 0)
+   {
+      return rc;
+   }
+
+   std::vector<const char*> values;
+   for(std::vector<Data>::const_iterator it = statement.mParams.begin(); it != statement.mParams.end(); it++)
+   {
+      values.push_back(it->c_str());
+   }
+   PGresult* _result = PQexecPrepared(connection.mConn, statement.mName.c_str(), (int)values.size(),
+                                      values.empty() ? 0 : &values[0], 0, 0, 0);
+   rc = pqOK(_result);
+   if(rc != 0)
+   {
+      ErrLog( << "PostgreSQL query failed: " << PQerrorMessage(connection.mConn));
+      PQclear(_result);
+   }
+   else if(result)
+   {
+      *result = _result;
+   }
+   else
+   {
+      PQclear(_result);
+   }
+   return rc;
+}
+
+#ifdef LIBPQ_HAS_PIPELINING
+// Waits until the connection's socket can be read, or written if forWrite is set
+static bool
+waitForSocket(PGconn* conn, bool forWrite)
+{
+   int rc;
+   do
+   {
+      FdSet fdset;
+      fdset.setRead(PQsocket(conn));
+      if(forWrite)
+      {
+         fdset.setWrite(PQsocket(conn));
+      }
+      rc = fdset.select();
+   } while(rc < 0 && getErrno() == EINTR);
+   return rc > 0;
+}
+#endif
+
+int
+PostgreSqlDb::executePipeline(Connection& connection, const std::vector<Statement>& statements) const
+{
+   if(connection.mConn == 0 && connectToDatabase(connection) != 0)
+   {
+      return -1;
+   }
+   for(std::vector<Statement>::const_iterator it = statements.begin(); it != statements.end(); it++)
+   {
+      int rc = prepare(connection, *it);
+      if(rc != 0)
+      {
+         return rc;
+      }
+   }
+
+#ifdef LIBPQ_HAS_PIPELINING
+   // Queue every statement and the sync without waiting for the server, then
+   // collect the results: one round trip for the whole batch.  Non-blocking mode
+   // keeps a large batch from deadlocking against the server's replies.
+   PGconn* conn = connection.mConn;
+   if(PQsetnonblocking(conn, 1) != 0 || PQenterPipelineMode(conn) != 1)
+   {
+      ErrLog( << "PostgreSQL failed to enter pipeline mode: " << PQerrorMessage(conn));
+      PQsetnonblocking(conn, 0);
+      return -1;
+   }
+
+   bool connectionOk = true;
+   for(std::vector<Statement>::const_iterator it = statements.begin(); connectionOk && it != statements.end(); it++)
+   {
+      std::vector<const char*> values;
+      for(std::vector<Data>::const_iterator p = it->mParams.begin(); p != it->mParams.end(); p++)
+      {
+         values.push_back(p->c_str());
+      }
+      connectionOk = PQsendQueryPrepared(conn, it->mName.c_str(), (int)values.size(),
+                                         values.empty() ? 0 : &values[0], 0, 0, 0) == 1;
+   }
+   connectionOk = connectionOk && PQpipelineSync(conn) == 1;
+
+   int flushed;
+   while(connectionOk && (flushed = PQflush(conn)) != 0)
+   {
+      connectionOk = flushed > 0 && waitForSocket(conn, true) && PQconsumeInput(conn) == 1;
+   }
+
+   int rc = 0;
+   unsigned int nulls = 0;
+   while(connectionOk)
+   {
+      while(connectionOk && PQisBusy(conn))
+      {
+         connectionOk = waitForSocket(conn, false) && PQconsumeInput(conn) == 1;
+      }
+      if(!connectionOk)
+      {
+         break;
+      }
+      PGresult* result = PQgetResult(conn);
+      if(result == 0)
+      {
+         // Each statement's results end with a null; two in a row means the sync was lost
+         connectionOk = ++nulls < 2;
+         continue;
+      }
+      nulls = 0;
+      ExecStatusType status = PQresultStatus(result);
+      if(status == PGRES_PIPELINE_SYNC)
+      {
+         PQclear(result);
+         break;
+      }
+      if(rc == 0 && status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK)
+      {
+         ErrLog( << "PostgreSQL pipelined query failed: " << PQresultErrorMessage(result));
+         rc = 1;
+      }
+      PQclear(result);
+   }
+
+   if(!connectionOk)
+   {
+      ErrLog( << "PostgreSQL pipeline failed: " << PQerrorMessage(conn));
+      // The pipeline is in an unknown state, start over on a new connection
+      disconnectFromDatabase(connection);
+      return -1;
+   }
+   PQexitPipelineMode(conn);
+   PQsetnonblocking(conn, 0);
+   return rc;
+#else
+   // No pipelining in this libpq: run the statements one at a time, inside a
+   // transaction of our own unless the caller already has one open
+   bool ownTransaction = PQtransactionStatus(connection.mConn) == PQTRANS_IDLE;
+   if(ownTransaction)
+   {
+      PGresult* result = PQexec(connection.mConn, "BEGIN");
+      int rc = pqOK(result);
+      PQclear(result);
+      if(rc != 0)
+      {
+         ErrLog( << "PostgreSQL query failed: " << PQerrorMessage(connection.mConn));
+         return rc;
+      }
+   }
+   int rc = 0;
+   for(std::vector<Statement>::const_iterator it = statements.begin(); rc == 0 && it != statements.end(); it++)
+   {
+      rc = execute(connection, *it, 0);
+   }
+   if(ownTransaction && connection.mConn != 0)
+   {
+      PGresult* result = PQexec(connection.mConn, rc == 0 ? "COMMIT" : "ROLLBACK");
+      PQclear(result);
+   }
+   return rc;
+#endif
+}
+
 int
 PostgreSqlDb::singleResultQuery(const Data& queryCommand, std::vector<Data>& fields) const
 {
@@ -291,11 +569,24 @@ PostgreSqlDb::singleResultQuery(const Data& queryCommand, std::vector<Data>& fie
 resip::Data& 
 PostgreSqlDb::escapeString(const resip::Data& str, resip::Data& escapedStr) const
 {
+   Connection& conn = connection();
+   Lock lock(conn.mMutex);
+   if(conn.mConn == 0)
+   {
+      connectToDatabase(conn);
+   }
+   if(conn.mConn == 0)
+   {
+      // Not connected, so escape for the library's default encoding
+      escapedStr.truncate2(PQescapeString((char*)escapedStr.getBuf(str.size()*2+1), str.c_str(), str.size()));
+      return escapedStr;
+   }
+
    int rc = 0;
-   escapedStr.truncate2(PQescapeStringConn(mConn, (char*)escapedStr.getBuf(str.size()*2+1), str.c_str(), str.size(), &rc));
+   escapedStr.truncate2(PQescapeStringConn(conn.mConn, (char*)escapedStr.getBuf(str.size()*2+1), str.c_str(), str.size(), &rc));
    if(rc != 0)
    {
-      ErrLog(<< "PostgreSQL string escaping failed: " << PQerrorMessage(mConn));
+      ErrLog(<< "PostgreSQL string escaping failed: " << PQerrorMessage(conn.mConn));
       // FIXME - should probably throw here.  According to the docs, there is a value in
       // the output buffer even after failure so we'll try to use it and fail later.
    }
@@ -357,7 +648,7 @@ PostgreSqlDb::getUser( const AbstractDb::Key& key ) const
    
    if (result==0)
    {
-      ErrLog( << "PostgreSQL failed: " << PQerrorMessage(mConn));
+      ErrLog( << "PostgreSQL failed: " << PQerrorMessage(connection().mConn));
       return ret;
    }
 
@@ -383,35 +674,72 @@ PostgreSqlDb::getUser( const AbstractDb::Key& key ) const
 resip::Data 
 PostgreSqlDb::getUserAuthInfo(  const AbstractDb::Key& key ) const
 { 
-   std::vector<Data> ret;
+   Data a1;
+   lookupUserAuthInfo(key, a1);
+   return a1;
+}
 
-   Data command;
+
+bool
+PostgreSqlDb::lookupUserAuthInfo( const AbstractDb::Key& key, Data& a1 ) const
+{
+   a1.clear();
+   Data user;
+   Data domain;
+   UserStore::getUserAndDomainFromKey(key, user, domain);
+
+   // Note: domain is empty when querying for HTTP admin user - for this special user, 
+   // we will only check the repro db, by not adding the UNION statement below
+   if(!mCustomUserAuthQuery.empty() && !domain.empty())  
    {
-      DataStream ds(command);
-      Data user;
-      Data domain;
-      UserStore::getUserAndDomainFromKey(key, user, domain);
-      ds << "SELECT passwordHash FROM " << tableName(UserTable) << " WHERE username = '" << user << "' AND domain = '" << domain << "' ";
-   
-      // Note: domain is empty when querying for HTTP admin user - for this special user, 
-      // we will only check the repro db, by not adding the UNION statement below
-      if(!mCustomUserAuthQuery.empty() && !domain.empty())  
+      std::vector<Data> ret;
+      Data command;
       {
+         DataStream ds(command);
+         ds << "SELECT passwordHash FROM " << tableName(UserTable) << " WHERE username = '" << user << "' AND domain = '" << domain << "' ";
          ds << " UNION " << mCustomUserAuthQuery;
-         ds.flush();
-         command.replace("$user", user);
-         command.replace("$domain", domain);
       }
+      command.replace("$user", user);
+      command.replace("$domain", domain);
+
+      if(singleResultQuery(command, ret) != 0)
+      {
+         return false;
+      }
+      if(ret.size() == 0)
+      {
+         return true;
+      }
+
+      DebugLog( << "Auth password is " << ret.front());
+
+      a1 = ret.front();
+      return true;
    }
 
-   if(singleResultQuery(command, ret) != 0 || ret.size() == 0)
+   Statement statement;
+   statement.mName = "userAuthInfo";
    {
-      return Data::Empty;
+      DataStream ds(statement.mCommand);
+      ds << "SELECT passwordHash FROM " << tableName(UserTable) << " WHERE username = $1 AND domain = $2";
    }
-   
-   DebugLog( << "Auth password is " << ret.front());
-   
-   return ret.front();
+   statement.mParams.push_back(user);
+   statement.mParams.push_back(domain);
+
+   PGresult* result = 0;
+   if(query(statement, &result) != 0)
+   {
+      return false;
+   }
+
+   if(PQntuples(result) > 0)
+   {
+      a1 = Data(PQgetvalue(result, 0, 0));
+      DebugLog( << "Auth password is " << a1);
+   }
+   PQclear(result);
+
+   return true;
 }
 
 
@@ -439,7 +767,7 @@ PostgreSqlDb::firstUserKey()
 
    if(mResult[UserTable] == 0)
    {
-      ErrLog( << "PostgreSQL failed: " << PQerrorMessage(mConn));
+      ErrLog( << "PostgreSQL failed: " << PQerrorMessage(connection().mConn));
       return Data::Empty;
    }
    
@@ -514,7 +842,7 @@ PostgreSqlDb::getTlsPeerIdentity( const AbstractDb::Key& key ) const
  
    if (result==0)
    {
-      ErrLog( << "PostgreSQL failed: " << PQerrorMessage(mConn));
+      ErrLog( << "PostgreSQL failed: " << PQerrorMessage(connection().mConn));
       return ret;
    }
 
@@ -555,7 +883,7 @@ PostgreSqlDb::firstTlsPeerIdentityKey()
 
    if(mResult[TlsPeerIdentityTable] == 0)
    {
-      ErrLog( << "PostgreSQL failed: " << PQerrorMessage(mConn));
+      ErrLog( << "PostgreSQL failed: " << PQerrorMessage(connection().mConn));
       return Data::Empty;
    }
 
@@ -591,42 +919,57 @@ PostgreSqlDb::dbWriteRecord(const Table table,
                        const resip::Data& pKey, 
                        const resip::Data& pData)
 {
-   Data command;
+   // The delete and insert go to the server together as one pipelined batch
+   std::vector<Statement> statements(2);
+   Statement& erase = statements[0];
+   Statement& insert = statements[1];
 
    // Check if there is a secondary key or not and get it's value
    char* secondaryKey;
    unsigned int secondaryKeyLen;
-   Data escapedKey;
    if(AbstractDb::getSecondaryKey(table, pKey, pData, (void**)&secondaryKey, &secondaryKeyLen) == 0)
    {
-      Data escapedSKey;
-      Data sKey(Data::Share, secondaryKey, secondaryKeyLen);
-      DataStream ds(command);
-      ds << "DELETE FROM " << tableName(table)
-         << " WHERE attr='" << escapeString(pKey, escapedKey)
-         << "' AND attr2='" << escapeString(sKey, escapedSKey)
-         << "';"
-         << " INSERT INTO " << tableName(table)
-         << " (attr, attr2, value) VALUES ("
-         << "'" << escapeString(pKey, escapedKey)
-         << "', '" << escapeString(sKey, escapedSKey)
-         << "', '"  << pData.base64encode()
-         << "')";
+      Data sKey(secondaryKey, secondaryKeyLen);
+      erase.mName = Data("recordDelete2_") + Data((int)table);
+      {
+         DataStream ds(erase.mCommand);
+         ds << "DELETE FROM " << tableName(table)
+            << " WHERE attr=$1 AND attr2=$2";
+      }
+      erase.mParams.push_back(pKey);
+      erase.mParams.push_back(sKey);
+
+      insert.mName = Data("recordInsert2_") + Data((int)table);
+      {
+         DataStream ds(insert.mCommand);
+         ds << "INSERT INTO " << tableName(table)
+            << " (attr, attr2, value) VALUES ($1, $2, $3)";
+      }
+      insert.mParams.push_back(pKey);
+      insert.mParams.push_back(sKey);
+      insert.mParams.push_back(pData.base64encode());
    }
    else
    {
-      DataStream ds(command);
-      ds << "DELETE FROM " << tableName(table)
-         << " WHERE attr='" << escapeString(pKey, escapedKey)
-         << "';"
-         << " INSERT INTO " << tableName(table)
-         << " (attr, value) VALUES ("
-         << "'" << escapeString(pKey, escapedKey)
-         << "', '"  << pData.base64encode()
-         << "')";
+      erase.mName = Data("recordDelete_") + Data((int)table);
+      {
+         DataStream ds(erase.mCommand);
+         ds << "DELETE FROM " << tableName(table)
+            << " WHERE attr=$1";
+      }
+      erase.mParams.push_back(pKey);
+
+      insert.mName = Data("recordInsert_") + Data((int)table);
+      {
+         DataStream ds(insert.mCommand);
+         ds << "INSERT INTO " << tableName(table)
+            << " (attr, value) VALUES ($1, $2)";
+      }
+      insert.mParams.push_back(pKey);
+      insert.mParams.push_back(pData.base64encode());
    }
 
-   return query(command, 0) == 0;
+   return query(statements) == 0;
 }
 
 bool 
@@ -634,39 +977,31 @@ PostgreSqlDb::dbReadRecord(const Table table,
                       const resip::Data& pKey, 
                       resip::Data& pData) const
 { 
-   Data command;
-   Data escapedKey;
+   Statement statement;
+   statement.mName = Data("recordRead_") + Data((int)table);
    {
-      DataStream ds(command);
+      DataStream ds(statement.mCommand);
       ds << "SELECT value FROM " << tableName(table) 
-         << " WHERE attr='" << escapeString(pKey, escapedKey)
-         << "'";
+         << " WHERE attr=$1";
    }
+   statement.mParams.push_back(pKey);
 
    PGresult* result = 0;
-   if(query(command, &result) != 0)
+   if(query(statement, &result) != 0)
    {
       return false;
    }
 
-   if (result == 0)
-   {
-      ErrLog( << "PostgreSQL result failed: " << PQerrorMessage(mConn));
-      return false;
-   }
-   else
+   bool success = false;
+   if(PQntuples(result) > 0)
    {
-      bool success = false;
-      if(PQntuples(result) > 0)
-      {
-         char *value = PQgetvalue(result, 0, 0);
-         pData = Data(Data::Share, value, (Data::size_type)strlen(value)).base64decode();
-         success = true;
-      }
-      PQclear(result);
-      StackLog(<<"query result: " << success);
-      return success;
+      char *value = PQgetvalue(result, 0, 0);
+      pData = Data(Data::Share, value, (Data::size_type)strlen(value)).base64decode();
+      success = true;
    }
+   PQclear(result);
+   StackLog(<<"query result: " << success);
+   return success;
 }
 
 
@@ -696,7 +1031,7 @@ PostgreSqlDb::dbNextKey(const Table table, bool first)
 
       if (mResult[table] == 0)
       {
-         ErrLog( << "PostgreSQL failed: " << PQerrorMessage(mConn));
+         ErrLog( << "PostgreSQL failed: " << PQerrorMessage(connection().mConn));
          return Data::Empty;
       }
    }
@@ -761,7 +1096,7 @@ PostgreSqlDb::dbNextRecord(const Table table,
 
       if (mResult[table] == 0)
       {
-         ErrLog( << "PostgreSQL failed: " << PQerrorMessage(mConn));
+         ErrLog( << "PostgreSQL failed: " << PQerrorMessage(connection().mConn));
          return false;
       }
    }
@@ -2,6 +2,9 @@
 #define RESIP_POSTGRESQLDB_HXX 
 
 #include <libpq-fe.h>
+#include <memory>
+#include <set>
+#include <vector>
 
 #include "rutil/Data.hxx"
 #include "repro/SqlDb.hxx"
@@ -31,6 +34,7 @@ class PostgreSqlDb: public SqlDb
       virtual bool addUser( const Key& key, const UserRecord& rec );
       virtual UserRecord getUser( const Key& key ) const;
       virtual resip::Data getUserAuthInfo(  const Key& key ) const;
+      virtual bool lookupUserAuthInfo( const Key& key, resip::Data& a1 ) const;
       virtual Key firstUserKey();// return empty if no more
       virtual Key nextUserKey(); // return empty if no more 
 
@@ -59,11 +63,40 @@ class PostgreSqlDb: public SqlDb
                                 bool first=false);  // return false if no more
       virtual bool dbBeginTransaction(const Table table);
 
+      // One pooled connection, and the statements prepared on it
+      class Connection
+      {
+         public:
+            explicit Connection(unsigned int index) : mIndex(index), mConn(0) {}
+            const unsigned int mIndex;  // in the pool
+            resip::Mutex mMutex;
+            PGconn* mConn;
+            std::set<resip::Data> mPrepared;
+      };
+
+      // A statement that is prepared once per connection under mName and then
+      // executed with mParams as its $1, $2, ... text parameters
+      class Statement
+      {
+         public:
+            resip::Data mName;
+            resip::Data mCommand;
+            std::vector<resip::Data> mParams;
+      };
+
       void initialize() const;
-      void disconnectFromDatabase() const;
-      int connectToDatabase() const;
+      Connection& connection() const;
+      void disconnectFromDatabase(Connection& connection) const;
+      int connectToDatabase(Connection& connection) const;
       int query(const resip::Data& queryCommand, PGresult** result) const;
       virtual int query(const resip::Data& queryCommand) const;
+      int query(const Statement& statement, PGresult** result) const;
+      // Executes the statements as a single pipelined round trip, in one implicit
+      // transaction unless a transaction is already open on the connection
+      int query(const std::vector<Statement>& statements) const;
+      int prepare(Connection& connection, const Statement& statement) const;
+      int execute(Connection& connection, const Statement& statement, PGresult** result) const;
+      int executePipeline(Connection& connection, const std::vector<Statement>& statements) const;
       resip::Data& escapeString(const resip::Data& str, resip::Data& escapedStr) const;
 
       resip::Data mDBConnInfo;
@@ -74,7 +107,7 @@ class PostgreSqlDb: public SqlDb
       unsigned int mDBPort;
       resip::Data mCustomUserAuthQuery;
 
-      mutable PGconn* mConn;
+      std::vector<std::unique_ptr<Connection> > mConnections;
       mutable PGresult* mResult[MaxTable];
       mutable int mRow[MaxTable];
 
@@ -13,6 +13,7 @@
 #include <rutil/Timer.hxx>
 
 #include "repro/RegSyncClient.hxx"
+#include "repro/RegSyncCodec.hxx"
 #include "repro/RegSyncServer.hxx"
 
 using namespace repro;
@@ -29,7 +30,10 @@ RegSyncClient::RegSyncClient(InMemorySyncRegDb* regDb,
    mPubDb(pubDb),
    mAddress(address),
    mPort(port),
-   mSocketDesc(0)
+   mSocketDesc(0),
+   mBinary(false),
+   mServerId(0),
+   mLastSequence(0)
 {
     resip_assert(mRegDb);
 }
@@ -124,9 +128,23 @@ RegSyncClient::thread()
       Data request(
          "<InitialSync>\r\n"
          "  <Request>\r\n"
-         "     <Version>" + Data(REGSYNC_VERSION) + "</Version>\r\n"   // For use in detecting if client/server are a compatible version
+         "     <Version>" + Data(REGSYNC_VERSION) + "</Version>\r\n");   // For use in detecting if client/server are a compatible version
+      if(mBinary)
+      {
+         request += "     <Binary>true</Binary>\r\n";
+         if(mServerId != 0)
+         {
+            request += "     <ResumeServerId>" + Data(mServerId) + "</ResumeServerId>\r\n";
+            request += "     <ResumeSequence>" + Data(mLastSequence) + "</ResumeSequence>\r\n";
+         }
+         // Until the server completes this sync we have nothing to resume from
+         mServerId = 0;
+         mLastSequence = 0;
+      }
+      request +=
          "  </Request>\r\n"
-         "</InitialSync>\r\n");   
+         "</InitialSync>\r\n";
+      mRxDataBuffer.clear();
       rc = ::send(mSocketDesc, request.c_str(), (int)request.size(), 0);
       if(rc < 0) 
       {
@@ -177,7 +195,7 @@ RegSyncClient::thread()
          }
          else if(rc == 0) // timeout - send keepalive
          {
-            rc = ::send(mSocketDesc, Symbols::CRLFCRLF, (int)request.size(), 0);
+            rc = ::send(mSocketDesc, Symbols::CRLFCRLF, (int)strlen(Symbols::CRLFCRLF), 0);
             if(rc < 0) 
             {
                int e = getErrno();
@@ -212,6 +230,38 @@ RegSyncClient::thread()
 bool 
 RegSyncClient::tryParse()
 {
+   // Binary frames start with a 0 byte, which cannot start an XML message
+   Data::size_type pos = 0;
+   while(pos < mRxDataBuffer.size() && isspace((unsigned char)mRxDataBuffer[pos]))
+   {
+      pos++;
+   }
+   if(pos < mRxDataBuffer.size() && mRxDataBuffer[pos] == 0)
+   {
+      RegSyncCodec::FrameType type;
+      const char* payload = 0;
+      size_t payloadSize = 0;
+      size_t frameSize = 0;
+      try
+      {
+         frameSize = RegSyncCodec::parseFrame(mRxDataBuffer.data() + pos, mRxDataBuffer.size() - pos,
+                                              type, payload, payloadSize);
+      }
+      catch(BaseException& e)
+      {
+         ErrLog(<< "RegSyncClient::tryParse: discarding received data: " << e);
+         mRxDataBuffer.clear();
+         return false;
+      }
+      if(frameSize == 0)
+      {
+         return false;  // wait for the rest of the frame
+      }
+      handleFrame(type, payload, payloadSize);
+      mRxDataBuffer = mRxDataBuffer.substr(pos + frameSize);
+      return !mRxDataBuffer.empty();
+   }
+
    ParseBuffer pb(mRxDataBuffer);
    Data initialTag;
    const char* start = pb.position();
@@ -299,6 +349,49 @@ RegSyncClient::handleXml(const Data& xmlData)
    }
 }
 
+void
+RegSyncClient::handleFrame(int type, const char* payload, size_t payloadSize)
+{
+   uint64_t now = Timer::getTimeSecs();
+   const char* pos = payload;
+   const char* end = payload + payloadSize;
+   try
+   {
+      switch(type)
+      {
+      case RegSyncCodec::RegInfo:
+         while(pos < end)
+         {
+            uint64_t sequence;
+            Uri aor;
+            ContactList contacts;
+            RegSyncCodec::decodeRegInfo(pos, end, sequence, aor, contacts, now);
+            if(mRegDb)
+            {
+               processModify(aor, contacts);
+            }
+            mLastSequence = resipMax(mLastSequence, sequence);
+         }
+         break;
+      case RegSyncCodec::SyncComplete:
+         {
+            uint64_t sequence;
+            RegSyncCodec::decodeSyncComplete(pos, end, mServerId, sequence);
+            mLastSequence = resipMax(mLastSequence, sequence);
+            InfoLog(<< "RegSyncClient::handleFrame: registration sync complete at sequence " << mLastSequence);
+         }
+         break;
+      default:
+         WarningLog(<< "RegSyncClient::handleFrame: Ignoring frame with unknown type: " << type);
+         break;
+      }
+   }
+   catch(BaseException& e)
+   {
+      ErrLog(<< "RegSyncClient::handleFrame: exception: " << e);
+   }
+}
+
 void 
 RegSyncClient::handleRegInfoEvent(resip::XMLCursor& xml)
 {
@@ -18,6 +18,11 @@ public:
                  unsigned short port,
                  resip::InMemorySyncPubDb* pubDb = 0);
 
+   // Ask the server for binary registration frames (see RegSyncCodec),
+   // and to resume from the last change seen after a reconnect.  Servers
+   // that do not support it keep sending XML.  Call before run().
+   void setBinary(bool binary) { mBinary = binary; }
+
    virtual void thread();
    virtual void shutdown();
 
@@ -25,6 +30,7 @@ private:
    void delaySeconds(unsigned int seconds);
    bool tryParse();  // returns true if we processed something and there is more data in the buffer
    void handleXml(const resip::Data& xmlData);
+   void handleFrame(int type, const char* payload, size_t payloadSize);
    void handleRegInfoEvent(resip::XMLCursor& xml);
    void handlePubInfoEvent(resip::XMLCursor& xml);
    void processModify(const resip::Uri& aor, resip::ContactList& syncContacts);
@@ -36,6 +42,10 @@ private:
    char mRxBuffer[8000];
    resip::Data mRxDataBuffer;
    int mSocketDesc;
+   bool mBinary;
+   // From the last SyncComplete frame, so we can resume; 0 if we cannot
+   uint64_t mServerId;
+   uint64_t mLastSequence;
 };
 
 }
@@ -0,0 +1,307 @@
+#include <resip/stack/NameAddr.hxx>
+#include <resip/stack/Tuple.hxx>
+#include <rutil/Data.hxx>
+
+#include "repro/RegSyncCodec.hxx"
+
+using namespace repro;
+using namespace resip;
+
+namespace
+{
+
+void
+putU32At(Data& out, Data::size_type pos, uint32_t value)
+{
+   for (int i = 3; i >= 0; --i)
+   {
+      out[pos + i] = (char)(value & 0xFF);
+      value >>= 8;
+   }
+}
+
+void
+need(const char* pos, const char* end, size_t size)
+{
+   if ((size_t)(end - pos) < size)
+   {
+      throw RegSyncCodec::Exception("Truncated RegSync record", __FILE__, __LINE__);
+   }
+}
+
+}
+
+void
+RegSyncCodec::putU32(Data& out, uint32_t value)
+{
+   char buf[4];
+   for (int i = 3; i >= 0; --i)
+   {
+      buf[i] = (char)(value & 0xFF);
+      value >>= 8;
+   }
+   out.append(buf, sizeof(buf));
+}
+
+void
+RegSyncCodec::putU64(Data& out, uint64_t value)
+{
+   putU32(out, (uint32_t)(value >> 32));
+   putU32(out, (uint32_t)value);
+}
+
+void
+RegSyncCodec::putString(Data& out, const Data& value)
+{
+   putU32(out, (uint32_t)value.size());
+   out.append(value.data(), value.size());
+}
+
+uint32_t
+RegSyncCodec::getU32(const char*& pos, const char* end)
+{
+   need(pos, end, 4);
+   const unsigned char* p = (const unsigned char*)pos;
+   pos += 4;
+   return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+uint64_t
+RegSyncCodec::getU64(const char*& pos, const char* end)
+{
+   uint64_t high = getU32(pos, end);
+   return (high << 32) | getU32(pos, end);
+}
+
+Data
+RegSyncCodec::getString(const char*& pos, const char* end)
+{
+   uint32_t size = getU32(pos, end);
+   need(pos, end, size);
+   Data value(pos, size);
+   pos += size;
+   return value;
+}
+
+bool
+RegSyncCodec::encodeRegInfo(Data& payload, uint64_t sequence,
+                            const Uri& aor, const ContactList& contacts,
+                            uint64_t now, bool encodeEmpty)
+{
+   Data::size_type start = payload.size();
+   putU64(payload, sequence);
+   putString(payload, Data::from(aor));
+   Data::size_type countPos = payload.size();
+   putU32(payload, 0);
+
+   uint32_t count = 0;
+   for (ContactList::const_iterator it = contacts.begin(); it != contacts.end(); it++)
+   {
+      const ContactInstanceRecord& rec = *it;
+      if (rec.mReceivedFrom.onlyUseExistingConnection ||
+          rec.mRegExpires == NeverExpire)  // Don't sync over static registrations
+      {
+         continue;
+      }
+
+      Data::size_type lengthPos = payload.size();
+      putU32(payload, 0);
+      putString(payload, Data::from(rec.mContact));
+      // If contact is expired or removed, then pass expires time as 0, otherwise send number of seconds until expirey
+      putU64(payload, rec.mRegExpires <= now ? 0 : rec.mRegExpires - now);
+      putU64(payload, now - rec.mLastUpdated);
+      Data token;
+      if (rec.mReceivedFrom.getPort() != 0)
+      {
+         Tuple::writeBinaryToken(rec.mReceivedFrom, token);
+      }
+      putString(payload, token);
+      token.clear();
+      if (rec.mPublicAddress.getType() != UNKNOWN_TRANSPORT)
+      {
+         Tuple::writeBinaryToken(rec.mPublicAddress, token);
+      }
+      putString(payload, token);
+      putU32(payload, (uint32_t)rec.mSipPath.size());
+      for (NameAddrs::const_iterator naIt = rec.mSipPath.begin(); naIt != rec.mSipPath.end(); naIt++)
+      {
+         putString(payload, Data::from(naIt->uri()));
+      }
+      putString(payload, rec.mInstance);
+      putU32(payload, rec.mRegId);
+      putString(payload, rec.mUserAgent);
+      putU32At(payload, lengthPos, (uint32_t)(payload.size() - lengthPos - 4));
+      ++count;
+   }
+
+   if (count == 0 && !encodeEmpty)
+   {
+      payload.truncate2(start);
+      return false;
+   }
+   putU32At(payload, countPos, count);
+   return true;
+}
+
+void
+RegSyncCodec::setSequence(Data& payload, Data::size_type pos, uint64_t sequence)
+{
+   putU32At(payload, pos, (uint32_t)(sequence >> 32));
+   putU32At(payload, pos + 4, (uint32_t)sequence);
+}
+
+void
+RegSyncCodec::rebaseRegInfo(Data& payload, const Data& record, uint64_t then, uint64_t now)
+{
+   const char* pos = record.data();
+   uint64_t sequence;
+   Uri aor;
+   ContactList contacts;
+   decodeRegInfo(pos, record.data() + record.size(), sequence, aor, contacts, then);
+   encodeRegInfo(payload, sequence, aor, contacts, now, true /* encodeEmpty */);
+}
+
+void
+RegSyncCodec::encodeSyncComplete(Data& payload, uint64_t serverId, uint64_t sequence)
+{
+   putU64(payload, serverId);
+   putU64(payload, sequence);
+}
+
+void
+RegSyncCodec::encodeFrame(Data& frame, FrameType type, const Data& payload)
+{
+   frame.reserve(frame.size() + HeaderSize + payload.size());
+   char header[2] = { 0, (char)type };
+   frame.append(header, sizeof(header));
+   putString(frame, payload);
+}
+
+size_t
+RegSyncCodec::parseFrame(const char* buffer, size_t size, FrameType& type,
+                         const char*& payload, size_t& payloadSize)
+{
+   if (size < HeaderSize)
+   {
+      return 0;
+   }
+   if (buffer[0] != 0)
+   {
+      throw Exception("Not a RegSync frame", __FILE__, __LINE__);
+   }
+   const char* pos = buffer + 2;
+   uint32_t length = getU32(pos, buffer + size);
+   if (length > MaxFrameSize)
+   {
+      throw Exception("RegSync frame too large", __FILE__, __LINE__);
+   }
+   if (size - HeaderSize < length)
+   {
+      return 0;
+   }
+   type = (FrameType)(unsigned char)buffer[1];
+   payload = pos;
+   payloadSize = length;
+   return HeaderSize + length;
+}
+
+void
+RegSyncCodec::decodeRegInfo(const char*& pos, const char* end, uint64_t& sequence,
+                            Uri& aor, ContactList& contacts, uint64_t now)
+{
+   sequence = getU64(pos, end);
+   aor = Uri(getString(pos, end));
+   uint32_t count = getU32(pos, end);
+   contacts.clear();
+   for (uint32_t i = 0; i < count; ++i)
+   {
+      uint32_t length = getU32(pos, end);
+      need(pos, end, length);
+      const char* recordEnd = pos + length;
+
+      ContactInstanceRecord rec;
+      rec.mContact = NameAddr(getString(pos, recordEnd));
+      uint64_t expires = getU64(pos, recordEnd);
+      rec.mRegExpires = (expires == 0 ? 0 : now + expires);
+      rec.mLastUpdated = now - getU64(pos, recordEnd);
+      Data token(getString(pos, recordEnd));
+      if (!token.empty())
+      {
+         rec.mReceivedFrom = Tuple::makeTupleFromBinaryToken(token);
+      }
+      token = getString(pos, recordEnd);
+      if (!token.empty())
+      {
+         rec.mPublicAddress = Tuple::makeTupleFromBinaryToken(token);
+      }
+      uint32_t paths = getU32(pos, recordEnd);
+      for (uint32_t p = 0; p < paths; ++p)
+      {
+         rec.mSipPath.push_back(NameAddr(getString(pos, recordEnd)));
+      }
+      rec.mInstance = getString(pos, recordEnd);
+      rec.mRegId = getU32(pos, recordEnd);
+      rec.mUserAgent = getString(pos, recordEnd);
+      rec.mSyncContact = true;  // This ContactInstanceRecord came from registration sync process
+      contacts.push_back(rec);
+
+      // Skip anything a later version appends to the record.
+      pos = recordEnd;
+   }
+}
+
+void
+RegSyncCodec::decodeSyncComplete(const char*& pos, const char* end,
+                                 uint64_t& serverId, uint64_t& sequence)
+{
+   serverId = getU64(pos, end);
+   sequence = getU64(pos, end);
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
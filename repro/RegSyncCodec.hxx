@@ -0,0 +1,144 @@
+#if !defined(RegSyncCodec_hxx)
+#define RegSyncCodec_hxx
+
+#include <rutil/Data.hxx>
+#include <resip/stack/Uri.hxx>
+#include <resip/dum/ContactInstanceRecord.hxx>
+
+namespace repro
+{
+
+/**
+  Binary framing for registration sync, used in place of <reginfo> XML
+  when the RegSyncClient asks for it in its InitialSync request.
+
+  A frame is a 0x00 marker byte (which can never start an XML message),
+  a type byte and a 4 byte payload length, followed by the payload.
+  All integers are in network byte order and strings are a 4 byte length
+  followed by the bytes.
+
+  A RegInfo frame carries one or more records, each of which is:
+     sequence   (8 bytes, 0 for records sent during an initial sync)
+     aor        (string)
+     count      (4 bytes)
+     count contacts, each a 4 byte length followed by:
+        contact uri, expires, lastupdate, receivedfrom, publicaddress,
+        path count and paths, instance, regid, useragent
+  Times are relative to now, as in the XML encoding, and the flow tokens
+  are the binary tokens from Tuple::writeBinaryToken.
+
+  A SyncComplete frame carries the server id and the sequence number of
+  the last change reflected in the data sent so far; a client that has
+  seen one can later ask to resume from the last sequence it applied.
+*/
+class RegSyncCodec
+{
+public:
+   typedef enum
+   {
+      RegInfo = 1,
+      SyncComplete = 2
+   } FrameType;
+
+   static const unsigned int HeaderSize = 6;
+   static const unsigned int MaxFrameSize = 16 * 1024 * 1024;
+
+   // Appends a record to a RegInfo payload, skipping static and
+   // connection-bound contacts as the XML encoding does.  Returns false,
+   // appending nothing, if there were no contacts to sync, unless
+   // encodeEmpty is set.
+   static bool encodeRegInfo(resip::Data& payload, uint64_t sequence,
+                             const resip::Uri& aor, const resip::ContactList& contacts,
+                             uint64_t now, bool encodeEmpty = false);
+   // Sets the sequence number of a record already encoded at pos in payload.
+   static void setSequence(resip::Data& payload, resip::Data::size_type pos, uint64_t sequence);
+   // Appends to payload a record that was encoded at time then, with its
+   // times made relative to now instead, so that a record kept for a while
+   // does not extend the bindings it carries.
+   static void rebaseRegInfo(resip::Data& payload, const resip::Data& record,
+                             uint64_t then, uint64_t now);
+   static void encodeSyncComplete(resip::Data& payload, uint64_t serverId, uint64_t sequence);
+   static void encodeFrame(resip::Data& frame, FrameType type, const resip::Data& payload);
+
+   // Returns the size of the frame at the start of buffer, or 0 if more
+   // data is needed.  Throws if the frame is malformed.
+   static size_t parseFrame(const char* buffer, size_t size, FrameType& type,
+                            const char*& payload, size_t& payloadSize);
+
+   // Decode one record or a SyncComplete payload, advancing pos.  Throw
+   // if the payload is truncated.
+   static void decodeRegInfo(const char*& pos, const char* end, uint64_t& sequence,
+                             resip::Uri& aor, resip::ContactList& contacts,
+                             uint64_t now);
+   static void decodeSyncComplete(const char*& pos, const char* end,
+                                  uint64_t& serverId, uint64_t& sequence);
+
+   // Primitives used by the encodings above.  The get functions throw if
+   // fewer than the required bytes remain.
+   static void putU32(resip::Data& out, uint32_t value);
+   static void putU64(resip::Data& out, uint64_t value);
+   static void putString(resip::Data& out, const resip::Data& value);
+   static uint32_t getU32(const char*& pos, const char* end);
+   static uint64_t getU64(const char*& pos, const char* end);
+   static resip::Data getString(const char*& pos, const char* end);
+
+   class Exception : public resip::BaseException
+   {
+   public:
+      Exception(const resip::Data& msg, const resip::Data& file, int line)
+         : resip::BaseException(msg, file, line) {}
+      const char* name() const noexcept { return "RegSyncCodec::Exception"; }
+   };
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -11,6 +11,7 @@
 #include <rutil/DnsUtil.hxx>
 #include <rutil/Logger.hxx>
 #include <rutil/ParseBuffer.hxx>
+#include <rutil/Random.hxx>
 #include <rutil/Socket.hxx>
 #include <rutil/TransportType.hxx>
 #include <rutil/Timer.hxx>
@@ -18,6 +19,7 @@
 #include "repro/XmlRpcServerBase.hxx"
 #include "repro/XmlRpcConnection.hxx"
 #include "repro/RegSyncServer.hxx"
+#include "repro/RegSyncCodec.hxx"
 
 using namespace repro;
 using namespace resip;
@@ -25,6 +27,17 @@ using namespace std;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::REPRO
 
+// Binary initial sync and catch-up records are sent in frames of about this size
+static const Data::size_type BatchSize = 64 * 1024;
+
+static uint64_t
+makeServerId()
+{
+   // Lets a client tell whether it is resuming with the same instance
+   uint64_t id = ((uint64_t)(unsigned int)Random::getRandom() << 32) ^ Timer::getTimeMicroSec();
+   return id != 0 ? id : 1;
+}
+
 
 RegSyncServer::RegSyncServer(resip::InMemorySyncRegDb* regDb,
                              int port, 
@@ -32,7 +45,12 @@ RegSyncServer::RegSyncServer(resip::InMemorySyncRegDb* regDb,
                              resip::InMemorySyncPubDb* pubDb) :
    XmlRpcHandler(std::unique_ptr<XmlRpcServerBase>(new XmlRpcSocketServer(*this, port, version))),
    mRegDb(regDb),
-   mPubDb(pubDb)
+   mPubDb(pubDb),
+   mServerId(makeServerId()),
+   mSequence(0),
+   mJournalFrom(0),
+   mJournalSize(0),
+   mInitialSyncConnectionId(0)
 {
    if (mRegDb)
    {
@@ -50,7 +68,12 @@ RegSyncServer::RegSyncServer(resip::InMemorySyncRegDb* regDb,
                              resip::InMemorySyncPubDb* pubDb) :
    XmlRpcHandler(std::unique_ptr<XmlRpcProtonServer>(new XmlRpcProtonServer(*this, brokerQueue, true))),
    mRegDb(regDb),
-   mPubDb(pubDb)
+   mPubDb(pubDb),
+   mServerId(makeServerId()),
+   mSequence(0),
+   mJournalFrom(0),
+   mJournalSize(0),
+   mInitialSyncConnectionId(0)
 {
    if (mRegDb)
    {
@@ -75,6 +98,22 @@ RegSyncServer::~RegSyncServer()
    }
 }
 
+void
+RegSyncServer::setJournalSize(unsigned int journalSize)
+{
+   Lock lock(mSequenceMutex);
+   if(mJournalSize == 0)
+   {
+      mJournalFrom = mSequence;
+   }
+   mJournalSize = journalSize;
+   while(mJournal.size() > mJournalSize)
+   {
+      mJournalFrom = mJournal.front().mSequence;
+      mJournal.pop_front();
+   }
+}
+
 void 
 RegSyncServer::sendResponse(unsigned int connectionId, 
                            unsigned int requestId, 
@@ -101,6 +140,15 @@ void
 RegSyncServer::sendRegistrationModifiedEvent(unsigned int connectionId, const resip::Uri& aor, const ContactList& contacts)
 {
    std::stringstream ss;
+   if(streamRegInfo(ss, aor, contacts))
+   {
+      mRpc->sendEvent(connectionId, ss.str().c_str());
+   }
+}
+
+bool
+RegSyncServer::streamRegInfo(std::stringstream& ss, const resip::Uri& aor, const ContactList& contacts)
+{
    bool infoFound = false;
 
    ss << "<reginfo>" << Symbols::CRLF;
@@ -117,11 +165,26 @@ RegSyncServer::sendRegistrationModifiedEvent(unsigned int connectionId, const re
       }
    }
    ss << "</reginfo>" << Symbols::CRLF;
+   return infoFound;
+}
 
-   if(infoFound)
-   {
-      mRpc->sendEvent(connectionId, ss.str().c_str());
-   }
+void
+RegSyncServer::sendRegInfoFrame(unsigned int connectionId, Data& payload)
+{
+   Data frame;
+   RegSyncCodec::encodeFrame(frame, RegSyncCodec::RegInfo, payload);
+   mRpc->sendEvent(connectionId, frame);
+   payload.clear();
+}
+
+void
+RegSyncServer::sendSyncCompleteFrame(unsigned int connectionId, uint64_t sequence)
+{
+   Data payload;
+   RegSyncCodec::encodeSyncComplete(payload, mServerId, sequence);
+   Data frame;
+   RegSyncCodec::encodeFrame(frame, RegSyncCodec::SyncComplete, payload);
+   mRpc->sendEvent(connectionId, frame);
 }
 
 void 
@@ -255,20 +318,50 @@ RegSyncServer::handleInitialSyncRequest(unsigned int connectionId, unsigned int
 
    // Check for correct Version
    unsigned int version = 0;
+   bool binary = false;
+   uint64_t resumeServerId = 0;
+   uint64_t resumeSequence = 0;
    if(xml.firstChild())
    {
       if(isEqualNoCase(xml.getTag(), "request"))
       {
          if(xml.firstChild())
          {
-            if(isEqualNoCase(xml.getTag(), "version"))
+            do
             {
-               if(xml.firstChild())
+               if(isEqualNoCase(xml.getTag(), "version"))
                {
-                  version = xml.getValue().convertUnsignedLong();
-                  xml.parent();
+                  if(xml.firstChild())
+                  {
+                     version = xml.getValue().convertUnsignedLong();
+                     xml.parent();
+                  }
                }
-            }
+               else if(isEqualNoCase(xml.getTag(), "binary"))
+               {
+                  if(xml.firstChild())
+                  {
+                     binary = isEqualNoCase(xml.getValue(), "true");
+                     xml.parent();
+                  }
+               }
+               else if(isEqualNoCase(xml.getTag(), "resumeserverid"))
+               {
+                  if(xml.firstChild())
+                  {
+                     resumeServerId = xml.getValue().convertUInt64();
+                     xml.parent();
+                  }
+               }
+               else if(isEqualNoCase(xml.getTag(), "resumesequence"))
+               {
+                  if(xml.firstChild())
+                  {
+                     resumeSequence = xml.getValue().convertUInt64();
+                     xml.parent();
+                  }
+               }
+            } while(xml.nextSibling());
             xml.parent();
          }
       }
@@ -279,7 +372,32 @@ RegSyncServer::handleInitialSyncRequest(unsigned int connectionId, unsigned int
    {
       if (mRegDb)
       {
-         mRegDb->initialSync(connectionId);
+         if(binary)
+         {
+            // Registration events not yet dispatched to this connection go to it as frames
+            mRpc->setBinaryEvents(connectionId, true);
+         }
+         if(!binary || !resume(connectionId, resumeServerId, resumeSequence))
+         {
+            // Every change numbered up to here is already in the database; later
+            // ones are sent to this connection as they happen.
+            uint64_t sequence;
+            {
+               Lock lock(mSequenceMutex);
+               sequence = mSequence;
+            }
+            mInitialSyncConnectionId = binary ? connectionId : 0;
+            mRegDb->initialSync(connectionId);
+            mInitialSyncConnectionId = 0;
+            if(binary)
+            {
+               if(!mInitialSyncBatch.empty())
+               {
+                  sendRegInfoFrame(connectionId, mInitialSyncBatch);
+               }
+               sendSyncCompleteFrame(connectionId, sequence);
+            }
+         }
       }
       if (mPubDb)
       {
@@ -293,6 +411,40 @@ RegSyncServer::handleInitialSyncRequest(unsigned int connectionId, unsigned int
    }
 }
 
+bool
+RegSyncServer::resume(unsigned int connectionId, uint64_t serverId, uint64_t sequence)
+{
+   Lock lock(mSequenceMutex);
+   if(serverId != mServerId || mJournalSize == 0 || sequence < mJournalFrom || sequence > mSequence)
+   {
+      return false;
+   }
+
+   uint64_t now = Timer::getTimeSecs();
+   Data payload;
+   unsigned int count = 0;
+   for(Journal::const_iterator it = mJournal.begin(); it != mJournal.end(); it++)
+   {
+      if(it->mSequence > sequence)
+      {
+         // Bindings that expired since the change go out with expires 0.
+         RegSyncCodec::rebaseRegInfo(payload, it->mRecord, it->mTime, now);
+         ++count;
+         if(payload.size() >= BatchSize)
+         {
+            sendRegInfoFrame(connectionId, payload);
+         }
+      }
+   }
+   if(!payload.empty())
+   {
+      sendRegInfoFrame(connectionId, payload);
+   }
+   sendSyncCompleteFrame(connectionId, mSequence);
+   InfoLog(<< "RegSyncServer::resume: resumed connection " << connectionId << " from sequence " << sequence << ", " << count << " changes sent");
+   return true;
+}
+
 void 
 RegSyncServer::streamContactInstanceRecord(std::stringstream& ss, const ContactInstanceRecord& rec)
 {
@@ -338,13 +490,57 @@ RegSyncServer::streamContactInstanceRecord(std::stringstream& ss, const ContactI
 void 
 RegSyncServer::onAorModified(const resip::Uri& aor, const ContactList& contacts)
 {
-   sendRegistrationModifiedEvent(0, aor, contacts);
+   uint64_t now = Timer::getTimeSecs();
+
+   // Encode without holding the lock; the database calls this with the
+   // record locked, so changes to one AOR still arrive here in order.  The
+   // sequence number is filled in once it is known.
+   Data record;
+   if(!RegSyncCodec::encodeRegInfo(record, 0, aor, contacts, now))
+   {
+      return;  // Nothing to sync
+   }
+   std::stringstream ss;
+   streamRegInfo(ss, aor, contacts);
+   Data xml(ss.str().c_str());
+   Data frame;
+   RegSyncCodec::encodeFrame(frame, RegSyncCodec::RegInfo, record);
+
+   // Number and queue the change under the lock, so that peers and the
+   // journal see changes in sequence order.
+   Lock lock(mSequenceMutex);
+   uint64_t sequence = ++mSequence;
+   RegSyncCodec::setSequence(frame, RegSyncCodec::HeaderSize, sequence);
+   mRpc->sendEvent(0, xml, frame);
+
+   if(mJournalSize > 0)
+   {
+      RegSyncCodec::setSequence(record, 0, sequence);
+      JournalEntry entry = { sequence, now, record };
+      mJournal.push_back(entry);
+      while(mJournal.size() > mJournalSize)
+      {
+         mJournalFrom = mJournal.front().mSequence;
+         mJournal.pop_front();
+      }
+   }
 }
 
 void 
 RegSyncServer::onInitialSyncAor(unsigned int connectionId, const resip::Uri& aor, const ContactList& contacts)
 {
-   sendRegistrationModifiedEvent(connectionId, aor, contacts);
+   if(connectionId != 0 && connectionId == mInitialSyncConnectionId)
+   {
+      RegSyncCodec::encodeRegInfo(mInitialSyncBatch, 0, aor, contacts, Timer::getTimeSecs());
+      if(mInitialSyncBatch.size() >= BatchSize)
+      {
+         sendRegInfoFrame(connectionId, mInitialSyncBatch);
+      }
+   }
+   else
+   {
+      sendRegistrationModifiedEvent(connectionId, aor, contacts);
+   }
 }
 
 void 
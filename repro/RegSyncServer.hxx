@@ -1,7 +1,10 @@
 #if !defined(RegSyncServer_hxx)
 #define RegSyncServer_hxx 
 
+#include <deque>
+
 #include <rutil/Data.hxx>
+#include <rutil/Mutex.hxx>
 #include <rutil/TransportType.hxx>
 #include <rutil/XMLCursor.hxx>
 #include <resip/dum/InMemorySyncRegDb.hxx>
@@ -30,6 +33,11 @@ public:
 #endif
    virtual ~RegSyncServer();
 
+   // Number of recent registration changes kept so that a RegSyncClient
+   // using the binary protocol can resume after a brief disconnect,
+   // instead of doing a full initial sync.  0 disables resuming.
+   void setJournalSize(unsigned int journalSize);
+
    // thread safe
    virtual void sendResponse(unsigned int connectionId, 
                              unsigned int requestId, 
@@ -57,10 +65,35 @@ protected:
 
 private: 
    void handleInitialSyncRequest(unsigned int connectionId, unsigned int requestId, resip::XMLCursor& xml);
+   bool resume(unsigned int connectionId, uint64_t serverId, uint64_t sequence);
+   bool streamRegInfo(std::stringstream& ss, const resip::Uri& aor, const resip::ContactList& contacts);
    void streamContactInstanceRecord(std::stringstream& ss, const resip::ContactInstanceRecord& rec);
+   void sendRegInfoFrame(unsigned int connectionId, resip::Data& payload);
+   void sendSyncCompleteFrame(unsigned int connectionId, uint64_t sequence);
 
    resip::InMemorySyncRegDb* mRegDb;
    resip::InMemorySyncPubDb* mPubDb;
+
+   // Registration changes sent to peers are numbered in the order they
+   // are queued; the journal keeps the binary records of the latest ones,
+   // with the time each was encoded at, since their times are relative.
+   resip::Mutex mSequenceMutex;
+   const uint64_t mServerId;
+   uint64_t mSequence;
+   struct JournalEntry
+   {
+      uint64_t mSequence;
+      uint64_t mTime;
+      resip::Data mRecord;
+   };
+   typedef std::deque<JournalEntry> Journal;
+   Journal mJournal;
+   uint64_t mJournalFrom;  // the journal holds every change after this one
+   unsigned int mJournalSize;
+
+   // Set while a binary initial sync is running on the server thread
+   unsigned int mInitialSyncConnectionId;
+   resip::Data mInitialSyncBatch;
 };
 
 }
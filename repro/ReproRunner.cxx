@@ -16,6 +16,7 @@
 #include "rutil/DnsUtil.hxx"
 #include "rutil/dns/DnsStub.hxx"
 #include "rutil/GeneralCongestionManager.hxx"
+#include "rutil/AdaptiveCongestionManager.hxx"
 #include "rutil/TransportType.hxx"
 #include "rutil/hep/HepAgent.hxx"
 
@@ -30,6 +31,7 @@
 #include "resip/stack/WsCookieContextFactory.hxx"
 
 #include "resip/dum/InMemorySyncRegDb.hxx"
+#include "resip/dum/ShardedInMemorySyncRegDb.hxx"
 #include "resip/dum/InMemorySyncPubDb.hxx"
 #include "resip/dum/MasterProfile.hxx"
 #include "resip/dum/DialogUsageManager.hxx"
@@ -54,6 +56,7 @@
 #include "repro/RegSyncClient.hxx"
 #include "repro/RegSyncServer.hxx"
 #include "repro/RegSyncServerThread.hxx"
+#include "repro/SyncDbStore.hxx"
 #include "repro/CommandServer.hxx"
 #include "repro/CommandServerThread.hxx"
 #include "repro/BasicWsConnectionValidator.hxx"
@@ -78,6 +81,7 @@
 #if defined(USE_SSL)
 #include "repro/stateAgents/CertServer.hxx"
 #include "resip/stack/ssl/Security.hxx"
+#include "resip/stack/ssl/TlsConnection.hxx"
 #define DEFAULT_TLS_METHOD SecurityTypes::SSLv23
 #endif
 
@@ -247,6 +251,7 @@ ReproRunner::ReproRunner()
    , mRegSyncServerV6(0)
    , mRegSyncServerAMQP(0)
    , mRegSyncServerThread(0)
+   , mSyncDbStore(0)
    , mCommandServerThread(0)
    , mCongestionManager(0)
 {
@@ -363,6 +368,14 @@ ReproRunner::run(int argc, char** argv)
       return false;
    }
 
+   // Restore registrations and publications saved by a previous run.  This
+   // is done once the presence server is listening for changes, so it can
+   // track the expiry of restored publications.
+   if(!mRestarting && !createSyncDbStore())
+   {
+      return false;
+   }
+
    // Create reg sync components if required
    createRegSync();
 
@@ -393,6 +406,10 @@ ReproRunner::run(int argc, char** argv)
    {
       mCommandServerThread->run();
    }
+   if(!mRestarting && mSyncDbStore)
+   {
+      mSyncDbStore->run();
+   }
    if(mRegSyncServerThread)
    {
       mRegSyncServerThread->run();
@@ -548,13 +565,28 @@ ReproRunner::cleanupObjects()
    if(!mRestarting) 
    {
       // If we are restarting then leave the In Memory Registration and Publication database intact
+      if(mSyncDbStore)
+      {
+         // Writes a final snapshot, so must go before the databases
+         mSyncDbStore->shutdown();
+         mSyncDbStore->join();
+         delete mSyncDbStore; mSyncDbStore = 0;
+      }
       delete mRegistrationPersistenceManager; mRegistrationPersistenceManager = 0;
       delete mPublicationPersistenceManager; mPublicationPersistenceManager = 0;
    }
+   if(mProxyConfig && mProxyConfig->getDataStore())
+   {
+      // Stop the credential cache's prefetch thread before its database goes away
+      mProxyConfig->getDataStore()->mUserStore.setAuthInfoCache(0, 0, 0);
+   }
    delete mAbstractDb; mAbstractDb = 0;
    delete mRuntimeAbstractDb; mRuntimeAbstractDb = 0;
    delete mStackThread; mStackThread = 0;
    delete mSipStack; mSipStack = 0;
+#if defined(USE_SSL)
+   TlsConnection::setHandshakeThreads(0);
+#endif
    delete mCongestionManager; mCongestionManager = 0;
    delete mAsyncProcessHandler; mAsyncProcessHandler = 0;
    delete mFdPollGrp; mFdPollGrp = 0;
@@ -619,6 +651,9 @@ ReproRunner::createSipStack()
       ConnectionBase::setMessageSizeMax(messageSizeLimit);
    }
 
+   // Copy the received lines of unmodified headers when forwarding messages
+   SipMessage::reuseWireEncoding = mProxyConfig->getConfigBool("ReuseWireEncoding", false);
+
    // Create Security (TLS / Certificates) and Compression (SigComp) objects if
    // pre-precessor defines are enabled
    Security* security = 0;
@@ -787,6 +822,9 @@ ReproRunner::createSipStack()
       }
       ConnectionManager::EnableAgressiveGc = true;
    }
+#if defined(USE_SSL)
+   TlsConnection::setHandshakeThreads(mProxyConfig->getConfigUnsignedLong("TLSHandshakeThreads", 0));
+#endif
 
    // Decide whether or not to add rport to the Via header
    InteropHelper::setRportEnabled(mProxyConfig->getConfigBool("AddViaRport", true));
@@ -844,9 +882,18 @@ ReproRunner::createSipStack()
       {
          WarningLog( << "CongestionManagementMetric specified as an unknown value (" << metricData << "), defaulting to WAIT_TIME.");
       }
-      mCongestionManager = new GeneralCongestionManager(
-                                          metric, 
-                                          mProxyConfig->getConfigUnsignedLong("CongestionManagementTolerance", 200));
+      unsigned long tolerance = mProxyConfig->getConfigUnsignedLong("CongestionManagementTolerance", 200);
+      if(mProxyConfig->getConfigBool("CongestionManagementAdaptive", false))
+      {
+         mCongestionManager = new AdaptiveCongestionManager(
+                                          metric,
+                                          tolerance,
+                                          mProxyConfig->getConfigUnsignedLong("CongestionManagementMaxCpuPercent", 90));
+      }
+      else
+      {
+         mCongestionManager = new GeneralCongestionManager(metric, tolerance);
+      }
       mSipStack->setCongestionManager(mCongestionManager);
    }
 
@@ -938,6 +985,10 @@ ReproRunner::createDatastore()
       return false;
    }
    mProxyConfig->createDataStore(mAbstractDb, mRuntimeAbstractDb);
+   mProxyConfig->getDataStore()->mUserStore.setAuthInfoCache(
+      mProxyConfig->getConfigUnsignedLong("UserAuthCacheSize", 0),
+      mProxyConfig->getConfigUnsignedLong("UserAuthCacheTtlSecs", 60),
+      mProxyConfig->getConfigUnsignedLong("UserAuthCacheNegativeTtlSecs", 10));
 
    // Create ImMemory Registration Database
    mRegSyncPort = mProxyConfig->getConfigInt("RegSyncPort", 0);
@@ -945,7 +996,16 @@ ReproRunner::createDatastore()
    if(!mRestarting)  // If we are restarting then we left the InMemorySyncRegDb and InMemorySyncPubDb intact at restart - don't recreate
    {
       resip_assert(!mRegistrationPersistenceManager);
-      mRegistrationPersistenceManager = new InMemorySyncRegDb(mRegSyncPort ? 86400 /* 24 hours */ : 0 /* removeLingerSecs */);  // !slg! could make linger time a setting
+      unsigned int removeLingerSecs = mRegSyncPort ? 86400 /* 24 hours */ : 0;  // !slg! could make linger time a setting
+      unsigned long shards = mProxyConfig->getConfigUnsignedLong("RegistrationDatabaseShards", 0);
+      if(shards > 0)
+      {
+         mRegistrationPersistenceManager = new ShardedInMemorySyncRegDb(removeLingerSecs, shards);
+      }
+      else
+      {
+         mRegistrationPersistenceManager = new InMemorySyncRegDb(removeLingerSecs);
+      }
       resip_assert(!mPublicationPersistenceManager);
       mPublicationPersistenceManager = new InMemorySyncPubDb((mRegSyncPort && mProxyConfig->getConfigBool("EnablePublicationReplication", false)) ? true : false);
    }
@@ -1339,6 +1399,36 @@ ReproRunner::createWebAdmin()
    return false;
 }
 
+bool
+ReproRunner::createSyncDbStore()
+{
+   resip_assert(!mSyncDbStore);
+   Data snapshotFile = mProxyConfig->getConfigData("RegistrationSnapshotFile", Data::Empty);
+   if(snapshotFile.empty())
+   {
+      return true;
+   }
+   InMemorySyncRegDb* regDb = dynamic_cast<InMemorySyncRegDb*>(mRegistrationPersistenceManager);
+   InMemorySyncPubDb* pubDb = dynamic_cast<InMemorySyncPubDb*>(mPublicationPersistenceManager);
+   if(!regDb)
+   {
+      WarningLog(<< "RegistrationSnapshotFile is only supported with the in memory registration database");
+      return true;
+   }
+   unsigned int removeLingerSecs = mRegSyncPort ? 86400 /* 24 hours */ : 0;  // must match createDatastore
+   mSyncDbStore = new SyncDbStore(snapshotFile, regDb, pubDb,
+                                  mProxyConfig->getConfigUnsignedLong("RegistrationSnapshotIntervalSecs", 300),
+                                  removeLingerSecs);
+   if(!mSyncDbStore->load())
+   {
+      CritLog(<< "Failed to write RegistrationSnapshotFile " << snapshotFile);
+      delete mSyncDbStore; mSyncDbStore = 0;
+      cleanupObjects();
+      return false;
+   }
+   return true;
+}
+
 void
 ReproRunner::createRegSync()
 {
@@ -1377,6 +1467,11 @@ ReproRunner::createRegSync()
       }
       if(!regSyncServerList.empty())
       {
+         unsigned long journalSize = mProxyConfig->getConfigUnsignedLong("RegSyncJournalSize", 10000);
+         for(std::list<RegSyncServer*>::iterator it = regSyncServerList.begin(); it != regSyncServerList.end(); it++)
+         {
+            (*it)->setJournalSize(journalSize);
+         }
          mRegSyncServerThread = new RegSyncServerThread(regSyncServerList);
       }
       Data regSyncPeerAddress(mProxyConfig->getConfigData("RegSyncPeer", ""));
@@ -1392,6 +1487,7 @@ ReproRunner::createRegSync()
             mRegSyncClient = new RegSyncClient(dynamic_cast<InMemorySyncRegDb*>(mRegistrationPersistenceManager),
                                                regSyncPeerAddress, remoteRegSyncPort,
                                                enablePublicationReplication ? dynamic_cast<InMemorySyncPubDb*>(mPublicationPersistenceManager) : 0);
+            mRegSyncClient->setBinary(mProxyConfig->getConfigBool("RegSyncBinary", false));
          }
       }
    }
@@ -1635,6 +1731,7 @@ ReproRunner::addTransports(bool& allTransportsSpecifyRecordRoute)
          // Transport1TlsClientVerification = None
          // Transport1RecordRouteUri = sip:sipdomain.com;transport=TLS
          // Transport1RcvBufLen = 2000
+         // Transport1BatchSize = 16
 
          allTransportsSpecifyRecordRoute = true;
 
@@ -1734,6 +1831,12 @@ ReproRunner::addTransports(bool& allTransportsSpecifyRecordRoute)
 #endif
                   }
 
+                  int batchSize = tc.getConfigInt("BatchSize", 0);
+                  if (batchSize > 1)
+                  {
+                     t->setBatchSize(batchSize);
+                  }
+
                   Data recordRouteUri = tc.getConfigData("RecordRouteUri", Data::Empty);
                   if(!recordRouteUri.empty())
                   {
@@ -40,6 +40,7 @@ class CertServer;
 class RegSyncClient;
 class RegSyncServer;
 class RegSyncServerThread;
+class SyncDbStore;
 class CommandServer;
 class CommandServerThread;
 class Processor;
@@ -75,6 +76,7 @@ protected:
    virtual bool createWebAdmin();
    virtual void createAuthenticatorFactory();
    virtual void createDialogUsageManager();
+   virtual bool createSyncDbStore();
    virtual void createRegSync();
    virtual void createCommandServer();
 
@@ -123,6 +125,7 @@ protected:
    RegSyncServer* mRegSyncServerV6;
    RegSyncServer* mRegSyncServerAMQP;
    RegSyncServerThread* mRegSyncServerThread;
+   SyncDbStore* mSyncDbStore;
    std::list<CommandServer*> mCommandServerList;
    CommandServerThread* mCommandServerThread;
    resip::CongestionManager* mCongestionManager;
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <cassert>
 #include <fcntl.h>
+#include <functional>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -8,6 +10,7 @@
 #include "rutil/ResipAssert.h"
 #include "rutil/Data.hxx"
 #include "rutil/DataStream.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/Logger.hxx"
 #include "rutil/ParseBuffer.hxx"
 
@@ -21,10 +24,124 @@ using namespace std;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::REPRO
 
-SqlDb::SqlDb(const resip::ConfigParse& config) : mConnected(false)
+struct SqlDb::ConnectionLoad
+{
+   Mutex mMutex;
+   std::vector<unsigned int> mThreads;  // bound to each connection
+};
+
+// The connections a thread is bound to, one per SqlDb it has queried.
+struct SqlDb::ThreadBindings
+{
+   struct Binding
+   {
+      const ConnectionLoad* mLoad;
+      std::weak_ptr<ConnectionLoad> mOwner;
+      unsigned int mIndex;
+
+      bool expired() const { return mOwner.expired(); }
+   };
+
+   ~ThreadBindings()
+   {
+      for(std::vector<Binding>::iterator it = mBindings.begin(); it != mBindings.end(); ++it)
+      {
+         std::shared_ptr<ConnectionLoad> load = it->mOwner.lock();
+         if(load)
+         {
+            Lock lock(load->mMutex);
+            --load->mThreads[it->mIndex];
+         }
+      }
+   }
+
+   std::vector<Binding> mBindings;
+};
+
+SqlDb::SqlDb(const resip::ConfigParse& config)
 {
    mTlsPeerAuthorizationQuery = config.getConfigData("CustomTlsAuthQuery", "");
    mTableNamePrefix = config.getConfigData("TableNamePrefix", "");
+   mConnectionPoolSize = config.getConfigUnsignedLong("ConnectionPoolSize", 1);
+   if(mConnectionPoolSize == 0)
+   {
+      mConnectionPoolSize = 1;
+   }
+   mConnectionLoad = std::make_shared<ConnectionLoad>();
+   mConnectionLoad->mThreads.resize(mConnectionPoolSize, 0);
+   mConnectionStates.reset(new std::atomic<int>[mConnectionPoolSize]);
+   for(unsigned int i = 0; i < mConnectionPoolSize; ++i)
+   {
+      mConnectionStates[i] = 0;
+   }
+}
+
+bool
+SqlDb::isSane()
+{
+   bool connected = false;
+   for(unsigned int i = 0; i < mConnectionPoolSize; ++i)
+   {
+      int state = mConnectionStates[i].load(std::memory_order_relaxed);
+      if(state < 0)
+      {
+         return false;
+      }
+      connected = connected || state > 0;
+   }
+   return connected;
+}
+
+void
+SqlDb::setConnected(unsigned int index, bool connected) const
+{
+   resip_assert(index < mConnectionPoolSize);
+   mConnectionStates[index].store(connected ? 1 : -1, std::memory_order_relaxed);
+}
+
+unsigned int
+SqlDb::connectionIndex() const
+{
+   if(mConnectionPoolSize == 1)
+   {
+      return 0;
+   }
+
+   static thread_local ThreadBindings bindings;
+   std::vector<ThreadBindings::Binding>& bound = bindings.mBindings;
+   for(std::vector<ThreadBindings::Binding>::const_iterator it = bound.begin(); it != bound.end(); ++it)
+   {
+      // An SqlDb since destroyed may have lived at the same address, but
+      // then the binding has expired.
+      if(it->mLoad == mConnectionLoad.get() && !it->expired())
+      {
+         return it->mIndex;
+      }
+   }
+
+   // First query from this thread.  Drop the bindings of destroyed SqlDbs
+   // while we are here.
+   bound.erase(std::remove_if(bound.begin(), bound.end(),
+                              std::mem_fn(&ThreadBindings::Binding::expired)),
+               bound.end());
+
+   unsigned int index = 0;
+   {
+      Lock lock(mConnectionLoad->mMutex);
+      std::vector<unsigned int>& threads = mConnectionLoad->mThreads;
+      for(unsigned int i = 1; i < threads.size(); ++i)
+      {
+         if(threads[i] < threads[index])
+         {
+            index = i;
+         }
+      }
+      ++threads[index];
+   }
+   ThreadBindings::Binding binding = { mConnectionLoad.get(), mConnectionLoad, index };
+   bound.push_back(binding);
+   DebugLog(<< "Thread bound to database connection " << index);
+   return index;
 }
 
 void 
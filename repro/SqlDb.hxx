@@ -1,6 +1,9 @@
 #if !defined(RESIP_SQLDB_HXX)
 #define RESIP_SQLDB_HXX 
 
+#include <atomic>
+#include <memory>
+
 #include "rutil/ConfigParse.hxx"
 #include "rutil/Data.hxx"
 #include "repro/AbstractDb.hxx"
@@ -18,7 +21,9 @@ class SqlDb: public AbstractDb
    public:
       SqlDb(const resip::ConfigParse& config);
       
-      virtual bool isSane() {return mConnected;}
+      // True once a pooled connection is up, and while none of the pooled
+      // connections that have been opened is down.
+      virtual bool isSane();
 
       virtual void eraseUser( const Key& key );
       virtual void eraseTlsPeerIdentity( const Key& key );
@@ -29,15 +34,22 @@ class SqlDb: public AbstractDb
       virtual int singleResultQuery(const resip::Data& queryCommand, std::vector<resip::Data>& fields) const = 0;
 
    protected:
-      virtual void setConnected(bool connected) const { mConnected = connected; }
-      virtual bool isConnected() const { return mConnected; }
+      // Records whether the pooled connection with this index is up.
+      void setConnected(unsigned int index, bool connected) const;
 
       void setToData(const std::set<resip::Data>& items, resip::Data& result, const resip::Data& sep = ",", const char quote = '\'') const;
 
-      // when multiple threads are in use with the same connection, you need to
-      // mutex calls to mysql_query and mysql_store_result:
+      // Returns the index of the pooled connection the calling thread is bound to.
+      // On first use a thread is bound to the connection with the fewest threads
+      // bound, and keeps it until it exits, so a transaction begun by a thread
+      // stays on one connection.  Only that first use takes a lock; after it the
+      // binding is found in a thread local.  When there are more threads than
+      // connections, a connection is shared and calls to it must still be
+      // serialized:
       // http://dev.mysql.com/doc/refman/5.1/en/threaded-clients.html
-      mutable resip::Mutex mMutex;
+      unsigned int connectionIndex() const;
+
+      unsigned int mConnectionPoolSize;
 
       resip::Data tableName( Table table ) const;
 
@@ -53,10 +65,18 @@ class SqlDb: public AbstractDb
       virtual int query(const resip::Data& queryCommand) const = 0;
       virtual resip::Data& escapeString(const resip::Data& str, resip::Data& escapedStr) const = 0;
 
-      mutable volatile bool mConnected;
+      // One per pooled connection: 0 until it is opened, then 1 while it is
+      // up and -1 while it is down.
+      std::unique_ptr<std::atomic<int>[]> mConnectionStates;
       resip::Data mTlsPeerAuthorizationQuery;
       resip::Data mTableNamePrefix;
 
+      // How many threads are bound to each connection.  Shared with the
+      // threads' bindings, which hand their connection back when they exit.
+      struct ConnectionLoad;
+      struct ThreadBindings;
+      std::shared_ptr<ConnectionLoad> mConnectionLoad;
+
       virtual void userWhereClauseToDataStream(const Key& key, resip::DataStream& ds) const = 0;
       virtual void tlsPeerIdentityWhereClauseToDataStream(const Key& key, resip::DataStream& ds) const = 0;
 };
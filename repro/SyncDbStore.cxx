@@ -0,0 +1,678 @@
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#ifdef WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <rutil/DataException.hxx>
+#include <rutil/DataStream.hxx>
+#include <rutil/Lock.hxx>
+#include <rutil/Logger.hxx>
+#include <rutil/ParseBuffer.hxx>
+#include <rutil/Timer.hxx>
+#include <rutil/XMLCursor.hxx>
+
+#include "repro/RegSyncCodec.hxx"
+#include "repro/SyncDbStore.hxx"
+
+using namespace repro;
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::REPRO
+
+namespace
+{
+
+const char SnapshotMagic[8] = { 'R', 'E', 'S', 'I', 'P', 'S', 'N', 'P' };
+const uint32_t SnapshotVersion = 1;
+const size_t RecordHeaderSize = 17;  // type, sequence, time written
+const size_t SnapshotBufferSize = 64 * 1024;
+
+uint32_t
+checksum(const char* data, size_t size)
+{
+   return (uint32_t)Data::rawHash((const unsigned char*)data, size);
+}
+
+bool
+syncFile(FILE* file)
+{
+   if (fflush(file) != 0)
+   {
+      return false;
+   }
+#ifdef WIN32
+   return _commit(_fileno(file)) == 0;
+#else
+   return fsync(fileno(file)) == 0;
+#endif
+}
+
+bool
+replaceFile(const Data& from, const Data& to)
+{
+#ifdef WIN32
+   return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+   return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// Makes a rename into the directory holding path durable.
+bool
+syncDirectory(const Data& path)
+{
+#ifdef WIN32
+   return true;  // MOVEFILE_WRITE_THROUGH already flushed it
+#else
+   Data dir(".");
+   size_t slash = path.find("/");
+   if (slash != Data::npos)
+   {
+      size_t last = slash;
+      while ((slash = path.find("/", last + 1)) != Data::npos)
+      {
+         last = slash;
+      }
+      dir = last == 0 ? Data("/") : path.substr(0, last);
+   }
+   int fd = open(dir.c_str(), O_RDONLY);
+   if (fd < 0)
+   {
+      return false;
+   }
+   bool ok = fsync(fd) == 0;
+   close(fd);
+   return ok;
+#endif
+}
+
+bool
+writeFile(FILE* file, const Data& data)
+{
+   return fwrite(data.data(), 1, data.size(), file) == data.size();
+}
+
+}
+
+SyncDbStore::SyncDbStore(const Data& path,
+                         InMemorySyncRegDb* regDb,
+                         InMemorySyncPubDb* pubDb,
+                         unsigned int snapshotIntervalSecs,
+                         unsigned int removeLingerSecs) :
+   InMemorySyncRegDbHandler(InMemorySyncRegDbHandler::AllChanges),
+   InMemorySyncPubDbHandler(InMemorySyncPubDbHandler::AllChanges),
+   mPath(path),
+   mJournalPath(path + ".journal"),
+   mOldJournalPath(path + ".journal.1"),
+   mRegDb(regDb),
+   mPubDb(pubDb),
+   mSnapshotIntervalSecs(snapshotIntervalSecs),
+   mRemoveLingerSecs(removeLingerSecs),
+   mRecording(false),
+   mSequence(0),
+   mJournal(0),
+   mOldJournalPending(false)
+{
+   resip_assert(mRegDb);
+}
+
+SyncDbStore::~SyncDbStore()
+{
+   if (mRecording)
+   {
+      mRegDb->removeHandler(this);
+      if (mPubDb)
+      {
+         mPubDb->removeHandler(this);
+      }
+   }
+   if (mJournal)
+   {
+      fclose(mJournal);
+   }
+}
+
+bool
+SyncDbStore::load()
+{
+   uint64_t start = Timer::getTimeMs();
+   uint64_t snapshotSequence = 0;
+   uint64_t lastSequence = 0;
+   loadFile(mPath, true, snapshotSequence, lastSequence);
+   loadFile(mOldJournalPath, false, snapshotSequence, lastSequence);
+   loadFile(mJournalPath, false, snapshotSequence, lastSequence);
+   mSequence = resipMax(snapshotSequence, lastSequence);
+   InfoLog(<< "SyncDbStore: loaded " << mPath << " up to change " << mSequence << " in " << Timer::getTimeMs() - start << "ms");
+
+   // Everything on disk is now in memory, so fold it into a new snapshot
+   // and start with an empty journal
+   if (!writeSnapshot(true))
+   {
+      ErrLog(<< "SyncDbStore: unable to write " << mPath << ", registrations will not be saved");
+      return false;
+   }
+
+   mRecording = true;
+   mRegDb->addHandler(this);
+   if (mPubDb)
+   {
+      mPubDb->addHandler(this);
+   }
+   return true;
+}
+
+void
+SyncDbStore::shutdown()
+{
+   ThreadIf::shutdown();
+   Lock lock(mPendingMutex);
+   mPendingCondition.notify_one();
+}
+
+void
+SyncDbStore::thread()
+{
+   uint64_t nextSnapshot = Timer::getTimeSecs() + mSnapshotIntervalSecs;
+   while (!isShutdown())
+   {
+      vector<Data> pending;
+      {
+         Lock lock(mPendingMutex);
+         if (mPending.empty())
+         {
+            mPendingCondition.wait_for(lock, std::chrono::seconds(1));
+         }
+         pending.swap(mPending);
+      }
+      // Everything that queued up while the last batch was being synced
+      // goes out with a single fsync
+      writeJournal(pending);
+
+      if (mSnapshotIntervalSecs > 0 && Timer::getTimeSecs() >= nextSnapshot)
+      {
+         writeSnapshot(false);
+         nextSnapshot = Timer::getTimeSecs() + mSnapshotIntervalSecs;
+      }
+   }
+
+   // Nothing more will be recorded, so leave just a snapshot behind and
+   // the next start has no journal to replay
+   mRegDb->removeHandler(this);
+   if (mPubDb)
+   {
+      mPubDb->removeHandler(this);
+   }
+   mRecording = false;
+   writeSnapshot(true);
+}
+
+void
+SyncDbStore::onAorModified(const Uri& aor, const ContactList& contacts)
+{
+   Data payload;
+   RegSyncCodec::encodeRegInfo(payload, 0, aor, contacts, Timer::getTimeSecs(), true /* encodeEmpty */);
+   queueRecord(RegAor, payload);
+}
+
+void
+SyncDbStore::onDocumentModified(bool sync, const Data& eventType, const Data& documentKey, const Data& eTag, uint64_t expirationTime, uint64_t lastUpdated, const Contents* contents, const SecurityAttributes* securityAttributes)
+{
+   PublicationPersistenceManager::PubDocument document(eventType, documentKey, eTag, expirationTime, contents, securityAttributes);
+   document.mLastUpdated = lastUpdated;
+   Data payload;
+   {
+      DataStream ds(payload);
+      document.stream(ds);
+   }
+   queueRecord(PubModified, payload);
+}
+
+void
+SyncDbStore::onDocumentRemoved(bool sync, const Data& eventType, const Data& documentKey, const Data& eTag, uint64_t lastUpdated)
+{
+   uint64_t now = Timer::getTimeSecs();
+   Data payload;
+   RegSyncCodec::putString(payload, eventType);
+   RegSyncCodec::putString(payload, documentKey);
+   RegSyncCodec::putString(payload, eTag);
+   RegSyncCodec::putU64(payload, now > lastUpdated ? now - lastUpdated : 0);
+   queueRecord(PubRemoved, payload);
+}
+
+void
+SyncDbStore::queueRecord(RecordType type, const Data& payload)
+{
+   // Called with the database locked, so records queue in the order the
+   // changes were made
+   Lock lock(mPendingMutex);
+   bool wake = mPending.empty();
+   mPending.push_back(Data());
+   appendRecord(mPending.back(), type, ++mSequence, payload);
+   if (wake)
+   {
+      mPendingCondition.notify_one();
+   }
+}
+
+void
+SyncDbStore::appendRecord(Data& out, RecordType type, uint64_t sequence, const Data& payload)
+{
+   Data body;
+   body.reserve(RecordHeaderSize + payload.size());
+   char typeByte = (char)type;
+   body.append(&typeByte, 1);
+   RegSyncCodec::putU64(body, sequence);
+   RegSyncCodec::putU64(body, (uint64_t)time(0));
+   body.append(payload.data(), payload.size());
+
+   RegSyncCodec::putU32(out, (uint32_t)body.size());
+   RegSyncCodec::putU32(out, checksum(body.data(), body.size()));
+   out.append(body.data(), body.size());
+}
+
+bool
+SyncDbStore::loadFile(const Data& fileName, bool snapshot, uint64_t& snapshotSequence, uint64_t& lastSequence)
+{
+   Data contents;
+   try
+   {
+      contents = Data::fromFile(fileName);
+   }
+   catch (DataException&)
+   {
+      return false;  // not there
+   }
+
+   const char* pos = contents.data();
+   const char* end = pos + contents.size();
+   uint64_t wallNow = (uint64_t)time(0);
+   uint64_t now = Timer::getTimeSecs();
+   unsigned int records = 0;
+   unsigned int applied = 0;
+   bool complete = !snapshot;
+   try
+   {
+      if (snapshot)
+      {
+         if (contents.size() < sizeof(SnapshotMagic) || memcmp(pos, SnapshotMagic, sizeof(SnapshotMagic)) != 0)
+         {
+            WarningLog(<< "SyncDbStore: " << fileName << " is not a snapshot, ignoring it");
+            return false;
+         }
+         pos += sizeof(SnapshotMagic);
+         uint32_t version = RegSyncCodec::getU32(pos, end);
+         if (version != SnapshotVersion)
+         {
+            WarningLog(<< "SyncDbStore: " << fileName << " has unsupported version " << version << ", ignoring it");
+            return false;
+         }
+         snapshotSequence = RegSyncCodec::getU64(pos, end);
+      }
+
+      while (pos < end)
+      {
+         uint32_t length = RegSyncCodec::getU32(pos, end);
+         uint32_t sum = RegSyncCodec::getU32(pos, end);
+         if (length < RecordHeaderSize || (size_t)(end - pos) < length || checksum(pos, length) != sum)
+         {
+            break;  // torn write or corruption; nothing after it can be trusted
+         }
+         const char* body = pos;
+         const char* bodyEnd = pos + length;
+         pos = bodyEnd;
+
+         RecordType type = (RecordType)(unsigned char)*body++;
+         uint64_t sequence = RegSyncCodec::getU64(body, bodyEnd);
+         uint64_t written = RegSyncCodec::getU64(body, bodyEnd);
+         if (type == End)
+         {
+            complete = RegSyncCodec::getU32(body, bodyEnd) == records;
+            break;
+         }
+         ++records;
+         if (!snapshot)
+         {
+            if (sequence <= snapshotSequence || sequence <= lastSequence)
+            {
+               continue;  // already in the snapshot
+            }
+            lastSequence = sequence;
+         }
+
+         // Times in a record are relative to when it was written
+         uint64_t elapsed = wallNow > written ? wallNow - written : 0;
+         applyRecord(type, body, bodyEnd, now > elapsed ? now - elapsed : 0);
+         ++applied;
+      }
+   }
+   catch (RegSyncCodec::Exception&)
+   {
+      // Truncated record header at the end of the file
+   }
+
+   if (pos < end || !complete)
+   {
+      WarningLog(<< "SyncDbStore: " << fileName << " is truncated or corrupt after " << records << " records");
+   }
+   InfoLog(<< "SyncDbStore: applied " << applied << " of " << records << " records from " << fileName);
+   return true;
+}
+
+void
+SyncDbStore::applyRecord(RecordType type, const char* pos, const char* end, uint64_t now)
+{
+   uint64_t current = Timer::getTimeSecs();
+   try
+   {
+      switch (type)
+      {
+      case RegAor:
+      {
+         uint64_t sequence;
+         Uri aor;
+         ContactList contacts;
+         RegSyncCodec::decodeRegInfo(pos, end, sequence, aor, contacts, now);
+
+         // Static registrations are loaded from configuration and never
+         // recorded, so keep them
+         ContactList restored;
+         mRegDb->getContactsFull(aor, restored);
+         for (ContactList::iterator it = restored.begin(); it != restored.end();)
+         {
+            if (it->mRegExpires == NeverExpire)
+            {
+               it++;
+            }
+            else
+            {
+               it = restored.erase(it);
+            }
+         }
+         for (ContactList::iterator it = contacts.begin(); it != contacts.end(); it++)
+         {
+            // Drop bindings that expired, or stopped lingering, while we were down
+            if (it->mRegExpires <= current && it->mLastUpdated + mRemoveLingerSecs < current)
+            {
+               continue;
+            }
+            it->mSyncContact = false;
+            restored.push_back(*it);
+         }
+         if (restored.empty())
+         {
+            mRegDb->removeAor(aor);
+         }
+         else
+         {
+            mRegDb->addAor(aor, restored);
+         }
+         break;
+      }
+      case PubModified:
+      {
+         if (!mPubDb)
+         {
+            break;
+         }
+         ParseBuffer pb(pos, end - pos);
+         XMLCursor xml(pb);
+         PublicationPersistenceManager::PubDocument document;
+         document.deserialize(xml, now);
+         if (document.mExpirationTime > current)
+         {
+            mPubDb->addUpdateDocument(document);
+         }
+         else
+         {
+            mPubDb->removeDocument(document.mEventType, document.mDocumentKey, document.mETag, document.mLastUpdated);
+         }
+         break;
+      }
+      case PubRemoved:
+      {
+         if (!mPubDb)
+         {
+            break;
+         }
+         Data eventType(RegSyncCodec::getString(pos, end));
+         Data documentKey(RegSyncCodec::getString(pos, end));
+         Data eTag(RegSyncCodec::getString(pos, end));
+         uint64_t age = RegSyncCodec::getU64(pos, end);
+         mPubDb->removeDocument(eventType, documentKey, eTag, now > age ? now - age : 0);
+         break;
+      }
+      default:
+         WarningLog(<< "SyncDbStore: ignoring record of unknown type " << (int)type);
+         break;
+      }
+   }
+   catch (BaseException& e)
+   {
+      WarningLog(<< "SyncDbStore: ignoring unreadable record: " << e);
+   }
+}
+
+bool
+SyncDbStore::openJournal()
+{
+   mJournal = fopen(mJournalPath.c_str(), "ab");
+   if (!mJournal)
+   {
+      ErrLog(<< "SyncDbStore: unable to open " << mJournalPath << ": " << strerror(errno));
+      return false;
+   }
+   return true;
+}
+
+bool
+SyncDbStore::writeJournal(const vector<Data>& records)
+{
+   if (records.empty() || !mJournal)
+   {
+      return true;
+   }
+   for (vector<Data>::const_iterator it = records.begin(); it != records.end(); it++)
+   {
+      if (!writeFile(mJournal, *it))
+      {
+         ErrLog(<< "SyncDbStore: unable to write " << mJournalPath << ": " << strerror(errno));
+         return false;
+      }
+   }
+   if (!syncFile(mJournal))
+   {
+      ErrLog(<< "SyncDbStore: unable to sync " << mJournalPath << ": " << strerror(errno));
+      return false;
+   }
+   return true;
+}
+
+bool
+SyncDbStore::writeSnapshot(bool compact)
+{
+   // Every change up to sequence is in the databases; later ones may be
+   // too, which is harmless as each record holds the whole AOR or
+   // document and replaying it again gives the same result
+   uint64_t sequence;
+   vector<Data> pending;
+   {
+      Lock lock(mPendingMutex);
+      pending.swap(mPending);
+      sequence = mSequence;
+   }
+   writeJournal(pending);
+
+   if (!compact && !mOldJournalPending)
+   {
+      // Changes after sequence go to a new journal, and the old one is
+      // kept until the snapshot is in place.  If the last snapshot failed
+      // the old journal is still needed, so carry on with the current one.
+      fclose(mJournal);
+      mJournal = 0;
+      mOldJournalPending = replaceFile(mJournalPath, mOldJournalPath);
+      if (!mOldJournalPending)
+      {
+         ErrLog(<< "SyncDbStore: unable to rename " << mJournalPath << ": " << strerror(errno));
+      }
+      if (!openJournal())
+      {
+         return false;
+      }
+   }
+
+   Data tmpPath(mPath + ".tmp");
+   FILE* file = fopen(tmpPath.c_str(), "wb");
+   if (!file)
+   {
+      ErrLog(<< "SyncDbStore: unable to open " << tmpPath << ": " << strerror(errno));
+      return false;
+   }
+
+   uint64_t now = Timer::getTimeSecs();
+   uint32_t records = 0;
+   bool ok = true;
+   Data buffer;
+   buffer.reserve(SnapshotBufferSize);
+   buffer.append(SnapshotMagic, sizeof(SnapshotMagic));
+   RegSyncCodec::putU32(buffer, SnapshotVersion);
+   RegSyncCodec::putU64(buffer, sequence);
+
+   RegistrationPersistenceManager::UriList aors;
+   mRegDb->getAors(aors);
+   for (RegistrationPersistenceManager::UriList::const_iterator it = aors.begin(); it != aors.end(); it++)
+   {
+      ContactList contacts;
+      mRegDb->getContactsFull(*it, contacts);
+      Data payload;
+      if (RegSyncCodec::encodeRegInfo(payload, 0, *it, contacts, now))
+      {
+         appendRecord(buffer, RegAor, 0, payload);
+         ++records;
+      }
+      if (buffer.size() >= SnapshotBufferSize)
+      {
+         ok = ok && writeFile(file, buffer);
+         buffer.truncate2(0);
+      }
+   }
+
+   if (mPubDb)
+   {
+      // Only encode while the documents are locked; the write comes after
+      mPubDb->lockDocuments();
+      PublicationPersistenceManager::KeyToETagMap& documents = mPubDb->getDocuments();
+      for (PublicationPersistenceManager::KeyToETagMap::const_iterator keyIt = documents.begin(); keyIt != documents.end(); keyIt++)
+      {
+         for (PublicationPersistenceManager::ETagToDocumentMap::const_iterator eTagIt = keyIt->second.begin(); eTagIt != keyIt->second.end(); eTagIt++)
+         {
+            if (eTagIt->second.mExpirationTime <= now)
+            {
+               continue;  // expired or lingering
+            }
+            Data payload;
+            {
+               DataStream ds(payload);
+               eTagIt->second.stream(ds);
+            }
+            appendRecord(buffer, PubModified, 0, payload);
+            ++records;
+         }
+      }
+      mPubDb->unlockDocuments();
+   }
+
+   Data payload;
+   RegSyncCodec::putU32(payload, records);
+   appendRecord(buffer, End, sequence, payload);
+   ok = ok && writeFile(file, buffer) && syncFile(file);
+   ok = (fclose(file) == 0) && ok;
+   if (!ok || !replaceFile(tmpPath, mPath))
+   {
+      ErrLog(<< "SyncDbStore: unable to write " << mPath << ": " << strerror(errno));
+      remove(tmpPath.c_str());
+      return false;
+   }
+   // The old journal may only go once the new snapshot is sure to survive
+   // a crash.
+   if (!syncDirectory(mPath))
+   {
+      ErrLog(<< "SyncDbStore: unable to sync directory of " << mPath << ": " << strerror(errno));
+      return false;
+   }
+
+   remove(mOldJournalPath.c_str());
+   mOldJournalPending = false;
+   if (compact)
+   {
+      // Only used when no changes can arrive, so the journal holds nothing
+      // the snapshot does not
+      if (mJournal)
+      {
+         fclose(mJournal);
+         mJournal = 0;
+      }
+      remove(mJournalPath.c_str());
+      if (!openJournal())
+      {
+         return false;
+      }
+   }
+   InfoLog(<< "SyncDbStore: wrote " << records << " records up to change " << sequence << " to " << mPath);
+   return true;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,153 @@
+#if !defined(SyncDbStore_hxx)
+#define SyncDbStore_hxx
+
+#include <cstdio>
+#include <vector>
+
+#include <rutil/Data.hxx>
+#include <rutil/Mutex.hxx>
+#include <rutil/Condition.hxx>
+#include <rutil/ThreadIf.hxx>
+#include <resip/dum/InMemorySyncRegDb.hxx>
+#include <resip/dum/InMemorySyncPubDb.hxx>
+
+namespace repro
+{
+
+/**
+  Keeps the in memory registration and publication databases on disk so
+  that repro can be restarted without waiting for every endpoint to
+  register or publish again.
+
+  The store is a snapshot file, written periodically, and an append-only
+  journal of the changes made since that snapshot.  Both are a sequence
+  of records, each a 4 byte length and a 4 byte checksum followed by a
+  type byte, a sequence number, the wall clock time it was written and
+  the record itself: registrations use the RegSyncCodec encoding and
+  publications the <pubinfo> XML, so times are relative to when the
+  record was written.  The snapshot starts with the sequence number of
+  the last change it contains and ends with a record count.
+
+  The journal is written from a thread of its own, one fsync per batch
+  of changes.  At snapshot time the journal is rotated to <path>.journal.1
+  and the snapshot is written to <path>.tmp and renamed into place before
+  the old journal is removed, so a crash at any point leaves a snapshot
+  and the journals needed to bring it up to date.  Loading stops at the
+  first torn or corrupt record of each file and drops bindings and
+  publications that expired while repro was down.
+*/
+class SyncDbStore : public resip::ThreadIf,
+                    public resip::InMemorySyncRegDbHandler,
+                    public resip::InMemorySyncPubDbHandler
+{
+public:
+   SyncDbStore(const resip::Data& path,
+               resip::InMemorySyncRegDb* regDb,
+               resip::InMemorySyncPubDb* pubDb,
+               unsigned int snapshotIntervalSecs,
+               unsigned int removeLingerSecs);
+   virtual ~SyncDbStore();
+
+   // Restores the databases from disk, writes a fresh snapshot and starts
+   // recording changes.  Call once, before run().  Returns false if the
+   // store could not be written, in which case nothing is recorded.
+   bool load();
+
+   virtual void thread();
+   virtual void shutdown();
+
+   // InMemorySyncRegDbHandler
+   virtual void onAorModified(const resip::Uri& aor, const resip::ContactList& contacts);
+
+   // InMemorySyncPubDbHandler
+   virtual void onDocumentModified(bool sync, const resip::Data& eventType, const resip::Data& documentKey, const resip::Data& eTag, uint64_t expirationTime, uint64_t lastUpdated, const resip::Contents* contents, const resip::SecurityAttributes* securityAttributes);
+   virtual void onDocumentRemoved(bool sync, const resip::Data& eventType, const resip::Data& documentKey, const resip::Data& eTag, uint64_t lastUpdated);
+
+private:
+   typedef enum
+   {
+      RegAor = 1,
+      PubModified = 2,
+      PubRemoved = 3,
+      End = 4
+   } RecordType;
+
+   void queueRecord(RecordType type, const resip::Data& payload);
+   static void appendRecord(resip::Data& out, RecordType type, uint64_t sequence, const resip::Data& payload);
+   bool loadFile(const resip::Data& fileName, bool snapshot, uint64_t& snapshotSequence, uint64_t& lastSequence);
+   void applyRecord(RecordType type, const char* pos, const char* end, uint64_t now);
+   bool openJournal();
+   bool writeJournal(const std::vector<resip::Data>& records);
+   bool writeSnapshot(bool compact);
+
+   resip::Data mPath;
+   resip::Data mJournalPath;
+   resip::Data mOldJournalPath;
+   resip::InMemorySyncRegDb* mRegDb;
+   resip::InMemorySyncPubDb* mPubDb;
+   unsigned int mSnapshotIntervalSecs;
+   unsigned int mRemoveLingerSecs;
+   bool mRecording;
+
+   // Guards the sequence number and the records waiting for the thread
+   resip::Mutex mPendingMutex;
+   resip::Condition mPendingCondition;
+   uint64_t mSequence;
+   std::vector<resip::Data> mPending;
+
+   // Only used by load() and then the thread
+   FILE* mJournal;
+   bool mOldJournalPending;
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
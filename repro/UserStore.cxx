@@ -7,6 +7,8 @@
 #include "rutil/DataStream.hxx"
 #include "resip/stack/Symbols.hxx"
 #include "rutil/Logger.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Timer.hxx"
 #include "resip/stack/TransactionUser.hxx"
 #include "resip/dum/UserAuthInfo.hxx"
 
@@ -23,7 +25,46 @@ using namespace std;
 
 const resip::Data UserStore::SEPARATOR("@");
 
-UserStore::UserStore(AbstractDb& db ) : mDb(db)
+// Fetches cache entries that are about to expire, so the auth workers
+// never wait on the database for a user that keeps registering
+class UserStore::AuthInfoPrefetcher : public ThreadIf
+{
+   public:
+      AuthInfoPrefetcher(const UserStore& store) : mStore(store) {}
+      virtual ~AuthInfoPrefetcher()
+      {
+         shutdown();
+         join();
+      }
+
+      void add(const Key& key)
+      {
+         mKeys.add(new Key(key));
+      }
+
+      virtual void thread()
+      {
+         while(!isShutdown())
+         {
+            std::unique_ptr<Key> key(mKeys.getNext(100));
+            if(key.get())
+            {
+               mStore.refreshAuthInfo(*key);
+            }
+         }
+      }
+
+   private:
+      const UserStore& mStore;
+      Fifo<Key> mKeys;
+};
+
+UserStore::UserStore(AbstractDb& db ) : 
+   mDb(db),
+   mAuthInfoGeneration(0),
+   mAuthInfoCacheSize(0),
+   mAuthInfoTtlMs(0),
+   mAuthInfoNegativeTtlMs(0)
 { 
 }
 
@@ -31,6 +72,119 @@ UserStore::~UserStore()
 { 
 }
 
+void
+UserStore::setAuthInfoCache(unsigned long maxEntries, unsigned int ttlSecs, unsigned int negativeTtlSecs)
+{
+   mAuthInfoCacheSize = maxEntries;
+   mAuthInfoTtlMs = (uint64_t)ttlSecs * 1000;
+   mAuthInfoNegativeTtlMs = (uint64_t)negativeTtlSecs * 1000;
+   flushAuthInfoCache();
+   if(mAuthInfoCacheSize == 0)
+   {
+      mPrefetcher.reset();
+   }
+   else if(!mPrefetcher.get())
+   {
+      mPrefetcher.reset(new AuthInfoPrefetcher(*this));
+      mPrefetcher->run();
+   }
+}
+
+void
+UserStore::flushAuthInfoCache()
+{
+   Lock lock(mAuthInfoCacheMutex);
+   ++mAuthInfoGeneration;
+   mAuthInfoCache.clear();
+   mAuthInfoLru.clear();
+}
+
+void
+UserStore::invalidateAuthInfo(const Key& key)
+{
+   Lock lock(mAuthInfoCacheMutex);
+   ++mAuthInfoGeneration;
+   AuthInfoCache::iterator it = mAuthInfoCache.find(key);
+   if(it != mAuthInfoCache.end())
+   {
+      mAuthInfoLru.erase(it->second.mLru);
+      mAuthInfoCache.erase(it);
+   }
+}
+
+void
+UserStore::refreshAuthInfo(const Key& key) const
+{
+   uint64_t generation;
+   {
+      Lock lock(mAuthInfoCacheMutex);
+      generation = mAuthInfoGeneration;
+   }
+   Data a1;
+   if(!mDb.lookupUserAuthInfo(key, a1) || a1.empty())
+   {
+      // Keep serving what we have until it expires, so a database outage
+      // does not lock out users in the meantime; the lookup after that
+      // finds out whether the user is really gone
+      Lock lock(mAuthInfoCacheMutex);
+      AuthInfoCache::iterator it = mAuthInfoCache.find(key);
+      if(it != mAuthInfoCache.end())
+      {
+         it->second.mRefreshing = false;
+      }
+      return;
+   }
+   storeAuthInfo(key, a1, generation);
+}
+
+void
+UserStore::storeAuthInfo(const Key& key, const Data& a1, uint64_t generation) const
+{
+   uint64_t ttl = a1.empty() ? mAuthInfoNegativeTtlMs : mAuthInfoTtlMs;
+   uint64_t now = getTimeMs();
+   Lock lock(mAuthInfoCacheMutex);
+   AuthInfoCache::iterator it = mAuthInfoCache.find(key);
+   if(generation != mAuthInfoGeneration || ttl == 0)
+   {
+      // Something changed while we were reading the database; the next
+      // lookup will read it again
+      if(it != mAuthInfoCache.end())
+      {
+         it->second.mRefreshing = false;
+      }
+      return;
+   }
+
+   if(it == mAuthInfoCache.end())
+   {
+      it = mAuthInfoCache.insert(AuthInfoCache::value_type(key, AuthInfoCacheEntry())).first;
+      mAuthInfoLru.push_front(key);
+      it->second.mLru = mAuthInfoLru.begin();
+      while(mAuthInfoCache.size() > mAuthInfoCacheSize)
+      {
+         mAuthInfoCache.erase(mAuthInfoLru.back());
+         mAuthInfoLru.pop_back();
+      }
+   }
+   else
+   {
+      mAuthInfoLru.splice(mAuthInfoLru.begin(), mAuthInfoLru, it->second.mLru);
+   }
+   AuthInfoCacheEntry& entry = it->second;
+   entry.mA1 = a1;
+   entry.mExpires = now + ttl;
+   // Unknown users are never prefetched, so a flood of them cannot drive
+   // database load
+   entry.mRefreshAt = a1.empty() ? entry.mExpires : now + ttl - ttl / 10;
+   entry.mRefreshing = false;
+}
+
+uint64_t
+UserStore::getTimeMs() const
+{
+   return Timer::getTimeMs();
+}
+
 AbstractDb::UserRecord
 UserStore::getUserInfo( const Key& key ) const
 {
@@ -42,7 +196,38 @@ UserStore::getUserAuthInfo(  const resip::Data& user,
                              const resip::Data& realm ) const
 {
    Key key =  buildKey(user, realm);
-   return mDb.getUserAuthInfo( key );
+   if(mAuthInfoCacheSize == 0)
+   {
+      return mDb.getUserAuthInfo( key );
+   }
+
+   uint64_t generation;
+   {
+      uint64_t now = getTimeMs();
+      Lock lock(mAuthInfoCacheMutex);
+      AuthInfoCache::iterator it = mAuthInfoCache.find(key);
+      if(it != mAuthInfoCache.end() && now < it->second.mExpires)
+      {
+         AuthInfoCacheEntry& entry = it->second;
+         mAuthInfoLru.splice(mAuthInfoLru.begin(), mAuthInfoLru, entry.mLru);
+         if(now >= entry.mRefreshAt && !entry.mRefreshing)
+         {
+            entry.mRefreshing = true;
+            mPrefetcher->add(key);
+         }
+         return entry.mA1;
+      }
+      generation = mAuthInfoGeneration;
+   }
+
+   Data a1;
+   if(mDb.lookupUserAuthInfo( key, a1 ))
+   {
+      // Only cache what the database confirmed, in particular that the
+      // user does not exist
+      storeAuthInfo(key, a1, generation);
+   }
+   return a1;
 }
 
 bool 
@@ -91,13 +276,17 @@ UserStore::addUser( const Data& username,
    rec.email = emailAddress;
    rec.forwardAddress = Data::Empty;
 
-   return mDb.addUser( buildKey(username,domain), rec);
+   Key key = buildKey(username,domain);
+   bool ret = mDb.addUser( key, rec);
+   invalidateAuthInfo(key);
+   return ret;
 }
 
 void 
 UserStore::eraseUser( const Key& key )
 { 
    mDb.eraseUser( key );
+   invalidateAuthInfo(key);
 }
 
 bool
@@ -1,8 +1,13 @@
 #if !defined(REPRO_USERSTORE_HXX)
 #define REPRO_USERSTORE_HXX
 
+#include <list>
+#include <memory>
+
 #include "rutil/Data.hxx"
 #include "rutil/Fifo.hxx"
+#include "rutil/HashMap.hxx"
+#include "rutil/Mutex.hxx"
 #include "resip/stack/Message.hxx"
 
 #include "repro/AbstractDb.hxx"
@@ -25,6 +30,16 @@ class UserStore
       UserStore(AbstractDb& db);
       
       virtual ~UserStore();
+
+      // Keeps up to maxEntries results of getUserAuthInfo in memory, for
+      // ttlSecs, or negativeTtlSecs for unknown users.  Entries still in
+      // use are fetched again in the background shortly before they
+      // expire.  Failed database reads are never cached.  Changes made
+      // through this class update the cache; use flushAuthInfoCache after
+      // changing the database directly.  0 disables the cache (the
+      // default).  Call before the store is used, or once it no longer is.
+      void setAuthInfoCache(unsigned long maxEntries, unsigned int ttlSecs, unsigned int negativeTtlSecs);
+      void flushAuthInfoCache();
       
       AbstractDb::UserRecord getUserInfo( const Key& key ) const;
 
@@ -58,10 +73,39 @@ class UserStore
       static Key buildKey(const resip::Data& user, const resip::Data& domain);
       static void getUserAndDomainFromKey(const AbstractDb::Key& key, resip::Data& user, resip::Data& domain);
 
+   protected:
+      // Clock for the auth info cache; tests override it
+      virtual uint64_t getTimeMs() const;
+
    private:
+      class AuthInfoPrefetcher;
+
+      void invalidateAuthInfo(const Key& key);
+      void refreshAuthInfo(const Key& key) const;
+      void storeAuthInfo(const Key& key, const resip::Data& a1, uint64_t generation) const;
 
       AbstractDb& mDb;
       static const resip::Data SEPARATOR;
+
+      struct AuthInfoCacheEntry
+      {
+         resip::Data mA1;
+         uint64_t mRefreshAt;  // a lookup after this prefetches the entry
+         uint64_t mExpires;
+         bool mRefreshing;
+         std::list<Key>::iterator mLru;
+      };
+      typedef HashMap<Key, AuthInfoCacheEntry> AuthInfoCache;
+      mutable resip::Mutex mAuthInfoCacheMutex;
+      mutable AuthInfoCache mAuthInfoCache;
+      mutable std::list<Key> mAuthInfoLru;  // most recently used first
+      // Bumped on every change, so a lookup that raced with one does not
+      // put the old value back
+      mutable uint64_t mAuthInfoGeneration;
+      unsigned long mAuthInfoCacheSize;
+      uint64_t mAuthInfoTtlMs;
+      uint64_t mAuthInfoNegativeTtlMs;
+      std::unique_ptr<AuthInfoPrefetcher> mPrefetcher;
 };
 
  }
@@ -23,7 +23,8 @@ std::atomic<unsigned int> XmlRpcConnectionBase::NextConnectionId(1);
 XmlRpcConnectionBase::XmlRpcConnectionBase(XmlRpcServerBase& server) :
    mXmlRcpServer(server),
    mConnectionId(NextConnectionId++),
-   mNextRequestId(1)
+   mNextRequestId(1),
+   mBinaryEvents(false)
 {
 }
 
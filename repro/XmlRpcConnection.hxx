@@ -22,6 +22,10 @@ public:
    unsigned int getConnectionId() const { return mConnectionId; }
    unsigned int getNextRequestId() { return mNextRequestId++; }
 
+   // Set when the peer asked for events in their binary form, if they have one
+   void setBinaryEvents(bool binaryEvents) { mBinaryEvents = binaryEvents; }
+   bool getBinaryEvents() const { return mBinaryEvents; }
+
    virtual void buildFdSet(resip::FdSet& fdset) = 0;
    virtual bool process(resip::FdSet& fdset) = 0;
 
@@ -40,6 +44,7 @@ private:
    const unsigned int mConnectionId;
    static std::atomic<unsigned int> NextConnectionId;
    unsigned int mNextRequestId;
+   bool mBinaryEvents;
 };
 
 class XmlRpcSocketConnection : public XmlRpcConnectionBase
@@ -203,7 +203,7 @@ XmlRpcServerBase::process(FdSet& fdset)
             ConnectionMap::iterator it = mConnections.begin();
             for(; it != mConnections.end(); it++)
             {
-               it->second->sendEvent(responseInfo->getResponseData());
+               sendEvent(*it->second, *responseInfo);
             }
          }
          else
@@ -211,7 +211,7 @@ XmlRpcServerBase::process(FdSet& fdset)
             ConnectionMap::iterator it = mConnections.find(responseInfo->getConnectionId());
             if(it != mConnections.end())
             {
-               it->second->sendEvent(responseInfo->getResponseData());
+               sendEvent(*it->second, *responseInfo);
             }
          }
       }
@@ -303,12 +303,36 @@ XmlRpcServerBase::sendResponse(unsigned int connectionId,
 
 void
 XmlRpcServerBase::sendEvent(unsigned int connectionId,
-                            const Data& eventData)
+                            const Data& eventData,
+                            const Data& binaryEventData)
 {
-   mResponseFifo.add(new ResponseInfo(connectionId, 0 /* requestId */, eventData, true /* isFinal */));
+   mResponseFifo.add(new ResponseInfo(connectionId, 0 /* requestId */, eventData, true /* isFinal */, binaryEventData));
    mSelectInterruptor.interrupt();
 }
 
+void
+XmlRpcServerBase::sendEvent(XmlRpcConnectionBase& connection, const ResponseInfo& responseInfo)
+{
+   if(connection.getBinaryEvents() && !responseInfo.getBinaryData().empty())
+   {
+      connection.sendEvent(responseInfo.getBinaryData());
+   }
+   else
+   {
+      connection.sendEvent(responseInfo.getResponseData());
+   }
+}
+
+void
+XmlRpcServerBase::setBinaryEvents(unsigned int connectionId, bool binaryEvents)
+{
+   ConnectionMap::iterator it = mConnections.find(connectionId);
+   if(it != mConnections.end())
+   {
+      it->second->setBinaryEvents(binaryEvents);
+   }
+}
+
 bool
 XmlRpcServerBase::isSane()
 {
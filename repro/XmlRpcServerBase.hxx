@@ -32,21 +32,25 @@ public:
    ResponseInfo(unsigned int connectionId,
                 unsigned int requestId,
                 const resip::Data& responseData,
-                bool isFinal) :
+                bool isFinal,
+                const resip::Data& binaryData = resip::Data::Empty) :
       mConnectionId(connectionId),
       mRequestId(requestId),
       mResponseData(responseData),
+      mBinaryData(binaryData),
       mIsFinal(isFinal) {}
 
    unsigned int getConnectionId() const noexcept { return mConnectionId; }
    unsigned int getRequestId() const noexcept { return mRequestId; }
    const resip::Data& getResponseData() const noexcept { return mResponseData; }
+   const resip::Data& getBinaryData() const noexcept { return mBinaryData; }
    bool getIsFinal() const noexcept { return mIsFinal; }
 
 private:
    unsigned int mConnectionId;
    unsigned int mRequestId;
    resip::Data mResponseData;
+   resip::Data mBinaryData;
    bool mIsFinal;
 };
 
@@ -91,13 +95,20 @@ public:
                      bool isFinal=true);
 
    // thread safe - uses fifo (use connectionId == 0 to send to all connections)
+   // binaryEventData, if not empty, is sent instead to connections set with setBinaryEvents
    virtual void sendEvent(unsigned int connectionId,
-                  const resip::Data& eventData);
+                  const resip::Data& eventData,
+                  const resip::Data& binaryEventData = resip::Data::Empty);
+
+   // not thread safe - call from handleRequest
+   void setBinaryEvents(unsigned int connectionId, bool binaryEvents);
 
    virtual void handleRequest(unsigned int connectionId,
                               unsigned int requestId,
                               const resip::Data& request) { mHandler.handleRequest(connectionId, requestId, request); };
 
+   void sendEvent(XmlRpcConnectionBase& connection, const ResponseInfo& responseInfo);
+
    XmlRpcHandler& mHandler;
    bool mSane;
    typedef std::map<unsigned int, XmlRpcConnectionBase*> ConnectionMap;
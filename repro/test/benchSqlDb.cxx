@@ -0,0 +1,270 @@
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "repro/AbstractDb.hxx"
+#include "repro/UserStore.hxx"
+#ifdef USE_MYSQL
+#include "repro/MySqlDb.hxx"
+#endif
+#ifdef USE_POSTGRESQL
+#include "repro/PostgreSqlDb.hxx"
+#endif
+#include "rutil/ConfigParse.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace repro;
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Measures the SQL backends against a running database server.  The database
+// must already hold the repro schema; the benchmark adds its own users, routes
+// and silo records and erases them again when done.
+//
+//   benchSqlDb mysql <host> <user> <password> <database> [threads] [connections] [seconds]
+//   benchSqlDb postgresql <conninfo> <user> <password> <database> [threads] [connections] [seconds]
+
+namespace
+{
+
+const int Users = 1000;
+const int Routes = 500;
+
+class BenchConfig : public ConfigParse
+{
+   public:
+      virtual void printHelpText(int argc, char **argv) {}
+};
+
+enum Operation
+{
+   AuthLookup,
+   SiloWrite
+};
+
+class Worker : public ThreadIf
+{
+   public:
+      Worker(AbstractDb& db, Operation op, int index, uint64_t endTime) :
+         mDb(db), mOp(op), mIndex(index), mEndTime(endTime), mCount(0), mFailures(0) {}
+
+      virtual void thread()
+      {
+         while(!isShutdown() && Timer::getTimeMs() < mEndTime)
+         {
+            if(mOp == AuthLookup)
+            {
+               Data user("bench" + Data(rand() % Users));
+               if(mDb.getUserAuthInfo(UserStore::buildKey(user, "bench.example.com")).empty())
+               {
+                  ++mFailures;
+               }
+            }
+            else
+            {
+               AbstractDb::SiloRecord rec;
+               rec.mDestUri = "sip:bench" + Data(mCount % Users) + "@bench.example.com";
+               rec.mSourceUri = "sip:bench@bench.example.com";
+               rec.mOriginalSentTime = Timer::getTimeSecs();
+               rec.mTid = "bench" + Data(mIndex) + "-" + Data(mCount);
+               rec.mMimeType = "text/plain";
+               rec.mMessageBody = "benchmark message body";
+               if(!mDb.addToSilo(key(mCount), rec))
+               {
+                  ++mFailures;
+               }
+            }
+            ++mCount;
+         }
+      }
+
+      Data key(unsigned int count) const
+      {
+         return "0:bench" + Data(mIndex) + "-" + Data(count);
+      }
+
+      AbstractDb& mDb;
+      Operation mOp;
+      int mIndex;
+      uint64_t mEndTime;
+      unsigned int mCount;
+      unsigned int mFailures;
+};
+
+void
+run(AbstractDb& db, Operation op, const char* name, int threads, int seconds)
+{
+   uint64_t start = Timer::getTimeMs();
+   std::vector<Worker*> workers;
+   for(int i = 0; i < threads; ++i)
+   {
+      workers.push_back(new Worker(db, op, i, start + seconds * 1000));
+      workers.back()->run();
+   }
+
+   unsigned int count = 0;
+   unsigned int failures = 0;
+   for(std::vector<Worker*>::iterator it = workers.begin(); it != workers.end(); ++it)
+   {
+      (*it)->join();
+      count += (*it)->mCount;
+      failures += (*it)->mFailures;
+   }
+   uint64_t elapsed = Timer::getTimeMs() - start;
+
+   cout << name << ": " << count << " in " << elapsed << "ms, "
+        << (elapsed ? count * 1000 / elapsed : 0) << "/s, " << failures << " failed" << endl;
+
+   if(op == SiloWrite)
+   {
+      for(std::vector<Worker*>::iterator it = workers.begin(); it != workers.end(); ++it)
+      {
+         for(unsigned int i = 0; i < (*it)->mCount; ++i)
+         {
+            db.eraseSiloRecord((*it)->key(i));
+         }
+      }
+   }
+   for(std::vector<Worker*>::iterator it = workers.begin(); it != workers.end(); ++it)
+   {
+      delete *it;
+   }
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   if(argc < 6)
+   {
+      cerr << "usage: " << argv[0] << " mysql|postgresql <host|conninfo> <user> <password> <database> [threads] [connections] [seconds]" << endl;
+      return 1;
+   }
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   Data type(argv[1]);
+   int threads = argc > 6 ? atoi(argv[6]) : 4;
+   Data connections(argc > 7 ? argv[7] : "4");
+   int seconds = argc > 8 ? atoi(argv[8]) : 10;
+
+   BenchConfig config;
+   config.insertConfigValue("ConnectionPoolSize", connections);
+
+   AbstractDb* db = 0;
+#ifdef USE_MYSQL
+   if(type == "mysql")
+   {
+      db = new MySqlDb(config, argv[2], argv[3], argv[4], argv[5], 0, Data::Empty);
+   }
+#endif
+#ifdef USE_POSTGRESQL
+   if(type == "postgresql")
+   {
+      db = new PostgreSqlDb(config, argv[2], Data::Empty, argv[3], argv[4], argv[5], 0, Data::Empty);
+   }
+#endif
+   if(db == 0 || !db->isSane())
+   {
+      cerr << "unable to open a " << type << " database" << endl;
+      delete db;
+      return 1;
+   }
+
+   cout << threads << " threads, " << connections << " connections, " << seconds << "s per run" << endl;
+
+   for(int i = 0; i < Users; ++i)
+   {
+      AbstractDb::UserRecord rec;
+      rec.user = "bench" + Data(i);
+      rec.domain = "bench.example.com";
+      rec.realm = rec.domain;
+      rec.passwordHash = "0123456789abcdef0123456789abcdef";
+      db->addUser(UserStore::buildKey(rec.user, rec.domain), rec);
+   }
+   for(int i = 0; i < Routes; ++i)
+   {
+      AbstractDb::RouteRecord rec;
+      rec.mMethod = "INVITE";
+      rec.mMatchingPattern = "^sip:bench" + Data(i) + "@.*$";
+      rec.mRewriteExpression = "sip:bench" + Data(i) + "@bench.example.com";
+      rec.mOrder = (short)i;
+      db->addRoute("bench;" + Data(i), rec);
+   }
+
+   run(*db, AuthLookup, "user auth lookups", threads, seconds);
+   run(*db, SiloWrite, "silo writes", threads, seconds);
+
+   // A route reload reads every key, then every record
+   uint64_t start = Timer::getTimeMs();
+   AbstractDb::RouteRecordList routes = db->getAllRoutes();
+   cout << "route reload: " << routes.size() << " routes in " << Timer::getTimeMs() - start << "ms" << endl;
+
+   for(int i = 0; i < Users; ++i)
+   {
+      db->eraseUser(UserStore::buildKey("bench" + Data(i), "bench.example.com"));
+   }
+   for(int i = 0; i < Routes; ++i)
+   {
+      db->eraseRoute("bench;" + Data(i));
+   }
+
+   delete db;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
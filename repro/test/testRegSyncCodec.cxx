@@ -0,0 +1,251 @@
+#include <cassert>
+#include <iostream>
+
+#include "repro/RegSyncCodec.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace repro;
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+   uint64_t now = Timer::getTimeSecs();
+
+   ContactList contacts;
+   {
+      ContactInstanceRecord rec;
+      rec.mContact = NameAddr("<sip:alice@10.0.0.1:5060>;+sip.instance=\"<urn:uuid:1>\"");
+      rec.mRegExpires = now + 3600;
+      rec.mLastUpdated = now - 10;
+      rec.mReceivedFrom = Tuple("1.1.1.1", 1111, UDP);
+      rec.mPublicAddress = Tuple("2.2.2.2", 2222, TCP);
+      rec.mSipPath.push_back(NameAddr("sip:path1@3.3.3.1:3331"));
+      rec.mSipPath.push_back(NameAddr("sip:path2@3.3.3.2:3332"));
+      rec.mInstance = "<urn:uuid:1>";
+      rec.mRegId = 7;
+      rec.mUserAgent = "TestUA";
+      contacts.push_back(rec);
+   }
+   {
+      // Removed, and lingering.
+      ContactInstanceRecord rec;
+      rec.mContact = NameAddr("sip:alice@10.0.0.2");
+      rec.mRegExpires = 0;
+      rec.mLastUpdated = now - 20;
+      contacts.push_back(rec);
+   }
+   {
+      // Static registrations are not synced.
+      ContactInstanceRecord rec;
+      rec.mContact = NameAddr("sip:alice@10.0.0.3");
+      rec.mRegExpires = NeverExpire;
+      contacts.push_back(rec);
+   }
+
+   {
+      cerr << "!! Test records round trip" << endl;
+      Uri aor("sip:alice@example.com");
+      Data payload;
+      assert(RegSyncCodec::encodeRegInfo(payload, 42, aor, contacts, now));
+      assert(RegSyncCodec::encodeRegInfo(payload, 43, Uri("sip:bob@example.com"), ContactList(contacts.begin(), ++contacts.begin()), now));
+
+      // Nothing is appended when there is nothing to sync.
+      Data::size_type size = payload.size();
+      assert(!RegSyncCodec::encodeRegInfo(payload, 44, aor, ContactList(--contacts.end(), contacts.end()), now));
+      assert(payload.size() == size);
+
+      Data frame;
+      RegSyncCodec::encodeFrame(frame, RegSyncCodec::RegInfo, payload);
+      assert(frame.size() == RegSyncCodec::HeaderSize + payload.size());
+      assert(frame[0] == 0);
+
+      // Partial frames need more data.
+      RegSyncCodec::FrameType type;
+      const char* data = 0;
+      size_t dataSize = 0;
+      assert(RegSyncCodec::parseFrame(frame.data(), 3, type, data, dataSize) == 0);
+      assert(RegSyncCodec::parseFrame(frame.data(), frame.size() - 1, type, data, dataSize) == 0);
+      assert(RegSyncCodec::parseFrame(frame.data(), frame.size(), type, data, dataSize) == frame.size());
+      assert(type == RegSyncCodec::RegInfo);
+      assert(dataSize == payload.size());
+
+      const char* pos = data;
+      const char* end = data + dataSize;
+      uint64_t sequence;
+      Uri decodedAor;
+      ContactList decoded;
+      RegSyncCodec::decodeRegInfo(pos, end, sequence, decodedAor, decoded, now);
+      assert(sequence == 42);
+      assert(decodedAor == aor);
+      assert(decoded.size() == 2);
+      const ContactInstanceRecord& rec = decoded.front();
+      assert(rec == contacts.front());
+      assert(rec.mRegExpires == now + 3600);
+      assert(rec.mLastUpdated == now - 10);
+      assert(rec.mReceivedFrom == Tuple("1.1.1.1", 1111, UDP));
+      assert(rec.mPublicAddress == Tuple("2.2.2.2", 2222, TCP));
+      assert(rec.mSipPath.size() == 2);
+      assert(rec.mSipPath.back().uri() == Uri("sip:path2@3.3.3.2:3332"));
+      assert(rec.mInstance == "<urn:uuid:1>");
+      assert(rec.mRegId == 7);
+      assert(rec.mUserAgent == "TestUA");
+      assert(rec.mSyncContact);
+      assert(decoded.back().mRegExpires == 0);
+      assert(decoded.back().mLastUpdated == now - 20);
+      assert(decoded.back().mReceivedFrom.getPort() == 0);
+
+      RegSyncCodec::decodeRegInfo(pos, end, sequence, decodedAor, decoded, now);
+      assert(sequence == 43);
+      assert(decodedAor == Uri("sip:bob@example.com"));
+      assert(decoded.size() == 1);
+      assert(pos == end);
+   }
+
+   {
+      cerr << "!! Test records replayed after a delay keep their times" << endl;
+      ContactList shortLived(contacts);
+      shortLived.front().mRegExpires = now + 60;
+      Data record;
+      assert(RegSyncCodec::encodeRegInfo(record, 0, Uri("sip:alice@example.com"), contacts, now));
+      RegSyncCodec::setSequence(record, 0, 45);
+      assert(RegSyncCodec::encodeRegInfo(record, 46, Uri("sip:bob@example.com"), shortLived, now));
+
+      // Replayed 10 minutes later, as after a peer was disconnected.
+      uint64_t later = now + 600;
+      const char* pos = record.data();
+      const char* end = record.data() + record.size();
+      Data replay;
+      while (pos != end)
+      {
+         const char* start = pos;
+         uint64_t sequence;
+         Uri aor;
+         ContactList decoded;
+         RegSyncCodec::decodeRegInfo(pos, end, sequence, aor, decoded, now);
+         RegSyncCodec::rebaseRegInfo(replay, Data(start, pos - start), now, later);
+      }
+
+      pos = replay.data();
+      end = replay.data() + replay.size();
+      uint64_t sequence;
+      Uri aor;
+      ContactList decoded;
+      RegSyncCodec::decodeRegInfo(pos, end, sequence, aor, decoded, later);
+      assert(sequence == 45);
+      assert(decoded.size() == 2);
+      assert(decoded.front().mRegExpires == now + 3600);
+      assert(decoded.front().mLastUpdated == now - 10);
+      assert(decoded.back().mRegExpires == 0);
+      assert(decoded.back().mLastUpdated == now - 20);
+
+      // A binding that expired meanwhile is not brought back.
+      RegSyncCodec::decodeRegInfo(pos, end, sequence, aor, decoded, later);
+      assert(sequence == 46);
+      assert(decoded.front().mRegExpires == 0);
+      assert(decoded.front().mLastUpdated == now - 10);
+      assert(pos == end);
+   }
+
+   {
+      cerr << "!! Test sync complete" << endl;
+      Data payload;
+      RegSyncCodec::encodeSyncComplete(payload, 0x0102030405060708ULL, 99);
+      const char* pos = payload.data();
+      uint64_t serverId;
+      uint64_t sequence;
+      RegSyncCodec::decodeSyncComplete(pos, payload.data() + payload.size(), serverId, sequence);
+      assert(serverId == 0x0102030405060708ULL);
+      assert(sequence == 99);
+   }
+
+   {
+      cerr << "!! Test malformed data" << endl;
+      Data payload;
+      RegSyncCodec::encodeRegInfo(payload, 1, Uri("sip:alice@example.com"), contacts, now);
+      const char* pos = payload.data();
+      uint64_t sequence;
+      Uri aor;
+      ContactList decoded;
+      bool thrown = false;
+      try
+      {
+         RegSyncCodec::decodeRegInfo(pos, payload.data() + payload.size() - 1, sequence, aor, decoded, now);
+      }
+      catch (RegSyncCodec::Exception&)
+      {
+         thrown = true;
+      }
+      assert(thrown);
+
+      thrown = false;
+      RegSyncCodec::FrameType type;
+      const char* data;
+      size_t dataSize;
+      try
+      {
+         RegSyncCodec::parseFrame("<reginfo>", 9, type, data, dataSize);
+      }
+      catch (RegSyncCodec::Exception&)
+      {
+         thrown = true;
+      }
+      assert(thrown);
+   }
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
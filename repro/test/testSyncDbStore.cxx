@@ -0,0 +1,258 @@
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+
+#include "repro/SyncDbStore.hxx"
+#include "resip/stack/GenericPidfContents.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Time.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace repro;
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+namespace
+{
+
+const Data Path("testSyncDbStore.db");
+
+void
+removeFiles(const Data& path)
+{
+   remove(path.c_str());
+   remove((path + ".journal").c_str());
+   remove((path + ".journal.1").c_str());
+   remove((path + ".tmp").c_str());
+}
+
+void
+copyFile(const Data& from, const Data& to)
+{
+   Data contents(Data::fromFile(from));
+   FILE* file = fopen(to.c_str(), "wb");
+   assert(file);
+   fwrite(contents.data(), 1, contents.size(), file);
+   fclose(file);
+}
+
+void
+appendToFile(const Data& path, const Data& data)
+{
+   FILE* file = fopen(path.c_str(), "ab");
+   assert(file);
+   fwrite(data.data(), 1, data.size(), file);
+   fclose(file);
+}
+
+ContactInstanceRecord
+contact(const char* uri, uint64_t expires, uint64_t lastUpdated)
+{
+   ContactInstanceRecord rec;
+   rec.mContact = NameAddr(uri);
+   rec.mRegExpires = expires;
+   rec.mLastUpdated = lastUpdated;
+   rec.mReceivedFrom = Tuple("1.1.1.1", 1111, UDP);
+   return rec;
+}
+
+size_t
+contactCount(InMemorySyncRegDb& regDb, const char* aor)
+{
+   ContactList contacts;
+   regDb.getContactsFull(Uri(aor), contacts);
+   return contacts.size();
+}
+
+void
+addDocument(InMemorySyncPubDb& pubDb, const char* key, const char* eTag, uint64_t expirationTime)
+{
+   GenericPidfContents pidf;
+   pidf.setEntity(Uri(key));
+   pidf.setSimplePresenceTupleNode("t1", true);
+   PublicationPersistenceManager::PubDocument document(Symbols::Presence, key, eTag, expirationTime, &pidf, 0);
+   pubDb.addUpdateDocument(document);
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+   uint64_t now = Timer::getTimeSecs();
+   removeFiles(Path);
+   removeFiles(Path + ".copy");
+
+   {
+      cerr << "!! Test a clean shutdown leaves a snapshot that restores" << endl;
+      {
+         InMemorySyncRegDb regDb;
+         InMemorySyncPubDb pubDb;
+         SyncDbStore store(Path, &regDb, &pubDb, 0, 0);
+         assert(store.load());
+         store.run();
+
+         ContactList contacts;
+         contacts.push_back(contact("sip:alice@10.0.0.1", now + 3600, now));
+         contacts.push_back(contact("sip:alice@10.0.0.2", now + 60, now));
+         regDb.addAor(Uri("sip:alice@example.com"), contacts);
+         regDb.addAor(Uri("sip:bob@example.com"), ContactList(1, contact("sip:bob@10.0.0.3", now + 3600, now)));
+         regDb.removeAor(Uri("sip:bob@example.com"));
+         addDocument(pubDb, "sip:alice@example.com", "etag1", now + 3600);
+
+         store.shutdown();
+         store.join();
+      }
+
+      InMemorySyncRegDb regDb;
+      InMemorySyncPubDb pubDb;
+      // Static registrations come from configuration and survive the load
+      regDb.updateContact(Uri("sip:alice@example.com"), contact("sip:alice@10.0.0.9", NeverExpire, now));
+      SyncDbStore store(Path, &regDb, &pubDb, 0, 0);
+      assert(store.load());
+      assert(contactCount(regDb, "sip:alice@example.com") == 3);
+      assert(!regDb.aorIsRegistered(Uri("sip:bob@example.com")));
+      assert(pubDb.documentExists(Symbols::Presence, "sip:alice@example.com", "etag1"));
+
+      ContactList contacts;
+      regDb.getContactsFull(Uri("sip:alice@example.com"), contacts);
+      for (ContactList::iterator it = contacts.begin(); it != contacts.end(); it++)
+      {
+         if (it->mContact.uri().host() == "10.0.0.1")
+         {
+            assert(it->mRegExpires >= now + 3598 && it->mRegExpires <= now + 3602);
+            assert(it->mReceivedFrom == Tuple("1.1.1.1", 1111, UDP));
+         }
+      }
+   }
+
+   {
+      cerr << "!! Test the journal replays after a crash" << endl;
+      {
+         InMemorySyncRegDb regDb;
+         InMemorySyncPubDb pubDb;
+         SyncDbStore store(Path, &regDb, &pubDb, 0, 0);
+         assert(store.load());
+         store.run();
+
+         regDb.addAor(Uri("sip:carol@example.com"), ContactList(1, contact("sip:carol@10.0.0.4", now + 3600, now)));
+         // Expired while we were down
+         regDb.addAor(Uri("sip:dave@example.com"), ContactList(1, contact("sip:dave@10.0.0.5", now - 5, now - 100)));
+         regDb.removeAor(Uri("sip:alice@example.com"));
+         pubDb.removeDocument(Symbols::Presence, "sip:alice@example.com", "etag1", now);
+         addDocument(pubDb, "sip:carol@example.com", "etag2", now + 3600);
+
+         // Wait for the journal to be written, then copy the files as a
+         // crash would leave them
+         Data journal(Path + ".journal");
+         for (int i = 0; i < 50; ++i)
+         {
+            FILE* file = fopen(journal.c_str(), "rb");
+            assert(file);
+            fseek(file, 0, SEEK_END);
+            long size = ftell(file);
+            fclose(file);
+            if (size > 0)
+            {
+               break;
+            }
+            sleepMs(100);
+         }
+         sleepMs(200);
+         copyFile(Path, Path + ".copy");
+         copyFile(journal, Path + ".copy.journal");
+         // A record torn by the crash is ignored
+         appendToFile(Path + ".copy.journal", Data("\0\0\0\x40garbage", 11));
+
+         store.shutdown();
+         store.join();
+      }
+
+      InMemorySyncRegDb regDb;
+      InMemorySyncPubDb pubDb;
+      SyncDbStore store(Path + ".copy", &regDb, &pubDb, 0, 0);
+      assert(store.load());
+      assert(contactCount(regDb, "sip:carol@example.com") == 1);
+      assert(!regDb.aorIsRegistered(Uri("sip:dave@example.com")));
+      assert(!regDb.aorIsRegistered(Uri("sip:alice@example.com")));
+      assert(!pubDb.documentExists(Symbols::Presence, "sip:alice@example.com", "etag1"));
+      assert(pubDb.documentExists(Symbols::Presence, "sip:carol@example.com", "etag2"));
+   }
+
+   {
+      cerr << "!! Test periodic snapshots rotate the journal" << endl;
+      InMemorySyncRegDb regDb;
+      InMemorySyncPubDb pubDb;
+      SyncDbStore store(Path, &regDb, &pubDb, 1, 0);
+      assert(store.load());
+      store.run();
+      regDb.addAor(Uri("sip:erin@example.com"), ContactList(1, contact("sip:erin@10.0.0.6", now + 3600, now)));
+      sleepMs(2500);
+      copyFile(Path, Path + ".copy");
+      removeFiles(Path + ".copy.journal");
+      store.shutdown();
+      store.join();
+
+      // The snapshot alone has it
+      InMemorySyncRegDb restoredDb;
+      SyncDbStore restored(Path + ".copy", &restoredDb, 0, 0, 0);
+      assert(restored.load());
+      assert(contactCount(restoredDb, "sip:erin@example.com") == 1);
+   }
+
+   removeFiles(Path);
+   removeFiles(Path + ".copy");
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,278 @@
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <map>
+
+#include "repro/AbstractDb.hxx"
+#include "repro/UserStore.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Time.hxx"
+
+using namespace repro;
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+namespace
+{
+
+// Keeps the tables in memory and counts reads
+class TestDb : public AbstractDb
+{
+   public:
+      TestDb() : mReads(0), mFail(false) {}
+
+      virtual bool isSane() { return true; }
+
+      virtual bool lookupUserAuthInfo(const Key& key, Data& a1) const
+      {
+         if (mFail)
+         {
+            ++mReads;
+            a1.clear();
+            return false;
+         }
+         return AbstractDb::lookupUserAuthInfo(key, a1);
+      }
+
+      // Changes the database behind the store's back
+      void setHash(const Data& key, const Data& hash)
+      {
+         UserRecord rec = getUser(key);
+         rec.passwordHash = hash;
+         AbstractDb::addUser(key, rec);
+      }
+
+      mutable std::atomic<int> mReads;
+      std::atomic<bool> mFail; // reads fail, as if the server were down
+
+   protected:
+      virtual bool dbWriteRecord(const Table table, const Data& key, const Data& data)
+      {
+         mTables[table][key] = data;
+         return true;
+      }
+      virtual bool dbReadRecord(const Table table, const Data& key, Data& data) const
+      {
+         ++mReads;
+         std::map<Data, Data>::const_iterator it = mTables[table].find(key);
+         if (it == mTables[table].end())
+         {
+            return false;
+         }
+         data = it->second;
+         return true;
+      }
+      virtual void dbEraseRecord(const Table table, const Data& key, bool isSecondaryKey = false)
+      {
+         mTables[table].erase(key);
+      }
+      virtual Data dbNextKey(const Table table, bool first = false) { return Data::Empty; }
+      virtual bool dbNextRecord(const Table table, const Data& key, Data& data, bool forUpdate, bool first = false) { return false; }
+      virtual bool dbBeginTransaction(const Table table) { return true; }
+      virtual bool dbCommitTransaction(const Table table) { return true; }
+      virtual bool dbRollbackTransaction(const Table table) { return true; }
+
+   private:
+      mutable std::map<Data, Data> mTables[MaxTable];
+};
+
+// Lets the test move the cache's clock instead of sleeping through TTLs
+class TestUserStore : public UserStore
+{
+   public:
+      TestUserStore(AbstractDb& db) : UserStore(db), mNow(1000000) {}
+
+      std::atomic<uint64_t> mNow;
+
+   protected:
+      virtual uint64_t getTimeMs() const { return mNow; }
+};
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   {
+      cerr << "!! Test lookups go to the database when the cache is off" << endl;
+      TestDb db;
+      UserStore store(db);
+      store.addUser("alice", "example.com", "example.com", "hash1", false, "Alice", "");
+      assert(store.getUserAuthInfo("alice", "example.com") == "hash1");
+      assert(store.getUserAuthInfo("alice", "example.com") == "hash1");
+      assert(db.mReads == 2);
+   }
+
+   {
+      cerr << "!! Test repeated lookups are served from the cache" << endl;
+      TestDb db;
+      UserStore store(db);
+      store.setAuthInfoCache(10, 60, 60);
+      store.addUser("alice", "example.com", "example.com", "hash1", false, "Alice", "");
+      assert(store.getUserAuthInfo("alice", "example.com") == "hash1");
+      assert(store.getUserAuthInfo("alice", "example.com") == "hash1");
+      assert(db.mReads == 1);
+
+      // Unknown users are cached too
+      assert(store.getUserAuthInfo("mallory", "example.com").empty());
+      assert(store.getUserAuthInfo("mallory", "example.com").empty());
+      assert(db.mReads == 2);
+
+      // Changes made through the store are seen straight away
+      store.updateUser("alice@example.com", "alice", "example.com", "example.com", "hash2", false, "Alice", "");
+      assert(store.getUserAuthInfo("alice", "example.com") == "hash2");
+      store.addUser("mallory", "example.com", "example.com", "hash3", false, "Mallory", "");
+      assert(store.getUserAuthInfo("mallory", "example.com") == "hash3");
+      store.eraseUser("mallory@example.com");
+      assert(store.getUserAuthInfo("mallory", "example.com").empty());
+
+      // Changes made elsewhere need a flush
+      db.setHash("alice@example.com", "hash4");
+      assert(store.getUserAuthInfo("alice", "example.com") == "hash2");
+      store.flushAuthInfoCache();
+      assert(store.getUserAuthInfo("alice", "example.com") == "hash4");
+   }
+
+   {
+      cerr << "!! Test least recently used entries are evicted" << endl;
+      TestDb db;
+      UserStore store(db);
+      store.setAuthInfoCache(2, 60, 60);
+      store.getUserAuthInfo("a", "example.com");
+      store.getUserAuthInfo("b", "example.com");
+      store.getUserAuthInfo("a", "example.com");
+      store.getUserAuthInfo("c", "example.com");
+      assert(db.mReads == 3);
+      store.getUserAuthInfo("a", "example.com");
+      assert(db.mReads == 3);
+      store.getUserAuthInfo("b", "example.com");
+      assert(db.mReads == 4);
+   }
+
+   {
+      cerr << "!! Test entries in use are refreshed before they expire" << endl;
+      TestDb db;
+      TestUserStore store(db);
+      store.setAuthInfoCache(10, 1, 1);
+      store.addUser("alice", "example.com", "example.com", "hash1", false, "Alice", "");
+      assert(store.getUserAuthInfo("alice", "example.com") == "hash1");
+      db.setHash("alice@example.com", "hash2");
+      int reads = db.mReads;
+
+      // In the last tenth of the TTL the cached value is returned and a
+      // fresh one fetched in the background
+      store.mNow += 950;
+      assert(store.getUserAuthInfo("alice", "example.com") == "hash1");
+      for (int i = 0; i < 500 && store.getUserAuthInfo("alice", "example.com") == "hash1"; ++i)
+      {
+         sleepMs(10);
+      }
+      assert(store.getUserAuthInfo("alice", "example.com") == "hash2");
+      assert(db.mReads == reads + 1);
+   }
+
+   {
+      cerr << "!! Test failed reads are not cached as unknown users" << endl;
+      TestDb db;
+      UserStore store(db);
+      store.setAuthInfoCache(10, 60, 60);
+      store.addUser("alice", "example.com", "example.com", "hash1", false, "Alice", "");
+      db.mFail = true;
+      assert(store.getUserAuthInfo("alice", "example.com").empty());
+      db.mFail = false;
+      assert(store.getUserAuthInfo("alice", "example.com") == "hash1");
+      assert(db.mReads == 2);
+   }
+
+   {
+      cerr << "!! Test a refresh that finds nothing keeps the cached entry" << endl;
+      TestDb db;
+      TestUserStore store(db);
+      store.setAuthInfoCache(10, 1, 60);
+      store.addUser("alice", "example.com", "example.com", "hash1", false, "Alice", "");
+      assert(store.getUserAuthInfo("alice", "example.com") == "hash1");
+
+      // The database is down when the entry is refreshed
+      db.mFail = true;
+      int reads = db.mReads;
+      store.mNow += 950;
+      assert(store.getUserAuthInfo("alice", "example.com") == "hash1");
+      for (int i = 0; i < 500 && db.mReads == reads; ++i)
+      {
+         sleepMs(10);
+      }
+      assert(db.mReads == reads + 1);
+      assert(store.getUserAuthInfo("alice", "example.com") == "hash1");
+
+      // The user is gone: still served until the entry expires, after
+      // which the absence is confirmed and cached
+      db.mFail = false;
+      db.eraseUser("alice@example.com");
+      for (int i = 0; i < 500 && db.mReads == reads + 1; ++i)
+      {
+         assert(store.getUserAuthInfo("alice", "example.com") == "hash1");
+         sleepMs(10);
+      }
+      assert(db.mReads == reads + 2);
+      store.mNow += 50;
+      assert(store.getUserAuthInfo("alice", "example.com").empty());
+      reads = db.mReads;
+      assert(store.getUserAuthInfo("alice", "example.com").empty());
+      assert(db.mReads == reads);
+   }
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -177,7 +177,8 @@ public:
                            xml.parent();
                         }
                     }
-                    else if(isEqualNoCase(xml.getTag(), "lastupdated"))
+                    else if(isEqualNoCase(xml.getTag(), "lastupdate") ||  // as written by stream()
+                            isEqualNoCase(xml.getTag(), "lastupdated"))
                     {
                         if(xml.firstChild())
                         {
@@ -0,0 +1,615 @@
+#include "resip/dum/ShardedInMemorySyncRegDb.hxx"
+#include "rutil/Timer.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/WinLeakCheck.hxx"
+
+using namespace resip;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::DUM
+
+// Number of due heap entries handled per call into a shard.
+static const int ExpiryBatch = 8;
+
+ShardedInMemorySyncRegDb::ShardedInMemorySyncRegDb(unsigned int removeLingerSecs, unsigned int shards) :
+   InMemorySyncRegDb(removeLingerSecs)
+{
+   if (shards == 0)
+   {
+      shards = 1;
+   }
+   mShards.reserve(shards);
+   for (unsigned int i = 0; i < shards; ++i)
+   {
+      mShards.push_back(std::unique_ptr<Shard>(new Shard));
+   }
+}
+
+ShardedInMemorySyncRegDb::~ShardedInMemorySyncRegDb()
+{
+}
+
+Data
+ShardedInMemorySyncRegDb::canonicalKey(const Uri& aor)
+{
+   Data scheme(aor.scheme());
+   Data host(aor.host());
+   Data key(scheme.size() + aor.user().size() + host.size() + 8, Data::Preallocate);
+   key += scheme.lowercase();
+   key += ':';
+   key += aor.user();
+   key += '@';
+   key += host.lowercase();
+   if (aor.port() != 0)
+   {
+      key += ':';
+      key += Data(aor.port());
+   }
+   return key;
+}
+
+ShardedInMemorySyncRegDb::Shard&
+ShardedInMemorySyncRegDb::shardFor(const Data& key)
+{
+   // The shard's HashMap buckets on the same hash, so take the shard from
+   // the high bits of a multiplicative mix rather than from hash % n.
+   uint64_t h = (uint64_t)key.hash() * 0x9E3779B97F4A7C15ULL;
+   return *mShards[(size_t)((h >> 32) % mShards.size())];
+}
+
+ShardedInMemorySyncRegDb::Record&
+ShardedInMemorySyncRegDb::getRecord(Shard& shard, const Data& key, const Uri& aor)
+{
+   HashMap<Data, Record>::iterator i = shard.mRecords.find(key);
+   if (i == shard.mRecords.end())
+   {
+      Record& record = shard.mRecords[key];
+      record.mAor = aor;
+      return record;
+   }
+   return i->second;
+}
+
+ShardedInMemorySyncRegDb::Record*
+ShardedInMemorySyncRegDb::findRecord(Shard& shard, const Data& key)
+{
+   HashMap<Data, Record>::iterator i = shard.mRecords.find(key);
+   return i == shard.mRecords.end() ? 0 : &i->second;
+}
+
+void
+ShardedInMemorySyncRegDb::eraseIfUnused(Shard& shard, const Data& key, Record& record)
+{
+   if (!record.mContacts && !record.mLocked && record.mWaiters == 0)
+   {
+      shard.mRecords.erase(key);
+   }
+}
+
+bool
+ShardedInMemorySyncRegDb::purgeContacts(ContactList& contacts, uint64_t now) const
+{
+   bool removed = false;
+   for (ContactList::iterator i = contacts.begin(); i != contacts.end(); )
+   {
+      if (i->mRegExpires <= now &&
+          (mRemoveLingerSecs == 0 || (now - i->mLastUpdated) > mRemoveLingerSecs))
+      {
+         DebugLog(<< "ContactInstanceRecord removed: " << i->mContact);
+         i = contacts.erase(i);
+         removed = true;
+      }
+      else
+      {
+         ++i;
+      }
+   }
+   return removed;
+}
+
+uint64_t
+ShardedInMemorySyncRegDb::nextCleanup(const ContactList& contacts) const
+{
+   uint64_t next = 0;
+   for (ContactList::const_iterator i = contacts.begin(); i != contacts.end(); ++i)
+   {
+      // The first time purgeContacts would remove this contact.
+      uint64_t when = resipMax(i->mRegExpires, (uint64_t)1);
+      if (mRemoveLingerSecs > 0)
+      {
+         when = resipMax(when, i->mLastUpdated + mRemoveLingerSecs + 1);
+      }
+      if (next == 0 || when < next)
+      {
+         next = when;
+      }
+   }
+   return next;
+}
+
+void
+ShardedInMemorySyncRegDb::scheduleCleanup(Shard& shard, const Data& key, Record& record)
+{
+   if (!record.mContacts)
+   {
+      return;
+   }
+   // An entry that is already scheduled earlier is left alone: when it
+   // comes due the record is simply rescheduled.  This keeps about one
+   // heap entry per record however often its contacts are refreshed.
+   uint64_t next = nextCleanup(*record.mContacts);
+   if (next != 0 && (record.mNextCleanup == 0 || next < record.mNextCleanup))
+   {
+      record.mNextCleanup = next;
+      shard.mExpiries.push(Expiry(next, key));
+   }
+}
+
+void
+ShardedInMemorySyncRegDb::afterPurge(Shard& shard, const Data& key, Record& record)
+{
+   // record may be erased; callers must not use it afterwards
+   if (record.mContacts->empty())
+   {
+      record.mContacts.reset();
+      eraseIfUnused(shard, key, record);
+   }
+   else
+   {
+      scheduleCleanup(shard, key, record);
+   }
+}
+
+void
+ShardedInMemorySyncRegDb::expireDue(Shard& shard, uint64_t now)
+{
+   for (int n = 0; n < ExpiryBatch && !shard.mExpiries.empty() && shard.mExpiries.top().first <= now; ++n)
+   {
+      Expiry expiry(shard.mExpiries.top());
+      shard.mExpiries.pop();
+
+      Record* record = findRecord(shard, expiry.second);
+      if (!record || record->mNextCleanup != expiry.first)
+      {
+         continue;  // superseded by an earlier entry, or the record is gone
+      }
+      record->mNextCleanup = 0;
+      if (record->mLocked || !record->mContacts)
+      {
+         continue;  // unlockRecord reschedules
+      }
+
+      if (purgeContacts(*record->mContacts, now))
+      {
+         if (record->mContacts->empty())
+         {
+            record->mContacts.reset();
+         }
+         if (mRemoveLingerSecs == 0)
+         {
+            // Removed contacts are synced while they linger; without linger
+            // only AllChanges handlers hear about expiry.  Peers expire the
+            // same contacts on their own clock.
+            invokeOnAorModified(false /* sync? */, record->mAor,
+                                record->mContacts ? *record->mContacts : ContactList());
+         }
+         if (!record->mContacts)
+         {
+            eraseIfUnused(shard, expiry.second, *record);
+            continue;
+         }
+      }
+      scheduleCleanup(shard, expiry.second, *record);
+   }
+}
+
+void
+ShardedInMemorySyncRegDb::initialSync(unsigned int connectionId)
+{
+   uint64_t now = Timer::getTimeSecs();
+   for (size_t s = 0; s < mShards.size(); ++s)
+   {
+      Shard& shard = *mShards[s];
+      Lock g(shard.mMutex);
+      expireDue(shard, now);
+      for (HashMap<Data, Record>::iterator it = shard.mRecords.begin(); it != shard.mRecords.end(); ++it)
+      {
+         if (it->second.mContacts)
+         {
+            if (mRemoveLingerSecs > 0)
+            {
+               // Leave the record itself to the expiry heap, it may be locked.
+               ContactList contacts(*it->second.mContacts);
+               purgeContacts(contacts, now);
+               invokeOnInitialSyncAor(connectionId, it->second.mAor, contacts);
+            }
+            else
+            {
+               invokeOnInitialSyncAor(connectionId, it->second.mAor, *it->second.mContacts);
+            }
+         }
+      }
+   }
+}
+
+void
+ShardedInMemorySyncRegDb::addAor(const Uri& aor,
+                                 const ContactList& contacts)
+{
+   Data key(canonicalKey(aor));
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   expireDue(shard, Timer::getTimeSecs());
+
+   Record& record = getRecord(shard, key, aor);
+   if (record.mContacts)
+   {
+      *record.mContacts = contacts;
+   }
+   else
+   {
+      record.mContacts.reset(new ContactList(contacts));
+   }
+   invokeOnAorModified(true /* sync? */, aor, contacts);
+   scheduleCleanup(shard, key, record);
+}
+
+void
+ShardedInMemorySyncRegDb::removeAor(const Uri& aor)
+{
+   Data key(canonicalKey(aor));
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   uint64_t now = Timer::getTimeSecs();
+   expireDue(shard, now);
+
+   Record* record = findRecord(shard, key);
+   if (!record || !record->mContacts)
+   {
+      return;
+   }
+   if (mRemoveLingerSecs > 0)
+   {
+      ContactList& contacts = *record->mContacts;
+      for (ContactList::iterator it = contacts.begin(); it != contacts.end(); it++)
+      {
+         // Don't delete record - set expires to 0
+         it->mRegExpires = 0;
+         it->mLastUpdated = now;
+      }
+      invokeOnAorModified(true /* sync? */, aor, contacts);
+      scheduleCleanup(shard, key, *record);
+   }
+   else
+   {
+      record->mContacts.reset();
+      ContactList emptyList;
+      invokeOnAorModified(true /* sync? */, aor, emptyList);
+      // If the record is locked it is removed when it is unlocked.
+      eraseIfUnused(shard, key, *record);
+   }
+}
+
+void
+ShardedInMemorySyncRegDb::getAors(InMemorySyncRegDb::UriList& container)
+{
+   container.clear();
+   uint64_t now = Timer::getTimeSecs();
+   for (size_t s = 0; s < mShards.size(); ++s)
+   {
+      Shard& shard = *mShards[s];
+      Lock g(shard.mMutex);
+      expireDue(shard, now);
+      for (HashMap<Data, Record>::const_iterator it = shard.mRecords.begin(); it != shard.mRecords.end(); ++it)
+      {
+         if (it->second.mContacts)
+         {
+            container.push_back(it->second.mAor);
+         }
+      }
+   }
+}
+
+bool
+ShardedInMemorySyncRegDb::aorIsRegistered(const Uri& aor)
+{
+   return aorIsRegistered(aor, 0);
+}
+
+bool
+ShardedInMemorySyncRegDb::aorIsRegistered(const Uri& aor, uint64_t* maxExpires)
+{
+   bool registered = false;
+
+   Data key(canonicalKey(aor));
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   uint64_t now = Timer::getTimeSecs();
+   expireDue(shard, now);
+
+   Record* record = findRecord(shard, key);
+   if (record && record->mContacts)
+   {
+      if (mRemoveLingerSecs > 0 || maxExpires)
+      {
+         ContactList& contacts = *record->mContacts;
+         for (ContactList::iterator it = contacts.begin(); it != contacts.end(); it++)
+         {
+            if (it->mRegExpires > now)
+            {
+               registered = true;
+               if (maxExpires)
+               {
+                  *maxExpires = resipMax(*maxExpires, it->mRegExpires);
+               }
+               else
+               {
+                  break; // Not looking for maxExpires - so we can quit iterating now
+               }
+            }
+         }
+      }
+      else
+      {
+         registered = true;
+      }
+   }
+   return registered;
+}
+
+void
+ShardedInMemorySyncRegDb::lockRecord(const Uri& aor)
+{
+   Data key(canonicalKey(aor));
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   DebugLog(<< "ShardedInMemorySyncRegDb::lockRecord:  aor=" << aor << " threadid=" << ThreadIf::selfId());
+
+   // This forces insertion if the record does not yet exist.  It is not
+   // erased while it is locked or waited for, so the reference stays valid.
+   Record& record = getRecord(shard, key, aor);
+   while (record.mLocked)
+   {
+      if (!record.mUnlocked)
+      {
+         record.mUnlocked.reset(new Condition);
+      }
+      ++record.mWaiters;
+      record.mUnlocked->wait(g);
+      --record.mWaiters;
+   }
+   record.mLocked = true;
+}
+
+void
+ShardedInMemorySyncRegDb::unlockRecord(const Uri& aor)
+{
+   Data key(canonicalKey(aor));
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   DebugLog(<< "ShardedInMemorySyncRegDb::unlockRecord:  aor=" << aor << " threadid=" << ThreadIf::selfId());
+
+   Record* record = findRecord(shard, key);
+
+   // The record must have been inserted when we locked it in the first place
+   resip_assert(record && record->mLocked);
+   if (!record)
+   {
+      return;
+   }
+
+   record->mLocked = false;
+   if (record->mWaiters > 0)
+   {
+      record->mUnlocked->notify_one();
+   }
+   scheduleCleanup(shard, key, *record);
+   eraseIfUnused(shard, key, *record);
+}
+
+RegistrationPersistenceManager::update_status_t
+ShardedInMemorySyncRegDb::updateContact(const resip::Uri& aor,
+                                        const ContactInstanceRecord& rec)
+{
+   Data key(canonicalKey(aor));
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   expireDue(shard, Timer::getTimeSecs());
+
+   Record& record = getRecord(shard, key, aor);
+   if (!record.mContacts)
+   {
+      record.mContacts.reset(new ContactList);
+   }
+   ContactList& contactList = *record.mContacts;
+
+   update_status_t status = CONTACT_CREATED;
+   ContactList::iterator j;
+
+   // See if the contact is already present. We use URI matching rules here.
+   for (j = contactList.begin(); j != contactList.end(); j++)
+   {
+      if (*j == rec)
+      {
+         // When contacts linger their expires time is set to 0; updating a
+         // lingering contact is reported as CREATED so that
+         // ServerRegistration generates onAdd instead of onRefresh.
+         if (mRemoveLingerSecs == 0 || j->mRegExpires != 0)
+         {
+            status = CONTACT_UPDATED;
+         }
+         *j = rec;
+         break;
+      }
+   }
+
+   if (j == contactList.end())
+   {
+      // This is a new contact, so we add it to the list.
+      contactList.push_back(rec);
+   }
+   // Only pass sync as true if this update didn't just come from an inbound sync operation
+   invokeOnAorModified(!rec.mSyncContact /* sync? */, aor, contactList);
+   scheduleCleanup(shard, key, record);
+   return status;
+}
+
+void
+ShardedInMemorySyncRegDb::removeContact(const Uri& aor,
+                                        const ContactInstanceRecord& rec)
+{
+   Data key(canonicalKey(aor));
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   uint64_t now = Timer::getTimeSecs();
+   expireDue(shard, now);
+
+   Record* record = findRecord(shard, key);
+   if (!record || !record->mContacts)
+   {
+      return;
+   }
+   ContactList& contactList = *record->mContacts;
+
+   // See if the contact is present. We use URI matching rules here.
+   for (ContactList::iterator j = contactList.begin(); j != contactList.end(); j++)
+   {
+      if (*j == rec)
+      {
+         if (mRemoveLingerSecs > 0)
+         {
+            j->mRegExpires = 0;
+            j->mLastUpdated = now;
+            // Only pass sync as true if this update didn't just come from an inbound sync operation
+            invokeOnAorModified(!rec.mSyncContact /* sync? */, aor, contactList);
+            scheduleCleanup(shard, key, *record);
+         }
+         else
+         {
+            contactList.erase(j);
+            if (contactList.empty())
+            {
+               record->mContacts.reset();
+               ContactList emptyList;
+               invokeOnAorModified(true /* sync? */, aor, emptyList);
+               eraseIfUnused(shard, key, *record);
+            }
+            else
+            {
+               // Only pass sync as true if this update didn't just come from an inbound sync operation
+               invokeOnAorModified(!rec.mSyncContact /* sync? */, aor, contactList);
+            }
+         }
+         return;
+      }
+   }
+}
+
+void
+ShardedInMemorySyncRegDb::getContacts(const Uri& aor, ContactList& container)
+{
+   Data key(canonicalKey(aor));
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   uint64_t now = Timer::getTimeSecs();
+   expireDue(shard, now);
+
+   container.clear();
+   Record* record = findRecord(shard, key);
+   if (!record || !record->mContacts)
+   {
+      return;
+   }
+   if (mRemoveLingerSecs > 0)
+   {
+      ContactList& contacts = *record->mContacts;
+      bool purged = purgeContacts(contacts, now);
+      for (ContactList::iterator it = contacts.begin(); it != contacts.end(); it++)
+      {
+         if (it->mRegExpires > now)
+         {
+            container.push_back(*it);
+         }
+      }
+      if (purged)
+      {
+         afterPurge(shard, key, *record);
+      }
+   }
+   else
+   {
+      // Expired contacts not yet purged are returned, as the base class
+      // does; ServerRegistration removes them when it sees them.
+      container = *record->mContacts;
+   }
+}
+
+void
+ShardedInMemorySyncRegDb::getContactsFull(const Uri& aor, ContactList& container)
+{
+   Data key(canonicalKey(aor));
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   uint64_t now = Timer::getTimeSecs();
+   expireDue(shard, now);
+
+   Record* record = findRecord(shard, key);
+   if (!record || !record->mContacts)
+   {
+      container.clear();
+      return;
+   }
+   bool purged = mRemoveLingerSecs > 0 && purgeContacts(*record->mContacts, now);
+   container = *record->mContacts;
+   if (purged)
+   {
+      afterPurge(shard, key, *record);
+   }
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
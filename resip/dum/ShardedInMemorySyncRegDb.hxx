@@ -0,0 +1,162 @@
+#if !defined(RESIP_SHARDEDINMEMORYSYNCREGDB_HXX)
+#define RESIP_SHARDEDINMEMORYSYNCREGDB_HXX
+
+#include <memory>
+#include <queue>
+#include <vector>
+
+#include "resip/dum/InMemorySyncRegDb.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/HashMap.hxx"
+
+namespace resip
+{
+
+/**
+  A variant of InMemorySyncRegDb for registrars holding a large number
+  of AORs.  The base class guards every AOR with a single database
+  mutex and a single condition variable, so every unlockRecord wakes
+  every thread waiting for any record.
+
+  Here AORs are hashed on a canonical key (scheme, user, lowercased host
+  and port) into a fixed number of shards, each with its own mutex.
+  Record locks are tracked on the record itself and only the next
+  waiter for that record is woken on unlock.
+
+  Each shard keeps a heap of the next time one of its records has a
+  contact to purge, and every call into a shard purges a few records
+  that are due.  This replaces the cleanup the base class does while
+  iterating records, and also drops expired contacts when
+  removeLingerSecs is 0, which the base class only does when the
+  registrar next sees a REGISTER for the AOR.
+
+  Handlers are called with the shard mutex held, so they must not call
+  back into the database.
+*/
+class ShardedInMemorySyncRegDb : public InMemorySyncRegDb
+{
+   public:
+
+      ShardedInMemorySyncRegDb(unsigned int removeLingerSecs = 0, unsigned int shards = 64);
+      virtual ~ShardedInMemorySyncRegDb();
+
+      virtual void initialSync(unsigned int connectionId);
+
+      virtual void addAor(const Uri& aor, const ContactList& contacts);
+      virtual void removeAor(const Uri& aor);
+      virtual bool aorIsRegistered(const Uri& aor);
+      virtual bool aorIsRegistered(const Uri& aor, uint64_t* maxExpires);
+
+      virtual void lockRecord(const Uri& aor);
+      virtual void unlockRecord(const Uri& aor);
+
+      virtual update_status_t updateContact(const resip::Uri& aor,
+                                             const ContactInstanceRecord& rec);
+      virtual void removeContact(const Uri& aor,
+                                 const ContactInstanceRecord& rec);
+
+      virtual void getContacts(const Uri& aor, ContactList& container);
+      virtual void getContactsFull(const Uri& aor, ContactList& container);
+
+      /// return all the AOR in the DB
+      virtual void getAors(UriList& container);
+
+      unsigned int getShardCount() const { return (unsigned int)mShards.size(); }
+
+      /// the key AORs are indexed on; AORs with the same key share a record
+      static Data canonicalKey(const Uri& aor);
+
+   private:
+      class Record
+      {
+         public:
+            Record() : mLocked(false), mWaiters(0), mNextCleanup(0) {}
+
+            Uri mAor;
+            // 0 if there is no binding for the AOR; the record is kept
+            // only while it is locked or waited for.
+            std::unique_ptr<ContactList> mContacts;
+            bool mLocked;
+            unsigned int mWaiters;
+            // created by the first thread to wait on this record
+            std::unique_ptr<Condition> mUnlocked;
+            // time of this record's live entry in the expiry heap, or 0
+            uint64_t mNextCleanup;
+      };
+
+      typedef std::pair<uint64_t, Data> Expiry;
+      typedef std::priority_queue<Expiry, std::vector<Expiry>, std::greater<Expiry> > ExpiryQueue;
+
+      class Shard
+      {
+         public:
+            Mutex mMutex;
+            HashMap<Data, Record> mRecords;
+            ExpiryQueue mExpiries;
+      };
+
+      Shard& shardFor(const Data& key);
+      Record& getRecord(Shard& shard, const Data& key, const Uri& aor);
+      Record* findRecord(Shard& shard, const Data& key);
+      void eraseIfUnused(Shard& shard, const Data& key, Record& record);
+
+      bool purgeContacts(ContactList& contacts, uint64_t now) const;
+      uint64_t nextCleanup(const ContactList& contacts) const;
+      void scheduleCleanup(Shard& shard, const Data& key, Record& record);
+      void afterPurge(Shard& shard, const Data& key, Record& record);
+      void expireDue(Shard& shard, uint64_t now);
+
+      std::vector<std::unique_ptr<Shard> > mShards;
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
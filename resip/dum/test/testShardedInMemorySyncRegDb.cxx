@@ -0,0 +1,277 @@
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "resip/dum/ShardedInMemorySyncRegDb.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+namespace
+{
+
+class CountingHandler : public InMemorySyncRegDbHandler
+{
+public:
+   CountingHandler() : InMemorySyncRegDbHandler(AllChanges), mCount(0), mLastSize(0) {}
+   virtual void onAorModified(const resip::Uri& aor, const ContactList& contacts)
+   {
+      ++mCount;
+      mLastSize = contacts.size();
+   }
+   int mCount;
+   size_t mLastSize;
+};
+
+ContactInstanceRecord
+contact(const char* uri, uint64_t expires)
+{
+   ContactInstanceRecord rec;
+   rec.mContact = NameAddr(uri);
+   rec.mRegExpires = expires;
+   rec.mLastUpdated = Timer::getTimeSecs();
+   return rec;
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+   uint64_t now = Timer::getTimeSecs();
+
+   {
+      cerr << "!! Test update, get and remove" << endl;
+      ShardedInMemorySyncRegDb db(0, 4);
+      assert(db.getShardCount() == 4);
+      Uri aor("sip:alice@example.com");
+      assert(!db.aorIsRegistered(aor));
+
+      db.lockRecord(aor);
+      assert(db.updateContact(aor, contact("sip:alice@10.0.0.1", now + 3600)) == RegistrationPersistenceManager::CONTACT_CREATED);
+      assert(db.updateContact(aor, contact("sip:alice@10.0.0.2", now + 3600)) == RegistrationPersistenceManager::CONTACT_CREATED);
+      assert(db.updateContact(aor, contact("sip:alice@10.0.0.1", now + 7200)) == RegistrationPersistenceManager::CONTACT_UPDATED);
+      db.unlockRecord(aor);
+
+      ContactList contacts;
+      db.getContacts(aor, contacts);
+      assert(contacts.size() == 2);
+      uint64_t maxExpires = 0;
+      assert(db.aorIsRegistered(aor, &maxExpires));
+      assert(maxExpires == now + 7200);
+
+      // The host is matched without regard to case.
+      db.getContacts(Uri("sip:alice@EXAMPLE.com"), contacts);
+      assert(contacts.size() == 2);
+      db.getContacts(Uri("sip:Alice@example.com"), contacts);
+      assert(contacts.empty());
+
+      InMemorySyncRegDb::UriList aors;
+      db.getAors(aors);
+      assert(aors.size() == 1);
+      assert(aors.front() == aor);
+
+      db.removeContact(aor, contact("sip:alice@10.0.0.1", 0));
+      db.getContacts(aor, contacts);
+      assert(contacts.size() == 1);
+      db.removeContact(aor, contact("sip:alice@10.0.0.2", 0));
+      assert(!db.aorIsRegistered(aor));
+      db.getAors(aors);
+      assert(aors.empty());
+   }
+
+   {
+      cerr << "!! Test removed contacts linger" << endl;
+      ShardedInMemorySyncRegDb db(3600, 4);
+      Uri aor("sip:bob@example.com");
+      db.updateContact(aor, contact("sip:bob@10.0.0.1", now + 3600));
+      db.removeAor(aor);
+      assert(!db.aorIsRegistered(aor));
+
+      ContactList contacts;
+      db.getContacts(aor, contacts);
+      assert(contacts.empty());
+      db.getContactsFull(aor, contacts);
+      assert(contacts.size() == 1);
+      assert(contacts.front().mRegExpires == 0);
+
+      // Refreshing a lingering contact creates it again.
+      assert(db.updateContact(aor, contact("sip:bob@10.0.0.1", now + 3600)) == RegistrationPersistenceManager::CONTACT_CREATED);
+      assert(db.aorIsRegistered(aor));
+   }
+
+   {
+      cerr << "!! Test reads drop a record whose lingering contacts are gone" << endl;
+      ShardedInMemorySyncRegDb db(1, 1);
+      Uri aor("sip:erin@example.com");
+      ContactList initial;
+      initial.push_back(contact("sip:erin@10.0.0.1", now - 10));
+      initial.back().mLastUpdated = now - 10;
+      // Locked, so only the read itself purges the contact.
+      db.lockRecord(aor);
+      db.addAor(aor, initial);
+
+      ContactList contacts;
+      db.getContactsFull(aor, contacts);
+      assert(contacts.empty());
+      InMemorySyncRegDb::UriList aors;
+      db.getAors(aors);
+      assert(aors.empty());
+      db.unlockRecord(aor);
+      db.getAors(aors);
+      assert(aors.empty());
+   }
+
+   {
+      cerr << "!! Test expired contacts are purged" << endl;
+      ShardedInMemorySyncRegDb db(0, 1);
+      CountingHandler handler;
+      db.addHandler(&handler);
+      Uri expiring("sip:carol@example.com");
+      Uri locked("sip:dave@example.com");
+      db.updateContact(locked, contact("sip:dave@10.0.0.1", now - 1));
+      db.lockRecord(locked);
+      ContactList initial;
+      initial.push_back(contact("sip:carol@10.0.0.1", now - 1));
+      initial.push_back(contact("sip:carol@10.0.0.2", now + 3600));
+      db.addAor(expiring, initial);
+      handler.mCount = 0;
+
+      // Any call into the shard purges what is due, except from locked records.
+      InMemorySyncRegDb::UriList aors;
+      db.getAors(aors);
+      assert(aors.size() == 2);
+      assert(handler.mCount == 1);
+      assert(handler.mLastSize == 1);
+      ContactList contacts;
+      db.getContacts(expiring, contacts);
+      assert(contacts.size() == 1);
+      db.getContacts(locked, contacts);
+      assert(contacts.size() == 1);
+
+      db.unlockRecord(locked);
+      db.getAors(aors);
+      assert(aors.size() == 1);
+      assert(aors.front() == expiring);
+      assert(handler.mCount == 2);
+      assert(handler.mLastSize == 0);
+      db.removeHandler(&handler);
+   }
+
+   {
+      cerr << "!! Test records are locked one thread at a time" << endl;
+      ShardedInMemorySyncRegDb db(0, 8);
+      const int threads = 8;
+      const int iterations = 500;
+      const int aorCount = 4;
+      vector<int> counts(aorCount, 0);
+      vector<thread> workers;
+      for (int t = 0; t < threads; ++t)
+      {
+         workers.push_back(thread([&db, &counts, t]()
+         {
+            for (int i = 0; i < iterations; ++i)
+            {
+               int n = (t + i) % aorCount;
+               Uri aor("sip:user" + Data(n) + "@example.com");
+               db.lockRecord(aor);
+               // Only the lock holder touches this AOR's count.
+               int count = counts[n];
+               std::this_thread::yield();
+               counts[n] = count + 1;
+               db.updateContact(aor, contact("sip:user@10.0.0.1", Timer::getTimeSecs() + 3600));
+               db.unlockRecord(aor);
+            }
+         }));
+      }
+      for (size_t t = 0; t < workers.size(); ++t)
+      {
+         workers[t].join();
+      }
+      int total = 0;
+      for (int n = 0; n < aorCount; ++n)
+      {
+         total += counts[n];
+      }
+      assert(total == threads * iterations);
+
+      InMemorySyncRegDb::UriList aors;
+      db.getAors(aors);
+      assert(aors.size() == aorCount);
+   }
+
+   {
+      cerr << "!! Test a large database" << endl;
+      ShardedInMemorySyncRegDb db(0);
+      const int count = 20000;
+      for (int i = 0; i < count; ++i)
+      {
+         Uri aor("sip:" + Data(i) + "@example.com");
+         db.updateContact(aor, contact("sip:ua@10.0.0.1", now + 3600));
+      }
+      InMemorySyncRegDb::UriList aors;
+      db.getAors(aors);
+      assert(aors.size() == count);
+      for (int i = 0; i < count; ++i)
+      {
+         assert(db.aorIsRegistered(Uri("sip:" + Data(i) + "@Example.COM")));
+      }
+   }
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -28,6 +28,7 @@
 using namespace resip;
 
 volatile bool Connection::mEnablePostConnectSocketFuncCall = false;
+volatile unsigned int Connection::mMaxBytesPerWrite = 16384;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
 
@@ -39,6 +40,8 @@ Connection::Connection(Transport* transport,const Tuple& who, Socket socket,
      mInWritable(false),
      mFlowTimerEnabled(false),
      mPollItemHandle(0),
+     mPreparedSends(0),
+     mPendingWriteBuffers(0),
      mIsServer(isServer)
 {
    mWho.mFlowKey=(FlowKey)socket;
@@ -79,8 +82,13 @@ Connection::requestWrite(SendData* sendData)
 void 
 Connection::removeFrontOutstandingSend()
 {
-   delete mOutstandingSends.front();
+   SendData* sendData = mOutstandingSends.front();
    mOutstandingSends.pop_front();
+   delete sendData;
+   if (mPreparedSends > 0)
+   {
+      --mPreparedSends;
+   }
 
    if (mOutstandingSends.empty())
    {
@@ -140,7 +148,116 @@ Connection::performWrite()
       break;
    }
 
-   const Data& sigcompId = mOutstandingSends.front()->sigcompId;
+   if (mPreparedSends == 0)
+   {
+      prepareSend(mOutstandingSends.front());
+      mPreparedSends = 1;
+   }
+
+   // Note:  The first time the socket is available for write, is when the TCP connect call is completed
+   if (mFirstWriteAfterConnectedPending)
+   {
+      mFirstWriteAfterConnectedPending = false;  // reset
+
+      // Notify all outstanding sends that we are now connected - stops the TCP Connection timer for all transactions
+      for (SendData* sendData = mOutstandingSends.front(); sendData; sendData = sendData->next())
+      {
+         mTransport->setTcpConnectState(sendData->transactionId, TcpConnectState::Connected);
+      }
+      if (mEnablePostConnectSocketFuncCall)
+      {
+          mTransport->callSocketFunc(getSocket());
+      }
+   }
+
+   // Gather the front message and as many of the ones queued behind it as
+   // fit in mMaxBytesPerWrite. If the last write wrote nothing, retry with
+   // exactly the same messages; TLS requires a retried write to be the same.
+   WriteBuffer buffers[MaxWriteBuffers];
+   int count = 0;
+   Data::size_type total = 0;
+   for (SendData* sendData = mOutstandingSends.front();
+        sendData && count < MaxWriteBuffers;
+        sendData = sendData->next())
+   {
+      if (count > 0)
+      {
+         if (sendData->command != SendData::NoCommand)
+         {
+            break;
+         }
+         if ((unsigned int)count >= mPreparedSends)
+         {
+            prepareSend(sendData);
+            ++mPreparedSends;
+         }
+         if (mPendingWriteBuffers ? (unsigned int)count == mPendingWriteBuffers
+                                  : total + sendData->data.size() > mMaxBytesPerWrite)
+         {
+            break;
+         }
+      }
+      Data::size_type pos = (count == 0) ? mSendPos : 0;
+      buffers[count].data = sendData->data.data() + pos;
+      buffers[count].size = int(sendData->data.size() - pos);
+      total += buffers[count].size;
+      ++count;
+   }
+
+   int nBytes = (count == 1) ? write(buffers[0].data, buffers[0].size) : writev(buffers, count);
+
+   //DebugLog (<< "Tried to send " << total << " bytes from " << count << " messages, sent " << nBytes << " bytes");
+
+   if (nBytes < 0)
+   {
+      //fail(data.transactionId);
+      InfoLog(<< "Write failed on socket: " << this->getSocket() << ", closing connection");
+      return -1;
+   }
+   else if (nBytes == 0)
+   {
+      // Nothing was written - likely socket buffers are backed up and EWOULDBLOCK was returned
+      // no need to do calculations in else statement
+      mPendingWriteBuffers = count;
+      return 0;
+   }
+   else
+   {
+      mPendingWriteBuffers = 0;
+      // Safe because of the conditional above ( < 0 ).
+      Data::size_type bytesWritten = static_cast<Data::size_type>(nBytes);
+      Data::size_type left = bytesWritten;
+      while (left > 0)
+      {
+         Data::size_type rest = mOutstandingSends.front()->data.size() - mSendPos;
+         if (left < rest)
+         {
+            mSendPos += left;
+            break;
+         }
+         left -= rest;
+         mSendPos = 0;
+         removeFrontOutstandingSend();
+      }
+      return (int)bytesWritten;
+   }
+}
+
+int
+Connection::writev(const WriteBuffer* buffers, int count)
+{
+   mCoalesceBuffer.clear();
+   for (int i = 0; i < count; ++i)
+   {
+      mCoalesceBuffer.append(buffers[i].data, buffers[i].size);
+   }
+   return write(mCoalesceBuffer.data(), int(mCoalesceBuffer.size()));
+}
+
+void
+Connection::prepareSend(SendData* sendData)
+{
+   const Data& sigcompId = sendData->sigcompId;
 
    if(mSendingTransmissionFormat == Unknown)
    {
@@ -159,8 +276,7 @@ Connection::performWrite()
    }
    else if(mSendingTransmissionFormat == WebSocketData)
    {
-      SendData *dataWs, *oldSd;
-      const Data& dataRaw = mOutstandingSends.front()->data;
+      const Data& dataRaw = sendData->data;
       uint64_t dataSize = 1 + 1 + dataRaw.size();
       uint64_t lSize = (uint64_t)dataRaw.size();
       uint8_t* uBuffer;
@@ -174,14 +290,8 @@ Connection::performWrite()
          dataSize += 8;
       }
 
-      oldSd = mOutstandingSends.front();
-      dataWs = new SendData(oldSd->destination,
-            Data(Data::Take, new char[(int)dataSize], (Data::size_type)dataSize),
-            oldSd->transactionId,
-            oldSd->sigcompId,
-            false);
-      resip_assert(dataWs && dataWs->data.data());
-      uBuffer = (uint8_t*)dataWs->data.data();
+      Data framed(Data::Take, new char[(int)dataSize], (Data::size_type)dataSize);
+      uBuffer = (uint8_t*)framed.data();
 
       uBuffer[0] = 0x82;
       if(lSize <= 0x7D)
@@ -211,17 +321,15 @@ Connection::performWrite()
       }
 
       memcpy(uBuffer, dataRaw.data(), dataRaw.size());
-      mOutstandingSends.front() = dataWs;
-      dataWs = 0;
-      delete oldSd;
+      sendData->data.takeBuf(framed);
    }
 
 #ifdef USE_SIGCOMP
    // Perform compression here, if appropriate
    if (mSendingTransmissionFormat == Compressed
-       && !(mOutstandingSends.front()->isAlreadyCompressed))
+       && !(sendData->isAlreadyCompressed))
    {
-      const Data& uncompressed = mOutstandingSends.front()->data;
+      const Data& uncompressed = sendData->data;
       osc::SigcompMessage *sm = 
         mSigcompStack->compressMessage(uncompressed.data(), uncompressed.size(),
                                        sigcompId.data(), sigcompId.size(),
@@ -230,64 +338,11 @@ Connection::performWrite()
                 << uncompressed.size() << " bytes to " 
                 << sm->getStreamLength() << " bytes");
 
-      SendData *oldSd = mOutstandingSends.front();
-      SendData *newSd = new SendData(oldSd->destination,
-                                     Data(sm->getStreamMessage(),
-                                          sm->getStreamLength()),
-                                     oldSd->transactionId,
-                                     oldSd->sigcompId,
-                                     true);
-      mOutstandingSends.front() = newSd;
-      delete oldSd;
+      sendData->data = Data(sm->getStreamMessage(), sm->getStreamLength());
+      sendData->isAlreadyCompressed = true;
       delete sm;
    }
 #endif
-
-   // Note:  The first time the socket is available for write, is when the TCP connect call is completed
-   if (mFirstWriteAfterConnectedPending)
-   {
-      mFirstWriteAfterConnectedPending = false;  // reset
-
-      // Notify all outstanding sends that we are now connected - stops the TCP Connection timer for all transactions
-      for (std::list<SendData*>::iterator it = mOutstandingSends.begin(); it != mOutstandingSends.end(); it++)
-      {
-         mTransport->setTcpConnectState((*it)->transactionId, TcpConnectState::Connected);
-      }
-      if (mEnablePostConnectSocketFuncCall)
-      {
-          mTransport->callSocketFunc(getSocket());
-      }
-   }
-
-   const Data& data = mOutstandingSends.front()->data;
-   int nBytes = write(data.data() + mSendPos,int(data.size() - mSendPos));
-
-   //DebugLog (<< "Tried to send " << data.size() - mSendPos << " bytes, sent " << nBytes << " bytes");
-
-   if (nBytes < 0)
-   {
-      //fail(data.transactionId);
-      InfoLog(<< "Write failed on socket: " << this->getSocket() << ", closing connection");
-      return -1;
-   }
-   else if (nBytes == 0)
-   {
-      // Nothing was written - likely socket buffers are backed up and EWOULDBLOCK was returned
-      // no need to do calculations in else statement
-      return 0;
-   }
-   else
-   {
-      // Safe because of the conditional above ( < 0 ).
-      Data::size_type bytesWritten = static_cast<Data::size_type>(nBytes);
-      mSendPos += bytesWritten;
-      if (mSendPos == data.size())
-      {
-         mSendPos = 0;
-         removeFrontOutstandingSend();
-      }
-      return (int)bytesWritten;
-   }
 }
 
 
@@ -319,6 +374,18 @@ Connection::ensureWritable()
    }
 }
 
+bool
+Connection::suspendPolling()
+{
+   return getConnectionManager().suspendPolling(this);
+}
+
+void
+Connection::resumePolling()
+{
+   getConnectionManager().resumePolling(this);
+}
+
 ConnectionManager&
 Connection::getConnectionManager() const
 {
@@ -103,12 +103,40 @@ class Connection : public ConnectionBase,
       bool mFirstWriteAfterConnectedPending;
       static volatile bool mEnablePostConnectSocketFuncCall;
       static void setEnablePostConnectSocketFuncCall(bool enabled = true) { mEnablePostConnectSocketFuncCall = enabled; }
+
+      /** performWrite() gathers queued messages into one write of at most
+          this many bytes (a single message larger than this is still
+          written on its own). The default of 16384 is the most a TLS record
+          can carry, so each TLS write fills one record. 0 writes one queued
+          message at a time. */
+      static volatile unsigned int mMaxBytesPerWrite;
+      static void setMaxBytesPerWrite(unsigned int bytes) { mMaxBytesPerWrite = bytes; }
       bool isServer()const;
    protected:
       /// pure virtual, but need concrete Connection for book-ends of lists
       virtual int read(char* /* buffer */, const int /* count */) { return 0; }
       /// pure virtual, but need concrete Connection for book-ends of lists
       virtual int write(const char* /* buffer */, const int /* count */) { return 0; }
+
+      /// One piece of a gathered write.
+      struct WriteBuffer
+      {
+         const char* data;
+         int size;
+      };
+      enum { MaxWriteBuffers = 64 };
+
+      /** Writes count buffers, in order, as if they were one; returns what
+          write() would for their concatenation. The default copies them into
+          one buffer, so a TLS connection makes a single SSL_write() (and
+          record) for all of them; TcpConnection uses ::writev(). */
+      virtual int writev(const WriteBuffer* buffers, int count);
+
+      /** Stops polling the socket, other than for errors, while another
+          thread works on this connection; resumePolling() restores it.
+          Returns false, doing nothing, if the transport has no FdPollGrp. */
+      bool suspendPolling();
+      void resumePolling();
       virtual void onDoubleCRLF();
       virtual void onSingleCRLF();
 
@@ -120,9 +148,15 @@ class Connection : public ConnectionBase,
    private:
       ConnectionManager& getConnectionManager() const;
       void removeFrontOutstandingSend();
+      void prepareSend(SendData* sendData);
       bool mInWritable;
       bool mFlowTimerEnabled;
       FdPollItemHandle mPollItemHandle;
+      /// leading entries of mOutstandingSends that prepareSend() has seen
+      unsigned int mPreparedSends;
+      /// entries covered by a write that wrote nothing; retried as they are
+      unsigned int mPendingWriteBuffers;
+      Data mCoalesceBuffer;
       
       /// no default c'tor
       Connection();
@@ -105,8 +105,8 @@ ConnectionBase::~ConnectionBase()
             mFailureReason ? mFailureReason : TransportFailure::ConnectionUnknown,
             mFailureSubCode);
       }
-      delete sendData;
       mOutstandingSends.pop_front();
+      delete sendData;
    }
    delete [] mBuffer;
    delete mMessage;
@@ -414,7 +414,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
                // The message body is complete.
                if (contentLength > 0)
                         mMessage->setBody(unprocessedCharPtr, (uint32_t)contentLength);
-               CongestionManager::RejectionBehavior b=mTransport->getRejectionBehaviorForIncoming();
+               CongestionManager::RejectionBehavior b=mTransport->getRejectionBehaviorForIncoming(*mMessage);
                if (b==CongestionManager::REJECTING_NON_ESSENTIAL
                      || (b==CongestionManager::REJECTING_NEW_WORK
                         && mMessage->isRequest()))
@@ -513,7 +513,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
 
             // .bwc. basicCheck takes up substantial CPU. Don't bother doing it
             // if we're overloaded.
-            CongestionManager::RejectionBehavior b=mTransport->getRejectionBehaviorForIncoming();
+            CongestionManager::RejectionBehavior b=mTransport->getRejectionBehaviorForIncoming(*mMessage);
             if (b==CongestionManager::REJECTING_NON_ESSENTIAL
                   || (b==CongestionManager::REJECTING_NEW_WORK
                      && mMessage->isRequest()))
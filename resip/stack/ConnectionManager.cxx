@@ -179,6 +179,25 @@ ConnectionManager::removeFromWritable(Connection* conn)
    }
 }
 
+bool
+ConnectionManager::suspendPolling(Connection* conn)
+{
+   if (!mPollGrp)
+   {
+      return false;
+   }
+   mPollGrp->modPollItem(conn->mPollItemHandle, FPEM_Error);
+   return true;
+}
+
+void
+ConnectionManager::resumePolling(Connection* conn)
+{
+   resip_assert(mPollGrp);
+   mPollGrp->modPollItem(conn->mPollItemHandle,
+                         conn->mInWritable ? FPEM_Read|FPEM_Write|FPEM_Error : FPEM_Read|FPEM_Error);
+}
+
 void
 ConnectionManager::addConnection(Connection* connection)
 {
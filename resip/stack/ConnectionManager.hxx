@@ -52,6 +52,8 @@ class ConnectionManager
    private:
       void addToWritable(Connection* conn); // add the specified conn to end
       void removeFromWritable(Connection* conn); // remove the current mWriteMark
+      bool suspendPolling(Connection* conn);
+      void resumePolling(Connection* conn);
 
       typedef std::map<Tuple, Connection*> AddrMap;
       typedef std::map<Socket, Connection*> IdMap;
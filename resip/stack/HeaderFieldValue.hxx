@@ -6,6 +6,7 @@
 #include "resip/stack/ParameterTypes.hxx"
 
 #include <iosfwd>
+#include <string.h>
 
 namespace resip
 {
@@ -41,6 +42,17 @@ class HeaderFieldValue
       HeaderFieldValue(const HeaderFieldValue& hfv);
       HeaderFieldValue(const HeaderFieldValue& hfv, CopyPaddingEnum);
       HeaderFieldValue(const HeaderFieldValue& hfv, NoOwnershipEnum);
+      // Takes over the buffer (and its ownership, if any) without copying, so
+      // that growing a HeaderFieldValueList does not copy every value.
+      HeaderFieldValue(HeaderFieldValue&& hfv) noexcept
+         : mField(hfv.mField),
+           mFieldLength(hfv.mFieldLength),
+           mMine(hfv.mMine)
+      {
+         hfv.mField=0;
+         hfv.mFieldLength=0;
+         hfv.mMine=false;
+      }
       HeaderFieldValue& operator=(const HeaderFieldValue&);
       HeaderFieldValue& copyWithPadding(const HeaderFieldValue& rhs);
       HeaderFieldValue& swap(HeaderFieldValue& orig);
@@ -63,6 +75,12 @@ class HeaderFieldValue
       
       inline const char* getBuffer() const {return mField;}
       inline size_t getLength() const {return mFieldLength;}
+      // true if this holds exactly the length bytes at field
+      inline bool isEqual(const char* field, size_t length) const
+      {
+         return mFieldLength == length &&
+                (mField == field || memcmp(mField, field, length) == 0);
+      }
       inline void clear()
       {
          if (mMine)
@@ -50,6 +50,33 @@ HeaderFieldValueList::HeaderFieldValueList(const HeaderFieldValueList& rhs, Pool
    }
 }
 
+HeaderFieldValueList::HeaderFieldValueList(const HeaderFieldValueList& rhs, PoolBase& pool,
+                                           const char* from, const char* fromEnd, const char* to)
+   : mHeaders(StlPoolAllocator<HeaderFieldValue, PoolBase>(&pool)),
+     mPool(&pool),
+     mParserContainer(0)
+{
+   if (rhs.mParserContainer)
+   {
+      mParserContainer = rhs.mParserContainer->clone(from, fromEnd, to);
+   }
+   else if(rhs.mHeaders.size())
+   {
+      mHeaders.reserve(rhs.mHeaders.size());
+      for (const_iterator i = rhs.begin(); i != rhs.end(); ++i)
+      {
+         if (i->getBuffer() >= from && i->getBuffer() < fromEnd)
+         {
+            push_back(to + (i->getBuffer() - from), i->getLength(), false);
+         }
+         else
+         {
+            mHeaders.push_back(*i);
+         }
+      }
+   }
+}
+
 HeaderFieldValueList&
 HeaderFieldValueList::operator=(const HeaderFieldValueList& rhs)
 {
@@ -244,6 +271,16 @@ HeaderFieldValueList::getHeaderValueByIndex(size_t index, Data& headerValue) con
    return false;
 }
 
+bool
+HeaderFieldValueList::isUnchangedValue(size_t index, const char* buffer, size_t length) const
+{
+   if (mParserContainer)
+   {
+      return mParserContainer->isUnchangedValue(index, buffer, length);
+   }
+   return index < mHeaders.size() && mHeaders[index].isEqual(buffer, length);
+}
+
 
 /* ====================================================================
  * The Vovida Software License, Version 1.0 
@@ -60,6 +60,11 @@ class HeaderFieldValueList
       ~HeaderFieldValueList();
       HeaderFieldValueList(const HeaderFieldValueList& rhs);
       HeaderFieldValueList(const HeaderFieldValueList& rhs, PoolBase& pool);
+      // Values of rhs that lie in [from, fromEnd) are not copied, but refer
+      // to the same place in a copy of that range starting at to. Parsed
+      // values that have not been changed are left to be parsed again.
+      HeaderFieldValueList(const HeaderFieldValueList& rhs, PoolBase& pool,
+                           const char* from, const char* fromEnd, const char* to);
       HeaderFieldValueList& operator=(const HeaderFieldValueList& rhs);
       
       inline void setParserContainer(ParserContainerBase* parser) {mParserContainer = parser;}
@@ -108,6 +113,9 @@ class HeaderFieldValueList
 
       size_t getNumHeaderValues() const;
       bool getHeaderValueByIndex(size_t index, Data& headerValue) const;
+      // true if the value at index still encodes as the length bytes at
+      // buffer, ie: it has not been replaced or modified since then
+      bool isUnchangedValue(size_t index, const char* buffer, size_t length) const;
 
    private:
       typedef std::vector<HeaderFieldValue, StlPoolAllocator<HeaderFieldValue, PoolBase > >  ListImpl;
@@ -83,8 +83,13 @@ H_##_enum::knownReturn(ParserContainerBase* container)
 }                                                                                                                       \
                                                                                                                         \
 ParserContainerBase*                                                                                                    \
-H_##_enum::makeContainer(HeaderFieldValueList* hfvs) const                                                              \
+H_##_enum::makeContainer(HeaderFieldValueList* hfvs, PoolBase* pool) const                                              \
 {                                                                                                                       \
+   if (pool)                                                                                                            \
+   {                                                                                                                    \
+      return new (pool->allocate(sizeof(ParserContainer<_type>)))                                                       \
+         ParserContainer<_type>(hfvs,Headers::_enum,*pool);                                                             \
+   }                                                                                                                    \
    return new ParserContainer<_type>(hfvs,Headers::_enum);                                                              \
 }                                                                                                                       \
                                                                                                                         \
@@ -118,8 +123,13 @@ H_##_enum##s::knownReturn(ParserContainerBase* container)
 }                                                                                                                                       \
                                                                                                                                         \
 ParserContainerBase*                                                                                                    \
-H_##_enum##s::makeContainer(HeaderFieldValueList* hfvs) const                                                           \
+H_##_enum##s::makeContainer(HeaderFieldValueList* hfvs, PoolBase* pool) const                                           \
 {                                                                                                                       \
+   if (pool)                                                                                                            \
+   {                                                                                                                    \
+      return new (pool->allocate(sizeof(ParserContainer<_type>)))                                                       \
+         ParserContainer<_type>(hfvs,Headers::_enum,*pool);                                                             \
+   }                                                                                                                    \
    return new ParserContainer<_type>(hfvs,Headers::_enum);                                                              \
 }                                                                                                                       \
                                                                                                                                         \
@@ -337,8 +347,13 @@ void H_RESIP_DO_NOT_USEs::merge(SipMessage& target, const SipMessage& embedded)
 }
 
 ParserContainerBase*
-H_RESIP_DO_NOT_USEs::makeContainer(HeaderFieldValueList* hfvs) const
+H_RESIP_DO_NOT_USEs::makeContainer(HeaderFieldValueList* hfvs, PoolBase* pool) const
 {
+   if (pool)
+   {
+      return new (pool->allocate(sizeof(ParserContainer<StringCategory>)))
+         ParserContainer<StringCategory>(hfvs,Headers::RESIP_DO_NOT_USE,*pool);
+   }
    return new ParserContainer<StringCategory>(hfvs,Headers::RESIP_DO_NOT_USE);
 }
 
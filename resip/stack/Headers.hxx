@@ -70,7 +70,8 @@ class HeaderBase
          return theHeaderInstances[typenum+1];
       }
       
-      virtual ParserContainerBase* makeContainer(HeaderFieldValueList* hfvs) const=0;
+      // Allocates the container from pool if not 0.
+      virtual ParserContainerBase* makeContainer(HeaderFieldValueList* hfvs, PoolBase* pool) const=0;
    protected:
       static HeaderBase* theHeaderInstances[Headers::MAX_HEADERS+1];
 };
@@ -84,7 +85,7 @@ class H_##_enum : public HeaderBase                             \
       typedef _type Type;                                       \
       UnusedChecking(_enum);                                    \
       static Type& knownReturn(ParserContainerBase* container); \
-      virtual ParserContainerBase* makeContainer(HeaderFieldValueList* hfvs) const;       \
+      virtual ParserContainerBase* makeContainer(HeaderFieldValueList* hfvs, PoolBase* pool) const; \
       virtual Headers::Type getTypeNum() const;                 \
       virtual void merge(SipMessage&, const SipMessage&);       \
       H_##_enum();                                              \
@@ -101,7 +102,7 @@ class H_##_enum##s : public HeaderBase                          \
       typedef _type ContainedType;                      \
       MultiUnusedChecking(_enum);                               \
       static Type& knownReturn(ParserContainerBase* container); \
-      virtual ParserContainerBase* makeContainer(HeaderFieldValueList* hfvs) const;       \
+      virtual ParserContainerBase* makeContainer(HeaderFieldValueList* hfvs, PoolBase* pool) const; \
       virtual Headers::Type getTypeNum() const;                 \
       virtual void merge(SipMessage&, const SipMessage&);       \
       H_##_enum##s();                                           \
@@ -1733,6 +1733,50 @@ Helper::fromAor(const Data& aor, const Data& scheme)
    return makeUri(aor, scheme);
 }
 
+CongestionManager::WorkClass
+Helper::getWorkClass(const SipMessage& message)
+{
+   if (message.isResponse())
+   {
+      return CongestionManager::ESSENTIAL_WORK;
+   }
+
+   try
+   {
+      switch (message.method())
+      {
+         case ACK:
+         case BYE:
+         case CANCEL:
+            return CongestionManager::ESSENTIAL_WORK;
+         default:
+            break;
+      }
+
+      if (!message.empty(h_To) &&
+          message.header(h_To).isWellFormed() &&
+          message.header(h_To).exists(p_tag))
+      {
+         return CongestionManager::CONTINUING_WORK;
+      }
+   }
+   catch (BaseException&)
+   {
+      // Not parseable; basicCheck will deal with it.
+   }
+   return CongestionManager::NEW_WORK;
+}
+
+CongestionManager::WorkClass
+Helper::getWorkClass(const SipMessage& message, const CongestionManager* manager)
+{
+   if (manager && manager->usesWorkClasses())
+   {
+      return getWorkClass(message);
+   }
+   return CongestionManager::NEW_WORK;
+}
+
 bool
 Helper::validateMessage(const SipMessage& message,resip::Data* reason)
 {
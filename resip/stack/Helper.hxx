@@ -8,6 +8,7 @@
 #include "resip/stack/Uri.hxx"
 #include "resip/stack/MethodTypes.hxx"
 #include "rutil/BaseException.hxx"
+#include "rutil/CongestionManager.hxx"
 #include "rutil/Data.hxx"
 #include "resip/stack/Contents.hxx"
 #include "resip/stack/SecurityAttributes.hxx"
@@ -514,6 +515,15 @@ class Helper
       // of reason.
       static bool validateMessage(const SipMessage& message,resip::Data* reason=0);
 
+      // The class of work a message represents, for congestion management:
+      // responses, ACK, BYE and CANCEL are essential, other requests with a
+      // To tag are continuing, and all other requests are new.
+      static CongestionManager::WorkClass getWorkClass(const SipMessage& message);
+      // As above, but only when manager looks at the class of work; 
+      // otherwise NEW_WORK, without parsing anything.
+      static CongestionManager::WorkClass getWorkClass(const SipMessage& message,
+                                                       const CongestionManager* manager);
+
       // GRUU support -- reversibly and opaquely combine instance id and aor
       static Data gruuUserPart(const Data& instanceId,
                                const Data& aor,
@@ -94,6 +94,22 @@ class LazyParser
          @internal
       */
       HeaderFieldValue& getHeaderField() { return mHeaderField; }
+      const HeaderFieldValue& getHeaderField() const { return mHeaderField; }
+
+      /**
+         @internal
+         @brief Returns true iff this element has been (or may have been)
+            modified, and will be encoded from its parsed form.
+      */
+      bool isDirty() const {return (mState==DIRTY);}
+
+      /**
+         @internal
+         @brief Returns true iff this element is unparsed, or was parsed
+            without error and not modified since; parsing its buffer again
+            then gives the same element.
+      */
+      bool isReparsable() const {return (mState==NOT_PARSED || mState==WELL_FORMED);}
 
       // call (internally) before every access 
       /**
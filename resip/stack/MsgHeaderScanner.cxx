@@ -10,6 +10,28 @@
 #include "resip/stack/MsgHeaderScanner.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
+// The vector fast path is only worth it (and only written) for x86 SSE2 and
+// AVX2.  It is compiled out when debugging the state machine, since it skips
+// characters without stepping them through the state machine.
+#if !defined(RESIP_MSG_HEADER_SCANNER_NO_VECTOR) && \
+    !defined(RESIP_MSG_HEADER_SCANNER_DEBUG)
+#  if defined(__AVX2__)
+#     include <immintrin.h>
+#     define RESIP_MSG_HEADER_SCANNER_AVX2
+#  elif defined(__SSE2__) || defined(_M_X64) || \
+        (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#     include <emmintrin.h>
+#     define RESIP_MSG_HEADER_SCANNER_SSE2
+#  endif
+#  if defined(RESIP_MSG_HEADER_SCANNER_AVX2) || \
+      defined(RESIP_MSG_HEADER_SCANNER_SSE2)
+#     define RESIP_MSG_HEADER_SCANNER_VECTOR
+#     if defined(_MSC_VER)
+#        include <intrin.h>
+#     endif
+#  endif
+#endif
+
 namespace resip 
 {
 
@@ -412,6 +434,173 @@ static void initStateMachine()
                   sMsgStart); // Arbitrary but possibly handy.
 }
 
+
+///////////////////////////////////////////////////////////////////////////////
+//   Most of a message header is made up of runs of characters that leave the
+//   state machine in the state it is already in (eg everything in a value up
+//   to the next CR, or everything inside a '<'/'>' pair).  For each state where
+//   only a handful of characters do anything else, "skipInfoArray" lists those
+//   "stop" characters, so that such runs can be skipped a vector at a time
+//   instead of one character at a time.  Both tables are derived from the state
+//   machine, so they can never disagree with it.
+
+enum { maxNumStopChars = 6 };
+
+struct SkipInfo
+{
+      unsigned char numStopChars;   // 0 if the state can not be skipped through.
+      char stopChars[maxNumStopChars];   // Padded with stopChars[0].
+};
+
+static SkipInfo skipInfoArray[numStates];
+static SkipInfo noSkipInfoArray[numStates];
+
+//   The characters with a text property that can be skipped over in some
+//   state.  Skipping must accumulate their properties just like the main loop.
+
+struct TextPropChar
+{
+      char character;
+      MsgHeaderScanner::TextPropBitMask textPropBitMask;
+};
+
+static TextPropChar textPropCharArray[UCHAR_MAX+1];
+static int numTextPropChars = 0;
+
+static void initSkipInfoArray()
+{
+   bool isSkippable[UCHAR_MAX+1] = { false };
+   for (int state = 0; state < numStates; ++state)
+   {
+      char stopChars[UCHAR_MAX+1];
+      int numStopChars = 0;
+      for (unsigned int charIndex = 0; charIndex <= UCHAR_MAX; ++charIndex)
+      {
+         const TransitionInfo& transitionInfo =
+            stateMachine[state][c2i(charInfoArray[charIndex].category)];
+         if (transitionInfo.action != taNone ||
+             transitionInfo.nextState != state)
+         {
+            stopChars[numStopChars++] = (char)charIndex;
+         }
+      }
+      SkipInfo& skipInfo = skipInfoArray[state];
+      skipInfo.numStopChars = 0;
+      // The sentinel is always a stop character, so numStopChars >= 1.
+      if (numStopChars > maxNumStopChars)
+      {
+         continue;
+      }
+      skipInfo.numStopChars = (unsigned char)numStopChars;
+      for (int i = 0; i < maxNumStopChars; ++i)
+      {
+         skipInfo.stopChars[i] = stopChars[i < numStopChars ? i : 0];
+      }
+      for (unsigned int charIndex = 0; charIndex <= UCHAR_MAX; ++charIndex)
+      {
+         bool isStopChar = false;
+         for (int i = 0; i < numStopChars; ++i)
+         {
+            isStopChar = isStopChar || (unsigned char)stopChars[i] == charIndex;
+         }
+         isSkippable[charIndex] = isSkippable[charIndex] || !isStopChar;
+      }
+   }
+   numTextPropChars = 0;
+   for (unsigned int charIndex = 0; charIndex <= UCHAR_MAX; ++charIndex)
+   {
+      if (isSkippable[charIndex] && charInfoArray[charIndex].textPropBitMask)
+      {
+         textPropCharArray[numTextPropChars].character = (char)charIndex;
+         textPropCharArray[numTextPropChars].textPropBitMask =
+            charInfoArray[charIndex].textPropBitMask;
+         ++numTextPropChars;
+      }
+   }
+}
+
+#if defined(RESIP_MSG_HEADER_SCANNER_VECTOR)
+
+#if defined(RESIP_MSG_HEADER_SCANNER_AVX2)
+typedef __m256i CharVector;
+typedef unsigned int CharVectorBits;
+static inline CharVector vecLoad(const char* p) { return _mm256_loadu_si256((const __m256i*)p); }
+static inline CharVector vecSplat(char c) { return _mm256_set1_epi8(c); }
+static inline CharVector vecEq(CharVector a, CharVector b) { return _mm256_cmpeq_epi8(a, b); }
+static inline CharVector vecOr(CharVector a, CharVector b) { return _mm256_or_si256(a, b); }
+static inline CharVectorBits vecBits(CharVector a) { return (CharVectorBits)_mm256_movemask_epi8(a); }
+#else
+typedef __m128i CharVector;
+typedef unsigned int CharVectorBits;
+static inline CharVector vecLoad(const char* p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline CharVector vecSplat(char c) { return _mm_set1_epi8(c); }
+static inline CharVector vecEq(CharVector a, CharVector b) { return _mm_cmpeq_epi8(a, b); }
+static inline CharVector vecOr(CharVector a, CharVector b) { return _mm_or_si128(a, b); }
+static inline CharVectorBits vecBits(CharVector a) { return (CharVectorBits)_mm_movemask_epi8(a); }
+#endif
+enum { charVectorSize = sizeof(CharVector) };
+
+static inline unsigned int firstBitIndex(CharVectorBits bits)
+{
+#if defined(_MSC_VER)
+   unsigned long index;
+   _BitScanForward(&index, bits);
+   return (unsigned int)index;
+#else
+   return (unsigned int)__builtin_ctz(bits);
+#endif
+}
+
+//   Returns the first character at or after "charPtr" that is a stop character
+//   of "skipInfo", or the first character not examined if it runs out of whole
+//   vectors first.  Never reads beyond "termCharPtr" (which holds the sentinel),
+//   since the chunk buffer is only MaxNumCharsChunkOverflow characters longer.
+
+static inline char *
+skipPlainText(char * charPtr,
+              const char * termCharPtr,
+              const SkipInfo & skipInfo,
+              MsgHeaderScanner::TextPropBitMask & textPropBitMask)
+{
+   const CharVector stop0 = vecSplat(skipInfo.stopChars[0]);
+   const CharVector stop1 = vecSplat(skipInfo.stopChars[1]);
+   const CharVector stop2 = vecSplat(skipInfo.stopChars[2]);
+   const CharVector stop3 = vecSplat(skipInfo.stopChars[3]);
+   const CharVector stop4 = vecSplat(skipInfo.stopChars[4]);
+   const CharVector stop5 = vecSplat(skipInfo.stopChars[5]);
+   while (termCharPtr - charPtr >= charVectorSize - 1)
+   {
+      const CharVector chars = vecLoad(charPtr);
+      CharVectorBits stopBits =
+         vecBits(vecOr(vecOr(vecOr(vecEq(chars, stop0), vecEq(chars, stop1)),
+                             vecOr(vecEq(chars, stop2), vecEq(chars, stop3))),
+                       vecOr(vecEq(chars, stop4), vecEq(chars, stop5))));
+      CharVectorBits plainBits = stopBits
+         ? (((CharVectorBits)1 << firstBitIndex(stopBits)) - 1)
+         : (CharVectorBits)~(CharVectorBits)0;
+      if (plainBits)
+      {
+         for (int i = 0; i < numTextPropChars; ++i)
+         {
+            const TextPropChar& textPropChar = textPropCharArray[i];
+            if (!(textPropBitMask & textPropChar.textPropBitMask) &&
+                (vecBits(vecEq(chars, vecSplat(textPropChar.character))) & plainBits))
+            {
+               textPropBitMask |= textPropChar.textPropBitMask;
+            }
+         }
+      }
+      if (stopBits)
+      {
+         return charPtr + firstBitIndex(stopBits);
+      }
+      charPtr += charVectorSize;
+   }
+   return charPtr;
+}
+
+#endif // defined(RESIP_MSG_HEADER_SCANNER_VECTOR)
+
 // Debug follows
 #if defined(RESIP_MSG_HEADER_SCANNER_DEBUG)  
 
@@ -874,6 +1063,11 @@ processMsgHeaderFieldNameAndValue(SipMessage * msg,
 #endif //!defined(RESIP_MSG_HEADER_SCANNER_DEBUG) }
 
 bool MsgHeaderScanner::mInitialized = false;
+#if defined(RESIP_MSG_HEADER_SCANNER_VECTOR)
+bool MsgHeaderScanner::mVectorScanEnabled = true;
+#else
+bool MsgHeaderScanner::mVectorScanEnabled = false;
+#endif
 
 MsgHeaderScanner::MsgHeaderScanner()
 {
@@ -917,6 +1111,10 @@ MsgHeaderScanner::scanChunk(char * chunk,
    MsgHeaderScanner::ScanChunkResult result;
    CharInfo* localCharInfoArray = charInfoArray;
    TransitionInfo (*localStateMachine)[numCharCategories] = stateMachine;
+#if defined(RESIP_MSG_HEADER_SCANNER_VECTOR)
+   const SkipInfo* localSkipInfoArray =
+      mVectorScanEnabled ? skipInfoArray : noSkipInfoArray;
+#endif
    State localState = mState;
    char *charPtr = chunk + mPrevScanChunkNumSavedTextChars;
    char *termCharPtr = chunk + chunkLength;
@@ -950,7 +1148,20 @@ MsgHeaderScanner::scanChunk(char * chunk,
       printStateTransition(localState, *charPtr, transitionAction);
 #endif
       localState = transitionInfo->nextState;
-      if (transitionAction == taNone) continue;
+      if (transitionAction == taNone)
+      {
+#if defined(RESIP_MSG_HEADER_SCANNER_VECTOR)
+         const SkipInfo& skipInfo = localSkipInfoArray[(unsigned)localState];
+         if (skipInfo.numStopChars)
+         {
+            charPtr = skipPlainText(charPtr + 1,
+                                    termCharPtr,
+                                    skipInfo,
+                                    localTextPropBitMask) - 1;
+         }
+#endif
+         continue;
+      }
       // END message header character scan block END
       // The loop remainder is executed about 4-5 times per message header line.
       switch (transitionAction)
@@ -1024,6 +1235,10 @@ MsgHeaderScanner::scanChunk(char * chunk,
             // textStartCharPtr is not 0.  Not currently relevant.
             result = MsgHeaderScanner::scrEnd;
             *unprocessedCharPtr = charPtr + 1;  // The current char is processed.
+            if (mMsg)
+            {
+               mMsg->setRawHeaders(chunk, *unprocessedCharPtr);
+            }
             goto endOfFunction;
             break;
          case taChunkTermSentinel:
@@ -1067,9 +1282,26 @@ MsgHeaderScanner::initialize()
 {
    initCharInfoArray();
    initStateMachine();
+   initSkipInfoArray();
    return true;
 }
 
+void
+MsgHeaderScanner::setVectorScanEnabled(bool enabled)
+{
+   mVectorScanEnabled = enabled && isVectorScanAvailable();
+}
+
+bool
+MsgHeaderScanner::isVectorScanAvailable()
+{
+#if defined(RESIP_MSG_HEADER_SCANNER_VECTOR)
+   return true;
+#else
+   return false;
+#endif
+}
+
 
 } //namespace resip
 
@@ -124,6 +124,14 @@ class MsgHeaderScanner
       // !ah! for documentation generation
       static int dumpStateMachine(int fd); 
 
+      // The scanner skips runs of characters that can not change its state
+      // (most of each value) 16 or 32 at a time using SSE2 or AVX2, when the
+      // library is built for a CPU that has them.  The results are the same
+      // either way; disabling it is only useful for testing and benchmarking.
+      static void setVectorScanEnabled(bool enabled);
+      static bool isVectorScanEnabled() { return mVectorScanEnabled; }
+      static bool isVectorScanAvailable();
+
    private:
 
 
@@ -136,6 +144,7 @@ class MsgHeaderScanner
       // Automatically called when 1st MsgHeaderScanner constructed.
       bool initialize();
       static bool mInitialized;
+      static bool mVectorScanEnabled;
 
 
 };
@@ -90,6 +90,15 @@ class ParserContainer : public ParserContainerBase
          : ParserContainerBase(other, pool)
       {}
 
+      /**
+         @internal
+         @brief Copy c'tor for a copy of a message (see ParserContainerBase).
+      */
+      ParserContainer(const ParserContainer& other,
+                      const char* from, const char* fromEnd, const char* to)
+         : ParserContainerBase(other, from, fromEnd, to)
+      {}
+
       /**
          @brief Assignment operator.
       */
@@ -320,6 +329,12 @@ class ParserContainer : public ParserContainerBase
          return new ParserContainer(*this);
       }
 
+      virtual ParserContainerBase* clone(const char* from, const char* fromEnd,
+                                         const char* to) const
+      {
+         return new ParserContainer(*this, from, fromEnd, to);
+      }
+
    private:
       friend class ParserContainer<T>::iterator;
       friend class ParserContainer<T>::const_iterator;
@@ -37,6 +37,16 @@ ParserContainerBase::ParserContainerBase(const ParserContainerBase& rhs,
    copyParsers(rhs.mParsers);
 }
 
+ParserContainerBase::ParserContainerBase(const ParserContainerBase& rhs,
+                                          const char* from, const char* fromEnd,
+                                          const char* to)
+   : mType(rhs.mType),
+     mParsers(),
+     mPool(0)
+{
+   copyParsers(rhs.mParsers, from, fromEnd, to);
+}
+
 ParserContainerBase::~ParserContainerBase()
 {
    freeParsers();
@@ -79,11 +89,23 @@ ParserContainerBase::append(const ParserContainerBase& source)
 EncodeStream& 
 ParserContainerBase::encode(const Data& headerName, 
                             EncodeStream& str) const
+{
+   return encode(headerName, str, mParsers.size());
+}
+
+EncodeStream& 
+ParserContainerBase::encode(const Data& headerName, 
+                            EncodeStream& str,
+                            size_t count) const
 {
    // !jf! this is not strictly correct since some headers are allowed to
    // be empty: Supported, Accept-Encoding, Allow-Events, Allow,
    // Accept,Accept-Language 
-   if (!mParsers.empty())
+   if (count > mParsers.size())
+   {
+      count = mParsers.size();
+   }
+   if (count > 0)
    {
       if (!headerName.empty())
       {
@@ -91,7 +113,7 @@ ParserContainerBase::encode(const Data& headerName,
       }
          
       for (Parsers::const_iterator i = mParsers.begin(); 
-           i != mParsers.end(); ++i)
+           i != mParsers.begin() + count; ++i)
       {
          if (i != mParsers.begin())
          {
@@ -170,6 +192,35 @@ ParserContainerBase::copyParsers(const Parsers& parsers)
    }
 }
 
+void
+ParserContainerBase::copyParsers(const Parsers& parsers,
+                                 const char* from, const char* fromEnd, const char* to)
+{
+   mParsers.reserve(mParsers.size() + parsers.size());
+   for(Parsers::const_iterator p=parsers.begin(); p!=parsers.end(); ++p)
+   {
+      mParsers.push_back(HeaderKit::Empty);
+
+      HeaderKit& kit(mParsers.back());
+      const HeaderFieldValue& field(p->pc ? p->pc->getHeaderField() : p->hfv);
+      if((!p->pc || p->pc->isReparsable()) &&
+         field.getBuffer() >= from && field.getBuffer() < fromEnd)
+      {
+         // Parsing it again from the copy is about as cheap as copying the
+         // parsed value, and what it parses to shares the copy's buffer.
+         kit.hfv.init(to + (field.getBuffer() - from), field.getLength(), false);
+      }
+      else if(p->pc)
+      {
+         kit.pc = makeParser(*(p->pc));
+      }
+      else
+      {
+         kit.hfv = p->hfv;
+      }
+   }
+}
+
 void 
 ParserContainerBase::freeParsers()
 {
@@ -193,6 +244,21 @@ ParserContainerBase::getHeaderValueByIndex(size_t index, Data& headerValue) cons
    return false;
 }
 
+bool
+ParserContainerBase::isUnchangedValue(size_t index, const char* buffer, size_t length) const
+{
+   if (index >= mParsers.size())
+   {
+      return false;
+   }
+   const HeaderKit& hk = mParsers[index];
+   if (hk.pc)
+   {
+      return !hk.pc->isDirty() && hk.pc->getHeaderField().isEqual(buffer, length);
+   }
+   return hk.hfv.isEqual(buffer, length);
+}
+
 
 /* ====================================================================
  * The Vovida Software License, Version 1.0 
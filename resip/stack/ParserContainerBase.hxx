@@ -44,6 +44,15 @@ class ParserContainerBase
       ParserContainerBase(const ParserContainerBase& rhs,
                            PoolBase& pool);
 
+      /**
+        @brief copies the mType and the mParsers from the rhs, except that
+         values that are still the bytes they were parsed from, in
+         [from, fromEnd), are not copied but left to be parsed again from
+         the copy of those bytes at to
+        */
+      ParserContainerBase(const ParserContainerBase& rhs,
+                           const char* from, const char* fromEnd, const char* to);
+
       /**
         @brief assignment operator copies the mParsers from the rhs
         @note this is a shallow copy
@@ -66,6 +75,13 @@ class ParserContainerBase
         */
       virtual ParserContainerBase* clone() const = 0;
 
+      /**
+        @brief clones this object for a copy of the message it belongs to
+         (see the relocating copy constructor)
+        */
+      virtual ParserContainerBase* clone(const char* from, const char* fromEnd,
+                                         const char* to) const = 0;
+
       /**
         @brief return the size of the mParsers vector
         */
@@ -86,6 +102,12 @@ class ParserContainerBase
         */
       EncodeStream& encode(const Data& headerName, EncodeStream& str) const;
 
+      /**
+        @internal
+        @brief encodes only the first count elements
+        */
+      EncodeStream& encode(const Data& headerName, EncodeStream& str, size_t count) const;
+
       /**
         @internal
         @brief the actual mechanics of parsing
@@ -124,6 +146,13 @@ class ParserContainerBase
 
       bool getHeaderValueByIndex(size_t index, Data& headerValue) const;
 
+      /**
+        @internal
+        @brief true if the element at index has not been modified and still
+         encodes as the length bytes at buffer
+        */
+      bool isUnchangedValue(size_t index, const char* buffer, size_t length) const;
+
    protected:
       const Headers::Type mType;
 
@@ -190,6 +219,8 @@ class ParserContainerBase
         @brief copy header kits
         */
       void copyParsers(const Parsers& parsers);
+      void copyParsers(const Parsers& parsers,
+                       const char* from, const char* fromEnd, const char* to);
 
       /**
         @brief free parser containers
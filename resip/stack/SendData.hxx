@@ -7,6 +7,8 @@
 namespace resip
 {
 
+class Transport;
+
 /**
    @internal
 */
@@ -20,7 +22,7 @@ class SendData
          EnableFlowTimer
       };
 
-      SendData() : isAlreadyCompressed(false), command(NoCommand)
+      SendData() : isAlreadyCompressed(false), command(NoCommand), transport(0), transportGeneration(0), mNext(0)
       {}
 
       SendData(const Tuple& dest,
@@ -33,7 +35,10 @@ class SendData
          transactionId(tid),
          sigcompId(scid),
          isAlreadyCompressed(isCompressed),
-         command(NoCommand)
+         command(NoCommand),
+         transport(0),
+         transportGeneration(0),
+         mNext(0)
       {
       }
 
@@ -44,13 +49,18 @@ class SendData
          transactionId(Data::Empty),
          sigcompId(Data::Empty),
          isAlreadyCompressed(false),
-         command(NoCommand)
+         command(NoCommand),
+         transport(0),
+         transportGeneration(0),
+         mNext(0)
       {
       }
 
       SendData* clone() const
       {
-         return new SendData(*this);
+         SendData* copy = new SendData(*this);
+         copy->mNext = 0;
+         return copy;
       }
 
       void clear()
@@ -71,6 +81,70 @@ class SendData
 
       // .bwc. Used for special commands: ie. to close connections, and enable flow timers
       SendDataCommand command;
+
+      // The transport TransportSelector::transmit() picked, for
+      // retransmit(); only valid while TransportSelector's set of transports
+      // is unchanged since (transportGeneration).
+      Transport* transport;
+      unsigned int transportGeneration;
+
+      /// The entry queued after this one in a SendDataQueue, or 0.
+      SendData* next() const { return mNext; }
+
+   private:
+      friend class SendDataQueue;
+      SendData* mNext;
+};
+
+/**
+   @internal
+   @brief A FIFO of SendData linked through the SendData themselves, so
+   queueing a send on a Connection does not allocate a list node.
+
+   A SendData can be on at most one SendDataQueue at a time. The queue does
+   not own its entries; whoever pops one deletes it.
+*/
+class SendDataQueue
+{
+   public:
+      SendDataQueue() : mFront(0), mBack(0) {}
+
+      bool empty() const { return mFront == 0; }
+      SendData* front() const { return mFront; }
+      SendData* back() const { return mBack; }
+
+      void push_back(SendData* sendData)
+      {
+         sendData->mNext = 0;
+         if (mBack)
+         {
+            mBack->mNext = sendData;
+         }
+         else
+         {
+            mFront = sendData;
+         }
+         mBack = sendData;
+      }
+
+      void pop_front()
+      {
+         SendData* front = mFront;
+         mFront = front->mNext;
+         front->mNext = 0;
+         if (!mFront)
+         {
+            mBack = 0;
+         }
+      }
+
+   private:
+      SendData* mFront;
+      SendData* mBack;
+
+      // no value semantics
+      SendDataQueue(const SendDataQueue&);
+      SendDataQueue& operator=(const SendDataQueue&);
 };
 
 }
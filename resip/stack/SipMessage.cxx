@@ -19,25 +19,50 @@
 #include "rutil/ParseBuffer.hxx"
 #include "resip/stack/MsgHeaderScanner.hxx"
 //#include "rutil/WinLeakCheck.hxx"  // not compatible with placement new used below
+#include <algorithm>
 #include <utility>
 
 using namespace resip;
 using namespace std;
 
+namespace
+{
+
+// What encodeWireHeaders() found out about the header that a WireHeader is
+// the first of.
+struct WireState
+{
+   const HeaderFieldValueList* current;
+   bool unchanged;
+   unsigned int added; // in front of the received values
+};
+
+const unsigned int NoWireHeader = ~0u;
+
+}
+
 #define RESIPROCATE_SUBSYSTEM Subsystem::SIP
 
 bool SipMessage::checkContentLength=true;
+bool SipMessage::useArena=false;
+bool SipMessage::reuseWireEncoding=false;
 
 SipMessage::SipMessage(const Tuple *receivedTransportTuple)
    : mIsDecorated(false),
      mIsBadAck200(false),     
      mIsExternal(receivedTransportTuple != 0),  // may be modified later by setFromTU or setFromExternal
+     mPool(useArena),
      mHeaders(StlPoolAllocator<HeaderFieldValueList*, PoolBase >(&mPool)),
 #ifndef __SUNPRO_CC
      mUnknownHeaders(StlPoolAllocator<std::pair<Data, HeaderFieldValueList*>, PoolBase >(&mPool)),
 #else
      mUnknownHeaders(),
 #endif
+     mReuseWireEncoding(reuseWireEncoding),
+     mWireHeaders(StlPoolAllocator<WireHeader, PoolBase >(&mPool)),
+     mWireHeadersEnd(0),
+     mWireFirsts(StlPoolAllocator<unsigned int, PoolBase >(&mPool)),
+     mUnknownWireFirsts(StlPoolAllocator<unsigned int, PoolBase >(&mPool)),
      mRequest(false),
      mResponse(false),
      mInvalid(false),
@@ -54,12 +79,18 @@ SipMessage::SipMessage(const Tuple *receivedTransportTuple)
 }
 
 SipMessage::SipMessage(const SipMessage& from)
-   : mHeaders(StlPoolAllocator<HeaderFieldValueList*, PoolBase >(&mPool)),
+   : mPool(useArena),
+     mHeaders(StlPoolAllocator<HeaderFieldValueList*, PoolBase >(&mPool)),
 #ifndef __SUNPRO_CC
      mUnknownHeaders(StlPoolAllocator<std::pair<Data, HeaderFieldValueList*>, PoolBase >(&mPool)),
 #else
      mUnknownHeaders(),
 #endif
+     mReuseWireEncoding(reuseWireEncoding),
+     mWireHeaders(StlPoolAllocator<WireHeader, PoolBase >(&mPool)),
+     mWireHeadersEnd(0),
+     mWireFirsts(StlPoolAllocator<unsigned int, PoolBase >(&mPool)),
+     mUnknownWireFirsts(StlPoolAllocator<unsigned int, PoolBase >(&mPool)),
      mCreatedTime(Timer::getTimeMicroSec())
 {
    init(from);
@@ -86,7 +117,12 @@ SipMessage::~SipMessage()
 {
 //#define DINKYPOOL_PROFILING
 #ifdef DINKYPOOL_PROFILING
-   if (mPool.getHeapBytes() > 0)
+   if (mPool.getNumBlocks() > 0)
+   {
+       InfoLog(<< "SipMessage mPool filled up and used " << mPool.getArenaBytes() << " bytes in " << mPool.getNumBlocks() << " arena blocks (sizeof SipMessage is " << sizeof(SipMessage) << " bytes): msg="
+           << std::endl << *this);
+   }
+   else if (mPool.getHeapBytes() > 0)
    {
        InfoLog(<< "SipMessage mPool filled up and used " << mPool.getHeapBytes() << " bytes on the heap, consider increasing the mPool size (sizeof SipMessage is " << sizeof(SipMessage) << " bytes): msg="
            << std::endl << *this);
@@ -111,9 +147,13 @@ SipMessage::clear(bool leaveResponseStuff)
       // !bwc! The "invalid" 0 index.
       mHeaders.push_back(getEmptyHfvl());
       mBufferList.clear();
+      mWireHeaders.clear();
+      mWireHeadersEnd = 0;
+      mWireFirsts.clear();
    }
 
    mUnknownHeaders.clear();
+   mUnknownWireFirsts.clear();
 
    mStartLine = 0;
    mContents = 0;
@@ -149,13 +189,41 @@ SipMessage::init(const SipMessage& rhs)
 
    memcpy(&mHeaderIndices,&rhs.mHeaderIndices,sizeof(mHeaderIndices));
 
+   // Values still in the received lines refer to a copy of those instead of
+   // being copied one by one, and the ones that have been parsed are parsed
+   // again from the copy. The start line comes along when it sits right in
+   // front of the headers, as it does in anything we received.
+   const char* rhsWire = 0;
+   const char* rhsCopied = 0;
+   char* copied = 0;
+   char* wire = 0;
+   if (rhs.mWireHeadersEnd != 0 && mReuseWireEncoding)
+   {
+      rhsWire = rhs.mWireHeaders.front().line;
+      rhsCopied = rhsWire;
+      if (rhs.mStartLine != 0)
+      {
+         const HeaderFieldValue& line = rhs.mStartLine->getHeaderField();
+         const char* lineEnd = line.getBuffer() + line.getLength();
+         if (line.getBuffer() != 0 && lineEnd <= rhsWire && rhsWire - lineEnd <= 2 &&
+             (lineEnd == rhsWire || rhsWire[-1] == Symbols::LF[0]))
+         {
+            rhsCopied = line.getBuffer();
+         }
+      }
+      copied = allocateBuffer(rhs.mWireHeadersEnd - rhsCopied);
+      memcpy(copied, rhsCopied, rhs.mWireHeadersEnd - rhsCopied);
+      wire = copied + (rhsWire - rhsCopied);
+   }
+
    // .bwc. Clear out the pesky invalid 0 index.
    clearHeaders();
    mHeaders.reserve(rhs.mHeaders.size());
    for (TypedHeaders::const_iterator i = rhs.mHeaders.begin();
         i != rhs.mHeaders.end(); i++)
    {
-      mHeaders.push_back(getCopyHfvl(**i));
+      mHeaders.push_back(wire ? getCopyHfvl(**i, rhsWire, rhs.mWireHeadersEnd, wire) :
+                                getCopyHfvl(**i));
    }
 
    for (UnknownHeaders::const_iterator i = rhs.mUnknownHeaders.begin();
@@ -163,11 +231,25 @@ SipMessage::init(const SipMessage& rhs)
    {
       mUnknownHeaders.push_back(pair<Data, HeaderFieldValueList*>(
                                    i->first,
-                                   getCopyHfvl(*i->second)));
+                                   wire ? getCopyHfvl(*i->second, rhsWire, rhs.mWireHeadersEnd, wire) :
+                                          getCopyHfvl(*i->second)));
+   }
+   if (wire)
+   {
+      copyWireHeaders(rhs, wire);
    }
    if (rhs.mStartLine != 0)
    {
-      mStartLine = rhs.mStartLine->clone(mStartLineMem);
+      const HeaderFieldValue& line = rhs.mStartLine->getHeaderField();
+      if (copied && rhs.mStartLine->isReparsable() &&
+          line.getBuffer() >= rhsCopied && line.getBuffer() < rhs.mWireHeadersEnd)
+      {
+         setStartLine(copied + (line.getBuffer() - rhsCopied), (int)line.getLength());
+      }
+      else
+      {
+         mStartLine = rhs.mStartLine->clone(mStartLineMem);
+      }
    }
    if (rhs.mContents != 0)
    {
@@ -275,9 +357,8 @@ SipMessage::make(const Data& data, bool isExternal)
    SipMessage* msg = new SipMessage(isExternal ? &fakeWireTuple : 0);
 
    size_t len = data.size();
-   char *buffer = new char[len + 5];
+   char *buffer = msg->allocateBuffer(len + MsgHeaderScanner::MaxNumCharsChunkOverflow);
 
-   msg->addBuffer(buffer);
    memcpy(buffer,data.data(), len);
    MsgHeaderScanner msgHeaderScanner;
    msgHeaderScanner.prepareForMessage(msg);
@@ -327,7 +408,7 @@ SipMessage::parseAllHeaders()
 
          if(!(pc=hfvl->getParserContainer()))
          {
-            pc = HeaderBase::getInstance((Headers::Type)i)->makeContainer(hfvl);
+            pc = HeaderBase::getInstance((Headers::Type)i)->makeContainer(hfvl, &mPool);
             hfvl->setParserContainer(pc);
          }
       
@@ -749,21 +830,28 @@ SipMessage::encode(EncodeStream& str, bool isSipFrag) const
 #endif
    }
 
-   for (uint8_t i = 0; i < Headers::MAX_HEADERS; i++)
+   if (mWireHeadersEnd != 0 && !isSipFrag)
    {
-      if (i != Headers::ContentLength) // !dlb! hack...
+      encodeWireHeaders(str);
+   }
+   else
+   {
+      for (uint8_t i = 0; i < Headers::MAX_HEADERS; i++)
       {
-         if (mHeaderIndices[i] > 0)
+         if (i != Headers::ContentLength) // !dlb! hack...
          {
-            mHeaders[mHeaderIndices[i]]->encode(i, str);
+            if (mHeaderIndices[i] > 0)
+            {
+               mHeaders[mHeaderIndices[i]]->encode(i, str);
+            }
          }
       }
-   }
 
-   for (UnknownHeaders::const_iterator i = mUnknownHeaders.begin(); 
-        i != mUnknownHeaders.end(); i++)
-   {
-      i->second->encode(i->first, str);
+      for (UnknownHeaders::const_iterator i = mUnknownHeaders.begin(); 
+           i != mUnknownHeaders.end(); i++)
+      {
+         i->second->encode(i->first, str);
+      }
    }
 
    if(!isSipFrag || !contents.empty())
@@ -777,6 +865,150 @@ SipMessage::encode(EncodeStream& str, bool isSipFrag) const
    return str;
 }
 
+// Copies runs of received lines whose headers are unchanged in one go, and
+// encodes the rest as encode() would.
+EncodeStream&
+SipMessage::encodeWireHeaders(EncodeStream& str) const
+{
+   bool onWire[Headers::MAX_HEADERS];
+   memset(onWire, 0, sizeof(onWire));
+
+   // Kept on the stack rather than in the WireHeaders, so that a message may
+   // be encoded by several threads at once.
+   WireState localStates[32];
+   std::vector<WireState> moreStates;
+   WireState* states = localStates;
+   if (mWireHeaders.size() > sizeof(localStates)/sizeof(localStates[0]))
+   {
+      moreStates.resize(mWireHeaders.size());
+      states = &moreStates[0];
+   }
+
+   UnknownIndex unknowns;
+   if (!mUnknownHeaders.empty())
+   {
+      unknowns.reserve(mUnknownHeaders.size());
+      for (UnknownHeaders::const_iterator i = mUnknownHeaders.begin();
+           i != mUnknownHeaders.end(); ++i)
+      {
+         unknowns.push_back(std::make_pair(i->second, &i->first));
+      }
+      std::sort(unknowns.begin(), unknowns.end());
+   }
+
+   // A header is unchanged if it is still there and every one of its values
+   // is still the one received.  The only other values it may have are ones
+   // added in front of those (like the Via a proxy adds), which are encoded
+   // on a line of their own.
+   std::vector<const HeaderFieldValueList*> unknownsOnWire;
+   for (WireHeaders::const_iterator i = mWireHeaders.begin(); i != mWireHeaders.end(); ++i)
+   {
+      const WireHeader& first = mWireHeaders[i->first];
+      WireState& state = states[i->first];
+      if (&first == &*i)
+      {
+         state.current = getWireHfvl(first, unknowns);
+         state.unchanged = false;
+         state.added = 0;
+         if (i->type != Headers::UNKNOWN)
+         {
+            onWire[i->type] = true;
+         }
+         else if (state.current)
+         {
+            unknownsOnWire.push_back(state.current);
+         }
+         if (state.current)
+         {
+            size_t numValues = state.current->getNumHeaderValues();
+            if (numValues == first.numValues ||
+                (numValues > first.numValues && first.numValues > 0 &&
+                 state.current->getParserContainer() != 0))
+            {
+               state.unchanged = true;
+               state.added = (unsigned int)(numValues - first.numValues);
+            }
+         }
+      }
+      if (state.unchanged && i->index >= 0)
+      {
+         state.unchanged = state.current->isUnchangedValue(i->index + state.added,
+                                                           i->value, i->length);
+      }
+   }
+   std::sort(unknownsOnWire.begin(), unknownsOnWire.end());
+
+   const char* copyFrom = 0;
+   for (WireHeaders::const_iterator i = mWireHeaders.begin(); i != mWireHeaders.end(); ++i)
+   {
+      if (i != mWireHeaders.begin() && i->line == (i - 1)->line)
+      {
+         // another value on the same line
+         continue;
+      }
+      const WireHeader& first = mWireHeaders[i->first];
+      const WireState& state = states[i->first];
+      if (state.unchanged && i->index != WireHeader::Dropped)
+      {
+         if (state.added > 0 && &first == &*i)
+         {
+            if (copyFrom)
+            {
+               str.write(copyFrom, i->line - copyFrom);
+            }
+            state.current->getParserContainer()->encode(
+               i->type != Headers::UNKNOWN ? Headers::getHeaderName(i->type) :
+                                             Data(Data::Share, i->line, i->nameLength),
+               str, state.added);
+            copyFrom = i->line;
+         }
+         else if (!copyFrom)
+         {
+            copyFrom = i->line;
+         }
+         continue;
+      }
+      if (copyFrom)
+      {
+         str.write(copyFrom, i->line - copyFrom);
+         copyFrom = 0;
+      }
+      if (state.current && !state.unchanged && &first == &*i)
+      {
+         if (i->type != Headers::UNKNOWN)
+         {
+            state.current->encode(i->type, str);
+         }
+         else
+         {
+            state.current->encode(Data(Data::Share, i->line, i->nameLength), str);
+         }
+      }
+   }
+   if (copyFrom)
+   {
+      str.write(copyFrom, mWireHeadersEnd - copyFrom);
+   }
+
+   // Headers added since
+   for (uint8_t i = 0; i < Headers::MAX_HEADERS; i++)
+   {
+      if (i != Headers::ContentLength && mHeaderIndices[i] > 0 && !onWire[i])
+      {
+         mHeaders[mHeaderIndices[i]]->encode(i, str);
+      }
+   }
+   for (UnknownHeaders::const_iterator i = mUnknownHeaders.begin(); 
+        i != mUnknownHeaders.end(); i++)
+   {
+      if (!std::binary_search(unknownsOnWire.begin(), unknownsOnWire.end(), i->second))
+      {
+         i->second->encode(i->first, str);
+      }
+   }
+   return str;
+}
+
 EncodeStream&
 SipMessage::encodeSingleHeader(Headers::Type type, EncodeStream& str) const
 {
@@ -866,6 +1098,18 @@ SipMessage::addBuffer(char* buf)
    mBufferList.push_back(buf);
 }
 
+char*
+SipMessage::allocateBuffer(size_t size)
+{
+   if (mPool.isGrowable())
+   {
+      return static_cast<char*>(mPool.allocate(size));
+   }
+   char* buf = new char[size];
+   addBuffer(buf);
+   return buf;
+}
+
 void 
 SipMessage::setStartLine(const char* st, int len)
 {
@@ -1229,9 +1473,21 @@ SipMessage::addHeader(Headers::Type header, const char* headerName, int headerLe
          {
             hfvl->push_back(start, len, false);
          }
+         if (mReuseWireEncoding)
+         {
+            addWireHeader(header, hfvl, headerName, headerLen, start, len,
+                          len ? (int)hfvl->size() - 1 : WireHeader::NoValue,
+                          mHeaderIndices[header]);
+         }
       }
       else
       {
+         if (mReuseWireEncoding)
+         {
+            addWireHeader(header, hfvl, headerName, headerLen, start, len,
+                          hfvl->empty() ? 0 : WireHeader::Dropped,
+                          mHeaderIndices[header]);
+         }
 #ifdef PEDANTIC_STACK
          if(hfvl->size()==1)
          {
@@ -1260,8 +1516,9 @@ SipMessage::addHeader(Headers::Type header, const char* headerName, int headerLe
    else
    {
       resip_assert(headerLen >= 0);
+      size_t position = 0;
       for (UnknownHeaders::iterator i = mUnknownHeaders.begin();
-           i != mUnknownHeaders.end(); i++)
+           i != mUnknownHeaders.end(); i++, position++)
       {
          if (i->first.size() == (unsigned int)headerLen &&
              strncasecmp(i->first.data(), headerName, headerLen) == 0)
@@ -1271,6 +1528,12 @@ SipMessage::addHeader(Headers::Type header, const char* headerName, int headerLe
             {
                i->second->push_back(start, len, false);
             }
+            if (mReuseWireEncoding)
+            {
+               addWireHeader(header, i->second, headerName, headerLen, start, len,
+                             len ? (int)i->second->size() - 1 : WireHeader::NoValue,
+                             position);
+            }
             return;
          }
       }
@@ -1283,9 +1546,140 @@ SipMessage::addHeader(Headers::Type header, const char* headerName, int headerLe
       }
       mUnknownHeaders.push_back(pair<Data, HeaderFieldValueList*>(Data(headerName, headerLen),
                                                                   hfvs));
+      if (mReuseWireEncoding)
+      {
+         addWireHeader(header, hfvs, headerName, headerLen, start, len,
+                       len ? 0 : WireHeader::NoValue, position);
+      }
+   }
+}
+
+void
+SipMessage::addWireHeader(Headers::Type type, HeaderFieldValueList* hfvl,
+                          const char* headerName, int headerLen,
+                          const char* start, int len, int index,
+                          size_t position)
+{
+   WireHeader wire;
+   wire.line = headerName;
+   wire.nameLength = (unsigned int)headerLen;
+   wire.type = type;
+   wire.hfvl = hfvl;
+   wire.value = start ? start : Data::Empty.data();
+   wire.length = (unsigned int)len;
+   wire.index = index;
+   wire.numValues = 0;
+   WireFirsts& firsts = type != Headers::UNKNOWN ? mWireFirsts : mUnknownWireFirsts;
+   if (position >= firsts.size())
+   {
+      firsts.resize(position + 1, NoWireHeader);
+   }
+   if (firsts[position] == NoWireHeader)
+   {
+      firsts[position] = (unsigned int)mWireHeaders.size();
+   }
+   wire.first = firsts[position];
+   mWireHeaders.push_back(wire);
+   if (index >= 0)
+   {
+      ++mWireHeaders[wire.first].numValues;
    }
 }
 
+void
+SipMessage::setRawHeaders(const char* start, const char* end)
+{
+   // The lines can only be copied as a block if they were all scanned from
+   // the buffer that the last of them is in.
+   if (mWireHeaders.empty() ||
+       mWireHeaders.front().line < start || mWireHeaders.front().line >= end)
+   {
+      mWireHeaders.clear();
+      return;
+   }
+   // Leave out the empty line.
+   --end;
+   if (end > start && end[-1] == '\r')
+   {
+      --end;
+   }
+   mWireHeadersEnd = end;
+}
+
+void
+SipMessage::copyWireHeaders(const SipMessage& rhs, const char* start)
+{
+   const char* rhsStart = rhs.mWireHeaders.front().line;
+   size_t size = rhs.mWireHeadersEnd - rhsStart;
+
+   // The unknown headers were copied in order.
+   std::vector<std::pair<const HeaderFieldValueList*, HeaderFieldValueList*> > unknowns;
+   unknowns.reserve(mUnknownHeaders.size());
+   UnknownHeaders::const_iterator r = rhs.mUnknownHeaders.begin();
+   for (UnknownHeaders::const_iterator u = mUnknownHeaders.begin();
+        u != mUnknownHeaders.end(); ++u, ++r)
+   {
+      unknowns.push_back(std::make_pair(r->second, u->second));
+   }
+   std::sort(unknowns.begin(), unknowns.end());
+
+   mWireHeaders.reserve(rhs.mWireHeaders.size());
+   for (WireHeaders::const_iterator i = rhs.mWireHeaders.begin(); i != rhs.mWireHeaders.end(); ++i)
+   {
+      WireHeader wire(*i);
+      wire.line = start + (i->line - rhsStart);
+      if (i->value >= rhsStart && i->value < rhs.mWireHeadersEnd)
+      {
+         wire.value = start + (i->value - rhsStart);
+      }
+      if (i->type != Headers::UNKNOWN)
+      {
+         short index = mHeaderIndices[i->type];
+         wire.hfvl = mHeaders[index < 0 ? -index : index];
+      }
+      else
+      {
+         wire.hfvl = 0;
+         std::vector<std::pair<const HeaderFieldValueList*, HeaderFieldValueList*> >::const_iterator u =
+            std::lower_bound(unknowns.begin(), unknowns.end(),
+                             std::make_pair((const HeaderFieldValueList*)i->hfvl, (HeaderFieldValueList*)0));
+         if (u != unknowns.end() && u->first == i->hfvl)
+         {
+            wire.hfvl = u->second;
+         }
+      }
+      mWireHeaders.push_back(wire);
+   }
+   mWireHeadersEnd = start + size;
+}
+
+const HeaderFieldValueList*
+SipMessage::getWireHfvl(const WireHeader& wire, const UnknownIndex& unknowns) const
+{
+   if (wire.type != Headers::UNKNOWN)
+   {
+      // Content-Length is always encoded from the contents.
+      if (wire.type == Headers::ContentLength || mHeaderIndices[wire.type] <= 0)
+      {
+         return 0;
+      }
+      return mHeaders[mHeaderIndices[wire.type]];
+   }
+   UnknownIndex::const_iterator i =
+      std::lower_bound(unknowns.begin(), unknowns.end(),
+                       std::make_pair((const HeaderFieldValueList*)wire.hfvl, (const Data*)0));
+   if (i != unknowns.end() && i->first == wire.hfvl)
+   {
+      // The same memory may have been reused for another header.
+      if (i->second->size() == wire.nameLength &&
+          strncasecmp(i->second->data(), wire.line, wire.nameLength) == 0)
+      {
+         return i->first;
+      }
+   }
+   return 0;
+}
+
 RequestLine& 
 SipMessage::header(const RequestLineType& l)
 {
@@ -21,7 +21,7 @@
 #include "resip/stack/WsCookieContext.hxx"
 #include "rutil/BaseException.hxx"
 #include "rutil/Data.hxx"
-#include "rutil/DinkyPool.hxx"
+#include "rutil/ArenaPool.hxx"
 #include "rutil/StlPoolAllocator.hxx"
 #include "rutil/Timer.hxx"
 #include "rutil/HeapInstanceCounter.hxx"
@@ -195,6 +195,32 @@ class SipMessage : public TransactionMessage
       
       static bool checkContentLength;
 
+      /**
+         When set, SipMessages constructed from then on keep everything they
+         pool-allocate (headers, parsed header objects, parameters and, for
+         messages received over UDP, the receive buffer itself) in a single
+         growable arena that is released in one go when the message is
+         destroyed, instead of spilling to the heap one allocation at a time
+         once the built-in pool is full.  Memory freed during the life of an
+         arena-backed message is not reused until the message goes away.
+         Off by default.
+      */
+      static bool useArena;
+
+      /**
+         When set, SipMessages constructed from then on remember where each
+         header line they are scanned from starts, and encode() copies the
+         received lines of headers that have not been modified (or removed)
+         as they are, instead of encoding every header again.  Headers that
+         have been modified are encoded where they were received, and headers
+         that have been added go after all of the received ones, so the order
+         of headers with different names is not the same as when this is off.
+         Copies of such messages keep a copy of the received lines.  Only
+         applies to messages whose headers were scanned from a single buffer.
+         Off by default.
+      */
+      static bool reuseWireEncoding;
+
       /**
       @brief Base exception for SipMessage related exceptions
       */
@@ -513,6 +539,10 @@ class SipMessage : public TransactionMessage
                      const char* headerName, int headerLen, 
                      const char* start, int len);
 
+      /// @internal Called once all of the headers have been scanned from a
+      /// single buffer; end points just past the empty line ending them.
+      void setRawHeaders(const char* start, const char* end);
+
       // Returns the source tuple for the transport that the message was received from
       // only makes sense for messages received from the wire.  Differs from Source
       // since it contains the transport bind address instead of the actual source 
@@ -534,6 +564,9 @@ class SipMessage : public TransactionMessage
       Tuple& getDestination() { return mDestination; }
 
       void addBuffer(char* buf);
+      /// Returns a buffer of size bytes that the message manages the memory
+      /// of, taken from the message's arena if it has one.
+      char* allocateBuffer(size_t size);
 
       uint64_t getCreatedTimeMicroSec() const {return mCreatedTime;}
 
@@ -594,6 +627,7 @@ class SipMessage : public TransactionMessage
 
       EncodeStream& 
       encode(EncodeStream& str, bool isSipFrag) const;      
+      EncodeStream& encodeWireHeaders(EncodeStream& str) const;
 
       void copyFrom(const SipMessage& message);
 
@@ -633,6 +667,14 @@ class SipMessage : public TransactionMessage
          return new (ptr) HeaderFieldValueList(hfvl, mPool);
       }
 
+      inline HeaderFieldValueList* getCopyHfvl(const HeaderFieldValueList& hfvl,
+                                               const char* from, const char* fromEnd,
+                                               const char* to)
+      {
+         void* ptr(mPool.allocate(sizeof(HeaderFieldValueList)));
+         return new (ptr) HeaderFieldValueList(hfvl, mPool, from, fromEnd, to);
+      }
+
       inline void freeHfvl(HeaderFieldValueList* hfvl)
       {
          if(hfvl)
@@ -666,7 +708,8 @@ class SipMessage : public TransactionMessage
       // To profile current sizing, enable DINKYPOOL_PROFILING in SipMessage.cxx 
       // and look for DebugLog message in SipMessage destructor to know when heap
       // allocations are occuring and how much of the pool is used.
-      DinkyPool<3732> mPool;
+      // Growable (see useArena) if useArena was set when constructed.
+      ArenaPool<3732> mPool;
 
       typedef std::vector<HeaderFieldValueList*, 
                            StlPoolAllocator<HeaderFieldValueList*, 
@@ -680,6 +723,52 @@ class SipMessage : public TransactionMessage
       // raw text corresponding to each unknown header
       UnknownHeaders mUnknownHeaders;
 
+      // One for each value (or line without a value) of each header received
+      // from the wire, in the order received.  Only kept if reuseWireEncoding
+      // was set when constructed.
+      class WireHeader
+      {
+         public:
+            enum
+            {
+               NoValue = -1, // the line holds no value
+               Dropped = -2  // a repeated single-value header, not encoded
+            };
+
+            const char* line; // start of the line, ie: the header name
+            unsigned int nameLength;
+            Headers::Type type;
+            HeaderFieldValueList* hfvl;
+            const char* value;
+            unsigned int length;
+            int index; // of the value in hfvl, or NoValue or Dropped
+            unsigned int first; // the first WireHeader for the same hfvl
+
+            // Only on the first WireHeader for each hfvl.
+            unsigned int numValues;
+      };
+      typedef std::vector<WireHeader, StlPoolAllocator<WireHeader, PoolBase > > WireHeaders;
+      const bool mReuseWireEncoding;
+      WireHeaders mWireHeaders;
+      // End of the last received header line, if the received lines can be
+      // reused by encode().
+      const char* mWireHeadersEnd;
+      // While parsing, the first WireHeader of each header, by its index in
+      // mHeaders and by its position in mUnknownHeaders.
+      typedef std::vector<unsigned int, StlPoolAllocator<unsigned int, PoolBase > > WireFirsts;
+      WireFirsts mWireFirsts;
+      WireFirsts mUnknownWireFirsts;
+
+      // The unknown headers, sorted by hfvl, for encodeWireHeaders().
+      typedef std::vector<std::pair<const HeaderFieldValueList*, const Data*> > UnknownIndex;
+      const HeaderFieldValueList* getWireHfvl(const WireHeader& wire,
+                                              const UnknownIndex& unknowns) const;
+      void addWireHeader(Headers::Type type, HeaderFieldValueList* hfvl,
+                         const char* headerName, int headerLen,
+                         const char* start, int len, int index,
+                         size_t position);
+      void copyWireHeaders(const SipMessage& rhs, const char* start);
+
       // For messages received from the wire, this indicates information about 
       // the transport the message was received on
       Tuple mReceivedTransportTuple;
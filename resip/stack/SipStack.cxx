@@ -35,6 +35,7 @@
 #include "resip/stack/TransactionUserMessage.hxx"
 #include "resip/stack/TransactionControllerThread.hxx"
 #include "resip/stack/TransportSelectorThread.hxx"
+#include "resip/stack/TransportThread.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
 #ifdef USE_SSL
@@ -204,8 +205,14 @@ SipStack::init(const SipStackOptions& options)
 
    // WATCHOUT: the transaction controller constructor will
    // grab the security, DnsStub, compression and statsManager
-   mTransactionController = new TransactionController(*this, mAsyncProcessHandler, options.mUseDnsVip);
+   mTransactionController = new TransactionController(*this, mAsyncProcessHandler, options.mUseDnsVip,
+                                                      resipMax(options.mTransactionShards, 1u));
    mTransactionController->transportSelector().setPollGrp(mPollGrp);
+   if(options.mLockFreeFifos)
+   {
+      mTUFifo.setLockFree();
+      mTransactionController->setLockFreeFifos();
+   }
    mTransactionControllerThread = 0;
    mTransportSelectorThread = 0;
 
@@ -230,8 +237,18 @@ SipStack::~SipStack()
    mDnsThread=0;
    delete mTransactionControllerThread;
    mTransactionControllerThread=0;
+   for(std::size_t i = 0; i < mTransactionShardThreads.size(); ++i)
+   {
+      delete mTransactionShardThreads[i];
+   }
+   mTransactionShardThreads.clear();
    delete mTransportSelectorThread;
    mTransportSelectorThread=0;
+   for(TransportThreadMap::iterator it = mTransportThreads.begin(); it != mTransportThreads.end(); ++it)
+   {
+      delete it->second;
+   }
+   mTransportThreads.clear();
 
    delete mTransactionController;
 #ifdef USE_SSL
@@ -271,6 +288,17 @@ SipStack::run()
    mTransactionControllerThread=new TransactionControllerThread(*mTransactionController);
    mTransactionControllerThread->run();
 
+   for(std::size_t i = 0; i < mTransactionShardThreads.size(); ++i)
+   {
+      delete mTransactionShardThreads[i];
+   }
+   mTransactionShardThreads.clear();
+   for(unsigned int i = 1; i < mTransactionController->getNumShards(); ++i)
+   {
+      mTransactionShardThreads.push_back(new TransactionControllerThread(mTransactionController->getShard(i)));
+      mTransactionShardThreads.back()->run();
+   }
+
    delete mTransportSelectorThread;
    mTransportSelectorThread=new TransportSelectorThread(mTransactionController->transportSelector());
    mTransportSelectorThread->run();
@@ -305,11 +333,23 @@ SipStack::shutdownAndJoinThreads()
       mTransactionControllerThread->join();
    }
 
+   for(std::size_t i = 0; i < mTransactionShardThreads.size(); ++i)
+   {
+      mTransactionShardThreads[i]->shutdown();
+      mTransactionShardThreads[i]->join();
+   }
+
    if(mTransportSelectorThread)
    {
       mTransportSelectorThread->shutdown();
       mTransportSelectorThread->join();
    }
+
+   for(TransportThreadMap::iterator it = mTransportThreads.begin(); it != mTransportThreads.end(); ++it)
+   {
+      it->second->shutdown();
+      it->second->join();
+   }
    mInternalThreadsRunning=false;
 }
 
@@ -373,10 +413,25 @@ SipStack::addTransport( TransportType protocol,
                         bool useEmailAsSIP,
                         std::shared_ptr<WsConnectionValidator> wsConnectionValidator,
                         std::shared_ptr<WsCookieContextFactory> wsCookieContextFactory,
-                        const Data& netNs)
+                        const Data& netNs,
+                        unsigned int numSockets)
 {
    resip_assert(!mShuttingDown);
 
+   if(numSockets > 1)
+   {
+      if(protocol == UDP || protocol == TCP)
+      {
+         transportFlags |= RESIP_TRANSPORT_FLAG_REUSEPORT | RESIP_TRANSPORT_FLAG_OWNTHREAD;
+      }
+      else
+      {
+         WarningLog(<< "Multiple sockets per transport are only supported for UDP and TCP, using one "
+                    << Tuple::toData(protocol) << " socket on port " << port);
+         numSockets = 1;
+      }
+   }
+
    // If address is specified, ensure it is valid
    if(!ipInterface.empty())
    {
@@ -516,9 +571,84 @@ SipStack::addTransport( TransportType protocol,
       throw;
    }
    addTransport(std::unique_ptr<Transport>(transport));
+
+   if(numSockets > 1)
+   {
+      runTransportThread(transport);
+      for(unsigned int i = 1; i < numSockets; ++i)
+      {
+         // Bind to the port the first socket ended up with, in case port was 0
+         InternalTransport* sibling = 0;
+         try
+         {
+            if(protocol == UDP)
+            {
+               sibling = new UdpTransport(stateMacFifo, transport->port(), version, stun, ipInterface, mSocketFunc, *mCompression, transportFlags);
+            }
+            else
+            {
+               sibling = new TcpTransport(stateMacFifo, transport->port(), version, ipInterface, mSocketFunc, *mCompression, transportFlags, netNs);
+            }
+         }
+         catch (BaseException& e)
+         {
+            ErrLog(<< "Failed to create additional SO_REUSEPORT socket " << i << " for " << transport->getTuple()
+                   << ": " << e);
+            throw;
+         }
+         addReusePortTransport(std::unique_ptr<Transport>(sibling));
+      }
+      InfoLog(<< "Listening on " << transport->getTuple() << " with " << numSockets << " SO_REUSEPORT sockets");
+   }
    return transport;
 }
 
+void
+SipStack::addReusePortTransport(std::unique_ptr<Transport> transport)
+{
+   // Shares the tuple (and so the aliases and port reference) of the first
+   // socket, so only needs a key of its own.
+   transport->setKey(mNextTransportKey++);
+   mReusePortTransports[transport->getKey()] = transport.get();
+
+   if(mCongestionManager)
+   {
+       transport->setCongestionManager(mCongestionManager);
+   }
+   if (!mTransportSipMessageLoggingHandlers.empty())
+   {
+       transport->setSipMessageLoggingHandlers(mTransportSipMessageLoggingHandlers);
+   }
+
+   Transport* raw = transport.get();
+   if(mProcessingHasStarted)
+   {
+       mTransactionController->addTransport(std::move(transport));
+   }
+   else
+   {
+       mTransactionController->transportSelector().addTransport(std::move(transport), false /* isStackRunning */);
+   }
+   runTransportThread(raw);
+}
+
+void
+SipStack::runTransportThread(Transport* transport)
+{
+   // Wire up the transaction shards now, rather than racing the
+   // TransportSelector doing it once the thread is running.
+   const std::vector<Fifo<TransactionMessage>*>& shardFifos =
+      mTransactionController->transportSelector().getTransactionShardFifos();
+   if(!shardFifos.empty())
+   {
+      transport->setTransactionShardFifos(shardFifos);
+   }
+
+   TransportThread* thread = new TransportThread(*transport);
+   mTransportThreads[transport->getKey()] = thread;
+   thread->run();
+}
+
 void
 SipStack::addTransport(std::unique_ptr<Transport> transport)
 {
@@ -621,6 +751,18 @@ SipStack::removeTransport(unsigned int transportKey)
 {
    Tuple removeTuple;
    Transport* transportToRemove = 0;
+   bool tupleStillInUse = false;
+
+   // SO_REUSEPORT sockets are served by a thread of our own; stop it before
+   // the transport goes away
+   TransportThreadMap::iterator itThread = mTransportThreads.find(transportKey);
+   if(itThread != mTransportThreads.end())
+   {
+      itThread->second->shutdown();
+      itThread->second->join();
+      delete itThread->second;
+      mTransportThreads.erase(itThread);
+   }
 
    // Find transport using Key in SipStack lists(sets)
    for(NonSecureTransportMap::iterator itNS = mNonSecureTransports.begin(); itNS != mNonSecureTransports.end(); itNS++)
@@ -633,6 +775,33 @@ SipStack::removeTransport(unsigned int transportKey)
          break;
       }
    }
+   if(transportToRemove)
+   {
+      // If other sockets share this tuple, one of them takes over
+      for(ReusePortTransportMap::iterator itR = mReusePortTransports.begin(); itR != mReusePortTransports.end(); ++itR)
+      {
+         if(itR->second->getTuple() == removeTuple)
+         {
+            Tuple promotedTuple(removeTuple);
+            promotedTuple.mTransportKey = itR->first;
+            mNonSecureTransports[promotedTuple] = itR->second;
+            mReusePortTransports.erase(itR);
+            tupleStillInUse = true;
+            break;
+         }
+      }
+   }
+   else
+   {
+      ReusePortTransportMap::iterator itR = mReusePortTransports.find(transportKey);
+      if(itR != mReusePortTransports.end())
+      {
+         transportToRemove = itR->second;
+         removeTuple = transportToRemove->getTuple();
+         mReusePortTransports.erase(itR);
+         tupleStillInUse = true;
+      }
+   }
    // If not found look in Secure list(set)
    if(!transportToRemove)
    {
@@ -653,7 +822,12 @@ SipStack::removeTransport(unsigned int transportKey)
       return;
    }
 
-   if(mSecureTransports.size() == 0 && mNonSecureTransports.size() == 0)
+   if(tupleStillInUse)
+   {
+      // Another SO_REUSEPORT socket is still listening on this tuple, so the
+      // aliases and port stay
+   }
+   else if(mSecureTransports.size() == 0 && mNonSecureTransports.size() == 0)
    {
       // If we have no more transports we can just clear out the mDomains map and mUri
       Lock lock(mDomainsMutex);
@@ -1122,6 +1296,10 @@ SipStack::processTimers()
    if(!mTransactionControllerThread)
    {
       mTransactionController->process();
+      for(unsigned int i = 1; i < mTransactionController->getNumShards(); ++i)
+      {
+         mTransactionController->getShard(i).process();
+      }
    }
 
    if(!mDnsThread)
@@ -1169,6 +1347,13 @@ SipStack::getTimeTillNextProcessMS()
                            INT_MAX : mDnsStub->getTimeTillNextProcessMS());
    unsigned int tcNextProcess = mTransactionControllerThread ? INT_MAX : 
                            mTransactionController->getTimeTillNextProcessMS();
+   if(!mTransactionControllerThread)
+   {
+      for(unsigned int i = 1; i < mTransactionController->getNumShards(); ++i)
+      {
+         tcNextProcess = resipMin(tcNextProcess, mTransactionController->getShard(i).getTimeTillNextProcessMS());
+      }
+   }
    unsigned int tsNextProcess = mTransportSelectorThread ? INT_MAX : mTransactionController->transportSelector().getTimeTillNextProcessMS();
 
    return resipMin(Timer::getMaxSystemTimeWaitMs(),
@@ -1311,13 +1496,13 @@ SipStack::dump(EncodeStream& strm)  const
       strm << "domains: " << Inserter(this->mDomains) << std::endl;
    }
    strm << " TUFifo size=" << this->mTUFifo.size() << std::endl
-        << " Timers size=" << this->mTransactionController->mTimers.size() << std::endl;
+        << " Timers size=" << this->mTransactionController->getTimerQueueSize() << std::endl;
    {
       Lock lock(mAppTimerMutex);
       strm << " AppTimers size=" << this->mAppTimers.size() << std::endl;
    }
-   strm << " ServerTransactionMap size=" << this->mTransactionController->mServerTransactionMap.size() << std::endl
-        << " ClientTransactionMap size=" << this->mTransactionController->mClientTransactionMap.size() << std::endl
+   strm << " ServerTransactionMap size=" << this->mTransactionController->getNumServerTransactions() << std::endl
+        << " ClientTransactionMap size=" << this->mTransactionController->getNumClientTransactions() << std::endl
         // !slg! TODO - There is technically a threading concern with the following three lines and the runtime addTransport or removeTransport call
         << " Exact interface / Specific port=" << Inserter(this->mTransactionController->mTransportSelector.mExactTransports) << std::endl
         << " Any interface / Specific port=" << Inserter(this->mTransactionController->mTransportSelector.mAnyInterfaceTransports) << std::endl
@@ -6,6 +6,7 @@
 #endif
 
 #include <set>
+#include <vector>
 #include <iosfwd>
 
 #include "rutil/CongestionManager.hxx"
@@ -46,6 +47,7 @@ class Tuple;
 class Uri;
 class TransactionControllerThread;
 class TransportSelectorThread;
+class TransportThread;
 class TransactionUser;
 class AsyncProcessHandler;
 class Compression;
@@ -103,6 +105,21 @@ class FdPollGrp;
            Set to true to enable Whitelisting of DNS entries.  A feature
            that usually desired by UA's that want to stick to a known
            good server / dns result.
+
+        mTransactionShards
+           Number of shards to split the transaction layer into. Each shard
+           has its own state machine fifo, transaction maps and timer queue,
+           and messages are assigned to a shard by hashing their transaction
+           id. When SipStack::run() is used each shard gets its own thread,
+           so transaction processing can use more than one core; otherwise
+           all shards are given cycles by SipStack::process(). Default 1.
+
+        mLockFreeFifos
+           Set to true to have the transaction layer's state machine fifos
+           and the TU fifo (read by SipStack::receive()) use a lock-free
+           queue, so that transport and application threads posting to them
+           do not contend on a mutex. Only one thread may take messages
+           from each of these fifos. Default false.
 **/
 class SipStackOptions
 {
@@ -111,7 +128,8 @@ class SipStackOptions
          : mSecurity(0), mExtraNameserverList(0),
            mAsyncProcessHandler(0), mStateless(false),
            mSocketFunc(0), mCompression(0), mPollGrp(0),
-           mUseDnsVip(false)
+           mUseDnsVip(false), mTransactionShards(1),
+           mLockFreeFifos(false)
       {
       }
 
@@ -123,6 +141,8 @@ class SipStackOptions
       Compression *mCompression;
       FdPollGrp* mPollGrp;
       bool mUseDnsVip;
+      unsigned int mTransactionShards;
+      bool mLockFreeFifos;
 };
 
 
@@ -225,7 +245,8 @@ class SipStack : public FdSetIOObserver
          out processing. 
 
          This includes a thread for DNS lookups, a thread for
-         transaction processing, and a thread for transport processing 
+         transaction processing (one per shard, see 
+         SipStackOptions::mTransactionShards), and a thread for transport processing 
          (individual Transport objects may be registered as having their own 
          thread; these are not serviced by the thread spawned by this call). 
          This function is intended to be used in addition to the normal method/s
@@ -369,6 +390,14 @@ class SipStack : public FdSetIOObserver
          @param netNs                 Set the network namespace (netns) in which the Transport is
                                       to bind the the given address and port.
 
+         @param numSockets            Number of SO_REUSEPORT sockets to open on this tuple (UDP
+                                      and TCP only). With more than one, the kernel spreads
+                                      inbound flows over the sockets, each of which is served
+                                      by its own TransportThread (and FdPollGrp) owned by the
+                                      stack; new outbound requests go to the least loaded
+                                      socket. The first socket is returned; the others are
+                                      additional transports with their own keys.
+
       */
       Transport* addTransport(TransportType protocol,
                               int port,
@@ -384,7 +413,8 @@ class SipStack : public FdSetIOObserver
                               bool useEmailAsSIP = false,
                               std::shared_ptr<WsConnectionValidator> = nullptr,
                               std::shared_ptr<WsCookieContextFactory> = nullptr,
-                              const Data& netNs = Data::Empty
+                              const Data& netNs = Data::Empty,
+                              unsigned int numSockets = 1
                              );
 
       /**
@@ -1152,6 +1182,13 @@ class SipStack : public FdSetIOObserver
       /** @brief Notify an async process handler - if one has been registered **/
       void checkAsyncProcessHandler();
 
+      /** @brief Adds an extra SO_REUSEPORT socket for a tuple that already has a
+          transport (see the numSockets argument of addTransport) **/
+      void addReusePortTransport(std::unique_ptr<Transport> transport);
+
+      /** @brief Starts the TransportThread serving one SO_REUSEPORT socket **/
+      void runTransportThread(Transport* transport);
+
       FdPollGrp* mPollGrp;
       bool mPollGrpIsMine;
 
@@ -1206,6 +1243,8 @@ class SipStack : public FdSetIOObserver
       TransactionController* mTransactionController;
 
       TransactionControllerThread* mTransactionControllerThread;
+      // One per additional transaction shard (see SipStackOptions)
+      std::vector<TransactionControllerThread*> mTransactionShardThreads;
       TransportSelectorThread* mTransportSelectorThread;
       bool mInternalThreadsRunning;
       bool mProcessingHasStarted; 
@@ -1231,6 +1270,13 @@ class SipStack : public FdSetIOObserver
       NonSecureTransportMap mNonSecureTransports;
       typedef std::map<TransportSelector::TlsTransportKey, Transport*> SecureTransportMap;
       SecureTransportMap mSecureTransports;
+      // Additional SO_REUSEPORT sockets, by transport key; they share the tuple of an
+      // entry in mNonSecureTransports
+      typedef std::map<unsigned int, Transport*> ReusePortTransportMap;
+      ReusePortTransportMap mReusePortTransports;
+      // Threads serving SO_REUSEPORT sockets, by transport key
+      typedef std::map<unsigned int, TransportThread*> TransportThreadMap;
+      TransportThreadMap mTransportThreads;
 
       bool mShuttingDown;
       mutable Mutex mShutdownMutex;
@@ -2,11 +2,16 @@
 #include "config.h"
 #endif
 
+#include "rutil/Lock.hxx"
 #include "rutil/Logger.hxx"
+#include "rutil/DataStream.hxx"
 #include "resip/stack/StatisticsManager.hxx"
 #include "resip/stack/SipMessage.hxx"
 #include "resip/stack/TransactionController.hxx"
 #include "resip/stack/SipStack.hxx"
+#ifdef USE_SSL
+#include "resip/stack/ssl/TlsSessionCache.hxx"
+#endif
 
 using namespace resip;
 using std::vector;
@@ -34,6 +39,95 @@ StatisticsManager::setInterval(unsigned long intervalSecs)
    mInterval = intervalSecs * 1000;
 }
 
+void
+StatisticsManager::setSharedAccess(bool shared)
+{
+   if(shared)
+   {
+      if(!mMutex.get())
+      {
+         mMutex.reset(new Mutex);
+      }
+   }
+   else
+   {
+      mMutex.reset();
+   }
+}
+
+void
+StatisticsManager::zeroOut()
+{
+   {
+      PtrLock lock(mMutex.get());
+      StatisticsMessage::Payload::zeroOut();
+   }
+
+   for(int i=0; i<MaxLatency; ++i)
+   {
+      mLatencies[i].reset();
+   }
+
+   Lock lock(mCountersMutex);
+   for(CounterMap::iterator i=mCounters.begin(); i!=mCounters.end(); ++i)
+   {
+      i->second->reset();
+   }
+}
+
+ShardedCounter&
+StatisticsManager::getCounter(const Data& name) const
+{
+   Lock lock(mCountersMutex);
+   std::unique_ptr<ShardedCounter>& counter = mCounters[name];
+   if(!counter.get())
+   {
+      counter.reset(new ShardedCounter);
+   }
+   return *counter;
+}
+
+void
+StatisticsManager::getCounters(std::map<Data, uint64_t>& counters) const
+{
+   Lock lock(mCountersMutex);
+   for(CounterMap::const_iterator i=mCounters.begin(); i!=mCounters.end(); ++i)
+   {
+      counters[i->first] = i->second->value();
+   }
+}
+
+EncodeStream&
+StatisticsManager::encodeLatencies(EncodeStream& strm) const
+{
+   static const char* names[MaxLatency] = {"TransactionSetup", "FifoWait", "DnsResolution"};
+   for(int i=0; i<MaxLatency; ++i)
+   {
+      if(i)
+      {
+         strm << std::endl;
+      }
+      strm << names[i] << "(us): " << mLatencies[i].snapshot();
+   }
+   return strm;
+}
+
+EncodeStream&
+StatisticsManager::encodeCounters(EncodeStream& strm) const
+{
+   std::map<Data, uint64_t> counters;
+   getCounters(counters);
+   for(std::map<Data, uint64_t>::const_iterator i=counters.begin(); i!=counters.end(); ++i)
+   {
+      if(i!=counters.begin())
+      {
+         strm << " ";
+      }
+      strm << i->first << "=" << i->second;
+   }
+   return strm;
+}
+
 void 
 StatisticsManager::poll()
 {
@@ -44,6 +138,12 @@ StatisticsManager::poll()
    activeTimers = mStack.mTransactionController->getTimerQueueSize();
    activeClientTransactions = mStack.mTransactionController->getNumClientTransactions();
    activeServerTransactions = mStack.mTransactionController->getNumServerTransactions();
+   mStack.mTransactionController->sumUdpBatchStats(udpRxDatagrams, udpRxSyscalls,
+                                                   udpTxDatagrams, udpTxSyscalls);
+#ifdef USE_SSL
+   tlsFullHandshakes = TlsSessionCache::fullHandshakes();
+   tlsResumedHandshakes = TlsSessionCache::resumedHandshakes();
+#endif
 
    // .kw. At last check payload was > 146kB, which seems too large
    // to alloc on stack. Also, the post'd message has reference
@@ -54,7 +154,10 @@ StatisticsManager::poll()
        mPublicPayload = new StatisticsMessage::AtomicPayload;
        // re-used each time, free'd in destructor
    }
-   mPublicPayload->loadIn(*this);
+   {
+      PtrLock lock(mMutex.get());
+      mPublicPayload->loadIn(*this);
+   }
 
    bool postToStack = true;
    StatisticsMessage msg(*mPublicPayload);
@@ -71,6 +174,17 @@ StatisticsManager::poll()
       // let the app do what it wants with it
       mStack.post(msg);
    }
+
+   {
+      Data buffer;
+      {
+         DataStream strm(buffer);
+         encodeLatencies(strm);
+         strm << std::endl << "Counters: ";
+         encodeCounters(strm);
+      }
+      InfoLog(<< "Latencies:" << std::endl << buffer);
+   }
    
    // !bwc! TODO maybe change this? Or is a flexible implementation of 
    // CongestionManager::logCurrentState() enough?
@@ -93,6 +207,7 @@ StatisticsManager::process()
 bool
 StatisticsManager::sent(SipMessage* msg)
 {
+   PtrLock lock(mMutex.get());
    MethodTypes met = msg->method();
 
    if (msg->isRequest())
@@ -121,6 +236,7 @@ StatisticsManager::retransmitted(MethodTypes met,
                                  bool request, 
                                  unsigned int code)
 {
+   PtrLock lock(mMutex.get());
    if(request)
    {
       ++requestsRetransmitted;
@@ -138,6 +254,7 @@ StatisticsManager::retransmitted(MethodTypes met,
 bool
 StatisticsManager::received(SipMessage* msg)
 {
+   PtrLock lock(mMutex.get());
    MethodTypes met = msg->header(h_CSeq).method();
 
    if (msg->isRequest())
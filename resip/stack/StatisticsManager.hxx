@@ -3,9 +3,15 @@
 
 #include "rutil/Timer.hxx"
 #include "rutil/Data.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/LatencyHistogram.hxx"
+#include "rutil/ShardedCounter.hxx"
 #include "resip/stack/StatisticsMessage.hxx"
 #include "resip/stack/StatisticsHandler.hxx"
 
+#include <map>
+#include <memory>
+
 namespace resip
 {
 class SipStack;
@@ -16,6 +22,12 @@ class TransactionController;
    @brief Keeps track of various statistics on the stack's operation, and 
       periodically issues a StatisticsMessage to the TransactionUser (or, if the
       ExternalStatsHandler is set, it will be sent there).
+
+   Besides the counts in StatisticsMessage::Payload, which are gathered by 
+   the transaction layer and published on each poll, it keeps latency 
+   histograms and named counters that can be updated from any thread 
+   without a lock, and read at any time with getLatency() and 
+   getCounters() while the stack runs.
 */
 class StatisticsManager : public StatisticsMessage::Payload
 {
@@ -33,6 +45,14 @@ class StatisticsManager : public StatisticsMessage::Payload
          StatsMemUsed
       } Measurement;
       
+      typedef enum
+      {
+         TransactionSetupTime, // request to first final response
+         FifoWaitTime, // read off the wire to reaching the transaction layer
+         DnsResolutionTime, // start to end of a transaction's DNS lookup
+         MaxLatency
+      } Latency;
+
       StatisticsManager(SipStack& stack, unsigned long intervalSecs=60);
       ~StatisticsManager();
 
@@ -50,11 +70,56 @@ class StatisticsManager : public StatisticsMessage::Payload
          mExternalHandler = handler;
       }
 
+      /**
+         Must be enabled (before the stack starts processing) if counts are
+         going to be updated from more than one thread, as is the case when
+         the transaction layer is sharded.
+      */
+      void setSharedAccess(bool shared);
+
+      /**
+         Records a latency, in microseconds. May be called from any thread.
+      */
+      void recordLatency(Latency which, uint64_t microSec)
+      {
+         mLatencies[which].record(microSec);
+      }
+
+      /**
+         Returns a copy of the histogram for this latency, in microseconds. 
+         May be called from any thread.
+      */
+      LatencyHistogram::Snapshot getLatency(Latency which) const
+      {
+         return mLatencies[which].snapshot();
+      }
+
+      /**
+         Returns the counter with this name, creating it if need be. The 
+         counter lives as long as the StatisticsManager, so callers that bump 
+         it often should look it up once and keep the reference; bumping it 
+         does not take a lock. May be called from any thread.
+
+         Counters are not part of the manager's logical state, so this is 
+         const, for use through SipStack::getStatisticsManager().
+      */
+      ShardedCounter& getCounter(const Data& name) const;
+
+      /**
+         Copies the current value of every counter into counters. May be 
+         called from any thread.
+      */
+      void getCounters(std::map<Data, uint64_t>& counters) const;
+
+      EncodeStream& encodeLatencies(EncodeStream& strm) const;
+      EncodeStream& encodeCounters(EncodeStream& strm) const;
+
    private:
       friend class TransactionState;
       bool sent(SipMessage* msg);
       bool retransmitted(MethodTypes type, bool request, unsigned int code);
       bool received(SipMessage* msg);
+      void zeroOut();
 
       void poll(); // force an update
 
@@ -69,6 +134,15 @@ class StatisticsManager : public StatisticsMessage::Payload
       // published thru both ExternalHandler and posted to stack as message.
       // This payload is mutex protected.
       StatisticsMessage::AtomicPayload *mPublicPayload;
+
+      // Only set when setSharedAccess(true) has been called.
+      std::unique_ptr<Mutex> mMutex;
+
+      LatencyHistogram mLatencies[MaxLatency];
+
+      typedef std::map<Data, std::unique_ptr<ShardedCounter> > CounterMap;
+      mutable Mutex mCountersMutex;
+      mutable CounterMap mCounters;
 };
 
 }
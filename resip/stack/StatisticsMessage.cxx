@@ -121,6 +121,12 @@ StatisticsMessage::Payload::zeroOut()
    activeClientTransactions = 0;
    activeServerTransactions = 0;
    pendingDnsQueries = 0;
+   tlsFullHandshakes = 0;
+   tlsResumedHandshakes = 0;
+   udpRxDatagrams = 0;
+   udpRxSyscalls = 0;
+   udpTxDatagrams = 0;
+   udpTxSyscalls = 0;
    requestsSent = 0;
    responsesSent = 0;
    requestsRetransmitted = 0;
@@ -153,6 +159,12 @@ StatisticsMessage::Payload::operator=(const StatisticsMessage::Payload& rhs)
       activeClientTransactions = rhs.activeClientTransactions;
       activeServerTransactions = rhs.activeServerTransactions;
       pendingDnsQueries = rhs.pendingDnsQueries;
+      tlsFullHandshakes = rhs.tlsFullHandshakes;
+      tlsResumedHandshakes = rhs.tlsResumedHandshakes;
+      udpRxDatagrams = rhs.udpRxDatagrams;
+      udpRxSyscalls = rhs.udpRxSyscalls;
+      udpTxDatagrams = rhs.udpTxDatagrams;
+      udpTxSyscalls = rhs.udpTxSyscalls;
 
       requestsSent = rhs.requestsSent;
       responsesSent = rhs.responsesSent;
@@ -220,6 +232,10 @@ resip::operator<<(EncodeStream& strm, const StatisticsMessage::Payload& stats)
         << " CLIENTTX " << stats.activeClientTransactions
         << " SERVERTX " << stats.activeServerTransactions
         << " TIMERS " << stats.activeTimers
+        << " TLSFULL " << stats.tlsFullHandshakes
+        << " TLSRESUMED " << stats.tlsResumedHandshakes
+        << " UDPRX " << stats.udpRxDatagrams << "/" << stats.udpRxSyscalls
+        << " UDPTX " << stats.udpTxDatagrams << "/" << stats.udpTxSyscalls
         << std::endl
         << "Transaction summary: reqi " << stats.requestsReceived
         << " reqo " << stats.requestsSent
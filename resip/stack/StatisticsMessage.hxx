@@ -35,6 +35,14 @@ class StatisticsMessage : public ApplicationMessage
             unsigned int activeClientTransactions;
             unsigned int activeServerTransactions;
             unsigned int pendingDnsQueries; // .dlb. not implemented
+            unsigned int tlsFullHandshakes; // since startup
+            unsigned int tlsResumedHandshakes; // since startup
+            // UDP datagrams moved, and the system calls that moved them,
+            // since startup; shows how well recvmmsg/sendmmsg batching does
+            unsigned int udpRxDatagrams;
+            unsigned int udpRxSyscalls;
+            unsigned int udpTxDatagrams;
+            unsigned int udpTxSyscalls;
 
             unsigned int requestsSent; // includes retransmissions
             unsigned int responsesSent; // includes retransmissions
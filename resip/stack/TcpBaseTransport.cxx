@@ -394,7 +394,7 @@ TcpBaseTransport::process()
    {
        processAllWriteRequests();
    }
-   mStateMachineFifo.flush();
+   flushStateMacFifo();
 }
 
 void
@@ -413,7 +413,7 @@ TcpBaseTransport::process(FdSet& fdSet)
       processListen();
    }
 
-   mStateMachineFifo.flush();
+   flushStateMacFifo();
 }
 
 void
@@ -7,6 +7,10 @@
 #include "resip/stack/TcpConnection.hxx"
 #include "resip/stack/Tuple.hxx"
 
+#if !defined(WIN32)
+#include <sys/uio.h>
+#endif
+
 using namespace resip;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
@@ -112,6 +116,39 @@ TcpConnection::write( const char* buf, const int count )
    return bytesWritten;
 }
 
+#if !defined(WIN32)
+int
+TcpConnection::writev( const WriteBuffer* buffers, int count )
+{
+   resip_assert(buffers);
+   resip_assert(count > 0 && count <= MaxWriteBuffers);
+
+   struct iovec iov[MaxWriteBuffers];
+   for (int i = 0; i < count; ++i)
+   {
+      iov[i].iov_base = const_cast<char*>(buffers[i].data);
+      iov[i].iov_len = buffers[i].size;
+   }
+
+   int bytesWritten = (int)::writev(getSocket(), iov, count);
+
+   if (bytesWritten == INVALID_SOCKET)
+   {
+      int e = getErrno();
+      if (e == EAGAIN || e == EWOULDBLOCK)
+      {
+          // TCP buffers are backed up - we couldn't write anything - but we shouldn't treat this an error - return we wrote 0 bytes
+          return 0;
+      }
+      InfoLog (<< "Failed writev on " << getSocket() << " " << strerror(e));
+      Transport::error(e);
+      return -1;
+   }
+
+   return bytesWritten;
+}
+#endif
+
 bool 
 TcpConnection::hasDataToRead()
 {
@@ -19,6 +19,12 @@ using namespace std;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::TRANSACTION
 
+#ifdef USE_TIMER_WHEEL
+bool TimerQueueBase::useTimerWheel = true;
+#else
+bool TimerQueueBase::useTimerWheel = false;
+#endif
+
 TransactionTimerQueue::TransactionTimerQueue(Fifo<TimerMessage>& fifo)
    : mFifo(fifo)
 {
@@ -35,20 +41,19 @@ DtlsTimerQueue::~DtlsTimerQueue()
 {
    while(!mTimers.empty())
    {
-      delete mTimers.top().getMessage();
-      mTimers.pop();
+      delete mTimers.front().getMessage();
+      mTimers.pop_front();
    }
 }
 
 #endif
 
-uint64_t
+TransactionTimerQueue::Handle
 TransactionTimerQueue::add(Timer::Type type, const Data& transactionId, unsigned long msOffset)
 {
    TransactionTimer t(msOffset, type, transactionId);
-   mTimers.push(t);
    DebugLog (<< "Adding timer: " << Timer::toData(type) << " tid=" << transactionId << " ms=" << msOffset);
-   return mTimers.top().getWhen();
+   return mTimers.push(t);
 }
 
 #ifdef USE_DTLS
@@ -67,8 +72,8 @@ BaseTimeLimitTimerQueue::~BaseTimeLimitTimerQueue()
 {
    while(!mTimers.empty())
    {
-      delete mTimers.top().getMessage();
-      mTimers.pop();
+      delete mTimers.front().getMessage();
+      mTimers.pop_front();
    }
 }
 
@@ -112,8 +117,8 @@ TuSelectorTimerQueue::~TuSelectorTimerQueue()
 {
    while(!mTimers.empty())
    {
-      delete mTimers.top().getMessage();
-      mTimers.pop();
+      delete mTimers.front().getMessage();
+      mTimers.pop_front();
    }
 }
 
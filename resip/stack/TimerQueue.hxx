@@ -14,10 +14,7 @@
 #include "rutil/Fifo.hxx"
 #include "rutil/TimeLimitFifo.hxx"
 #include "rutil/Timer.hxx"
-
-// .dlb. 
-// to do: timer wheel for transaction-bound timers and a heap for
-// everything longer.
+#include "rutil/TimerWheel.hxx"
 
 namespace resip
 {
@@ -26,14 +23,135 @@ class Message;
 class TransactionMessage;
 class TuSelector;
 
+/**
+   @internal
+   Settings shared by every TimerQueue.
+*/
+class TimerQueueBase
+{
+   public:
+      /// If true, TimerQueues created from then on keep their timers in a
+      /// TimerWheel rather than a binary heap. Defaults to true when the
+      /// stack is built with USE_TIMER_WHEEL.
+      static bool useTimerWheel;
+};
+
+/**
+   @internal
+   @brief The timers of a TimerQueue: a binary heap, or a TimerWheel if
+   TimerQueueBase::useTimerWheel was set when the queue was created.
+*/
+template <class T>
+class TimerStore
+{
+   public:
+      TimerStore()
+         : mWheel(TimerQueueBase::useTimerWheel ? new TimerWheel<T>(Timer::getTimeMs()) : 0)
+      {}
+
+      ~TimerStore()
+      {
+         delete mWheel;
+      }
+
+      /// Identifies a pushed timer for cancel(); 0 if it cannot be cancelled.
+      typedef typename TimerWheel<T>::Handle Handle;
+
+      /// @return a handle for cancel(), which is 0 unless the store is a
+      /// TimerWheel; timers in the heap can only expire.
+      Handle push(const T& timer)
+      {
+         if (mWheel)
+         {
+            return mWheel->push(timer);
+         }
+         mHeap.push(timer);
+         return 0;
+      }
+
+      /// @return false if the timer has already expired or the handle is 0
+      bool cancel(Handle handle)
+      {
+         return mWheel && handle && mWheel->cancel(handle);
+      }
+
+      /// True if the timer has been pushed and has neither expired nor been
+      /// cancelled; always false for a handle of 0.
+      bool contains(Handle handle) const
+      {
+         return mWheel && handle && mWheel->contains(handle);
+      }
+
+      const T& top() const
+      {
+         return mWheel ? mWheel->top() : mHeap.top();
+      }
+
+      void pop()
+      {
+         if (mWheel)
+         {
+            mWheel->pop();
+         }
+         else
+         {
+            mHeap.pop();
+         }
+      }
+
+      /// Some timer, in no particular order; for draining the queue.
+      const T& front() const
+      {
+         return mWheel ? mWheel->front() : mHeap.top();
+      }
+
+      void pop_front()
+      {
+         if (mWheel)
+         {
+            mWheel->pop_front();
+         }
+         else
+         {
+            mHeap.pop();
+         }
+      }
+
+      /// Lets a TimerWheel collect the timers that are due by now; top()
+      /// is then the earliest timer either way.
+      void advance(uint64_t now)
+      {
+         if (mWheel)
+         {
+            mWheel->advance(now);
+         }
+      }
+
+      bool empty() const
+      {
+         return mWheel ? mWheel->empty() : mHeap.empty();
+      }
+
+      size_t size() const
+      {
+         return mWheel ? mWheel->size() : mHeap.size();
+      }
+
+   private:
+      // disabled
+      TimerStore(const TimerStore&);
+      TimerStore& operator=(const TimerStore&);
+
+      typedef std::vector<T, std::allocator<T> > TimerVector;
+      std::priority_queue<T, TimerVector, std::greater<T> > mHeap;
+      TimerWheel<T>* mWheel;
+};
+
 /**
   * @internal
   * @brief This class takes a fifo as a place to where you can write your stuff.
   * When using this in the main loop, call process() on this.
   * During Transaction processing, TimerMessages and SIP messages are generated.
-  * 
-    @todo .dlb. timer wheel for transaction-bound timers and a heap for 
-      everything longer.
   */
 template <class T>
 class TimerQueue
@@ -43,6 +161,23 @@ class TimerQueue
       // thing subclasses must implement.
       virtual void processTimer(const T& timer)=0;
 
+      typedef typename TimerStore<T>::Handle Handle;
+
+      /// @brief removes a timer before it fires, in O(1). Only timers in a
+      /// TimerWheel can be cancelled; elsewhere the handle is 0 and the timer
+      /// simply fires as usual.
+      /// @retval false if the timer has already fired or cannot be cancelled
+      bool cancel(Handle handle)
+      {
+         return mTimers.cancel(handle);
+      }
+
+      /// @brief true while the timer is still waiting to fire.
+      bool isPending(Handle handle) const
+      {
+         return mTimers.contains(handle);
+      }
+
       /// @brief deletes the message associated with the timer as well.
       virtual ~TimerQueue()
       {
@@ -50,7 +185,7 @@ class TimerQueue
          // delete the message associated with the timer
          while (!mTimers.empty())
          {
-            mTimers.pop();
+            mTimers.pop_front();
          }
       }
 
@@ -96,6 +231,7 @@ class TimerQueue
          if (!mTimers.empty())
          {
             uint64_t now=Timer::getTimeMs();
+            mTimers.advance(now);
             while (!mTimers.empty() && !(mTimers.top().getWhen() > now))
             {
                processTimer(mTimers.top());
@@ -149,8 +285,7 @@ class TimerQueue
 #endif
 
    protected:
-      typedef std::vector<T, std::allocator<T> > TimerVector;
-      std::priority_queue<T, TimerVector, std::greater<T> > mTimers;
+      TimerStore<T> mTimers;
 };
 
 /**
@@ -203,7 +338,8 @@ class TransactionTimerQueue : public TimerQueue<TransactionTimer>
 {
    public:
       TransactionTimerQueue(Fifo<TimerMessage>& fifo);
-      uint64_t add(Timer::Type type, const Data& transactionId, unsigned long msOffset);
+      /// @return a handle for cancel(); 0 unless timers are kept in a TimerWheel
+      Handle add(Timer::Type type, const Data& transactionId, unsigned long msOffset);
       virtual void processTimer(const TransactionTimer& timer);
    private:
       Fifo<TimerMessage>& mFifo;
@@ -5,12 +5,15 @@
 #include "resip/stack/AbandonServerTransaction.hxx"
 #include "resip/stack/ApplicationMessage.hxx"
 #include "resip/stack/CancelClientInviteTransaction.hxx"
+#include "resip/stack/ConnectionTerminated.hxx"
 #include "resip/stack/Helper.hxx"
 #include "resip/stack/AddTransport.hxx"
 #include "resip/stack/RemoveTransport.hxx"
 #include "resip/stack/TerminateFlow.hxx"
 #include "resip/stack/EnableFlowTimer.hxx"
 #include "resip/stack/InvokeAfterSocketCreationFunc.hxx"
+#include "resip/stack/KeepAliveMessage.hxx"
+#include "resip/stack/KeepAlivePong.hxx"
 #include "resip/stack/ZeroOutStatistics.hxx"
 #include "resip/stack/PollStatistics.hxx"
 #include "resip/stack/ShutdownMessage.hxx"
@@ -39,7 +42,8 @@ unsigned int TransactionController::MaxTUFifoTimeDepthSecs = 0;
 
 TransactionController::TransactionController(SipStack& stack, 
                                              AsyncProcessHandler* handler,
-                                             bool useDnsVip) :
+                                             bool useDnsVip,
+                                             unsigned int numShards) :
    mStack(stack),
    mDiscardStrayResponses(true),
    mFixBadDialogIdentifiers(true),
@@ -47,24 +51,80 @@ TransactionController::TransactionController(SipStack& stack,
    mStateMacFifo(handler),
    mStateMacFifoOutBuffer(mStateMacFifo),
    mCongestionManager(0),
-   mTuSelector(stack.mTuSelector),
-   mTransportSelector(mStateMacFifo,
-                      stack.getSecurity(),
-                      stack.getDnsStub(),
-                      stack.getCompression(),
-                      useDnsVip),
    mTimers(mTimerFifo),
+   mTuSelector(stack.mTuSelector),
+   mOwnTransportSelector(new TransportSelector(mStateMacFifo,
+                                               stack.getSecurity(),
+                                               stack.getDnsStub(),
+                                               stack.getCompression(),
+                                               useDnsVip)),
+   mTransportSelector(*mOwnTransportSelector),
    mShuttingDown(false),
    mStatsManager(stack.mStatsManager),
-   mHostname(DnsUtil::getLocalHostName())
+   mBadRequestsRejected(mStatsManager.getCounter("BadRequestsRejected")),
+   mUnhandledRequestsRejected(mStatsManager.getCounter("UnhandledRequestsRejected")),
+   mStrayResponsesDiscarded(mStatsManager.getCounter("StrayResponsesDiscarded")),
+   mStrayResponsesForwarded(mStatsManager.getCounter("StrayResponsesForwarded")),
+   mTransmitsUnsent(mStatsManager.getCounter("TransmitsUnsent")),
+   mHostname(DnsUtil::getLocalHostName()),
+   mShardIndex(0)
 {
    mStateMacFifo.setDescription("TransactionController::mStateMacFifo");
+
+   if(numShards > 1)
+   {
+      std::vector<Fifo<TransactionMessage>*> fifos(1, &mStateMacFifo);
+      for(unsigned int i = 1; i < numShards; ++i)
+      {
+         mShards.push_back(std::unique_ptr<TransactionController>(new TransactionController(*this, handler, i)));
+         fifos.push_back(&mShards.back()->mStateMacFifo);
+      }
+      mTransportSelector.setTransactionShardFifos(fifos);
+      mStatsManager.setSharedAccess(true);
+      InfoLog(<< "Transaction layer running with " << numShards << " shards");
+   }
+}
+
+TransactionController::TransactionController(TransactionController& primary,
+                                             AsyncProcessHandler* handler,
+                                             unsigned int shardIndex) :
+   mStack(primary.mStack),
+   mDiscardStrayResponses(primary.mDiscardStrayResponses),
+   mFixBadDialogIdentifiers(primary.mFixBadDialogIdentifiers),
+   mFixBadCSeqNumbers(primary.mFixBadCSeqNumbers),
+   mStateMacFifo(handler),
+   mStateMacFifoOutBuffer(mStateMacFifo),
+   mCongestionManager(0),
+   mTimers(mTimerFifo),
+   mTuSelector(primary.mTuSelector),
+   mTransportSelector(primary.mTransportSelector),
+   mShuttingDown(false),
+   mStatsManager(primary.mStatsManager),
+   mBadRequestsRejected(primary.mBadRequestsRejected),
+   mUnhandledRequestsRejected(primary.mUnhandledRequestsRejected),
+   mStrayResponsesDiscarded(primary.mStrayResponsesDiscarded),
+   mStrayResponsesForwarded(primary.mStrayResponsesForwarded),
+   mTransmitsUnsent(primary.mTransmitsUnsent),
+   mHostname(primary.mHostname),
+   mShardIndex(shardIndex)
+{
+   mStateMacFifo.setDescription("TransactionController::mStateMacFifo[" + Data(shardIndex) + "]");
 }
 
 #if defined(WIN32) && !defined(__GNUC__)
 #pragma warning( default : 4355 )
 #endif
 
+void
+TransactionController::setLockFreeFifos()
+{
+   mStateMacFifo.setLockFree();
+   for(std::size_t i=0; i < mShards.size(); ++i)
+   {
+      mShards[i]->setLockFreeFifos();
+   }
+}
+
 TransactionController::~TransactionController()
 {
    if(mClientTransactionMap.size())
@@ -99,7 +159,8 @@ TransactionController::process(int timeout)
        //mTimers.empty() && 
        !mStateMacFifoOutBuffer.messageAvailable() && // !dcm! -- see below 
        !mStack.mTUFifo.messageAvailable() &&
-       mTransportSelector.isFinished())
+       mTransportSelector.isFinished() &&
+       getTransactionFifoSize() == 0)
 // !dcm! -- why would one wait for the Tu's fifo to be empty before delivering a
 // shutdown message?
    {
@@ -118,7 +179,7 @@ TransactionController::process(int timeout)
 
       // Check if Statistics Manager needs to be polled - note:  all statistic manager polls should happen from the 
       // TransactionController thread / process loop
-      if(mStack.mStatisticsManagerEnabled)
+      if(mShardIndex == 0 && mStack.mStatisticsManagerEnabled)
       {
          mStatsManager.process();
       }
@@ -150,7 +211,10 @@ TransactionController::process(int timeout)
          int runs=16;
          while(message)
          {
-            TransactionState::process(*this, message);
+            if(mShards.empty() || !dispatchToShard(message))
+            {
+               TransactionState::process(*this, message);
+            }
             if(--runs==0)
             {
                break;
@@ -173,22 +237,67 @@ TransactionController::getTimeTillNextProcessMS()
    return mTimers.msTillNextTimer();
 } 
 
+bool
+TransactionController::dispatchToShard(TransactionMessage* message)
+{
+   // Only shard 0 ever has messages posted to it that belong elsewhere; this
+   // happens when something posts directly to SipStack::stateMacFifo().
+   Fifo<TransactionMessage>& fifo = stateMacFifoFor(message);
+   if(&fifo == &mStateMacFifo)
+   {
+      return false;
+   }
+   fifo.add(message);
+   return true;
+}
+
+Fifo<TransactionMessage>&
+TransactionController::stateMacFifoFor(TransactionMessage* message)
+{
+   if(mShards.empty())
+   {
+      return mStateMacFifo;
+   }
+
+   // These are not associated with any transaction (and will assert, or
+   // throw for a KeepAliveMessage, which has no Via, if asked for a tid).
+   if(dynamic_cast<ConnectionTerminated*>(message) ||
+      dynamic_cast<KeepAlivePong*>(message) ||
+      dynamic_cast<KeepAliveMessage*>(message))
+   {
+      return mStateMacFifo;
+   }
+
+   unsigned int shard = 0;
+   try
+   {
+      shard = shardFor(message->getTransactionId(), getNumShards());
+   }
+   catch(BaseException&)
+   {
+      // No usable tid; shard 0 will deal with (or drop) this.
+   }
+   return shard == 0 ? mStateMacFifo : mShards[shard-1]->mStateMacFifo;
+}
+
 void
 TransactionController::send(SipMessage* msg)
 {
+   Fifo<TransactionMessage>& fifo = stateMacFifoFor(msg);
    if(msg->isRequest() && 
       msg->method() != ACK && 
-      getRejectionBehavior()!=CongestionManager::NORMAL)
+      mCongestionManager &&
+      mCongestionManager->getRejectionBehaviorForWork(&fifo, Helper::getWorkClass(*msg, mCongestionManager))!=CongestionManager::NORMAL)
    {
       // Need to 503 this.
       SipMessage* resp(Helper::makeResponse(*msg, 503));
-      resp->header(h_RetryAfter).value()=(uint32_t)mStateMacFifo.expectedWaitTimeMilliSec()/1000;
+      resp->header(h_RetryAfter).value()=mCongestionManager->getRetryAfter(&fifo);
       resp->setTransactionUser(msg->getTransactionUser());
       mTuSelector.add(resp, TimeLimitFifo<Message>::InternalElement);
       delete msg;
       return;
    }
-   mStateMacFifo.add(msg);
+   fifo.add(msg);
 }
 
 
@@ -204,30 +313,57 @@ TransactionController::sumTransportFifoSizes() const
    return mTransportSelector.sumTransportFifoSizes();
 }
 
+void
+TransactionController::sumUdpBatchStats(unsigned int& rxDatagrams, unsigned int& rxSyscalls,
+                                        unsigned int& txDatagrams, unsigned int& txSyscalls) const
+{
+   mTransportSelector.sumUdpBatchStats(rxDatagrams, rxSyscalls, txDatagrams, txSyscalls);
+}
+
 unsigned int 
 TransactionController::getTransactionFifoSize() const
 {
    // Should we include the stuff in mStateMacFifoOutBuffer here too? This is
    // likely to be called from other threads...
-   return mStateMacFifo.size();
+   unsigned int size = mStateMacFifo.size();
+   for(std::size_t i = 0; i < mShards.size(); ++i)
+   {
+      size += mShards[i]->getTransactionFifoSize();
+   }
+   return size;
 }
 
 unsigned int 
 TransactionController::getNumClientTransactions() const
 {
-   return mClientTransactionMap.size();
+   unsigned int num = mClientTransactionMap.size();
+   for(std::size_t i = 0; i < mShards.size(); ++i)
+   {
+      num += mShards[i]->getNumClientTransactions();
+   }
+   return num;
 }
 
 unsigned int 
 TransactionController::getNumServerTransactions() const
 {
-   return mServerTransactionMap.size();
+   unsigned int num = mServerTransactionMap.size();
+   for(std::size_t i = 0; i < mShards.size(); ++i)
+   {
+      num += mShards[i]->getNumServerTransactions();
+   }
+   return num;
 }
 
 unsigned int 
 TransactionController::getTimerQueueSize() const
 {
-   return mTimers.size();
+   unsigned int size = mTimers.size();
+   for(std::size_t i = 0; i < mShards.size(); ++i)
+   {
+      size += mShards[i]->getTimerQueueSize();
+   }
+   return size;
 }
 
 void 
@@ -256,13 +392,15 @@ void TransactionController::unregisterMarkListener(MarkListener* listener)
 void 
 TransactionController::abandonServerTransaction(const Data& tid)
 {
-   mStateMacFifo.add(new AbandonServerTransaction(tid));
+   TransactionMessage* msg = new AbandonServerTransaction(tid);
+   stateMacFifoFor(msg).add(msg);
 }
 
 void 
 TransactionController::cancelClientInviteTransaction(const Data& tid, const resip::Tokens* reasons)
 {
-   mStateMacFifo.add(new CancelClientInviteTransaction(tid, reasons));
+   TransactionMessage* msg = new CancelClientInviteTransaction(tid, reasons);
+   stateMacFifoFor(msg).add(msg);
 }
 
 void 
@@ -8,6 +8,10 @@
 #include "rutil/CongestionManager.hxx"
 
 #include "rutil/ConsumerFifoBuffer.hxx"
+#include "rutil/ShardedCounter.hxx"
+
+#include <memory>
+#include <vector>
 
 namespace resip
 {
@@ -27,9 +31,25 @@ class TransactionController
       static unsigned int MaxTUFifoSize;
       static unsigned int MaxTUFifoTimeDepthSecs;
 
-      TransactionController(SipStack& stack, AsyncProcessHandler* handler, bool useDnsVip);
+      /**
+         @param numShards The number of transaction shards to run. Each shard
+            owns its own state machine fifo, TransactionMaps and timer queue,
+            so that shards can be given cycles by separate threads. Messages
+            are assigned to a shard by hashing their transaction id. The
+            controller constructed here is always shard 0; it also handles
+            all non-transactional work (adding transports, statistics, etc).
+      */
+      TransactionController(SipStack& stack, AsyncProcessHandler* handler, bool useDnsVip,
+                            unsigned int numShards=1);
       ~TransactionController();
 
+      /**
+         Switches the state machine fifo of every shard to a lock-free queue.
+         Must be called before any threads are started.
+         @see AbstractFifo::setLockFree()
+      */
+      void setLockFreeFifos();
+
       void process(int timeout=0);
       unsigned int getTimeTillNextProcessMS();
 
@@ -45,6 +65,8 @@ class TransactionController
 
       unsigned int getTuFifoSize() const;
       unsigned int sumTransportFifoSizes() const;
+      void sumUdpBatchStats(unsigned int& rxDatagrams, unsigned int& rxSyscalls,
+                            unsigned int& txDatagrams, unsigned int& txSyscalls) const;
       unsigned int getTransactionFifoSize() const;
       unsigned int getNumClientTransactions() const;
       unsigned int getNumServerTransactions() const;
@@ -54,7 +76,10 @@ class TransactionController
       
       void setCongestionManager( CongestionManager *manager ) 
       { 
-         mTransportSelector.setCongestionManager(manager);
+         if(mShardIndex == 0)
+         {
+            mTransportSelector.setCongestionManager(manager);
+         }
          if(mCongestionManager)
          {
             mCongestionManager->unregisterFifo(&mStateMacFifo);
@@ -64,6 +89,10 @@ class TransactionController
          {
             mCongestionManager->registerFifo(&mStateMacFifo);
          }
+         for(std::size_t i=0; i < mShards.size(); ++i)
+         {
+            mShards[i]->setCongestionManager(manager);
+         }
       }
 
       CongestionManager::RejectionBehavior getRejectionBehavior() const
@@ -86,12 +115,20 @@ class TransactionController
       inline void setFixBadDialogIdentifiers(bool pFixBadDialogIdentifiers) 
       {
          mFixBadDialogIdentifiers = pFixBadDialogIdentifiers;
+         for(std::size_t i=0; i < mShards.size(); ++i)
+         {
+            mShards[i]->setFixBadDialogIdentifiers(pFixBadDialogIdentifiers);
+         }
       }
 
       inline bool getFixBadCSeqNumbers() const { return mFixBadCSeqNumbers;} 
       inline void setFixBadCSeqNumbers(bool pFixBadCSeqNumbers)
       {
          mFixBadCSeqNumbers = pFixBadCSeqNumbers;
+         for(std::size_t i=0; i < mShards.size(); ++i)
+         {
+            mShards[i]->setFixBadCSeqNumbers(pFixBadCSeqNumbers);
+         }
       }
 
       void abandonServerTransaction(const Data& tid);
@@ -105,9 +142,37 @@ class TransactionController
 
       void invokeAfterSocketCreationFunc(TransportType type);
 
+      /// Number of transaction shards, including this one (shard 0).
+      unsigned int getNumShards() const { return (unsigned int)mShards.size() + 1; }
+      /// Returns shard i (1 <= i < getNumShards()); shard 0 is this object.
+      TransactionController& getShard(unsigned int i) { return *mShards[i-1]; }
+      unsigned int getShardIndex() const { return mShardIndex; }
+
+      /**
+         Maps a transaction id onto a shard. Every message belonging to a
+         given transaction (including its CANCEL and non-2xx ACK) maps onto the
+         same shard.
+      */
+      static unsigned int shardFor(const Data& tid, unsigned int numShards)
+      {
+         return (numShards > 1 && !tid.empty()) ? (unsigned int)(tid.hash() % numShards) : 0;
+      }
+
    private:
       TransactionController(const TransactionController& rhs);
       TransactionController& operator=(const TransactionController& rhs);
+
+      // Constructs an additional shard; shares the transports, TUs and
+      // statistics of primary.
+      TransactionController(TransactionController& primary,
+                            AsyncProcessHandler* handler,
+                            unsigned int shardIndex);
+
+      // Hands message over to the shard that owns its transaction. Returns
+      // false if this shard is the owner.
+      bool dispatchToShard(TransactionMessage* message);
+      Fifo<TransactionMessage>& stateMacFifoFor(TransactionMessage* message);
+
       SipStack& mStack;
       
       // If true, indicate to the Transaction to ignore responses for which
@@ -136,25 +201,42 @@ class TransactionController
       // and consumed from the same thread.
       Fifo<TimerMessage> mTimerFifo;
 
+      // timers associated with the transactions. When a timer fires, it is
+      // placed in the mStateMacFifo. Declared before the transaction maps,
+      // so that it outlives the TransactionStates that cancel their timers
+      // as they are destroyed.
+      TransactionTimerQueue  mTimers;
+
       // from the sipstack (for convenience)
       TuSelector& mTuSelector;
 
-      // Used to decide which transport to send a sip message on. 
-      TransportSelector mTransportSelector;
+      // Used to decide which transport to send a sip message on. Owned by
+      // shard 0, and shared (under the TransportSelector's lock) by the
+      // other shards.
+      std::unique_ptr<TransportSelector> mOwnTransportSelector;
+      TransportSelector& mTransportSelector;
 
       // stores all of the transactions that are currently active in this stack 
       TransactionMap mClientTransactionMap;
       TransactionMap mServerTransactionMap;
 
-      // timers associated with the transactions. When a timer fires, it is
-      // placed in the mStateMacFifo
-      TransactionTimerQueue  mTimers;
-
       bool mShuttingDown;
       
       StatisticsManager& mStatsManager;
+
+      // Bumped on every shard's message paths, so looked up once (and
+      // shared by all shards) rather than by name each time.
+      ShardedCounter& mBadRequestsRejected;
+      ShardedCounter& mUnhandledRequestsRejected;
+      ShardedCounter& mStrayResponsesDiscarded;
+      ShardedCounter& mStrayResponsesForwarded;
+      ShardedCounter& mTransmitsUnsent;
       
       Data mHostname;
+
+      const unsigned int mShardIndex;
+      // Additional shards (1..n-1); only populated on shard 0.
+      std::vector<std::unique_ptr<TransactionController> > mShards;
       
       friend class SipStack; // for debug only
       friend class StatelessHandler;
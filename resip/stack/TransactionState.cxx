@@ -2,6 +2,8 @@
 #include "config.h"
 #endif
 
+#include <algorithm>
+
 #include "resip/stack/AbandonServerTransaction.hxx"
 #include "resip/stack/CancelClientInviteTransaction.hxx"
 #include "resip/stack/AddTransport.hxx"
@@ -70,7 +72,9 @@ TransactionState::TransactionState(TransactionController& controller, Machine m,
    mTransactionUser(tu),
    mFailureReason(TransportFailure::None),
    mFailureSubCode(0),
-   mTcpConnectTimerStarted(false)
+   mTcpConnectTimerStarted(false),
+   mStartTimeMicroSec(Timer::getTimeMicroSec()),
+   mDnsStartTimeMicroSec(0)
 {
    StackLog (<< "Creating new TransactionState: " << *this);
 }
@@ -109,13 +113,14 @@ TransactionState::handleInternalCancel(SipMessage* cancel,
    cancel->header(h_Vias).front().param(p_branch) = clientInvite.mNextTransmission->const_header(h_Vias).front().param(p_branch);
    state->processClientNonInvite(cancel);
    // for the INVITE in case we never get a 487
-   clientInvite.mController.mTimers.add(Timer::TimerCleanUp, clientInvite.mId, 128*Timer::T1);
+   clientInvite.addTimer(Timer::TimerCleanUp, 128*Timer::T1);
 }
 
 bool
 TransactionState::handleBadRequest(const resip::SipMessage& badReq, TransactionController& controller)
 {
    resip_assert(badReq.isRequest() && badReq.method() != ACK);
+   ++controller.mBadRequestsRejected;
    try
    {
       SipMessage* error = Helper::makeResponse(badReq,400);
@@ -159,6 +164,11 @@ TransactionState::~TransactionState()
 
    //StackLog (<< "Deleting TransactionState " << mId << " : " << this);
    erase(mId);
+
+   for (std::vector<uint64_t>::const_iterator i = mTimerHandles.begin(); i != mTimerHandles.end(); ++i)
+   {
+      mController.mTimers.cancel(*i);
+   }
    
    delete mNextTransmission;
    delete mMethodText;
@@ -189,6 +199,7 @@ TransactionState::processSipMessageAsNew(SipMessage* sip, TransactionController&
             // Uri scheme, we should be returning a 416, for example.
             // ?bwc? Um, should we _really_ be doing this statelessly?
             InfoLog( << "No TU found for message: " << sip->brief());               
+            ++controller.mUnhandledRequestsRejected;
             SipMessage* noMatch = Helper::makeResponse(*sip, 500);
             Tuple target(sip->getSource());
 
@@ -243,7 +254,7 @@ TransactionState::processSipMessageAsNew(SipMessage* sip, TransactionController&
             else
             {
                //StackLog(<<" adding T100 timer (INV)");
-               controller.mTimers.add(Timer::TimerTrying, tid, Timer::T100);
+               state->addTimer(Timer::TimerTrying, Timer::T100);
             }
             state->sendToTU(sip);
             return true;
@@ -322,7 +333,7 @@ TransactionState::processSipMessageAsNew(SipMessage* sip, TransactionController&
                                                             Data::Empty,
                                                             tu);
             state->add(state->mId);
-            state->mController.mTimers.add(Timer::TimerStateless, state->mId, Timer::TS );
+            state->addTimer(Timer::TimerStateless, Timer::TS );
             state->processStateless(sip);
          }
          else if (method == CANCEL)
@@ -380,11 +391,13 @@ TransactionState::processSipMessageAsNew(SipMessage* sip, TransactionController&
       if (controller.mDiscardStrayResponses)
       {
          InfoLog (<< "discarding stray response: " << sip->brief());
+         ++controller.mStrayResponsesDiscarded;
          return false;
       }
       else
       {
          StackLog (<< "forwarding stateless response: " << sip->brief());
+         ++controller.mStrayResponsesForwarded;
          TransactionState* state = 
             new TransactionState(controller, 
                                  Stateless, 
@@ -394,7 +407,7 @@ TransactionState::processSipMessageAsNew(SipMessage* sip, TransactionController&
                                  sip->methodStr(),
                                  tu);
          state->add(state->mId);
-         state->mController.mTimers.add(Timer::TimerStateless, state->mId, Timer::TS );
+         state->addTimer(Timer::TimerStateless, Timer::TS );
          state->processStateless(sip);
       }
    }
@@ -540,6 +553,12 @@ TransactionState::process(TransactionController& controller,
       if(controller.mStack.statisticsManagerEnabled() && sip->isExternal())
       {
          controller.mStatsManager.received(sip);
+         uint64_t now=Timer::getTimeMicroSec();
+         if(now > sip->getCreatedTimeMicroSec())
+         {
+            controller.mStatsManager.recordLatency(StatisticsManager::FifoWaitTime,
+                                                   now-sip->getCreatedTimeMicroSec());
+         }
       }
       
       // .bwc. Check for error conditions we can respond to.
@@ -840,7 +859,11 @@ TransactionState::processTimer(TransactionController& controller,
 {
    Data tid = message->getTransactionId();
 
-   if(controller.getRejectionBehavior()==CongestionManager::REJECTING_NON_ESSENTIAL)
+   TransactionState* state = 0;
+   if (message->isClientTransaction()) state = controller.mClientTransactionMap.find(tid);
+   else state = controller.mServerTransactionMap.find(tid);
+
+   if(state && controller.getRejectionBehavior()==CongestionManager::REJECTING_NON_ESSENTIAL)
    {
       // .bwc. State machine fifo is backed up; we probably should not be 
       // retransmitting anything right now. If we have a retransmit timer, 
@@ -848,23 +871,20 @@ TransactionState::processTimer(TransactionController& controller,
       switch(message->getType())
       {
          case Timer::TimerA: // doubling
-            controller.mTimers.add(Timer::TimerA, 
-                                    tid, 
-                                    message->getDuration()*2);
+            state->addTimer(Timer::TimerA, 
+                            message->getDuration()*2);
             delete message;
             return;
          case Timer::TimerE1:// doubling, until T2
          case Timer::TimerG: // doubling, until T2
-            controller.mTimers.add(message->getType(), 
-                                    tid, 
-                                    resipMin(message->getDuration()*2,
-                                             Timer::T2));
+            state->addTimer(message->getType(), 
+                            resipMin(message->getDuration()*2,
+                                     Timer::T2));
             delete message;
             return;
          case Timer::TimerE2:// just reset
-            controller.mTimers.add(Timer::TimerE2, 
-                                    tid, 
-                                    Timer::T2);
+            state->addTimer(Timer::TimerE2, 
+                            Timer::T2);
             delete message;
             return;
          default:
@@ -872,10 +892,6 @@ TransactionState::processTimer(TransactionController& controller,
       }
    }
 
-   TransactionState* state = 0;
-   if (message->isClientTransaction()) state = controller.mClientTransactionMap.find(tid);
-   else state = controller.mServerTransactionMap.find(tid);
-   
    if (state) // found transaction for timer
    {
       StackLog (<< "Found matching transaction for " << message->brief() << " -> " << *state);
@@ -916,6 +932,22 @@ TransactionState::processTimer(TransactionController& controller,
 
 }
 
+void
+TransactionState::addTimer(Timer::Type type, unsigned long msOffset)
+{
+   TransactionTimerQueue::Handle handle = mController.mTimers.add(type, mId, msOffset);
+   if (handle)
+   {
+      // Forget the timers that have fired, so this holds only the few that
+      // are running.
+      TransactionTimerQueue& timers = mController.mTimers;
+      mTimerHandles.erase(std::remove_if(mTimerHandles.begin(), mTimerHandles.end(),
+                                         [&timers](uint64_t h) { return !timers.isPending(h); }),
+                          mTimerHandles.end());
+      mTimerHandles.push_back(handle);
+   }
+}
+
 void
 TransactionState::startServerNonInviteTimerTrying(SipMessage& sip, const Data& tid)
 {
@@ -927,7 +959,7 @@ TransactionState::startServerNonInviteTimerTrying(SipMessage& sip, const Data& t
       while(duration*2<Timer::T2) duration = duration * 2;
    }
    resetNextTransmission(make100(&sip));  // Store for use when timer expires
-   mController.mTimers.add(Timer::TimerTrying, tid, duration );  // Start trying timer so that we can send 100 to NITs as recommened in RFC4320
+   addTimer(Timer::TimerTrying, duration );  // Start trying timer so that we can send 100 to NITs as recommened in RFC4320
 }
 
 void
@@ -1033,7 +1065,7 @@ TransactionState::processClientNonInvite(TransactionMessage* msg)
       SipMessage* sip = dynamic_cast<SipMessage*>(msg);
       resetNextTransmission(sip);
       saveOriginalContactAndVia(*sip);
-      mController.mTimers.add(Timer::TimerF, mId, Timer::TF);
+      addTimer(Timer::TimerF, Timer::TF);
       sendCurrentToWire();
    }
    else if (isResponse(msg) && isFromWire(msg)) // from the wire
@@ -1050,7 +1082,7 @@ TransactionState::processClientNonInvite(TransactionMessage* msg)
             // Should we restart the E2 timer though?  If so, we need to use somekind of timer sequence number so that previous E2 timers get discarded.
             if (!mIsReliable && mState == Trying)
             {
-               mController.mTimers.add(Timer::TimerE2, mId, Timer::T2 );
+               addTimer(Timer::TimerE2, Timer::T2 );
             }
             mState = Proceeding;
             sendToTU(msg); // don't delete            
@@ -1086,7 +1118,7 @@ TransactionState::processClientNonInvite(TransactionMessage* msg)
          else if (mState != Completed) // prevent TimerK reproduced
          {
             mState = Completed;
-            mController.mTimers.add(Timer::TimerK, mId, Timer::T4 );
+            addTimer(Timer::TimerK, Timer::T4 );
             // !bwc! Got final response in NIT. We don't need to do anything
             // except quietly absorb retransmissions. Dump all state.
             if(mDnsResult)
@@ -1116,7 +1148,7 @@ TransactionState::processClientNonInvite(TransactionMessage* msg)
             {
                unsigned long d = timer->getDuration();
                if (d < Timer::T2) d *= 2;
-               mController.mTimers.add(Timer::TimerE1, mId, d);
+               addTimer(Timer::TimerE1, d);
                StackLog (<< "Transmitting current message");
                sendCurrentToWire();
                delete timer;
@@ -1131,7 +1163,7 @@ TransactionState::processClientNonInvite(TransactionMessage* msg)
          case Timer::TimerE2:
             if (mState == Proceeding)
             {
-               mController.mTimers.add(Timer::TimerE2, mId, Timer::T2);
+               addTimer(Timer::TimerE2, Timer::T2);
                StackLog (<< "Transmitting current message");
                sendCurrentToWire();
                delete timer;
@@ -1231,7 +1263,7 @@ TransactionState::processClientInvite(TransactionMessage* msg)
             {
                resetNextTransmission(sip);
                saveOriginalContactAndVia(*sip);
-               mController.mTimers.add(Timer::TimerB, mId, Timer::TB );
+               addTimer(Timer::TimerB, Timer::TB );
                sendCurrentToWire();
             }
             else
@@ -1323,7 +1355,7 @@ TransactionState::processClientInvite(TransactionMessage* msg)
                }
                StackLog (<< "Received 2xx on client invite transaction");
                StackLog (<< *this);
-               mController.mTimers.add(Timer::TimerStaleClient, mId, Timer::TS );
+               addTimer(Timer::TimerStaleClient, Timer::TS );
             }
             else if (code >= 300)
             {
@@ -1361,7 +1393,7 @@ TransactionState::processClientInvite(TransactionMessage* msg)
                      // reliable, if transport is Unreliable then Fire the Timer D which 
                      // take care of re-Transmission of ACK 
                      mState = Completed;
-                     mController.mTimers.add(Timer::TimerD, mId, Timer::TD );
+                     addTimer(Timer::TimerD, Timer::TD );
                      SipMessage* ack = Helper::makeFailureAck(*mNextTransmission, *sip);
                      mNextTransmission->copyOutboundDecoratorsToStackFailureAck(*ack);
                      resetNextTransmission(ack);
@@ -1428,7 +1460,7 @@ TransactionState::processClientInvite(TransactionMessage* msg)
                unsigned long d = timer->getDuration()*2;
                // TimerA is supposed to double with each retransmit RFC3261 17.1.1          
 
-               mController.mTimers.add(Timer::TimerA, mId, d);
+               addTimer(Timer::TimerA, d);
                DebugLog (<< "Retransmitting INVITE ");
                sendCurrentToWire();
             }
@@ -1631,7 +1663,7 @@ TransactionState::processServerNonInvite(TransactionMessage* msg)
             if (mState == Trying || mState == Proceeding)
             {
                mState = Completed;
-               mController.mTimers.add(Timer::TimerJ, mId, 64*Timer::T1 );
+               addTimer(Timer::TimerJ, 64*Timer::T1 );
                resetNextTransmission(sip);
                sendCurrentToWire();
             }
@@ -1721,7 +1753,7 @@ TransactionState::processServerNonInvite(TransactionMessage* msg)
             // retransmission comes in. In the meantime, set up timers for
             // transaction termination.
             mState = Completed;
-            mController.mTimers.add(Timer::TimerJ, mId, 64*Timer::T1 );
+            addTimer(Timer::TimerJ, 64*Timer::T1 );
          }
       }
       delete msg;
@@ -1756,10 +1788,10 @@ TransactionState::processServerInvite(TransactionMessage* msg)
                mAckIsValid=true;
                resetNextTransmission(Helper::makeResponse(*sip, 500));
                mState = Completed;
-               mController.mTimers.add(Timer::TimerH, mId, Timer::TH );
+               addTimer(Timer::TimerH, Timer::TH );
                if (!mIsReliable)
                {
-                  mController.mTimers.add(Timer::TimerG, mId, Timer::T1 );
+                  addTimer(Timer::TimerG, Timer::T1 );
                }
                sendCurrentToWire();
                delete msg;
@@ -1810,7 +1842,7 @@ TransactionState::processServerInvite(TransactionMessage* msg)
                {
                   //StackLog (<< "Received ACK in Completed (unreliable) - confirmed, start Timer I");
                   mState = Confirmed;
-                  mController.mTimers.add(Timer::TimerI, mId, Timer::T4 );
+                  addTimer(Timer::TimerI, Timer::T4 );
                   // !bwc! Got an ACK/failure; we can stop retransmitting
                   // our failure response now.
                   resetNextTransmission(0);
@@ -1885,7 +1917,7 @@ TransactionState::processServerInvite(TransactionMessage* msg)
                   // source Tuple that the request was received on. 
                   //terminateServerTransaction(mId);
                   mMachine = ServerStale;
-                  mController.mTimers.add(Timer::TimerStaleServer, mId, Timer::TS );
+                  addTimer(Timer::TimerStaleServer, Timer::TS );
                }
                else
                {
@@ -1911,10 +1943,10 @@ TransactionState::processServerInvite(TransactionMessage* msg)
                   StackLog (<< "Received failed response in Trying or Proceeding. Start Timer H, move to completed." << *this);
                   resetNextTransmission(sip);
                   mState = Completed;
-                  mController.mTimers.add(Timer::TimerH, mId, Timer::TH );
+                  addTimer(Timer::TimerH, Timer::TH );
                   if (!mIsReliable)
                   {
-                     mController.mTimers.add(Timer::TimerG, mId, Timer::T1 );
+                     addTimer(Timer::TimerG, Timer::T1 );
                   }
                   sendCurrentToWire(); // don't delete msg
                }
@@ -1952,7 +1984,7 @@ TransactionState::processServerInvite(TransactionMessage* msg)
             {
                StackLog (<< "TimerG fired. retransmit, and re-add TimerG");
                sendCurrentToWire();
-               mController.mTimers.add(Timer::TimerG, mId, resipMin(Timer::T2, timer->getDuration()*2) );  //  TimerG is supposed to double - up until a max of T2 RFC3261 17.2.1
+               addTimer(Timer::TimerG, resipMin(Timer::T2, timer->getDuration()*2) );  //  TimerG is supposed to double - up until a max of T2 RFC3261 17.2.1
             }
             break;
 
@@ -2021,10 +2053,10 @@ TransactionState::processServerInvite(TransactionMessage* msg)
             mAckIsValid=true;
             StackLog (<< "Received failed response in Trying or Proceeding. Start Timer H, move to completed." << *this);
             mState = Completed;
-            mController.mTimers.add(Timer::TimerH, mId, Timer::TH );
+            addTimer(Timer::TimerH, Timer::TH );
             if (!mIsReliable)
             {
-               mController.mTimers.add(Timer::TimerG, mId, Timer::T1 );
+               addTimer(Timer::TimerG, Timer::T1 );
             }
          }
          else
@@ -2397,6 +2429,7 @@ TransactionState::processTransportFailure(TransactionMessage* msg)
             case DnsResult::Pending:
                InfoLog(<< "We have a DNS query pending.");
                mPendingOperation=Dns;
+               mDnsStartTimeMicroSec=Timer::getTimeMicroSec();
                restoreOriginalContactAndVia();
                mMsgToRetransmit.clear();
                break;
@@ -2431,7 +2464,7 @@ TransactionState::processTcpConnectState(TransactionMessage* msg)
        (mState == Trying || mState == Calling))
    {
       // Start Timer
-      mController.mTimers.add(Timer::TcpConnectTimer, mId, Timer::TcpConnectTimeout);
+      addTimer(Timer::TcpConnectTimer, Timer::TcpConnectTimeout);
       mTcpConnectTimerStarted = true;
    }
    else if (tcpConnectState->getState() == TcpConnectState::Connected &&
@@ -2481,7 +2514,14 @@ TransactionState::handleSync(DnsResult* result)  // !slg! it is strange that we
    if (mPendingOperation == Dns)
    {
       resip_assert(mDnsResult);
-      switch (mDnsResult->available())
+      DnsResult::Type available=mDnsResult->available();
+      if(available != DnsResult::Pending && mDnsStartTimeMicroSec)
+      {
+         recordLatency(StatisticsManager::DnsResolutionTime, mDnsStartTimeMicroSec);
+         mDnsStartTimeMicroSec=0;
+      }
+
+      switch (available)
       {
          case DnsResult::Available:
             mPendingOperation=None;
@@ -2509,6 +2549,19 @@ TransactionState::handleSync(DnsResult* result)  // !slg! it is strange that we
    }
 }
 
+void
+TransactionState::recordLatency(StatisticsManager::Latency which, uint64_t startTimeMicroSec) const
+{
+   if(mController.mStack.statisticsManagerEnabled())
+   {
+      uint64_t now=Timer::getTimeMicroSec();
+      if(now > startTimeMicroSec)
+      {
+         mController.mStatsManager.recordLatency(which, now-startTimeMicroSec);
+      }
+   }
+}
+
 void
 TransactionState::processReliability(TransportType type)
 {
@@ -2523,11 +2576,11 @@ TransactionState::processReliability(TransportType type)
             switch (mMachine)
             {
                case ClientNonInvite:
-                  mController.mTimers.add(Timer::TimerE1, mId, Timer::T1 );
+                  addTimer(Timer::TimerE1, Timer::T1 );
                   break;
                   
                case ClientInvite:
-                  mController.mTimers.add(Timer::TimerA, mId, Timer::T1 );
+                  addTimer(Timer::TimerA, Timer::T1 );
                   break;
 
                default:
@@ -2640,6 +2693,7 @@ TransactionState::sendCurrentToWire()
                   resip_assert(mMethod!=CANCEL); // .bwc. mTarget should be set in this case.
                   mDnsResult = mController.mTransportSelector.createDnsResult(this);
                   mPendingOperation=Dns;
+                  mDnsStartTimeMicroSec=Timer::getTimeMicroSec();
                   mController.mTransportSelector.dnsResolve(mDnsResult, sip);
                }
                else // ... but our DNS query isn't done yet.
@@ -2706,6 +2760,10 @@ TransactionState::sendCurrentToWire()
       {
          onSendSuccess();
       }
+      else if (mPendingOperation != Dns)
+      {
+         ++mController.mTransmitsUnsent;
+      }
    }
    else
    {
@@ -2723,6 +2781,13 @@ TransactionState::onSendSuccess()
       mController.mStatsManager.sent(sip);
    }
 
+   if(sip->isResponse() && sip->const_header(h_StatusLine).statusCode() >= 200 &&
+      mStartTimeMicroSec)
+   {
+      recordLatency(StatisticsManager::TransactionSetupTime, mStartTimeMicroSec);
+      mStartTimeMicroSec=0;
+   }
+
    mCurrentMethodType = sip->method();
    if(sip->isResponse())
    {
@@ -2743,6 +2808,13 @@ void
 TransactionState::sendToTU(TransactionMessage* msg)
 {
    SipMessage* sipMsg = dynamic_cast<SipMessage*>(msg);
+   if (sipMsg && sipMsg->isResponse() && sipMsg->isExternal() && mStartTimeMicroSec &&
+       sipMsg->const_header(h_StatusLine).statusCode() >= 200)
+   {
+      recordLatency(StatisticsManager::TransactionSetupTime, mStartTimeMicroSec);
+      mStartTimeMicroSec=0;
+   }
+
    if (sipMsg && sipMsg->isResponse() && mDnsResult)
    {
       // whitelisting rules.
@@ -2780,7 +2852,14 @@ TransactionState::sendToTU(TransactionMessage* msg)
    }
 
    CongestionManager::RejectionBehavior behavior=CongestionManager::NORMAL;
-   behavior=mController.mTuSelector.getRejectionBehavior(mTransactionUser);
+   if(sipMsg)
+   {
+      behavior=mController.mTuSelector.getRejectionBehavior(mTransactionUser, *sipMsg);
+   }
+   else
+   {
+      behavior=mController.mTuSelector.getRejectionBehavior(mTransactionUser);
+   }
 
    if(behavior!=CongestionManager::NORMAL)
    {
@@ -2806,7 +2885,7 @@ TransactionState::sendToTU(TransactionMessage* msg)
                SipMessage* response(Helper::makeResponse(*sipMsg, 503));
                delete sipMsg;
                
-               uint16_t retryAfter=mController.mTuSelector.getExpectedWait(mTransactionUser);
+               uint32_t retryAfter=mController.mTuSelector.getRetryAfter(mTransactionUser);
                response->header(h_RetryAfter).value()=retryAfter;
                response->setFromTU();
                if(mMethod==INVITE)
@@ -3,9 +3,11 @@
 
 #include <iosfwd>
 #include <memory>
+#include <vector>
 #include "rutil/dns/DnsHandler.hxx"
 #include "resip/stack/MethodTypes.hxx"
 #include "resip/stack/SipMessage.hxx"
+#include "resip/stack/StatisticsManager.hxx"
 #include "resip/stack/Transport.hxx"
 #include "rutil/HeapInstanceCounter.hxx"
 
@@ -91,9 +93,13 @@ class TransactionState : public DnsHandler
       void processTcpConnectState(TransactionMessage* msg);
       void processNoDnsResults();
       void processReliability(TransportType type);
+      void recordLatency(StatisticsManager::Latency which, uint64_t startTimeMicroSec) const;
       
       void add(const Data& tid);
       void erase(const Data& tid);
+      // Starts a timer for this transaction, to be cancelled if the
+      // transaction goes away before it fires.
+      void addTimer(Timer::Type type, unsigned long msOffset);
       
       bool isClient() const;
    private:
@@ -179,6 +185,10 @@ class TransactionState : public DnsHandler
       std::unique_ptr<NameAddr> mOriginalContact;
       std::unique_ptr<Via> mOriginalVia;
 
+      // Handles of the timers from addTimer() that may not have fired yet;
+      // empty unless the controller keeps its timers in a TimerWheel.
+      std::vector<uint64_t> mTimerHandles;
+
       const Data mId;
       const MethodTypes mMethod;
       Data* mMethodText;
@@ -194,6 +204,10 @@ class TransactionState : public DnsHandler
       int mFailureSubCode;
       bool mTcpConnectTimerStarted;
 
+      // For StatisticsManager latencies; 0 once recorded.
+      uint64_t mStartTimeMicroSec;
+      uint64_t mDnsStartTimeMicroSec;
+
       static uint32_t StatelessIdCounter;
       
       friend EncodeStream& operator<<(EncodeStream& strm, const TransactionState& state);
@@ -154,6 +154,15 @@ class TransactionUser
          return CongestionManager::NORMAL;
       }
       
+      inline CongestionManager::RejectionBehavior getRejectionBehavior(CongestionManager::WorkClass work) const
+      {
+         if(mCongestionManager)
+         {
+            return mCongestionManager->getRejectionBehaviorForWork(&mFifo, work);
+         }
+         return CongestionManager::NORMAL;
+      }
+
       virtual void setCongestionManager(CongestionManager* manager)
       {
          if(mCongestionManager)
@@ -173,6 +182,16 @@ class TransactionUser
       {
          return (uint16_t)mFifo.expectedWaitTimeMilliSec();
       }
+
+      // Retry-After, in seconds, for work rejected due to congestion.
+      virtual uint32_t getRetryAfter() const
+      {
+         if(mCongestionManager)
+         {
+            return mCongestionManager->getRetryAfter(&mFifo);
+         }
+         return (uint32_t)mFifo.expectedWaitTimeMilliSec()/1000;
+      }
       
       // .bwc. This specifies whether the TU can cope with dropped responses
       // (due to congestion). Some TUs may need responses to clean up state,
@@ -17,6 +17,7 @@
 #include "resip/stack/KeepAlivePong.hxx"
 #include "resip/stack/Transport.hxx"
 #include "resip/stack/SipMessage.hxx"
+#include "resip/stack/TransactionController.hxx"
 #include "resip/stack/TransportFailure.hxx"
 #include "resip/stack/Helper.hxx"
 #include "resip/stack/SendData.hxx"
@@ -275,7 +276,7 @@ Transport::fail(const Data& tid, TransportFailure::FailureReason reason, int sub
 {
    if (!tid.empty())
    {
-      mStateMachineFifo.add(new TransportFailure(tid, reason, subCode));
+      stateMacFifoFor(tid).add(new TransportFailure(tid, reason, subCode));
    }
 }
 
@@ -284,10 +285,39 @@ Transport::setTcpConnectState(const Data& tid, TcpConnectState::State state)
 {
     if (!tid.empty())
     {
-        mStateMachineFifo.add(new TcpConnectState(tid, state));
+        stateMacFifoFor(tid).add(new TcpConnectState(tid, state));
     }
 }
 
+void
+Transport::setTransactionShardFifos(const std::vector<Fifo<TransactionMessage>*>& fifos)
+{
+   resip_assert(!fifos.empty() && fifos.front() == &mStateMachineFifo.getFifo());
+   if(mShardFifos.size() + 1 == fifos.size())
+   {
+      // already wired up (SipStack does this before starting a transport's
+      // own thread)
+      return;
+   }
+   mShardFifos.clear();
+   for(std::size_t i = 1; i < fifos.size(); ++i)
+   {
+      mShardFifos.push_back(std::unique_ptr<ProducerFifoBuffer<TransactionMessage> >(
+         new ProducerFifoBuffer<TransactionMessage>(*fifos[i], 8)));
+   }
+}
+
+ProducerFifoBuffer<TransactionMessage>&
+Transport::stateMacFifoFor(const Data& tid)
+{
+   if(mShardFifos.empty())
+   {
+      return mStateMachineFifo;
+   }
+   unsigned int shard = TransactionController::shardFor(tid, (unsigned int)mShardFifos.size() + 1);
+   return shard == 0 ? mStateMachineFifo : *mShardFifos[shard-1];
+}
+
 std::unique_ptr<SendData>
 Transport::makeSendData( const Tuple& dest, const Data& d, const Data& tid, const Data &sigcompId)
 {
@@ -326,6 +356,17 @@ Transport::makeFailedResponse(const SipMessage& msg,
   send(makeSendData(dest, encoded, Data::Empty, remoteSigcompId));
 }
 
+CongestionManager::RejectionBehavior
+Transport::getRejectionBehaviorForIncoming(const SipMessage& msg) const
+{
+   if(mCongestionManager)
+   {
+      return mCongestionManager->getRejectionBehaviorForWork(&mStateMachineFifo.getFifo(),
+                                                             Helper::getWorkClass(msg, mCongestionManager));
+   }
+   return CongestionManager::NORMAL;
+}
+
 std::unique_ptr<SendData>
 Transport::make503(SipMessage& msg, uint16_t retryAfter)
 {
@@ -503,6 +544,20 @@ Transport::pushRxMsgUp(SipMessage* message)
        handler->inboundMessage(message->getSource(), message->getReceivedTransportTuple(), *message);
    }
 
+   if(!mShardFifos.empty())
+   {
+      // Parsing the top Via here (rather than on shard 0) is part of the
+      // point; it is work that no longer happens on a shared thread.
+      try
+      {
+         stateMacFifoFor(message->getTransactionId()).add(message);
+         return;
+      }
+      catch(BaseException&)
+      {
+         // Shard 0 will respond to (or drop) this.
+      }
+   }
    mStateMachineFifo.add(message);
 }
 
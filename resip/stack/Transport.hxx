@@ -15,6 +15,7 @@
 #include <list>
 #include <memory>
 #include <utility>
+#include <vector>
 
 namespace resip
 {
@@ -51,12 +52,19 @@ class FdPollGrp;
  *    Specifies whether this Transport object has its own thread (ie; if
  *    set, the TransportSelector should not run the select/poll loop for
  *    this transport, since that is another thread's job)
+ * REUSEPORT:
+ *    Set SO_REUSEPORT on the socket before binding, so that several
+ *    transports can listen on the same tuple and the kernel spreads
+ *    inbound flows between them. The TransportSelector treats all
+ *    REUSEPORT transports on one tuple as a group. Normally set by
+ *    SipStack::addTransport() when asked for more than one socket.
  */
 #define RESIP_TRANSPORT_FLAG_NOBIND      (1<<0)
 #define RESIP_TRANSPORT_FLAG_RXALL       (1<<1)
 #define RESIP_TRANSPORT_FLAG_TXALL       (1<<2)
 #define RESIP_TRANSPORT_FLAG_TXNOW       (1<<4)
 #define RESIP_TRANSPORT_FLAG_OWNTHREAD   (1<<5)
+#define RESIP_TRANSPORT_FLAG_REUSEPORT   (1<<6)
 
 /**
    @brief The base class for Transport classes.
@@ -284,6 +292,9 @@ class Transport : public FdSetIOObserver
       /// @return net namespace in which Transport is bound
       const Data& netNs() const { return(mTuple.getNetNs()); }
 
+      /// @return the RESIP_TRANSPORT_FLAG_* bits this transport was created with
+      unsigned getTransportFlags() const { return mTransportFlags; }
+
       /**
          @return true here if the subclass has a specific contact
          value that it wishes the TransportSelector to use.
@@ -369,31 +380,45 @@ class Transport : public FdSetIOObserver
          mCongestionManager=manager;
       }
 
-      CongestionManager::RejectionBehavior getRejectionBehaviorForIncoming() const
-      {
-         if(mCongestionManager)
-         {
-            return mCongestionManager->getRejectionBehavior(&mStateMachineFifo.getFifo());
-         }
-         return CongestionManager::NORMAL;
-      }
+      CongestionManager::RejectionBehavior getRejectionBehaviorForIncoming(const SipMessage& msg) const;
 
       void flushStateMacFifo()
       {
           mStateMachineFifo.flush();
+          for(std::size_t i = 0; i < mShardFifos.size(); ++i)
+          {
+             mShardFifos[i]->flush();
+          }
       }
 
+      // Retry-After, in seconds, for incoming work rejected due to congestion.
       uint32_t getExpectedWaitForIncoming() const
       {
+         if(mCongestionManager)
+         {
+            return mCongestionManager->getRetryAfter(&mStateMachineFifo.getFifo());
+         }
          return (uint32_t)mStateMachineFifo.getFifo().expectedWaitTimeMilliSec()/1000;
       }
 
       // called by Connection to deliver a received message
       virtual void pushRxMsgUp(SipMessage* msg);
 
+      /**
+         Called by the TransportSelector (before this transport starts
+         processing) when the transaction layer is split into several
+         shards. Element 0 is the fifo passed in at construction. Received
+         messages, and failures relating to a transaction, are then delivered
+         straight to the fifo of the shard that owns the transaction.
+      */
+      void setTransactionShardFifos(const std::vector<Fifo<TransactionMessage>*>& fifos);
+
       // set the receive buffer length (SO_RCVBUF)
       virtual void setRcvBufLen(int buflen) { };	// make pure?
 
+      // set the number of datagrams read/written per system call
+      virtual void setBatchSize(unsigned int batchSize) { };
+
       inline unsigned int getKey() const {return mTuple.mTransportKey;} 
       inline void setKey(unsigned int pKey) { mTuple.mTransportKey = pKey;} // should only be called once after creation
 
@@ -406,6 +431,11 @@ class Transport : public FdSetIOObserver
       ProducerFifoBuffer<TransactionMessage> mStateMachineFifo; // passed in
       bool mShuttingDown;
 
+      // Buffers for transaction shards 1..n-1 (shard 0 is mStateMachineFifo);
+      // empty unless the transaction layer is sharded.
+      std::vector<std::unique_ptr<ProducerFifoBuffer<TransactionMessage> > > mShardFifos;
+      ProducerFifoBuffer<TransactionMessage>& stateMacFifoFor(const Data& tid);
+
       void setTlsDomain(const Data& domain) { mTlsDomain = domain; }
    private:
       static const Data transportNames[MAX_TRANSPORT];
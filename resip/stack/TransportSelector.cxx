@@ -13,12 +13,16 @@
 #include <netdb.h>
 #endif
 
+#include <algorithm>
+#include <string.h>
+
 #include "resip/stack/NameAddr.hxx"
 #include "resip/stack/Uri.hxx"
 
 #include "resip/stack/ExtensionParameter.hxx"
 #include "resip/stack/Compression.hxx"
 #include "resip/stack/SipMessage.hxx"
+#include "resip/stack/TransactionController.hxx"
 #include "resip/stack/TransactionState.hxx"
 #include "resip/stack/TransportFailure.hxx"
 #include "resip/stack/TransportSelector.hxx"
@@ -32,6 +36,7 @@
 #include "rutil/DataStream.hxx"
 #include "rutil/DnsUtil.hxx"
 #include "rutil/Inserter.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/Logger.hxx"
 #include "rutil/Socket.hxx"
 #include "rutil/FdPoll.hxx"
@@ -67,6 +72,47 @@ using namespace resip;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
 
+namespace
+{
+
+// Holds mShardMutex, which only exists when the transaction layer is
+// sharded, shared or exclusively.  May be released before going out of scope.
+class ShardLock
+{
+   public:
+      ShardLock(RWMutex* mutex, bool exclusive=false) : mMutex(mutex)
+      {
+         if(mMutex)
+         {
+            if(exclusive)
+            {
+               mMutex->writelock();
+            }
+            else
+            {
+               mMutex->readlock();
+            }
+         }
+      }
+      ~ShardLock()
+      {
+         unlock();
+      }
+      void unlock()
+      {
+         if(mMutex)
+         {
+            mMutex->unlock();
+            mMutex = 0;
+         }
+      }
+
+   private:
+      RWMutex* mMutex;
+};
+
+}
+
 TransportSelector::TlsTransportKey::TlsTransportKey(const resip::Data& domainName, const resip::Tuple& tuple) :
    mTuple(tuple)
 {
@@ -114,6 +160,8 @@ TransportSelector::TransportSelector(Fifo<TransactionMessage>& fifo, Security* s
    mDns(dnsStub, useDnsVip),
    mStateMacFifo(fifo),
    mSecurity(security),
+   mTransportGeneration(0),
+   mReusePortNext(0),
    mCompression(compression),
    mSigcompStack (0),
    mPollGrp(0),
@@ -207,11 +255,40 @@ TransportSelector::isFinished() const
    return true;
 }
 
+void
+TransportSelector::setTransactionShardFifos(const std::vector<Fifo<TransactionMessage>*>& fifos)
+{
+   resip_assert(!fifos.empty() && fifos.front() == &mStateMacFifo);
+   resip_assert(mTransports.empty());
+   if(fifos.size() > 1)
+   {
+      mShardFifos = fifos;
+      mShardMutex.reset(new RWMutex);
+      mSourceInterfaceMutex.reset(new Mutex);
+   }
+}
+
+Fifo<TransactionMessage>&
+TransportSelector::stateMacFifoFor(const Data& tid)
+{
+   if(mShardFifos.empty())
+   {
+      return mStateMacFifo;
+   }
+   return *mShardFifos[TransactionController::shardFor(tid, (unsigned int)mShardFifos.size())];
+}
+
 void
 TransportSelector::addTransport(std::unique_ptr<Transport> autoTransport, bool isStackRunning)
 {
+   ShardLock lock(mShardMutex.get(), true /* exclusive */);
    Transport* transport = autoTransport.release();
 
+   if(!mShardFifos.empty())
+   {
+      transport->setTransactionShardFifos(mShardFifos);
+   }
+
    // !bwc! This is a multimap from TransportType/IpVersion to Transport*.
    // Make _extra_ sure that no garbage goes in here.
    if(transport->transport()==TCP)
@@ -257,7 +334,20 @@ TransportSelector::addTransport(std::unique_ptr<Transport> autoTransport, bool i
                transport->netNs());
    tuple.mTransportKey = transport->getKey();
 
-   if(!isSecure(transport->transport()))
+   // An additional SO_REUSEPORT socket on a tuple we already listen on
+   // joins the existing group instead of the tuple maps.
+   bool reusePortSibling = false;
+   if(transport->getTransportFlags() & RESIP_TRANSPORT_FLAG_REUSEPORT)
+   {
+      ReusePortGroupMap::iterator group = mReusePortGroups.find(tuple);
+      reusePortSibling = (group != mReusePortGroups.end() && !group->second.empty());
+   }
+
+   if(reusePortSibling)
+   {
+      DebugLog (<< "Adding transport to SO_REUSEPORT group: " << tuple);
+   }
+   else if(!isSecure(transport->transport()))
    {
       if(mExactTransports.find(tuple) == mExactTransports.end() &&
          mAnyInterfaceTransports.find(tuple) == mAnyInterfaceTransports.end())
@@ -330,9 +420,17 @@ TransportSelector::addTransport(std::unique_ptr<Transport> autoTransport, bool i
       mHasOwnProcessTransports.back()->startOwnProcessing();
    }
 
-   mTypeToTransportMap.insert(TypeToTransportMap::value_type(tuple,transport));
+   if(!reusePortSibling)
+   {
+      mTypeToTransportMap.insert(TypeToTransportMap::value_type(tuple,transport));
+   }
+   if(transport->getTransportFlags() & RESIP_TRANSPORT_FLAG_REUSEPORT)
+   {
+      mReusePortGroups[tuple].push_back(transport);
+   }
    mDns.addTransportType(transport->transport(), transport->ipVersion());
    mTransports[transport->getKey()] = transport;
+   rebuildTransportIndex();
 
    InfoLog(<< "TransportSelector::addTransport:  added transport for tuple=" << tuple << ", key=" << transport->getKey());
 }
@@ -340,6 +438,7 @@ TransportSelector::addTransport(std::unique_ptr<Transport> autoTransport, bool i
 void
 TransportSelector::removeTransport(unsigned int transportKey)
 {
+   ShardLock lock(mShardMutex.get(), true /* exclusive */);
    Transport* transportToRemove = 0;
 
    // Find transport in global map and remove it
@@ -358,11 +457,49 @@ TransportSelector::removeTransport(unsigned int transportKey)
       // notify transport to shutdown
       transportToRemove->shutdown();
 
-      if(!isSecure(transportToRemove->transport()))
+      // If this is one socket of a SO_REUSEPORT group, leave the group. When
+      // it was the member in the tuple maps, the next one takes its place.
+      bool reusePortSibling = false;
+      Transport* promoted = 0;
+      ReusePortGroupMap::iterator group = mReusePortGroups.find(transportToRemove->getTuple());
+      if(group != mReusePortGroups.end())
+      {
+         std::vector<Transport*>& members = group->second;
+         reusePortSibling = (members.front() != transportToRemove);
+         members.erase(std::remove(members.begin(), members.end(), transportToRemove), members.end());
+         if(members.empty())
+         {
+            mReusePortGroups.erase(group);
+         }
+         else if(!reusePortSibling)
+         {
+            promoted = members.front();
+         }
+      }
+
+      if(reusePortSibling)
+      {
+         // not in the tuple maps, but may have ended up in the any port maps
+         rebuildAnyPortTransportMaps();
+      }
+      else if(!isSecure(transportToRemove->transport()))
       {
          // Ensure transport is removed from all containers
          mExactTransports.erase(transportToRemove->getTuple());
          mAnyInterfaceTransports.erase(transportToRemove->getTuple());
+         if(promoted)
+         {
+            if (promoted->interfaceName().empty() ||
+                promoted->getTuple().isAnyInterface() ||
+                promoted->hasSpecificContact() )
+            {
+               mAnyInterfaceTransports[promoted->getTuple()] = promoted;
+            }
+            else
+            {
+               mExactTransports[promoted->getTuple()] = promoted;
+            }
+         }
 
          // In the AnyPort maps 2 transports can end up overwriting each other in these maps - then when we remove one, there may be none left - even though we should have an
          // entry.  The rebuilt method will dig through all transports again and rebuild these maps.
@@ -372,6 +509,10 @@ TransportSelector::removeTransport(unsigned int transportKey)
       {
          TlsTransportKey tlsKey(transportToRemove->tlsDomain(), transportToRemove->getTuple());
          mTlsTransports.erase(tlsKey);
+         if(promoted)
+         {
+            mTlsTransports[tlsKey] = promoted;
+         }
       }
 
       // mTypeToTransportMap is a multimap - make sure to delete only this instance by looking up transportKey, instead of using 
@@ -384,6 +525,11 @@ TransportSelector::removeTransport(unsigned int transportKey)
               break;
           }
       }
+      if(promoted)
+      {
+         mTypeToTransportMap.insert(TypeToTransportMap::value_type(promoted->getTuple(), promoted));
+      }
+      rebuildTransportIndex();
 
       // Remove transport types from Dns list of supported protocols
       // Note:  DNS tracks use counts so that we will only remove this transport type if this is the last of the type to be removed
@@ -446,6 +592,169 @@ TransportSelector::rebuildAnyPortTransportMaps()
     }
 }
 
+void
+TransportSelector::rebuildTransportIndex()
+{
+   mTransportIndex.clear();
+   for (ExactTupleMap::const_iterator it = mExactTransports.begin(); it != mExactTransports.end(); ++it)
+   {
+      mTransportIndex.add(TransportIndex::Exact, it->first, it->second);
+   }
+   for (AnyInterfaceTupleMap::const_iterator it = mAnyInterfaceTransports.begin(); it != mAnyInterfaceTransports.end(); ++it)
+   {
+      mTransportIndex.add(TransportIndex::AnyInterface, it->first, it->second);
+   }
+   for (AnyPortTupleMap::const_iterator it = mAnyPortTransports.begin(); it != mAnyPortTransports.end(); ++it)
+   {
+      mTransportIndex.add(TransportIndex::AnyPort, it->first, it->second);
+   }
+   for (AnyPortAnyInterfaceTupleMap::const_iterator it = mAnyPortAnyInterfaceTransports.begin(); it != mAnyPortAnyInterfaceTransports.end(); ++it)
+   {
+      mTransportIndex.add(TransportIndex::AnyPortAnyInterface, it->first, it->second);
+   }
+   for (TypeToTransportMap::const_iterator it = mTypeToTransportMap.begin(); it != mTypeToTransportMap.end(); ++it)
+   {
+      mTransportIndex.add(TransportIndex::Type, it->first, it->second);
+   }
+   ++mTransportGeneration;
+}
+
+TransportSelector::TransportIndex::Key::Key() :
+   kind(0),
+   transportType(0),
+   family(0),
+   port(0)
+{
+   memset(address, 0, sizeof(address));
+}
+
+TransportSelector::TransportIndex::Key::Key(Kind k, const Tuple& tuple) :
+   kind((unsigned char)k),
+   transportType((unsigned char)tuple.getType()),
+   family(tuple.getSockaddr().sa_family),
+   port(0)
+{
+   memset(address, 0, sizeof(address));
+
+   // Keep what the corresponding map's comparator looks at
+   if (k == Exact || k == AnyInterface)
+   {
+      port = (unsigned short)tuple.getPort();
+   }
+   if (k == Exact || k == AnyPort)
+   {
+      if (family == AF_INET)
+      {
+         memcpy(address, &reinterpret_cast<const sockaddr_in&>(tuple.getSockaddr()).sin_addr, sizeof(in_addr));
+      }
+#ifdef USE_IPV6
+      else if (family == AF_INET6)
+      {
+         memcpy(address, &reinterpret_cast<const sockaddr_in6&>(tuple.getSockaddr()).sin6_addr, sizeof(in6_addr));
+      }
+#endif
+#ifdef USE_NETNS
+      netNs = tuple.getNetNs();
+#endif
+   }
+}
+
+bool
+TransportSelector::TransportIndex::Key::operator==(const Key& rhs) const
+{
+   return kind == rhs.kind &&
+          transportType == rhs.transportType &&
+          family == rhs.family &&
+          port == rhs.port &&
+          memcmp(address, rhs.address, sizeof(address)) == 0
+#ifdef USE_NETNS
+          && netNs == rhs.netNs
+#endif
+          ;
+}
+
+size_t
+TransportSelector::TransportIndex::Key::hash() const
+{
+   // FNV-1a
+   size_t h = 2166136261u;
+   h = (h ^ kind) * 16777619u;
+   h = (h ^ transportType) * 16777619u;
+   h = (h ^ family) * 16777619u;
+   h = (h ^ port) * 16777619u;
+   for (size_t i = 0; i < sizeof(address); ++i)
+   {
+      h = (h ^ address[i]) * 16777619u;
+   }
+#ifdef USE_NETNS
+   h ^= netNs.hash();
+#endif
+   return h;
+}
+
+TransportSelector::TransportIndex::TransportIndex() :
+   mSlots(16),
+   mUsed(0)
+{
+}
+
+void
+TransportSelector::TransportIndex::clear()
+{
+   mSlots.assign(16, Slot());
+   mUsed = 0;
+}
+
+size_t
+TransportSelector::TransportIndex::slotFor(const Key& key) const
+{
+   const size_t mask = mSlots.size() - 1;
+   size_t i = key.hash() & mask;
+   while (mSlots[i].used && !(mSlots[i].key == key))
+   {
+      i = (i + 1) & mask;
+   }
+   return i;
+}
+
+void
+TransportSelector::TransportIndex::add(Kind kind, const Tuple& tuple, Transport* transport)
+{
+   if (2 * (mUsed + 1) > mSlots.size())
+   {
+      std::vector<Slot> old(mSlots.size() * 2);
+      old.swap(mSlots);
+      for (std::vector<Slot>::const_iterator it = old.begin(); it != old.end(); ++it)
+      {
+         if (it->used)
+         {
+            mSlots[slotFor(it->key)] = *it;
+         }
+      }
+   }
+
+   Key key(kind, tuple);
+   Slot& slot = mSlots[slotFor(key)];
+   if (slot.used)
+   {
+      // The tuple maps hold one transport per key, so only the Type entry
+      // (a multimap) gets here; like findTransportByDest(), give up on it.
+      slot.transport = 0;
+      return;
+   }
+   slot.key = key;
+   slot.transport = transport;
+   slot.used = true;
+   ++mUsed;
+}
+
+Transport*
+TransportSelector::TransportIndex::find(Kind kind, const Tuple& tuple) const
+{
+   const Slot& slot = mSlots[slotFor(Key(kind, tuple))];
+   return slot.used ? slot.transport : 0;
+}
+
 void
 TransportSelector::setPollGrp(FdPollGrp *grp)
 {
@@ -612,6 +921,7 @@ TransportSelector::hasDataToSend() const
 DnsResult*
 TransportSelector::createDnsResult(DnsHandler* handler)
 {
+   ShardLock lock(mShardMutex.get());
    return mDns.createDnsResult(handler);
 }
 
@@ -619,6 +929,7 @@ void
 TransportSelector::dnsResolve(DnsResult* result,
                               SipMessage* msg)
 {
+   ShardLock lock(mShardMutex.get());
    // Picking the target destination:
    //   - for request, use forced target if set
    //     otherwise use loose routing behaviour (route or, if none, request-uri)
@@ -807,6 +1118,7 @@ TransportSelector::determineSourceInterface(SipMessage* msg, const Tuple& target
    resip_assert((!(msg->isRequest() && !via.sentHost().empty())) || isSecure(target.getType()));
    if (1)
    {
+      PtrLock lock(mSourceInterfaceMutex.get());
       Tuple source(target);
 #if defined(WIN32) && !defined(NO_IPHLPAPI)
       try
@@ -981,6 +1293,7 @@ TransportSelector::determineSourceInterface(SipMessage* msg, const Tuple& target
 TransportSelector::TransmitState
 TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
 {
+   ShardLock lock(mShardMutex.get());
    resip_assert(msg);
 
    if(msg->mIsDecorated)
@@ -1028,6 +1341,7 @@ TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
 
       if (msg->isRequest())
       {
+         const bool transportPinned = (target.mTransportKey != 0 || target.mFlowKey != 0);
          transport = findTransportByVia(msg, target, source);
          if (!transport)
          {
@@ -1090,6 +1404,14 @@ TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
             }
          }
 
+         if(transport && !transportPinned && !mReusePortGroups.empty())
+         {
+            // Spread new outbound requests over the sockets of a
+            // SO_REUSEPORT group; they all share one tuple, so source and
+            // Via are unaffected.
+            transport = findLeastLoadedTransport(transport);
+         }
+
          target.mTransportKey = transport ? transport->getKey() : 0;
 
          // .bwc. Topmost Via is only filled out in the request case. Also, if
@@ -1361,20 +1683,21 @@ TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
 
          resip_assert(target.mTransportKey == transport->getKey());
 
+         // Decorating and encoding only touch the message, so let the other
+         // shards at the transports meanwhile.
+         const unsigned int transportGeneration = mTransportGeneration;
+         lock.unlock();
+
          // Call back anyone who wants to perform outbound decoration
          msg->callOutboundDecorators(source, target,remoteSigcompId);
 
-         for(auto& handler : transport->getSipMessageLoggingHandlers())
-         {
-            handler->outboundMessage(source, target, *msg);
-         }
-
          std::unique_ptr<SendData> send(new SendData(target,
                                                    resip::Data::Empty,
                                                    msg->getTransactionId(),
                                                    remoteSigcompId));
 
-         send->data.reserve(mAvgBufferSize + mAvgBufferSize/4);
+         const int avgBufferSize = mAvgBufferSize;
+         send->data.reserve(avgBufferSize + avgBufferSize/4);
 
          DataStream str(send->data);
          msg->encode(str);
@@ -1383,7 +1706,7 @@ TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
          // !bwc! Moving average of message size. (Used to intelligently
          // predict how much space to reserve in the buffer, to minimize
          // dynamic resizing.)
-         mAvgBufferSize = (255*mAvgBufferSize + (int)send->data.size()+128)/256;
+         mAvgBufferSize = (255*avgBufferSize + (int)send->data.size()+128)/256;
 
          resip_assert(!send->data.empty());
          DebugLog (<< "Transmitting to " << target
@@ -1392,9 +1715,30 @@ TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
                    << std::endl << std::endl << send->data.escaped()
                    << "sigcomp id=" << remoteSigcompId);
 
+         ShardLock sendLock(mShardMutex.get());
+         if(transportGeneration != mTransportGeneration)
+         {
+            // The transports changed while we were encoding; make sure ours
+            // is still there.
+            transport = findTransportByDest(target);
+            if(!transport)
+            {
+               InfoLog (<< "tid=" << msg->getTransactionId() << " transport to " << target << " was removed");
+               stateMacFifoFor(msg->getTransactionId()).add(new TransportFailure(msg->getTransactionId(), TransportFailure::NoTransport));
+               return Unsent;
+            }
+         }
+
+         for(auto& handler : transport->getSipMessageLoggingHandlers())
+         {
+            handler->outboundMessage(source, target, *msg);
+         }
+
          if(sendData)
          {
             *sendData = *send;
+            sendData->transport = transport;
+            sendData->transportGeneration = mTransportGeneration;
          }
 
          transport->send(std::move(send));
@@ -1403,14 +1747,14 @@ TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
       else
       {
          InfoLog (<< "tid=" << msg->getTransactionId() << " failed to find a transport to " << target);
-         mStateMacFifo.add(new TransportFailure(msg->getTransactionId(), transportFailureReason));
+         stateMacFifoFor(msg->getTransactionId()).add(new TransportFailure(msg->getTransactionId(), transportFailureReason));
          return Unsent;
       }
    }
    catch (Transport::Exception& )
    {
       InfoLog (<< "tid=" << msg->getTransactionId() << " no route to target: " << target);
-      mStateMacFifo.add(new TransportFailure(msg->getTransactionId(), TransportFailure::NoRoute));
+      stateMacFifoFor(msg->getTransactionId()).add(new TransportFailure(msg->getTransactionId(), TransportFailure::NoRoute));
       return Unsent;
    }
 }
@@ -1418,8 +1762,13 @@ TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
 void
 TransportSelector::retransmit(const SendData& data)
 {
+   ShardLock lock(mShardMutex.get());
    resip_assert(data.destination.mTransportKey);
-   Transport* transport = findTransportByDest(data.destination);
+   Transport* transport = data.transport;
+   if(!transport || data.transportGeneration != mTransportGeneration)
+   {
+      transport = findTransportByDest(data.destination);
+   }
 
    // !jf! The previous call to transmit may have blocked or failed (It seems to
    // block in windows when the network is disconnected - don't know why just
@@ -1459,6 +1808,7 @@ TransportSelector::retransmit(const SendData& data)
 void 
 TransportSelector::closeConnection(const Tuple& peer)
 {
+   ShardLock lock(mShardMutex.get());
    Transport* t = findTransportByDest(peer);
    if(t)
    {
@@ -1482,6 +1832,22 @@ TransportSelector::sumTransportFifoSizes() const
    return sum;
 }
 
+void
+TransportSelector::sumUdpBatchStats(unsigned int& rxDatagrams, unsigned int& rxSyscalls,
+                                    unsigned int& txDatagrams, unsigned int& txSyscalls) const
+{
+   rxDatagrams = rxSyscalls = txDatagrams = txSyscalls = 0;
+   ShardLock lock(mShardMutex.get());
+   for(TransportKeyMap::const_iterator it = mTransports.begin(); it != mTransports.end(); it++)
+   {
+      const UdpTransport* udp = dynamic_cast<const UdpTransport*>(it->second);
+      if(udp)
+      {
+         udp->addBatchStats(rxDatagrams, rxSyscalls, txDatagrams, txSyscalls);
+      }
+   }
+}
+
 void 
 TransportSelector::terminateFlow(const resip::Tuple& flow)
 {
@@ -1491,6 +1857,7 @@ TransportSelector::terminateFlow(const resip::Tuple& flow)
 void 
 TransportSelector::enableFlowTimer(const resip::Tuple& flow)
 {
+   ShardLock lock(mShardMutex.get());
    Transport* t = findTransportByDest(flow);
    if(t)
    {
@@ -1506,6 +1873,7 @@ TransportSelector::enableFlowTimer(const resip::Tuple& flow)
 void 
 TransportSelector::invokeAfterSocketCreationFunc(TransportType type)
 {
+   ShardLock lock(mShardMutex.get());
     for (TransportKeyMap::iterator it = mTransports.begin(); it != mTransports.end(); it++)
     {
         if (type == UNKNOWN_TRANSPORT || type == it->second->transport())
@@ -1520,6 +1888,38 @@ TransportSelector::invokeAfterSocketCreationFunc(TransportType type)
     }
 }
 
+Transport*
+TransportSelector::findLeastLoadedTransport(Transport* transport) const
+{
+   ReusePortGroupMap::const_iterator group = mReusePortGroups.find(transport->getTuple());
+   if(group == mReusePortGroups.end() || group->second.size() < 2)
+   {
+      return transport;
+   }
+
+   // Start from a rotating position so that idle sockets share the work
+   // rather than the first one always winning the tie.
+   const std::vector<Transport*>& members = group->second;
+   const std::size_t start = mReusePortNext++ % members.size();
+   Transport* best = 0;
+   unsigned int bestLoad = 0;
+   for(std::size_t n = 0; n < members.size(); ++n)
+   {
+      Transport* candidate = members[(start + n) % members.size()];
+      const unsigned int load = candidate->getFifoSize();
+      if(!best || load < bestLoad)
+      {
+         best = candidate;
+         bestLoad = load;
+         if(load == 0)
+         {
+            break;
+         }
+      }
+   }
+   return best;
+}
+
 Transport*
 TransportSelector::findTransportByDest(const Tuple& target)
 {
@@ -1533,17 +1933,8 @@ TransportSelector::findTransportByDest(const Tuple& target)
    }
    else
    {
-      std::pair<TypeToTransportMap::iterator, TypeToTransportMap::iterator> range(mTypeToTransportMap.equal_range(target));
-
-      if(range.first != range.second) // At least one match
-      {
-         TypeToTransportMap::iterator i=range.first;
-         ++i;
-         if(i==range.second) // Exactly one match
-         {
-            return range.first->second;
-         }
-      }
+      // Only if exactly one transport matches
+      return mTransportIndex.find(TransportIndex::Type, target);
    }
 
    // .bwc. No luck here. Maybe findTransportBySource will end up working.
@@ -1617,11 +2008,11 @@ TransportSelector::findTransportBySource(Tuple& search, const SipMessage* msg) c
    {
       // 1. search for matching port on a specific interface
       {
-         ExactTupleMap::const_iterator i = mExactTransports.find(search);
-         if (i != mExactTransports.end())
+         Transport* transport = mTransportIndex.find(TransportIndex::Exact, search);
+         if (transport)
          {
-            DebugLog(<< "findTransport (exact) => " << *(i->second));
-            return i->second;
+            DebugLog(<< "findTransport (exact) => " << *transport);
+            return transport;
          }
       }
 
@@ -1638,11 +2029,11 @@ TransportSelector::findTransportBySource(Tuple& search, const SipMessage* msg) c
 
       // 3. search for specific port on ANY interface
       {
-         AnyInterfaceTupleMap::const_iterator i = mAnyInterfaceTransports.find(search);
-         if (i != mAnyInterfaceTransports.end())
+         Transport* transport = mTransportIndex.find(TransportIndex::AnyInterface, search);
+         if (transport)
          {
-            DebugLog(<< "findTransport (any interface) => " << *(i->second));
-            return i->second;
+            DebugLog(<< "findTransport (any interface) => " << *transport);
+            return transport;
          }
       }
    }
@@ -1650,11 +2041,11 @@ TransportSelector::findTransportBySource(Tuple& search, const SipMessage* msg) c
    {
       // 1. search for ANY port on specific interface
       {
-         AnyPortTupleMap::const_iterator i = mAnyPortTransports.find(search);
-         if (i != mAnyPortTransports.end())
+         Transport* transport = mTransportIndex.find(TransportIndex::AnyPort, search);
+         if (transport)
          {
-            DebugLog(<< "findTransport (any port, specific interface) => " << *(i->second) << " key: " << (i->first) << " search: " << search);
-            return i->second;
+            DebugLog(<< "findTransport (any port, specific interface) => " << *transport << " search: " << search);
+            return transport;
          }
       }
 
@@ -1671,11 +2062,11 @@ TransportSelector::findTransportBySource(Tuple& search, const SipMessage* msg) c
       // 3. search for ANY port on ANY interface
       {
          //CerrLog(<< "Trying AnyPortAnyInterfaceTupleMap " << mAnyPortAnyInterfaceTransports.size());
-         AnyPortAnyInterfaceTupleMap::const_iterator i = mAnyPortAnyInterfaceTransports.find(search);
-         if (i != mAnyPortAnyInterfaceTransports.end())
+         Transport* transport = mTransportIndex.find(TransportIndex::AnyPortAnyInterface, search);
+         if (transport)
          {
-            DebugLog(<< "findTransport (any port, any interface) => " << *(i->second));
-            return i->second;
+            DebugLog(<< "findTransport (any port, any interface) => " << *transport);
+            return transport;
          }
       }
    }
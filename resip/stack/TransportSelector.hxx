@@ -5,6 +5,7 @@
 #include <sys/select.h>
 #endif
 
+#include <atomic>
 #include <map>
 #include <vector>
 #include <list>
@@ -12,6 +13,8 @@
 #include "rutil/Data.hxx"
 #include "rutil/Fifo.hxx"
 #include "rutil/GenericIPAddress.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/RWMutex.hxx"
 #include "resip/stack/Transport.hxx"
 #include "resip/stack/DnsInterface.hxx"
 #include "rutil/SelectInterruptor.hxx"
@@ -122,10 +125,24 @@ class TransportSelector
       void closeConnection(const Tuple& peer);
 
       unsigned int sumTransportFifoSizes() const;
+      /// Totals of UdpTransport::addBatchStats() over the UDP transports.
+      void sumUdpBatchStats(unsigned int& rxDatagrams, unsigned int& rxSyscalls,
+                            unsigned int& txDatagrams, unsigned int& txSyscalls) const;
 
       unsigned int getTimeTillNextProcessMS();
       Fifo<TransactionMessage>& stateMacFifo() { return mStateMacFifo; }
 
+      /**
+         Called by the TransactionController when the transaction layer is
+         split into several shards; element i is the state machine fifo of
+         shard i, and element 0 must be stateMacFifo(). From this point on,
+         the TransportSelector may be used concurrently by all shards, and
+         every Transport added is told to route received messages directly to
+         the owning shard.
+      */
+      void setTransactionShardFifos(const std::vector<Fifo<TransactionMessage>*>& fifos);
+      const std::vector<Fifo<TransactionMessage>*>& getTransactionShardFifos() const { return mShardFifos; }
+
       void registerMarkListener(MarkListener* listener);
       void unregisterMarkListener(MarkListener* listener);
       void setEnumSuffixes(const std::vector<Data>& suffixes);
@@ -193,9 +210,22 @@ class TransportSelector
       Transport* findTlsTransport(const Data& domain, const Tuple& search) const;
       Tuple determineSourceInterface(SipMessage* msg, const Tuple& dest) const;
       void rebuildAnyPortTransportMaps(void);
+      void rebuildTransportIndex();
+      Transport* findLeastLoadedTransport(Transport* transport) const;
+
+      Fifo<TransactionMessage>& stateMacFifoFor(const Data& tid);
 
       DnsInterface mDns;
       Fifo<TransactionMessage>& mStateMacFifo;
+
+      // Only set when there is more than one transaction shard; see
+      // setTransactionShardFifos().  Shards hold mShardMutex shared while
+      // they look up transports and hand messages to them, and exclusively
+      // to add or remove transports.  determineSourceInterface() shares
+      // its sockets, so is serialized by mSourceInterfaceMutex.
+      std::vector<Fifo<TransactionMessage>*> mShardFifos;
+      std::unique_ptr<RWMutex> mShardMutex;
+      std::unique_ptr<Mutex> mSourceInterfaceMutex;
       Security* mSecurity;// for computing identity header
 
       // specific port and interface
@@ -227,6 +257,74 @@ class TransportSelector
       typedef std::multimap<Tuple, Transport*, Tuple::AnyPortAnyInterfaceCompare> TypeToTransportMap;
       TypeToTransportMap mTypeToTransportMap;
 
+      /**
+         Open-addressed hash table over the tuple maps above, for the
+         lookups made on every outbound message. A key keeps only the Tuple
+         fields that the lookup's map compares, so it finds what the map
+         would. Rebuilt whenever a transport is added or removed.
+      */
+      class TransportIndex
+      {
+         public:
+            enum Kind
+            {
+               Exact,               // mExactTransports
+               AnyInterface,        // mAnyInterfaceTransports
+               AnyPort,             // mAnyPortTransports
+               AnyPortAnyInterface, // mAnyPortAnyInterfaceTransports
+               Type                 // mTypeToTransportMap
+            };
+
+            TransportIndex();
+            void clear();
+            /// A transport added twice under a key's Type entry is ambiguous,
+            /// and found as 0.
+            void add(Kind kind, const Tuple& tuple, Transport* transport);
+            Transport* find(Kind kind, const Tuple& tuple) const;
+
+         private:
+            struct Key
+            {
+               Key();
+               Key(Kind kind, const Tuple& tuple);
+               bool operator==(const Key& rhs) const;
+               size_t hash() const;
+
+               unsigned char kind;
+               unsigned char transportType;
+               unsigned short family;
+               unsigned short port;
+               unsigned char address[16];
+#ifdef USE_NETNS
+               Data netNs;
+#endif
+            };
+            struct Slot
+            {
+               Slot() : transport(0), used(false) {}
+               Key key;
+               Transport* transport;
+               bool used;
+            };
+
+            size_t slotFor(const Key& key) const;
+
+            std::vector<Slot> mSlots; // a power of two in size, at most half used
+            size_t mUsed;
+      };
+      TransportIndex mTransportIndex;
+      // Bumped with every change to the set of transports; see
+      // SendData::transportGeneration.
+      unsigned int mTransportGeneration;
+
+      // RESIP_TRANSPORT_FLAG_REUSEPORT transports listening on the same tuple.
+      // Only the first of each group is in the tuple maps above; the others
+      // are reached by key (mTransports), or picked by
+      // findLeastLoadedTransport() for new outbound requests.
+      typedef std::map<Tuple, std::vector<Transport*> > ReusePortGroupMap;
+      ReusePortGroupMap mReusePortGroups;
+      mutable std::atomic<unsigned int> mReusePortNext;
+
       // fake socket(s) one for each netns, for connect() and route table lookups
       mutable HashMap<Data, Socket> mSockets;
       mutable HashMap<Data, Socket> mSocket6s;
@@ -242,7 +340,7 @@ class TransportSelector
       // epoll support, for sharedprocess transports
       FdPollGrp* mPollGrp;
 
-      int mAvgBufferSize;
+      std::atomic<int> mAvgBufferSize;
       Fifo<Transport> mTransportsToAddRemove;
       std::unique_ptr<SelectInterruptor> mSelectInterruptor;
       FdPollItemHandle mInterruptorHandle;
@@ -1,4 +1,5 @@
 #include "resip/stack/ConnectionTerminated.hxx"
+#include "resip/stack/Helper.hxx"
 #include "resip/stack/KeepAlivePong.hxx"
 #include "resip/stack/TuSelector.hxx"
 #include "resip/stack/TransactionUser.hxx"
@@ -318,6 +319,39 @@ TuSelector::getExpectedWait(TransactionUser* tu) const
    return (uint32_t)mFallBackFifo.expectedWaitTimeMilliSec();
 }
 
+CongestionManager::RejectionBehavior 
+TuSelector::getRejectionBehavior(TransactionUser* tu, const SipMessage& msg) const
+{
+   if(!mCongestionManager)
+   {
+      return CongestionManager::NORMAL;
+   }
+
+   CongestionManager::WorkClass work = Helper::getWorkClass(msg, mCongestionManager);
+
+   if(tu)
+   {
+      return tu->getRejectionBehavior(work);
+   }
+
+   return mCongestionManager->getRejectionBehaviorForWork(&mFallBackFifo, work);
+}
+
+uint32_t 
+TuSelector::getRetryAfter(TransactionUser* tu) const
+{
+   if(tu)
+   {
+      return tu->getRetryAfter();
+   }
+
+   if(mCongestionManager)
+   {
+      return mCongestionManager->getRetryAfter(&mFallBackFifo);
+   }
+   return (uint32_t)mFallBackFifo.expectedWaitTimeMilliSec()/1000;
+}
+
 
 
 /* ====================================================================
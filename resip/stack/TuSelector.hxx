@@ -45,6 +45,11 @@ class TuSelector
       void setCongestionManager(CongestionManager* manager);
       CongestionManager::RejectionBehavior getRejectionBehavior(TransactionUser* tu) const;
       uint32_t getExpectedWait(TransactionUser* tu) const;
+      // As above, for msg's class of work (see Helper::getWorkClass()).
+      CongestionManager::RejectionBehavior getRejectionBehavior(TransactionUser* tu,
+                                                                const SipMessage& msg) const;
+      // Retry-After, in seconds, for work rejected due to congestion at tu.
+      uint32_t getRetryAfter(TransactionUser* tu) const;
 
    private:
       void remove(TransactionUser* tu);
@@ -10,6 +10,7 @@ namespace resip
 TupleMarkManager::MarkType 
 TupleMarkManager::getMarkType(const Tuple& tuple)
 {
+   Lock lock(mMutex);
    ListEntry entry(tuple,0);
    TupleList::iterator i=mList.find(entry);
    
@@ -32,6 +33,7 @@ TupleMarkManager::getMarkType(const Tuple& tuple)
 void 
 TupleMarkManager::mark(const Tuple& tuple,uint64_t expiry,MarkType mark)
 {
+   Lock lock(mMutex);
    // .amr. Notify listeners first so they can change the entry if they want
    notifyListeners(tuple,expiry,mark);
    ListEntry entry(tuple,expiry);
@@ -41,6 +43,7 @@ TupleMarkManager::mark(const Tuple& tuple,uint64_t expiry,MarkType mark)
 void 
 TupleMarkManager::unmark(const Tuple& tuple, MarkType markFilter)
 {
+   Lock lock(mMutex);
    ListEntry entry(tuple, 0);
    TupleList::iterator i = mList.find(entry);
 
@@ -56,12 +59,14 @@ TupleMarkManager::unmark(const Tuple& tuple, MarkType markFilter)
 void 
 TupleMarkManager::registerMarkListener(MarkListener* listener)
 {
+   Lock lock(mMutex);
    mListeners.insert(listener);
 }
 
 void 
 TupleMarkManager::unregisterMarkListener(MarkListener* listener)
 {
+   Lock lock(mMutex);
    mListeners.erase(listener);
 }
 
@@ -55,6 +55,10 @@ class TupleMarkManager
             
       typedef std::set<MarkListener*> Listeners;
       Listeners mListeners;
+
+      // Marks are looked up from the DNS thread, and set from every
+      // transaction shard.
+      Mutex mMutex;
       
       void removeMark(const Tuple& tuple, TupleList::iterator i);
       void notifyListeners(const resip::Tuple& tuple, uint64_t& expiry, MarkType& mark);
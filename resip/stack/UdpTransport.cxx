@@ -23,11 +23,68 @@
 #include <osc/SigcompMessage.h>
 #endif
 
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+#define RESIP_UDP_BATCHING
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
 #define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
 
 using namespace std;
 using namespace resip;
 
+#ifdef RESIP_UDP_BATCHING
+/**
+   The msghdr arrays handed to recvmmsg/sendmmsg. The receive side is a
+   ring of MaxMessageSize buffers, wired up once; the transmit side only
+   points at the SendData being written.
+*/
+class UdpTransport::BatchBuffers
+{
+   public:
+      explicit BatchBuffers(unsigned int size)
+         : mRxBuffers(size * UdpTransport::MaxMessageSize),
+           mRxAddrs(size),
+           mRxIov(size),
+           mRxHdrs(size),
+           mTxIov(size),
+           mTxHdrs(size),
+           mTxData(size)
+      {
+         memset(mRxHdrs.data(), 0, mRxHdrs.size() * sizeof(mmsghdr));
+         memset(mTxHdrs.data(), 0, mTxHdrs.size() * sizeof(mmsghdr));
+         for (unsigned int i = 0; i < size; ++i)
+         {
+            mRxIov[i].iov_base = rxBuffer(i);
+            mRxIov[i].iov_len = UdpTransport::MaxMessageSize;
+            mRxHdrs[i].msg_hdr.msg_iov = &mRxIov[i];
+            mRxHdrs[i].msg_hdr.msg_iovlen = 1;
+            mRxHdrs[i].msg_hdr.msg_name = &mRxAddrs[i];
+            mTxHdrs[i].msg_hdr.msg_iov = &mTxIov[i];
+            mTxHdrs[i].msg_hdr.msg_iovlen = 1;
+         }
+      }
+
+      char* rxBuffer(unsigned int i)
+      {
+         return mRxBuffers.data() + i * UdpTransport::MaxMessageSize;
+      }
+
+      std::vector<char> mRxBuffers;
+      std::vector<sockaddr_storage> mRxAddrs;
+      std::vector<iovec> mRxIov;
+      std::vector<mmsghdr> mRxHdrs;
+      std::vector<iovec> mTxIov;
+      std::vector<mmsghdr> mTxHdrs;
+      std::vector<SendData*> mTxData;
+};
+#else
+class UdpTransport::BatchBuffers
+{
+};
+#endif
+
 UdpTransport::UdpTransport(Fifo<TransactionMessage>& fifo,
                            int portNum,
                            IpVersion version,
@@ -40,11 +97,13 @@ UdpTransport::UdpTransport(Fifo<TransactionMessage>& fifo,
      mSigcompStack(nullptr),
      mStunSetting(stun),
      mExternalUnknownDatagramHandler(nullptr),
-     mInWritable(false)
+     mInWritable(false),
+     mBatchSize(1)
 {
    mPollEventCnt = 0;
    mTxTryCnt = mTxMsgCnt = mTxFailCnt = 0;
    mRxTryCnt = mRxMsgCnt = mRxKeepaliveCnt = mRxTransactionCnt = 0;
+   mRxSyscallCnt = mTxSyscallCnt = 0;
    mTuple.setType(UDP);
    mFd = InternalTransport::socket(transport(), version);
    mTuple.mFlowKey=(FlowKey)mFd;
@@ -84,6 +143,11 @@ UdpTransport::~UdpTransport()
            <<" rxmsg="<<mRxMsgCnt
            <<" rxka="<<mRxKeepaliveCnt
            <<" rxtr="<<mRxTransactionCnt
+           <<" batch="<<mBatchSize
+           <<" rxsys="<<mRxSyscallCnt
+           <<" txsys="<<mTxSyscallCnt
+           <<" rxpersys="<<(mRxSyscallCnt ? double(mRxMsgCnt)/mRxSyscallCnt : 0.0)
+           <<" txpersys="<<(mTxSyscallCnt ? double(mTxMsgCnt)/mTxSyscallCnt : 0.0)
            );
 #ifdef USE_SIGCOMP
    delete mSigcompStack;
@@ -91,6 +155,16 @@ UdpTransport::~UdpTransport()
    setPollGrp(nullptr);
 }
 
+void
+UdpTransport::addBatchStats(unsigned int& rxDatagrams, unsigned int& rxSyscalls,
+                            unsigned int& txDatagrams, unsigned int& txSyscalls) const
+{
+   rxDatagrams += mRxMsgCnt.load(std::memory_order_relaxed);
+   rxSyscalls += mRxSyscallCnt.load(std::memory_order_relaxed);
+   txDatagrams += mTxMsgCnt.load(std::memory_order_relaxed);
+   txSyscalls += mTxSyscallCnt.load(std::memory_order_relaxed);
+}
+
 void
 UdpTransport::setPollGrp(FdPollGrp *grp)
 {
@@ -132,7 +206,7 @@ UdpTransport::process()
        updateEvents();
    }
 
-   mStateMachineFifo.flush();
+   flushStateMacFifo();
 }
 
 void
@@ -170,7 +244,7 @@ UdpTransport::processPollEvent(FdPollEventMask mask)
    {
       processRxAll();
    }
-   mStateMachineFifo.flush();
+   flushStateMacFifo();
 }
 
 /**
@@ -210,7 +284,7 @@ UdpTransport::process(FdSet& fdset)
    {
       processRxAll();
    }
-   mStateMachineFifo.flush();
+   flushStateMacFifo();
 }
 
 /**
@@ -223,6 +297,11 @@ UdpTransport::processTxAll()
 {
    SendData *msg;
    ++mTxTryCnt;
+   if (mBatch && !mSigcompStack)
+   {
+      processTxBatch();
+      return;
+   }
    while ( (msg=mTxFifoOutBuffer.getNext(RESIP_FIFO_NOWAIT)) != nullptr)
    {
       processTxOne(msg);
@@ -243,7 +322,7 @@ UdpTransport::processTxOne(SendData *data)
       // We don't handle any special SendData commands in the UDP transport yet.
       return;
    }
-   ++mTxMsgCnt;
+   mTxMsgCnt.fetch_add(1, std::memory_order_relaxed);
    std::unique_ptr<SendData> sendData(data);
    //DebugLog (<< "Sent: " <<  sendData->data);
    //DebugLog (<< "Sending message on udp.");
@@ -270,6 +349,7 @@ UdpTransport::processTxOne(SendData *data)
 
        expected = sm->getDatagramLength();
 
+       mTxSyscallCnt.fetch_add(1, std::memory_order_relaxed);
        count = sendto(mFd,
                       sm->getDatagramMessage(),
                       sm->getDatagramLength(),
@@ -281,6 +361,7 @@ UdpTransport::processTxOne(SendData *data)
 #endif
    {
        expected = (int)sendData->data.size();
+       mTxSyscallCnt.fetch_add(1, std::memory_order_relaxed);
        count = sendto(mFd,
                       sendData->data.data(), (int)sendData->data.size(),
                       0, // flags
@@ -305,6 +386,77 @@ UdpTransport::processTxOne(SendData *data)
    }
 }
 
+/**
+ * Drain up to mBatchSize messages from the transmit fifo and write them
+ * with one sendmmsg() call. If the kernel refuses a datagram, that
+ * message is failed and the rest of the batch is retried.
+ */
+void
+UdpTransport::processTxBatch()
+{
+#ifdef RESIP_UDP_BATCHING
+   BatchBuffers& batch = *mBatch;
+   unsigned int n;
+   do
+   {
+      n = 0;
+      SendData* msg;
+      while (n < mBatchSize &&
+             (msg = mTxFifoOutBuffer.getNext(RESIP_FIFO_NOWAIT)) != nullptr)
+      {
+         if (msg->command != SendData::NoCommand)
+         {
+            // We don't handle any special SendData commands in the UDP transport yet.
+            delete msg;
+            continue;
+         }
+         resip_assert(msg->destination.getPort() != 0);
+         batch.mTxData[n] = msg;
+         batch.mTxIov[n].iov_base = const_cast<char*>(msg->data.data());
+         batch.mTxIov[n].iov_len = msg->data.size();
+         msghdr& hdr = batch.mTxHdrs[n].msg_hdr;
+         hdr.msg_name = const_cast<sockaddr*>(&msg->destination.getSockaddr());
+         hdr.msg_namelen = msg->destination.length();
+         ++n;
+      }
+      mTxMsgCnt.fetch_add(n, std::memory_order_relaxed);
+
+      unsigned int sent = 0;
+      while (sent < n)
+      {
+         mTxSyscallCnt.fetch_add(1, std::memory_order_relaxed);
+         const int count = sendmmsg(mFd, &batch.mTxHdrs[sent], n - sent, 0);
+         if (count <= 0)
+         {
+            SendData* failed = batch.mTxData[sent];
+            int e = getErrno();
+            error(e);
+            InfoLog (<< "Failed (" << e << ") sending to " << failed->destination);
+            fail(failed->transactionId);
+            ++mTxFailCnt;
+            ++sent;
+            continue;
+         }
+         for (unsigned int i = sent; i < sent + count; ++i)
+         {
+            if (batch.mTxHdrs[i].msg_len != batch.mTxData[i]->data.size())
+            {
+               ErrLog (<< "UDPTransport - send buffer full" );
+               fail(batch.mTxData[i]->transactionId);
+            }
+         }
+         sent += count;
+      }
+
+      for (unsigned int i = 0; i < n; ++i)
+      {
+         delete batch.mTxData[i];
+         batch.mTxData[i] = nullptr;
+      }
+   } while (n == mBatchSize && (mTransportFlags & RESIP_TRANSPORT_FLAG_TXALL) != 0);
+#endif
+}
+
 /**
  * Add options RXALL (to try receive all readable data).
  * With RXALL, every read cycle will have end with an EAGAIN read.
@@ -315,6 +467,11 @@ void
 UdpTransport::processRxAll()
 {
    ++mRxTryCnt;
+   if (mBatch)
+   {
+      processRxBatch();
+      return;
+   }
    for (;;)
    {
       // TBD: check StateMac capacity
@@ -324,8 +481,8 @@ UdpTransport::processRxAll()
       {
          break;
       }
-      ++mRxMsgCnt;
-      processRxParse(len, sender);
+      mRxMsgCnt.fetch_add(1, std::memory_order_relaxed);
+      processRxParse(mRxBuffer.data(), len, sender);
       if ( (mTransportFlags & RESIP_TRANSPORT_FLAG_RXALL) == 0 )
       {
          break;
@@ -348,6 +505,7 @@ UdpTransport::processRxRecv(Tuple& sender)
       // !jf! how do we tell if it discarded bytes
       // !ah! we use the len-1 trick :-(
       socklen_t slen = sender.length();
+      mRxSyscallCnt.fetch_add(1, std::memory_order_relaxed);
       int len = recvfrom( mFd,
                           mRxBuffer.data(),
                           MaxMessageSize,
@@ -374,14 +532,73 @@ UdpTransport::processRxRecv(Tuple& sender)
 
 
 /**
- * Parse the contents of {mRxBuffer} and do something with it.
+ * Read up to mBatchSize datagrams into the batch ring with one recvmmsg()
+ * call, and parse each of them. With RXALL, keep going while the ring
+ * comes back full.
+ */
+void
+UdpTransport::processRxBatch()
+{
+#ifdef RESIP_UDP_BATCHING
+   BatchBuffers& batch = *mBatch;
+   for (;;)
+   {
+      for (unsigned int i = 0; i < mBatchSize; ++i)
+      {
+         batch.mRxHdrs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+      }
+      mRxSyscallCnt.fetch_add(1, std::memory_order_relaxed);
+      const int n = recvmmsg(mFd, batch.mRxHdrs.data(), mBatchSize, MSG_DONTWAIT, nullptr);
+      if (n == SOCKET_ERROR)
+      {
+         int err = getErrno();
+         if ( err != EAGAIN && err != EWOULDBLOCK )
+         {
+            error( err );
+         }
+         return;
+      }
+
+      for (int i = 0; i < n; ++i)
+      {
+         const mmsghdr& hdr = batch.mRxHdrs[i];
+         const int len = (int)hdr.msg_len;
+         if ((hdr.msg_hdr.msg_flags & MSG_TRUNC) != 0 || len + 1 >= MaxMessageSize)
+         {
+            InfoLog( << "Datagram exceeded max length " << MaxMessageSize);
+            continue;
+         }
+         if (len <= 0)
+         {
+            continue;
+         }
+         // TBD: check StateMac capacity
+         Tuple sender(mTuple);
+         memcpy(&sender.getMutableSockaddr(), &batch.mRxAddrs[i],
+                resipMin((socklen_t)sender.length(), hdr.msg_hdr.msg_namelen));
+         mRxMsgCnt.fetch_add(1, std::memory_order_relaxed);
+         processRxParse(batch.rxBuffer(i), len, sender);
+      }
+
+      if (n < (int)mBatchSize || (mTransportFlags & RESIP_TRANSPORT_FLAG_RXALL) == 0)
+      {
+         break;
+      }
+   }
+#endif
+}
+
+
+/**
+ * Parse the contents of {buffer} (either mRxBuffer or a slot of the
+ * batch ring) and do something with it.
 **/
 void
-UdpTransport::processRxParse(int len, const Tuple& sender)
+UdpTransport::processRxParse(char* buffer, int len, const Tuple& sender)
 {
    //handle incoming CRLFCRLF keep-alive packets
    if (len == 4 &&
-       strncmp(mRxBuffer.data(), Symbols::CRLFCRLF, len) == 0)
+       strncmp(buffer, Symbols::CRLFCRLF, len) == 0)
    {
       StackLog(<<"Throwing away incoming firewall keep-alive");
       ++mRxKeepaliveCnt;
@@ -389,7 +606,7 @@ UdpTransport::processRxParse(int len, const Tuple& sender)
    }
 
    // this must be a STUN response (or garbage)
-   if (mRxBuffer[0] == 1 && mRxBuffer[1] == 1 && ipVersion() == V4)
+   if (buffer[0] == 1 && buffer[1] == 1 && ipVersion() == V4)
    {
       StunMessage resp;
 
@@ -399,7 +616,7 @@ UdpTransport::processRxParse(int len, const Tuple& sender)
       // Once parsing is successful below, the return code will be updated
       mStunResult = StunResultResponseParseFailed;
 
-      if (stunParseMessage(mRxBuffer.data(), len, resp, false))
+      if (stunParseMessage(buffer, len, resp, false))
       {
          in_addr sin_addr;
          // Use XorMappedAddress if present - if not use MappedAddress
@@ -437,7 +654,7 @@ UdpTransport::processRxParse(int len, const Tuple& sender)
    }
 
    // this must be a STUN request (or garbage)
-   if (mRxBuffer[0] == 0 && mRxBuffer[1] == 1 && ipVersion() == V4)
+   if (buffer[0] == 0 && buffer[1] == 1 && ipVersion() == V4)
    {
       // Drop stun requests unless StunEnabled is set and return false to indicate
       // we did not consume the buffer
@@ -465,7 +682,7 @@ UdpTransport::processRxParse(int len, const Tuple& sender)
       secondary.port = 0;
       secondary.addr = 0;
 
-      bool ok = stunServerProcessMsg( mRxBuffer.data(), len, // input buffer
+      bool ok = stunServerProcessMsg( buffer, len, // input buffer
                                       from,  // packet source
                                       secondary, // not used
                                       myAddr, // address to fill into response
@@ -492,7 +709,7 @@ UdpTransport::processRxParse(int len, const Tuple& sender)
       return;
    }
 
-   processRxParseSip(mRxBuffer.data(), len, sender);
+   processRxParseSip(buffer, len, sender);
 }
 
 void
@@ -535,15 +752,18 @@ UdpTransport::processRxParseSip(char* buffer, int len, const Tuple& sender)
 #endif
    }
 
-   auto* const msgBuffer = MsgHeaderScanner::allocateBuffer(len);
+   std::unique_ptr<SipMessage> message(new SipMessage(&mTuple));
+
+   // Copy the datagram into a buffer that the message manages (from its
+   // arena if it has one).
+   auto* const msgBuffer =
+      message->allocateBuffer(len + MsgHeaderScanner::MaxNumCharsChunkOverflow);
    memcpy(msgBuffer, buffer, len);
    msgBuffer[len] = '\0';  // null terminate the buffer string just to make debug easier and reduce errors
 
    //DebugLog ( << "UDP Rcv : " << len << " b" );
    //DebugLog ( << Data(buffer, len).escaped().c_str());
 
-   std::unique_ptr<SipMessage> message(new SipMessage(&mTuple));
-
    // set the received from information into the received= parameter in the
    // via
 
@@ -554,10 +774,6 @@ UdpTransport::processRxParseSip(char* buffer, int len, const Tuple& sender)
    message->setSource(sender);
    //DebugLog (<< "Received from: " << sender);
 
-   // Tell the SipMessage about this datagram buffer.
-   // WATCHOUT: below here buffer is consumed by message
-   message->addBuffer(msgBuffer);
-
    mMsgHeaderScanner.prepareForMessage(message.get());
 
    char *unprocessedCharPtr;
@@ -595,7 +811,7 @@ UdpTransport::processRxParseSip(char* buffer, int len, const Tuple& sender)
 
    // .bwc. basicCheck takes up substantial CPU. Don't bother doing it
    // if we're overloaded.
-   CongestionManager::RejectionBehavior behavior=getRejectionBehaviorForIncoming();
+   CongestionManager::RejectionBehavior behavior=getRejectionBehaviorForIncoming(*message);
    if (behavior==CongestionManager::REJECTING_NON_ESSENTIAL
          || (behavior==CongestionManager::REJECTING_NEW_WORK
             && message->isRequest()))
@@ -729,6 +945,26 @@ UdpTransport::setRcvBufLen(int buflen)
    setSocketRcvBufLen(mFd, buflen);
 }
 
+void
+UdpTransport::setBatchSize(unsigned int batchSize)
+{
+   if (batchSize == 0)
+   {
+      batchSize = 1;
+   }
+#ifdef RESIP_UDP_BATCHING
+   mBatchSize = batchSize;
+   mBatch.reset(batchSize > 1 ? new BatchBuffers(batchSize) : nullptr);
+   InfoLog(<< "UDP transport " << mTuple << " using batch size " << mBatchSize);
+#else
+   if (batchSize > 1)
+   {
+      WarningLog(<< "recvmmsg/sendmmsg not available, ignoring batch size "
+                 << batchSize << " for " << mTuple);
+   }
+#endif
+}
+
 /* ====================================================================
  * The Vovida Software License, Version 1.0
  *
@@ -1,6 +1,7 @@
 #if !defined(RESIP_UDPTRANSPORT_HXX)
 #define RESIP_UDPTRANSPORT_HXX
 
+#include <atomic>
 #include <memory>
 #include "resip/stack/InternalTransport.hxx"
 #include "resip/stack/MsgHeaderScanner.hxx"
@@ -78,6 +79,28 @@ public:
    virtual void setPollGrp(FdPollGrp *grp);
    virtual void setRcvBufLen(int buflen);
 
+   /**
+      Receive and transmit up to batchSize datagrams per system call
+      (recvmmsg/sendmmsg), where the platform supports it. A batch size
+      of 1 (the default) keeps the traditional one-syscall-per-datagram
+      behavior. Each slot of the receive ring is MaxMessageSize bytes,
+      so keep this modest. Combine with RESIP_TRANSPORT_FLAG_RXALL and
+      RESIP_TRANSPORT_FLAG_TXALL to keep draining until the socket or
+      transmit fifo is empty.
+
+      Must be called before the transport starts processing.
+   */
+   virtual void setBatchSize(unsigned int batchSize);
+   unsigned int getBatchSize() const { return mBatchSize; }
+
+   /**
+      Adds the datagrams moved and system calls made since startup, which
+      show how well batching is doing, to these totals. May be called from
+      any thread.
+   */
+   void addBatchStats(unsigned int& rxDatagrams, unsigned int& rxSyscalls,
+                      unsigned int& txDatagrams, unsigned int& txSyscalls) const;
+
    // FdPollItemIf
    // virtual Socket getPollSocket() const;
    virtual void processPollEvent(FdPollEventMask mask);
@@ -103,23 +126,28 @@ protected:
 
    void processRxAll();
    int processRxRecv(Tuple& sender);
-   void processRxParse(int len, const Tuple& sender);
+   void processRxBatch();
+   void processRxParse(char* buffer, int len, const Tuple& sender);
    void processRxParseSip(char* buffer, int len, const Tuple& sender);
    void processTxAll();
    void processTxOne(SendData *data);
+   void processTxBatch();
    void updateEvents();
 
    osc::Stack *mSigcompStack;
 
-   // statistics
+   // statistics; the datagram and syscall counts are also read by the
+   // StatisticsManager, from another thread
    unsigned mPollEventCnt;
    unsigned mTxTryCnt;
-   unsigned mTxMsgCnt;
+   std::atomic<unsigned> mTxMsgCnt;
    unsigned mTxFailCnt;
    unsigned mRxTryCnt;
-   unsigned mRxMsgCnt;
+   std::atomic<unsigned> mRxMsgCnt;
    unsigned mRxKeepaliveCnt;
    unsigned mRxTransactionCnt;
+   std::atomic<unsigned> mRxSyscallCnt;
+   std::atomic<unsigned> mTxSyscallCnt;
    std::array<char, MaxMessageSize> mRxBuffer{};
 private:
 #ifdef USE_SIGCOMP
@@ -134,6 +162,11 @@ private:
 
    ExternalUnknownDatagramHandler* mExternalUnknownDatagramHandler;
    bool mInWritable;
+
+   // preallocated recvmmsg/sendmmsg state; only present when batching
+   class BatchBuffers;
+   unsigned int mBatchSize;
+   std::unique_ptr<BatchBuffers> mBatch;
 };
 
 }
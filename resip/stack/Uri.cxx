@@ -665,33 +665,9 @@ Uri::operator<(const Uri& other) const
    }
 
    // !bwc! Canonicalize before we compare! Jeez...
-   if (!mHostCanonicalized)
-   {
-      if(DnsUtil::isIpV6Address(mHost))
-      {
-         mCanonicalHost = DnsUtil::canonicalizeIpV6Address(mHost);
-      }
-      else
-      {
-         mCanonicalHost = mHost;
-         mCanonicalHost.lowercase();
-      }
-      mHostCanonicalized=true;
-   }
+   canonicalizeHost();
    
-   if (!other.mHostCanonicalized)
-   {
-      if(DnsUtil::isIpV6Address(other.mHost))
-      {
-         other.mCanonicalHost = DnsUtil::canonicalizeIpV6Address(other.mHost);
-      }
-      else
-      {
-         other.mCanonicalHost = other.mHost;
-         other.mCanonicalHost.lowercase();
-      }
-      other.mHostCanonicalized=true;
-   }
+   other.canonicalizeHost();
 
    if (mCanonicalHost < other.mCanonicalHost)
    {
@@ -814,36 +790,47 @@ Uri::aorEqual(const resip::Uri& rhs) const
    checkParsed();
    rhs.checkParsed();
 
-   if (!mHostCanonicalized)
+   canonicalizeHost();
+   
+   rhs.canonicalizeHost();
+   
+   return (mUser == rhs.mUser) && (mCanonicalHost == rhs.mCanonicalHost) && (mPort == rhs.mPort) &&
+           isEqualNoCase(mScheme, rhs.mScheme) && (mNetNs == rhs.mNetNs);
+}
+
+void
+Uri::canonicalizeHost() const
+{
+   if (mHostCanonicalized)
    {
-      if(DnsUtil::isIpV6Address(mHost))
-      {
-         mCanonicalHost = DnsUtil::canonicalizeIpV6Address(mHost);
-      }
-      else
-      {
-         mCanonicalHost = mHost;
-         mCanonicalHost.lowercase();
-      }
-      mHostCanonicalized=true;
+      return;
    }
-   
-   if (!rhs.mHostCanonicalized)
+
+   if (DnsUtil::isIpV6Address(mHost))
    {
-      if(DnsUtil::isIpV6Address(rhs.mHost))
+      mCanonicalHost = DnsUtil::canonicalizeIpV6Address(mHost);
+   }
+   else
+   {
+      const char* p = mHost.data();
+      const char* end = p + mHost.size();
+      while (p != end && !isupper((unsigned char)*p))
       {
-         rhs.mCanonicalHost = DnsUtil::canonicalizeIpV6Address(rhs.mHost);
+         ++p;
+      }
+      if (p == end && mHost.isShared())
+      {
+         // Hosts nearly always arrive in lower case; point at the same bytes
+         // in the message instead of copying them.
+         mCanonicalHost.setBuf(Data::Share, mHost.data(), mHost.size());
       }
       else
       {
-         rhs.mCanonicalHost = rhs.mHost;
-         rhs.mCanonicalHost.lowercase();
+         mCanonicalHost = mHost;
+         mCanonicalHost.lowercase();
       }
-      rhs.mHostCanonicalized=true;
    }
-   
-   return (mUser == rhs.mUser) && (mCanonicalHost == rhs.mCanonicalHost) && (mPort == rhs.mPort) &&
-           isEqualNoCase(mScheme, rhs.mScheme) && (mNetNs == rhs.mNetNs);
+   mHostCanonicalized = true;
 }
 
 void 
@@ -855,19 +842,7 @@ Uri::getAorInternal(bool dropScheme, bool addPort, Data& aor) const
    addPort = addPort && mPort!=0;
 
    bool hostIsIpV6Address = DnsUtil::isIpV6Address(mHost);
-   if(!mHostCanonicalized)
-   {
-      if (hostIsIpV6Address)
-      {
-         mCanonicalHost = DnsUtil::canonicalizeIpV6Address(mHost);
-      }
-      else
-      {
-         mCanonicalHost = mHost;
-         mCanonicalHost.lowercase();
-      }
-      mHostCanonicalized = true;
-   }
+   canonicalizeHost();
 
    // !bwc! Maybe reintroduce caching of aor. (Would use a bool instead of the
    // mOldX cruft)
@@ -298,6 +298,7 @@ class Uri : public ParserCategory
       Data mPath;
 
       void getAorInternal(bool dropScheme, bool addPort, Data& aor) const;
+      void canonicalizeHost() const;
       mutable bool mHostCanonicalized;
       mutable Data mCanonicalHost;  ///< cache for IPv6 host comparison
 
@@ -5,6 +5,7 @@
 #ifdef USE_SSL
 
 #include "resip/stack/ssl/Security.hxx"
+#include "resip/stack/ssl/TlsSessionCache.hxx"
 
 #include <ostream>
 #include <fstream>
@@ -412,6 +413,7 @@ Security::createDomainCtx(const SSL_METHOD* method, const Data& domain, const Da
    setDHParams(ctx);
    SSL_CTX_set_options(ctx, BaseSecurity::OpenSSLCTXSetOptions);
    SSL_CTX_clear_options(ctx, BaseSecurity::OpenSSLCTXClearOptions);
+   TlsSessionCache::configure(ctx, domain);
 
    return ctx;
 }
@@ -1198,6 +1200,7 @@ BaseSecurity::BaseSecurity (const CipherList& cipherSuite, const Data& defaultPr
    setDHParams(mTlsCtx);
    SSL_CTX_set_options(mTlsCtx, BaseSecurity::OpenSSLCTXSetOptions);
    SSL_CTX_clear_options(mTlsCtx, BaseSecurity::OpenSSLCTXClearOptions);
+   TlsSessionCache::configure(mTlsCtx, Data::Empty);
    
    mSslCtx = SSL_CTX_new( SSLv23_method() );
    resip_assert(mSslCtx);
@@ -1209,6 +1212,8 @@ BaseSecurity::BaseSecurity (const CipherList& cipherSuite, const Data& defaultPr
    setDHParams(mSslCtx);
    SSL_CTX_set_options(mSslCtx, BaseSecurity::OpenSSLCTXSetOptions);
    SSL_CTX_clear_options(mSslCtx, BaseSecurity::OpenSSLCTXClearOptions);
+   // Trusts a different set of roots than mTlsCtx
+   TlsSessionCache::configure(mSslCtx, "ssl:");
 }
 
 
@@ -14,6 +14,7 @@
 #include "resip/stack/ssl/TlsBaseTransport.hxx"
 #include "resip/stack/ssl/TlsConnection.hxx"
 #include "resip/stack/ssl/Security.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
@@ -46,7 +47,9 @@ TlsBaseTransport::TlsBaseTransport(Fifo<TransactionMessage>& fifo,
    mCertificateFilename(certificateFilename),
    mPrivateKeyFilename(privateKeyFilename),
    mPrivateKeyPassPhrase(privateKeyPassPhrase),
-   mReloadCertificate(false)
+   mReloadCertificate(false),
+   mHandshakeInterruptor(*this),
+   mHandshakeInterruptorHandle(0)
 {
    setTlsDomain(sipDomain);   
    mTuple.setType(transportType);
@@ -80,6 +83,14 @@ TlsBaseTransport::TlsBaseTransport(Fifo<TransactionMessage>& fifo,
 
 TlsBaseTransport::~TlsBaseTransport()
 {
+   // Our connections outlive this, but not the handshake steps that would
+   // report back to it
+   TlsConnection::cancelHandshakes(this);
+   if (mPollGrp && mHandshakeInterruptorHandle)
+   {
+      mPollGrp->delPollItem(mHandshakeInterruptorHandle);
+      mHandshakeInterruptorHandle = 0;
+   }
    if (mDomainCtx)
    {
       SSL_CTX_free(mDomainCtx);mDomainCtx=0;
@@ -93,6 +104,59 @@ TlsBaseTransport::onReload()
    mReloadCertificate = true;
 }
 
+void
+TlsBaseTransport::setPollGrp(FdPollGrp* grp)
+{
+   if (mPollGrp && mHandshakeInterruptorHandle)
+   {
+      mPollGrp->delPollItem(mHandshakeInterruptorHandle);
+      mHandshakeInterruptorHandle = 0;
+   }
+   if (grp)
+   {
+      mHandshakeInterruptorHandle = grp->addPollItem(mHandshakeInterruptor.getReadSocket(), FPEM_Read, &mHandshakeInterruptor);
+   }
+   TcpBaseTransport::setPollGrp(grp);
+}
+
+void
+TlsBaseTransport::handshakeStepDone(const Tuple& who)
+{
+   {
+      Lock lock(mHandshakeStepsDoneMutex);
+      mHandshakeStepsDone.push_back(who);
+   }
+   mHandshakeInterruptor.interrupt();
+}
+
+void
+TlsBaseTransport::HandshakeInterruptor::processPollEvent(FdPollEventMask mask)
+{
+   SelectInterruptor::processPollEvent(mask);
+   mTransport.processHandshakeStepsDone();
+}
+
+void
+TlsBaseTransport::processHandshakeStepsDone()
+{
+   std::vector<Tuple> done;
+   {
+      Lock lock(mHandshakeStepsDoneMutex);
+      done.swap(mHandshakeStepsDone);
+   }
+   for (std::vector<Tuple>::const_iterator it = done.begin(); it != done.end(); ++it)
+   {
+      // The connection may have closed meanwhile, and its socket been reused
+      // by another; a read event it did not ask for does no harm.
+      Connection* conn = getConnectionManager().findConnection(*it);
+      if (conn)
+      {
+         conn->performReads();
+      }
+   }
+   flushStateMacFifo();
+}
+
 SSL_CTX* 
 TlsBaseTransport::getCtx()
 { 
@@ -10,8 +10,11 @@
 #include "resip/stack/SecurityTypes.hxx"
 #include "rutil/HeapInstanceCounter.hxx"
 #include "resip/stack/Compression.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/SelectInterruptor.hxx"
 
 #include <openssl/ssl.h>
+#include <vector>
 
 namespace resip
 {
@@ -44,6 +47,8 @@ class TlsBaseTransport : public TcpBaseTransport
 
       void onReload();
 
+      virtual void setPollGrp(FdPollGrp* grp);
+
       SSL_CTX* getCtx();
 
       SecurityTypes::TlsClientVerificationMode getClientVerificationMode() 
@@ -76,9 +81,24 @@ class TlsBaseTransport : public TcpBaseTransport
          void *func,
          void *arg);
 
+      /** Called on a TlsHandshakePool thread once the handshake step of
+          who's connection is done; the connection picks up the result on
+          this transport's thread. */
+      void handshakeStepDone(const Tuple& who);
+
    protected:
       Connection* createConnection(const Tuple& who, Socket fd, bool server=false);
 
+      class HandshakeInterruptor : public SelectInterruptor
+      {
+         public:
+            HandshakeInterruptor(TlsBaseTransport& transport) : mTransport(transport) {}
+            virtual void processPollEvent(FdPollEventMask mask);
+         private:
+            TlsBaseTransport& mTransport;
+      };
+      void processHandshakeStepsDone();
+
       Security* mSecurity;
       SecurityTypes::SSLType mSslType;
       SSL_CTX* mDomainCtx;
@@ -91,6 +111,11 @@ class TlsBaseTransport : public TcpBaseTransport
       const Data mPrivateKeyFilename;
       const Data mPrivateKeyPassPhrase;
       volatile bool mReloadCertificate;
+
+      HandshakeInterruptor mHandshakeInterruptor;
+      FdPollItemHandle mHandshakeInterruptorHandle;
+      Mutex mHandshakeStepsDoneMutex;
+      std::vector<Tuple> mHandshakeStepsDone;
 };
 
 }
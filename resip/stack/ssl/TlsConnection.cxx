@@ -7,6 +7,8 @@
 #include "resip/stack/ssl/TlsConnection.hxx"
 #include "resip/stack/ssl/TlsTransport.hxx"
 #include "resip/stack/ssl/Security.hxx"
+#include "resip/stack/ssl/TlsSessionCache.hxx"
+#include "resip/stack/ssl/TlsHandshakePool.hxx"
 #include "rutil/Logger.hxx"
 #include "resip/stack/Uri.hxx"
 #include "rutil/Socket.hxx"
@@ -28,6 +30,8 @@ using namespace resip;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
 
+TlsHandshakePool* TlsConnection::mHandshakePool = 0;
+
 TlsConnection::TlsConnection(Transport* transport, const Tuple& tuple,
    Socket fd, Security* security,
    bool server, Data domain, SecurityTypes::SSLType sslType,
@@ -36,7 +40,9 @@ TlsConnection::TlsConnection(Transport* transport, const Tuple& tuple,
    mServer(server),
    mSecurity(security),
    mSslType(sslType),
-   mDomain(domain)
+   mDomain(domain),
+   mHandshakeJob(NoJob),
+   mHandshakeStep(StepRetry)
 {
 #if defined(USE_SSL)
    InfoLog(<< "Creating TLS connection for domain " << mDomain << " " << tuple << " on " << fd);
@@ -68,6 +74,9 @@ TlsConnection::TlsConnection(Transport* transport, const Tuple& tuple,
 
    mSsl = SSL_new(ctx);
    resip_assert(mSsl);
+   // Queued messages are gathered into Connection's coalescing buffer, which
+   // may be reallocated between a write that wanted to be retried and the retry
+   SSL_set_mode(mSsl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 
    resip_assert(mSecurity);
 
@@ -93,6 +102,8 @@ TlsConnection::TlsConnection(Transport* transport, const Tuple& tuple,
             resip_assert(0);
       }
       SSL_set_verify(mSsl, verify_mode, 0);  // Modify verify flags, but leave callback same as set in Security.cxx
+      // Sessions set up with a different verify mode must not be resumed here
+      TlsSessionCache::setSessionContext(mSsl);
    }
 
    mBio = BIO_new_socket((int)fd, 0/*close flag*/);
@@ -115,6 +126,10 @@ TlsConnection::TlsConnection(Transport* transport, const Tuple& tuple,
 TlsConnection::~TlsConnection()
 {
 #if defined(USE_SSL)
+   if (mHandshakeJob != NoJob && mHandshakePool)
+   {
+      mHandshakePool->cancel(this);
+   }
    ERR_clear_error();
    int ret = SSL_shutdown(mSsl);
    if (ret < 0)
@@ -163,7 +178,17 @@ TlsConnection::checkState()
       return mTlsState;
    }
 
-   int handshakeRet = 0;
+   if (mHandshakeJob == JobQueued)
+   {
+      // a TlsHandshakePool thread owns mSsl
+      return mTlsState;
+   }
+   if (mHandshakeJob == JobDone)
+   {
+      mHandshakeJob = NoJob;
+      resumePolling();
+      return applyHandshakeStep(mHandshakeStep);
+   }
 
    ERR_clear_error();
 
@@ -183,6 +208,7 @@ TlsConnection::checkState()
          DebugLog(<< "TLS SNI extension in Client Hello: " << who().getTargetDomain());
          SSL_set_tlsext_host_name(mSsl, who().getTargetDomain().c_str()); // set the SNI hostname
 #endif
+         TlsSessionCache::resume(mSsl, who(), who().getTargetDomain());
          SSL_set_connect_state(mSsl);
          mTlsState = Handshaking;
       }
@@ -191,8 +217,31 @@ TlsConnection::checkState()
       mTlsState = Handshaking;
    }
 
-   mHandShakeWantsRead = false;
-   handshakeRet = SSL_do_handshake(mSsl);
+   if (mHandshakePool && suspendPolling())
+   {
+      mHandshakeJob = JobQueued;
+      if (mHandshakePool->post(this))
+      {
+         StackLog(<< "TLS handshake step queued");
+         return mTlsState;
+      }
+      DebugLog(<< "TLS handshake pool is full, handshaking inline");
+      mHandshakeJob = NoJob;
+      resumePolling();
+   }
+
+   return applyHandshakeStep(doHandshake());
+#else
+   return mTlsState;
+#endif // USE_SSL
+}
+
+TlsConnection::HandshakeStep
+TlsConnection::doHandshake()
+{
+#if defined(USE_SSL)
+   ERR_clear_error();
+   int handshakeRet = SSL_do_handshake(mSsl);
 
    if (handshakeRet <= 0)
    {
@@ -202,29 +251,27 @@ TlsConnection::checkState()
       {
          case SSL_ERROR_WANT_READ:
             StackLog(<< "TLS handshake want read");
-            mHandShakeWantsRead = true;
-            return mTlsState;
+            return StepWantRead;
 
          case SSL_ERROR_WANT_WRITE:
             StackLog(<< "TLS handshake want write");
-            ensureWritable();
-            return mTlsState;
+            return StepWantWrite;
 
          case SSL_ERROR_ZERO_RETURN:
             StackLog(<< "TLS connection closed cleanly");
-            return mTlsState;
+            return StepRetry;
 
          case SSL_ERROR_WANT_CONNECT:
             StackLog(<< "BIO not connected, try later");
-            return mTlsState;
+            return StepRetry;
 
          case SSL_ERROR_WANT_ACCEPT:
             StackLog(<< "TLS connection want accept");
-            return mTlsState;
+            return StepRetry;
 
          case SSL_ERROR_WANT_X509_LOOKUP:
             DebugLog(<< "Try later / SSL_ERROR_WANT_X509_LOOKUP");
-            return mTlsState;
+            return StepRetry;
 
          default:
             TransportFailure::FailureReason failureReason = TransportFailure::ConnectionException;
@@ -244,7 +291,7 @@ TlsConnection::checkState()
                   case EWOULDBLOCK:  // Treat EGAIN and EWOULDBLOCK as the same: http://stackoverflow.com/questions/7003234/which-systems-define-eagain-and-ewouldblock-as-different-values
 #endif
                      StackLog(<< "try later: " << e);
-                     return mTlsState;
+                     return StepRetry;
                }
                ds << "socket error=" << e << ": " << Transport::errorToString(e);
                failureSubCode = e;
@@ -309,14 +356,13 @@ TlsConnection::checkState()
             ErrLog(<< failureString);
             handleOpenSSLErrorQueue(handshakeRet, err, "SSL_do_handshake", addToAdditionalFailureStrings);
             setFailureReason(failureReason, failureSubCode, failureString);
-            mBio = NULL;
-            mTlsState = Broken;
-            return mTlsState;
+            return StepFailed;
       }
    }
    else // handshakeRet > 1
    {
-      InfoLog(<< "TLS connected");
+      InfoLog(<< "TLS connected" << (SSL_session_reused(mSsl) ? " (session resumed)" : ""));
+      TlsSessionCache::onHandshakeDone(mSsl);
    }
 
    // force peer name to get checked and perhaps cert loaded
@@ -336,8 +382,6 @@ TlsConnection::checkState()
       }
       if (!matches)
       {
-         mTlsState = Broken;
-         mBio = NULL;
          Data failureString;
          {
             DataStream ds(failureString);
@@ -348,20 +392,72 @@ TlsConnection::checkState()
          }
          ErrLog(<< failureString);
          setFailureReason(TransportFailure::CertNameMismatch, 0, failureString);
-         return mTlsState;
+         return StepFailed;
       }
    }
 
    InfoLog(<< "TLS handshake done for peer " << getPeerNamesData());
-   mTlsState = Up;
-   if (!mOutstandingSends.empty())
+   return StepDone;
+#else
+   return StepFailed;
+#endif // USE_SSL
+}
+
+TlsConnection::TlsState
+TlsConnection::applyHandshakeStep(HandshakeStep step)
+{
+   mHandShakeWantsRead = false;
+   switch (step)
    {
-      ensureWritable();
+      case StepWantRead:
+         mHandShakeWantsRead = true;
+         break;
+      case StepWantWrite:
+         ensureWritable();
+         break;
+      case StepRetry:
+         break;
+      case StepFailed:
+         mBio = NULL;
+         mTlsState = Broken;
+         break;
+      case StepDone:
+         mTlsState = Up;
+         if (!mOutstandingSends.empty())
+         {
+            ensureWritable();
+         }
+         break;
    }
-#endif // USE_SSL
    return mTlsState;
 }
 
+void
+TlsConnection::processHandshakeStep()
+{
+   mHandshakeStep = doHandshake();
+   mHandshakeJob = JobDone;
+   TlsBaseTransport* t = dynamic_cast<TlsBaseTransport*>(transport());
+   resip_assert(t);
+   t->handshakeStepDone(who());
+}
+
+void
+TlsConnection::setHandshakeThreads(unsigned int numThreads, unsigned int maxQueued)
+{
+   delete mHandshakePool;
+   mHandshakePool = numThreads ? new TlsHandshakePool(numThreads, maxQueued) : 0;
+}
+
+void
+TlsConnection::cancelHandshakes(const Transport* transport)
+{
+   if (mHandshakePool)
+   {
+      mHandshakePool->cancel(transport);
+   }
+}
+
 bool
 TlsConnection::handleOpenSSLErrorQueue(int ret, unsigned long err, const char* op, bool addToAdditionalFailureStrings)
 {
@@ -661,6 +757,12 @@ TlsConnection::isWritable()
    switch (mTlsState)
    {
       case Handshaking:
+         // while a pool thread has the handshake, the socket stays out of
+         // the poll set; a finished step calls ensureWritable() if needed
+         if (mHandshakeJob != NoJob)
+         {
+            return false;
+         }
          return mHandShakeWantsRead ? false : true;
       case Initial:
       case Up:
@@ -23,11 +23,14 @@
 
 #include <openssl/ssl.h>
 
+#include <atomic>
+
 namespace resip
 {
 
 class Tuple;
 class Security;
+class TlsHandshakePool;
 
 class TlsConnection : public Connection
 {
@@ -53,13 +56,35 @@ class TlsConnection : public Connection
       
       typedef enum TlsState { Initial, Broken, Handshaking, Up } TlsState;
       static const char * fromState(TlsState);
+
+      /** Runs handshakes on a TlsHandshakePool of numThreads threads, shared
+          by all TLS transports, instead of on the transport thread. A
+          handshake step that finds maxQueued others waiting for a thread
+          runs inline. 0 threads (the default) turns this off. Only
+          transports on an FdPollGrp offload their handshakes. Call this
+          while no TLS connections exist. */
+      static void setHandshakeThreads(unsigned int numThreads, unsigned int maxQueued = 256);
+
+      /// Drops, or waits for, the offloaded handshake steps of transport.
+      static void cancelHandshakes(const Transport* transport);
    
    private:
+      friend class TlsHandshakePool;
+
+      typedef enum HandshakeStep { StepWantRead, StepWantWrite, StepRetry, StepFailed, StepDone } HandshakeStep;
+      typedef enum HandshakeJob { NoJob, JobQueued, JobDone } HandshakeJob;
+
       /// No default c'tor
       TlsConnection();
       void computePeerName();
       Data getPeerNamesData() const;
       TlsState checkState();
+      /// One SSL_do_handshake() plus, once it completes, peer verification.
+      /// Touches only mSsl and the peer names, so it may run on a pool thread.
+      HandshakeStep doHandshake();
+      TlsState applyHandshakeStep(HandshakeStep step);
+      /// Runs doHandshake() on a TlsHandshakePool thread.
+      void processHandshakeStep();
       bool handleOpenSSLErrorQueue(int ret, unsigned long err, const char* op, bool addToAdditionalFailureStrings = false);
 
       bool mServer;
@@ -69,6 +94,10 @@ class TlsConnection : public Connection
       
       TlsState mTlsState;
       bool mHandShakeWantsRead;
+      /// While JobQueued, a pool thread owns mSsl and the socket is not polled
+      std::atomic<HandshakeJob> mHandshakeJob;
+      HandshakeStep mHandshakeStep;
+      static TlsHandshakePool* mHandshakePool;
 
       SSL* mSsl;
       BIO* mBio;
@@ -0,0 +1,185 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <algorithm>
+
+#include "resip/stack/ssl/TlsHandshakePool.hxx"
+#include "resip/stack/ssl/TlsConnection.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Logger.hxx"
+
+using namespace resip;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
+
+TlsHandshakePool::TlsHandshakePool(unsigned int numThreads, unsigned int maxQueued) :
+   mMaxQueued(maxQueued),
+   mShutdown(false)
+{
+   InfoLog(<< "Starting " << numThreads << " TLS handshake threads");
+   for (unsigned int i = 0; i < numThreads; ++i)
+   {
+      mThreads.push_back(std::thread(&TlsHandshakePool::run, this));
+   }
+}
+
+TlsHandshakePool::~TlsHandshakePool()
+{
+   {
+      Lock lock(mMutex);
+      mShutdown = true;
+      mQueue.clear();
+   }
+   mQueued.notify_all();
+   for (std::vector<std::thread>::iterator it = mThreads.begin(); it != mThreads.end(); ++it)
+   {
+      it->join();
+   }
+}
+
+bool
+TlsHandshakePool::post(TlsConnection* conn)
+{
+   {
+      Lock lock(mMutex);
+      if (mShutdown || mQueue.size() >= mMaxQueued)
+      {
+         return false;
+      }
+      mQueue.push_back(conn);
+   }
+   mQueued.notify_one();
+   return true;
+}
+
+void
+TlsHandshakePool::cancel(const TlsConnection* conn)
+{
+   Lock lock(mMutex);
+   std::deque<TlsConnection*>::iterator it = std::find(mQueue.begin(), mQueue.end(), conn);
+   if (it != mQueue.end())
+   {
+      mQueue.erase(it);
+   }
+   while (isRunning(conn))
+   {
+      mFinished.wait(lock);
+   }
+}
+
+void
+TlsHandshakePool::cancel(const Transport* transport)
+{
+   Lock lock(mMutex);
+   for (std::deque<TlsConnection*>::iterator it = mQueue.begin(); it != mQueue.end(); )
+   {
+      if ((*it)->transport() == transport)
+      {
+         it = mQueue.erase(it);
+      }
+      else
+      {
+         ++it;
+      }
+   }
+   while (isRunning(transport))
+   {
+      mFinished.wait(lock);
+   }
+}
+
+bool
+TlsHandshakePool::isRunning(const TlsConnection* conn) const
+{
+   return std::find(mRunning.begin(), mRunning.end(), conn) != mRunning.end();
+}
+
+bool
+TlsHandshakePool::isRunning(const Transport* transport) const
+{
+   for (std::vector<TlsConnection*>::const_iterator it = mRunning.begin(); it != mRunning.end(); ++it)
+   {
+      if ((*it)->transport() == transport)
+      {
+         return true;
+      }
+   }
+   return false;
+}
+
+void
+TlsHandshakePool::run()
+{
+   Lock lock(mMutex);
+   while (true)
+   {
+      while (!mShutdown && mQueue.empty())
+      {
+         mQueued.wait(lock);
+      }
+      if (mShutdown)
+      {
+         return;
+      }
+
+      TlsConnection* conn = mQueue.front();
+      mQueue.pop_front();
+      mRunning.push_back(conn);
+
+      lock.unlock();
+      conn->processHandshakeStep();
+      lock.lock();
+
+      mRunning.erase(std::find(mRunning.begin(), mRunning.end(), conn));
+      mFinished.notify_all();
+   }
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
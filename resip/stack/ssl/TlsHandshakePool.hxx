@@ -0,0 +1,115 @@
+#if !defined(RESIP_TLSHANDSHAKEPOOL_HXX)
+#define RESIP_TLSHANDSHAKEPOOL_HXX
+
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include "rutil/Condition.hxx"
+#include "rutil/Mutex.hxx"
+
+namespace resip
+{
+
+class TlsConnection;
+class Transport;
+
+/**
+   @brief A bounded pool of threads that runs TLS handshake steps
+   (SSL_do_handshake(), certificate verification and peer name extraction)
+   for TlsConnection, so that the transport thread keeps serving established
+   connections during a burst of new ones.
+
+   While a step is queued or running the pool owns the connection's SSL
+   object; the connection is out of its transport's poll set and is handed
+   back through TlsBaseTransport once the step is done.
+
+   @see TlsConnection::setHandshakeThreads()
+*/
+class TlsHandshakePool
+{
+   public:
+      /// Starts numThreads threads; at most maxQueued steps wait for one.
+      TlsHandshakePool(unsigned int numThreads, unsigned int maxQueued);
+      /// Stops and joins the threads; steps still queued are dropped.
+      ~TlsHandshakePool();
+
+      /// Queues a handshake step for conn; false if the queue is full.
+      bool post(TlsConnection* conn);
+
+      /// Drops conn's queued step, or waits for its running step to finish.
+      void cancel(const TlsConnection* conn);
+
+      /// As cancel(), for every connection of transport.
+      void cancel(const Transport* transport);
+
+   private:
+      void run();
+      bool isRunning(const TlsConnection* conn) const;
+      bool isRunning(const Transport* transport) const;
+
+      Mutex mMutex;
+      Condition mQueued;
+      Condition mFinished;
+      std::deque<TlsConnection*> mQueue;
+      std::vector<TlsConnection*> mRunning;
+      std::vector<std::thread> mThreads;
+      const unsigned int mMaxQueued;
+      bool mShutdown;
+
+      // no value semantics
+      TlsHandshakePool(const TlsHandshakePool&);
+      TlsHandshakePool& operator=(const TlsHandshakePool&);
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,521 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <string.h>
+#include <time.h>
+
+#include "resip/stack/ssl/TlsSessionCache.hxx"
+#include "resip/stack/ssl/Security.hxx"
+#include "resip/stack/ConnectionBase.hxx"
+#include "resip/stack/Tuple.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/ResipAssert.h"
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#else
+#include <openssl/hmac.h>
+#endif
+
+using namespace resip;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
+
+namespace
+{
+
+// Not emptied on destruction: OpenSSL may already have been cleaned up by
+// the time static objects are destroyed at exit.
+class SessionStore
+{
+   public:
+      // Takes the caller's reference to session.
+      void add(const Data& key, SSL_SESSION* session, unsigned int max)
+      {
+         Sessions::iterator i = mSessions.find(key);
+         if (i != mSessions.end())
+         {
+            SSL_SESSION_free(i->second.session);
+            mOrder.erase(i->second.position);
+            mSessions.erase(i);
+         }
+         while (!mOrder.empty() && mSessions.size() >= max)
+         {
+            Sessions::iterator oldest = mSessions.find(mOrder.front());
+            SSL_SESSION_free(oldest->second.session);
+            mSessions.erase(oldest);
+            mOrder.pop_front();
+         }
+         if (max == 0)
+         {
+            SSL_SESSION_free(session);
+            return;
+         }
+         Entry& entry = mSessions[key];
+         entry.session = session;
+         entry.position = mOrder.insert(mOrder.end(), key);
+      }
+
+      // Returns a new reference, or 0.
+      SSL_SESSION* find(const Data& key)
+      {
+         Sessions::iterator i = mSessions.find(key);
+         if (i == mSessions.end())
+         {
+            return 0;
+         }
+         SSL_SESSION* session = i->second.session;
+         if (SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session) < (long)time(0))
+         {
+            SSL_SESSION_free(session);
+            mOrder.erase(i->second.position);
+            mSessions.erase(i);
+            return 0;
+         }
+         SSL_SESSION_up_ref(session);
+         return session;
+      }
+
+      void remove(const Data& key, const SSL_SESSION* session)
+      {
+         Sessions::iterator i = mSessions.find(key);
+         if (i != mSessions.end() && (!session || i->second.session == session))
+         {
+            SSL_SESSION_free(i->second.session);
+            mOrder.erase(i->second.position);
+            mSessions.erase(i);
+         }
+      }
+
+      void clear()
+      {
+         for (Sessions::iterator i = mSessions.begin(); i != mSessions.end(); ++i)
+         {
+            SSL_SESSION_free(i->second.session);
+         }
+         mSessions.clear();
+         mOrder.clear();
+      }
+
+   private:
+      typedef std::list<Data> Order;
+      struct Entry
+      {
+         SSL_SESSION* session;
+         Order::iterator position;
+      };
+      typedef std::map<Data, Entry> Sessions;
+      Sessions mSessions;
+      Order mOrder; // oldest first
+};
+
+struct TicketKey
+{
+   unsigned char name[16];
+   unsigned char aesKey[32];
+   unsigned char hmacKey[32];
+   time_t created;
+};
+
+struct TicketKeys
+{
+   TicketKeys() : count(0) {}
+   TicketKey keys[2]; // current, previous
+   unsigned int count;
+};
+
+Mutex cacheMutex;
+SessionStore serverSessions; // keyed by session id context + session id
+SessionStore clientSessions;
+std::map<Data, TicketKeys> ticketKeys; // by session id context
+std::atomic<int> ctxNameIndex(-1);
+unsigned int maxSessions = 20000;
+unsigned int ticketKeyLifetime = 12*60*60;
+std::atomic<unsigned int> fullHandshakeCount(0);
+std::atomic<unsigned int> resumedHandshakeCount(0);
+
+Data
+clientKey(const Tuple& who, const Data& sni)
+{
+   Data key(Tuple::inet_ntop(who));
+   key += ":";
+   key += Data(who.getPort());
+   key += "/";
+   key += sni;
+   return key;
+}
+
+Data
+sessionId(const SSL_SESSION* session)
+{
+   unsigned int length = 0;
+   const unsigned char* id = SSL_SESSION_get_id(session, &length);
+   return Data(reinterpret_cast<const char*>(id), length);
+}
+
+// The session id context for sessions on ctx with verifyMode: a digest of
+// the name ctx was configured with and verifyMode.
+Data
+sessionContext(const SSL_CTX* ctx, int verifyMode)
+{
+   const Data* name = ctxNameIndex >= 0 ? (const Data*)SSL_CTX_get_ex_data(ctx, ctxNameIndex) : 0;
+   Data context(name ? *name : Data::Empty);
+   context += "/";
+   context += Data(verifyMode);
+
+   unsigned char digest[EVP_MAX_MD_SIZE];
+   unsigned int length = 0;
+   if (EVP_Digest(context.data(), context.size(), digest, &length, EVP_sha256(), 0) != 1)
+   {
+      ErrLog(<< "Could not compute a TLS session id context");
+   }
+   return Data(reinterpret_cast<const char*>(digest), length < SSL_MAX_SID_CTX_LENGTH ? length : SSL_MAX_SID_CTX_LENGTH);
+}
+
+Data
+sessionContext(const SSL* ssl)
+{
+   return sessionContext(SSL_get_SSL_CTX(ssl), SSL_get_verify_mode(ssl));
+}
+
+Data
+serverKey(const Data& context, const Data& id)
+{
+   Data key(context);
+   key += id;
+   return key;
+}
+
+// Call with cacheMutex held. Returns false if no key could be made.
+bool
+currentTicketKey(TicketKeys& ticketKeys, TicketKey*& key)
+{
+   time_t now = time(0);
+   if (ticketKeys.count == 0 || now - ticketKeys.keys[0].created >= (time_t)ticketKeyLifetime)
+   {
+      TicketKey next;
+      if (RAND_bytes(next.name, sizeof(next.name)) != 1 ||
+          RAND_bytes(next.aesKey, sizeof(next.aesKey)) != 1 ||
+          RAND_bytes(next.hmacKey, sizeof(next.hmacKey)) != 1)
+      {
+         ErrLog(<< "Could not generate a TLS session ticket key");
+         return false;
+      }
+      next.created = now;
+      if (ticketKeys.count)
+      {
+         DebugLog(<< "Rotating TLS session ticket key");
+         ticketKeys.keys[1] = ticketKeys.keys[0];
+      }
+      ticketKeys.keys[0] = next;
+      ticketKeys.count = ticketKeys.count ? 2 : 1;
+   }
+   key = &ticketKeys.keys[0];
+   return true;
+}
+
+}
+
+extern "C"
+{
+
+static void
+freeCtxName(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx, long argl, void* argp)
+{
+   delete static_cast<Data*>(ptr);
+}
+
+}
+
+extern "C"
+{
+
+static int
+newSessionCallback(SSL* ssl, SSL_SESSION* session)
+{
+   if (SSL_is_server(ssl))
+   {
+      Data id(sessionId(session));
+      if (id.empty())
+      {
+         return 0;
+      }
+      Data key(serverKey(sessionContext(ssl), id));
+      Lock lock(cacheMutex);
+      serverSessions.add(key, session, maxSessions);
+      return 1;
+   }
+
+   ConnectionBase* connection = (ConnectionBase*)SSL_get_ex_data(ssl, BaseSecurity::resip_connection_ssl_ex_data_idx);
+   const char* sni = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+   if (!connection)
+   {
+      return 0;
+   }
+   Data key(clientKey(connection->who(), sni ? Data(sni) : Data::Empty));
+   Lock lock(cacheMutex);
+   clientSessions.add(key, session, maxSessions);
+   return 1;
+}
+
+static SSL_SESSION*
+getSessionCallback(SSL* ssl, const unsigned char* id, int length, int* copy)
+{
+   // find() took a new reference, which OpenSSL now owns.
+   *copy = 0;
+   Data key(serverKey(sessionContext(ssl), Data(reinterpret_cast<const char*>(id), length)));
+   Lock lock(cacheMutex);
+   return serverSessions.find(key);
+}
+
+static void
+removeSessionCallback(SSL_CTX* ctx, SSL_SESSION* session)
+{
+   unsigned int length = 0;
+   const unsigned char* context = SSL_SESSION_get0_id_context(session, &length);
+   Data key(serverKey(Data(reinterpret_cast<const char*>(context), length), sessionId(session)));
+   Lock lock(cacheMutex);
+   serverSessions.remove(key, session);
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int
+ticketKeyCallback(SSL* ssl, unsigned char name[16], unsigned char* iv,
+                  EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac, int enc)
+#else
+static int
+ticketKeyCallback(SSL* ssl, unsigned char name[16], unsigned char* iv,
+                  EVP_CIPHER_CTX* cipher, HMAC_CTX* mac, int enc)
+#endif
+{
+   // Tickets sealed for one session id context cannot even be opened by
+   // another.
+   Data context(sessionContext(ssl));
+   Lock lock(cacheMutex);
+   TicketKeys& keys = ticketKeys[context];
+   TicketKey* key = 0;
+   int ret = 1;
+   if (enc)
+   {
+      if (!currentTicketKey(keys, key) || RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1)
+      {
+         return -1;
+      }
+      memcpy(name, key->name, sizeof(key->name));
+      if (EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), 0, key->aesKey, iv) != 1)
+      {
+         return -1;
+      }
+   }
+   else
+   {
+      for (unsigned int i = 0; i < keys.count; ++i)
+      {
+         if (memcmp(name, keys.keys[i].name, sizeof(keys.keys[i].name)) == 0 &&
+             time(0) - keys.keys[i].created < (time_t)(2*ticketKeyLifetime))
+         {
+            key = &keys.keys[i];
+            // Ask for a fresh ticket if this one was sealed with the old key.
+            ret = (i == 0) ? 1 : 2;
+            break;
+         }
+      }
+      if (!key)
+      {
+         // Unknown or expired key; fall back to a full handshake.
+         return 0;
+      }
+      if (EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), 0, key->aesKey, iv) != 1)
+      {
+         return -1;
+      }
+   }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+   OSSL_PARAM params[3];
+   params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key->hmacKey, sizeof(key->hmacKey));
+   params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0);
+   params[2] = OSSL_PARAM_construct_end();
+   if (EVP_MAC_CTX_set_params(mac, params) != 1)
+   {
+      return -1;
+   }
+#else
+   if (HMAC_Init_ex(mac, key->hmacKey, sizeof(key->hmacKey), EVP_sha256(), 0) != 1)
+   {
+      return -1;
+   }
+#endif
+   return ret;
+}
+
+} // extern "C"
+
+void
+TlsSessionCache::configure(SSL_CTX* ctx, const Data& name)
+{
+   {
+      Lock lock(cacheMutex);
+      if (ctxNameIndex < 0)
+      {
+         ctxNameIndex = SSL_CTX_get_ex_new_index(0, 0, 0, 0, freeCtxName);
+         resip_assert(ctxNameIndex >= 0);
+      }
+   }
+   delete static_cast<Data*>(SSL_CTX_get_ex_data(ctx, ctxNameIndex));
+   SSL_CTX_set_ex_data(ctx, ctxNameIndex, new Data(name));
+
+   Data context(sessionContext(ctx, SSL_CTX_get_verify_mode(ctx)));
+   SSL_CTX_set_session_id_context(ctx, reinterpret_cast<const unsigned char*>(context.data()), (unsigned int)context.size());
+   SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_BOTH | SSL_SESS_CACHE_NO_INTERNAL);
+   SSL_CTX_sess_set_new_cb(ctx, newSessionCallback);
+   SSL_CTX_sess_set_get_cb(ctx, getSessionCallback);
+   SSL_CTX_sess_set_remove_cb(ctx, removeSessionCallback);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+   SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticketKeyCallback);
+#else
+   SSL_CTX_set_tlsext_ticket_key_cb(ctx, ticketKeyCallback);
+#endif
+}
+
+void
+TlsSessionCache::setSessionContext(SSL* ssl)
+{
+   Data context(sessionContext(ssl));
+   SSL_set_session_id_context(ssl, reinterpret_cast<const unsigned char*>(context.data()), (unsigned int)context.size());
+}
+
+void
+TlsSessionCache::resume(SSL* ssl, const Tuple& who, const Data& sni)
+{
+   SSL_SESSION* session;
+   {
+      Lock lock(cacheMutex);
+      session = clientSessions.find(clientKey(who, sni));
+   }
+   if (session)
+   {
+      DebugLog(<< "Offering cached TLS session to " << who << " (" << sni << ")");
+      SSL_set_session(ssl, session);
+      SSL_SESSION_free(session);
+   }
+}
+
+void
+TlsSessionCache::onHandshakeDone(SSL* ssl)
+{
+   if (SSL_session_reused(ssl))
+   {
+      resumedHandshakeCount.fetch_add(1, std::memory_order_relaxed);
+   }
+   else
+   {
+      fullHandshakeCount.fetch_add(1, std::memory_order_relaxed);
+   }
+}
+
+unsigned int
+TlsSessionCache::fullHandshakes()
+{
+   return fullHandshakeCount.load(std::memory_order_relaxed);
+}
+
+unsigned int
+TlsSessionCache::resumedHandshakes()
+{
+   return resumedHandshakeCount.load(std::memory_order_relaxed);
+}
+
+void
+TlsSessionCache::setMaxSessions(unsigned int max)
+{
+   Lock lock(cacheMutex);
+   maxSessions = max;
+}
+
+unsigned int
+TlsSessionCache::getMaxSessions()
+{
+   Lock lock(cacheMutex);
+   return maxSessions;
+}
+
+void
+TlsSessionCache::setTicketKeyLifetime(unsigned int seconds)
+{
+   Lock lock(cacheMutex);
+   ticketKeyLifetime = seconds;
+}
+
+unsigned int
+TlsSessionCache::getTicketKeyLifetime()
+{
+   Lock lock(cacheMutex);
+   return ticketKeyLifetime;
+}
+
+void
+TlsSessionCache::clear()
+{
+   Lock lock(cacheMutex);
+   serverSessions.clear();
+   clientSessions.clear();
+   ticketKeys.clear();
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
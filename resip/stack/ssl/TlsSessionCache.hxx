@@ -0,0 +1,125 @@
+#if !defined(RESIP_TLSSESSIONCACHE_HXX)
+#define RESIP_TLSSESSIONCACHE_HXX
+
+#include "rutil/Data.hxx"
+
+#include <openssl/ssl.h>
+
+namespace resip
+{
+
+class Tuple;
+
+/**
+   @brief TLS session resumption shared by every SSL_CTX that Security hands
+   to TlsTransport and WssTransport.
+
+   As a server, sessions are resumed from stateless session tickets, sealed
+   with an in-process key that is rotated every getTicketKeyLifetime()
+   seconds (tickets sealed with the previous key are still accepted, and
+   replaced), and, for clients that do not do tickets, from a session cache
+   keyed by session id. A session is only resumed by a context configured
+   with the same name that verifies client certificates the same way: each
+   such pair has its own session id context and ticket keys, so a session
+   set up where no client certificate was asked for cannot skip the check
+   on a transport that requires one. Transports for the same domain and
+   verification mode share sessions, so a client that reconnects to a
+   different listener still resumes.
+
+   As a client, the last session from each server is kept, keyed by the
+   server's address and the SNI name we sent, and offered on the next
+   connection to it.
+
+   The number of full and resumed handshakes is reported through
+   StatisticsManager (tlsFullHandshakes and tlsResumedHandshakes).
+
+   All methods are thread safe.
+*/
+class TlsSessionCache
+{
+   public:
+      /// Turns on tickets and the shared cache for ctx. Sessions are only
+      /// resumed between contexts configured with the same name, usually
+      /// the domain the context serves.
+      static void configure(SSL_CTX* ctx, const Data& name);
+
+      /// Server side: ties sessions on ssl to its verify mode. Call after
+      /// changing the verify mode of ssl from that of its context.
+      static void setSessionContext(SSL* ssl);
+
+      /// Client side: offers the cached session for (who, sni), if any.
+      static void resume(SSL* ssl, const Tuple& who, const Data& sni);
+
+      /// Counts a completed handshake on ssl as full or resumed.
+      static void onHandshakeDone(SSL* ssl);
+
+      static unsigned int fullHandshakes();
+      static unsigned int resumedHandshakes();
+
+      /// Maximum number of sessions kept in each of the server and client caches.
+      static void setMaxSessions(unsigned int max);
+      static unsigned int getMaxSessions();
+
+      /// Seconds a session ticket key is used for before it is replaced.
+      static void setTicketKeyLifetime(unsigned int seconds);
+      static unsigned int getTicketKeyLifetime();
+
+      /// Drops every cached session and ticket key.
+      static void clear();
+
+   private:
+      // static interface only
+      TlsSessionCache();
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -56,30 +56,41 @@ main(int argc, char** argv)
 {
    Log::initialize(Log::Cout, Log::Debug, argv[0]);
 
-   TimeLimitFifo<Message> f(0, 0);
-   TimeLimitTimerQueue timer(f);
-
-   cerr << "Before Fifo size: " << f.size() << endl;
-   assert(f.size() == 0);
-   cerr << "next timer = " << timer.msTillNextTimer() << endl;
-   assert(timer.msTillNextTimer() == INT_MAX);
-
-   timer.add(1000, new AppMessage("first"));
-   cerr << timer;
-   assert(f.size() == 0);
-   timer.process();
-   cerr << "Immediately after Fifo size: " << f.size() << endl;
-   assert(f.size() == 0);
-
-   sleep(1);
-   timer.process();
-   assert(f.size() == 1);
-
-   Message* msg = f.getNext();
-
-   cerr << *msg << endl;
-
-   delete msg;
+   // Once with the timers in a heap, once in a TimerWheel.
+   for (int wheel = 0; wheel < 2; ++wheel)
+   {
+      TimerQueueBase::useTimerWheel = (wheel == 1);
+
+      TimeLimitFifo<Message> f(0, 0);
+      TimeLimitTimerQueue timer(f);
+
+      cerr << "Before Fifo size: " << f.size() << endl;
+      assert(f.size() == 0);
+      cerr << "next timer = " << timer.msTillNextTimer() << endl;
+      assert(timer.msTillNextTimer() == INT_MAX);
+
+      timer.add(1000, new AppMessage("first"));
+      // still pending when the queue goes away, which deletes it
+      timer.add(60000, new AppMessage("last"));
+      cerr << timer;
+      assert(isNear(timer.msTillNextTimer(), 1000));
+      assert(f.size() == 0);
+      timer.process();
+      cerr << "Immediately after Fifo size: " << f.size() << endl;
+      assert(f.size() == 0);
+
+      sleep(1);
+      timer.process();
+      assert(f.size() == 1);
+      assert(timer.size() == 1);
+      assert(isNear(timer.msTillNextTimer(), 59000));
+
+      Message* msg = f.getNext();
+
+      cerr << *msg << endl;
+
+      delete msg;
+   }
    return 0;
 }
 
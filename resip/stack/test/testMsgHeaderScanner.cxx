@@ -0,0 +1,301 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <vector>
+
+#include "resip/stack/MsgHeaderScanner.hxx"
+#include "resip/stack/SipMessage.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/ParseException.hxx"
+#include "rutil/Random.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Checks that the vector fast path of MsgHeaderScanner produces exactly the
+// same results as the plain state machine (on the RFC 4475 torture messages,
+// and on random garbage, both in one chunk and split into many small ones),
+// and then reports the scan rate with and without it.
+
+static const char* const tortureFiles[] = {
+   "badaspec.dat", "badbranch.dat", "baddate.dat", "baddn.dat",
+   "badinv01.dat", "badvers.dat", "bcast.dat", "bext01.dat", "bigcode.dat",
+   "clerr.dat", "cparam01.dat", "cparam02.dat", "dblreq.dat", "esc01.dat",
+   "esc02.dat", "escnull.dat", "escruri.dat", "insuf.dat", "intmeth.dat",
+   "inv2543.dat", "invut.dat", "longreq.dat", "ltgtruri.dat", "lwsdisp.dat",
+   "lwsruri.dat", "lwsstart.dat", "mcl01.dat", "mismatch01.dat",
+   "mismatch02.dat", "mpart01.dat", "multi01.dat", "ncl.dat", "noreason.dat",
+   "novelsc.dat", "quotbal.dat", "regaut01.dat", "regbadct.dat",
+   "regescrt.dat", "scalar02.dat", "scalarlg.dat", "sdp01.dat", "semiuri.dat",
+   "test.dat", "transports.dat", "trws.dat", "unkscm.dat", "unksm2.dat",
+   "unreason.dat", "wsinv.dat", "zeromf.dat"
+};
+
+static Data
+readFile(const char* name)
+{
+   ifstream is(name, ios::binary);
+   if (!is)
+   {
+      return Data::Empty;
+   }
+   stringstream ss;
+   ss << is.rdbuf();
+   return Data(ss.str());
+}
+
+// Scans "text" the way ConnectionBase does, handing the scanner at most
+// "chunkSize" new characters at a time, and describes everything observable
+// about the outcome: the result, where the scan stopped, the header count,
+// and the message as built by the scanner.
+static Data
+scan(const Data& text, unsigned int chunkSize)
+{
+   MsgHeaderScanner scanner;
+   SipMessage msg;
+   scanner.prepareForMessage(&msg);
+
+   Data description;
+   DataStream ds(description);
+   MsgHeaderScanner::ScanChunkResult result = MsgHeaderScanner::scrNextChunk;
+   unsigned int consumed = 0;
+   unsigned int numSaved = 0;
+   const char* saved = 0;
+   try
+   {
+      while (result == MsgHeaderScanner::scrNextChunk && consumed < text.size())
+      {
+         unsigned int numNew = resipMin(chunkSize, (unsigned int)(text.size() - consumed));
+         char* buffer = MsgHeaderScanner::allocateBuffer(numSaved + numNew);
+         msg.addBuffer(buffer);
+         memcpy(buffer, saved, numSaved);
+         memcpy(buffer + numSaved, text.data() + consumed, numNew);
+         // Whatever follows the chunk must not matter.
+         memset(buffer + numSaved + numNew, 'x', MsgHeaderScanner::MaxNumCharsChunkOverflow);
+         consumed += numNew;
+
+         char* unprocessed;
+         result = scanner.scanChunk(buffer, numSaved + numNew, &unprocessed);
+         numSaved = (unsigned int)(buffer + numSaved + numNew - unprocessed);
+         saved = unprocessed;
+      }
+      ds << "result=" << result
+         << " remaining=" << (numSaved + text.size() - consumed)
+         << " headers=" << scanner.getHeaderCount() << endl;
+      if (result == MsgHeaderScanner::scrEnd)
+      {
+         ds << msg;
+      }
+   }
+   catch (BaseException& e)
+   {
+      ds << "exception after " << consumed << ": " << e.getMessage();
+   }
+   ds.flush();
+   return description;
+}
+
+// Messages that are mostly well formed, but with random runs of every
+// character the scanner treats specially thrown into the values.
+static Data
+randomMessage()
+{
+   static const char* const names[] = { "Via", "To", "f", "Contact", "Subject",
+                                        "Accept", "X-Unknown", "Require" };
+   static const char special[] = " \t:\"<>\\,;%()\r\n\0";
+   Data text("INVITE sip:bob@example.com SIP/2.0\r\n");
+   int numHeaders = 1 + Random::getRandom() % 12;
+   for (int h = 0; h < numHeaders; ++h)
+   {
+      text += names[Random::getRandom() % (sizeof(names)/sizeof(*names))];
+      text += (Random::getRandom() % 4) ? ": " : " :\r\n ";
+      int valueLength = Random::getRandom() % 120;
+      for (int i = 0; i < valueLength; ++i)
+      {
+         int r = Random::getRandom() % 100;
+         if (r < 12)
+         {
+            text += special[Random::getRandom() % (sizeof(special) - 1)];
+         }
+         else if (r < 14)
+         {
+            text += "\r\n ";
+         }
+         else
+         {
+            text += (char)('a' + Random::getRandom() % 26);
+         }
+      }
+      text += "\r\n";
+   }
+   text += "\r\nbody";
+   return text;
+}
+
+static bool
+compare(const Data& name, const Data& text)
+{
+   static const unsigned int chunkSizes[] = { 1, 3, 16, 31, 64, 0xFFFFFFFF };
+   for (unsigned int i = 0; i < sizeof(chunkSizes)/sizeof(*chunkSizes); ++i)
+   {
+      MsgHeaderScanner::setVectorScanEnabled(false);
+      Data expected = scan(text, chunkSizes[i]);
+      MsgHeaderScanner::setVectorScanEnabled(true);
+      Data actual = scan(text, chunkSizes[i]);
+      if (expected != actual)
+      {
+         cerr << "FAILED: " << name << " chunk size " << chunkSizes[i] << endl
+              << "expected: " << expected << endl
+              << "actual: " << actual << endl;
+         return false;
+      }
+   }
+   return true;
+}
+
+// Only the scanning is timed; the messages and their buffers are set up
+// beforehand, a batch at a time.
+static double
+benchmark(const vector<Data>& corpus, bool vectorScan)
+{
+   MsgHeaderScanner::setVectorScanEnabled(vectorScan);
+   MsgHeaderScanner scanner;
+   uint64_t numBytes = 0;
+   uint64_t elapsed = 0;
+   while (elapsed < 500000)
+   {
+      vector<SipMessage*> msgs;
+      vector<char*> buffers;
+      for (int n = 0; n < 20; ++n)
+      {
+         for (vector<Data>::const_iterator i = corpus.begin(); i != corpus.end(); ++i)
+         {
+            char* buffer = MsgHeaderScanner::allocateBuffer(i->size());
+            memcpy(buffer, i->data(), i->size());
+            SipMessage* msg = new SipMessage;
+            msg->addBuffer(buffer);
+            msgs.push_back(msg);
+            buffers.push_back(buffer);
+         }
+      }
+
+      uint64_t start = Timer::getTimeMicroSec();
+      for (size_t i = 0; i < msgs.size(); ++i)
+      {
+         const Data& text = corpus[i % corpus.size()];
+         scanner.prepareForMessage(msgs[i]);
+         char* unprocessed;
+         scanner.scanChunk(buffers[i], (unsigned int)text.size(), &unprocessed);
+         numBytes += unprocessed - buffers[i];
+      }
+      elapsed += Timer::getTimeMicroSec() - start;
+
+      for (size_t i = 0; i < msgs.size(); ++i)
+      {
+         delete msgs[i];
+      }
+   }
+   return numBytes * 1000000.0 / elapsed;
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   cout << "vector scan available: "
+        << (MsgHeaderScanner::isVectorScanAvailable() ? "yes" : "no") << endl;
+
+   bool ok = true;
+   vector<Data> corpus;
+   for (unsigned int i = 0; i < sizeof(tortureFiles)/sizeof(*tortureFiles); ++i)
+   {
+      Data text = readFile(tortureFiles[i]);
+      if (text.empty())
+      {
+         cerr << "FAILED: could not read " << tortureFiles[i] << endl;
+         ok = false;
+         continue;
+      }
+      corpus.push_back(text);
+      ok = compare(tortureFiles[i], text) && ok;
+   }
+
+   Random::initialize();
+   for (int i = 0; i < 2000; ++i)
+   {
+      Data text = randomMessage();
+      ok = compare("random message " + Data(i) + ":\n" + text, text) && ok;
+   }
+
+   if (!ok)
+   {
+      return -1;
+   }
+   cout << "scanner results identical with and without vector scan" << endl;
+
+   double scalarRate = benchmark(corpus, false);
+   double vectorRate = benchmark(corpus, true);
+   cout << "scalar: " << (uint64_t)(scalarRate / 1e6) << " MB/s, "
+        << "vector: " << (uint64_t)(vectorRate / 1e6) << " MB/s" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
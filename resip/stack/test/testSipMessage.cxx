@@ -2394,6 +2394,139 @@ main(int argc, char** argv)
        assert( msg->header(resip::h_PAccessNetworkInfos).size() == 2);
    }
 
+   {
+      // With reuseWireEncoding, the received lines of unmodified headers are
+      // copied as they are (compact forms, odd whitespace and all), modified
+      // headers are encoded where they were, and new ones go at the end.
+      SipMessage::reuseWireEncoding = true;
+      Data txt("INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+               "v: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bKnashds8\r\n"
+               "To:   Bob <sip:bob@biloxi.com>\r\n"
+               "f: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+               "Call-ID: a84b4c76e66710\r\n"
+               "CSeq: 314159 INVITE\r\n"
+               "Max-Forwards: 70\r\n"
+               "X-Custom: one,\r\n two\r\n"
+               "Route: <sip:p1.example.com;lr>, <sip:p2.example.com;lr>\r\n"
+               "Supported: timer\r\n"
+               "Contact: <sip:alice@pc33.atlanta.com>\r\n"
+               "X-Other: 1\r\n"
+               "Content-Type: text/plain\r\n"
+               "Content-Length: 5\r\n"
+               "\r\n"
+               "hello");
+
+      unique_ptr<SipMessage> msg(TestSupport::makeMessage(txt));
+      assert(Data::from(*msg) == txt);
+
+      // Parsing, but not modifying, a header does not count as a change.
+      assert(msg->const_header(h_From).uri().user() == "alice");
+      assert(msg->const_header(h_To).uri().user() == "bob");
+      assert(Data::from(*msg) == txt);
+
+      // What a proxy does to a request it forwards.
+      msg->header(h_RequestLine).uri() = Uri("sip:bob@192.0.2.4");
+      Via via(msg->header(h_Vias).front());
+      via.sentHost() = "proxy.example.com";
+      msg->header(h_Vias).push_front(via);
+      msg->header(h_MaxForwards).value()--;
+      msg->header(h_Routes).pop_front();
+      msg->header(h_RecordRoutes).push_front(NameAddr("<sip:proxy.example.com;lr>"));
+      msg->remove(h_Supporteds);
+      msg->remove(ExtensionHeader("X-Other"));
+      msg->header(ExtensionHeader("X-Added")).push_back(StringCategory("2"));
+
+      Data expected("INVITE sip:bob@192.0.2.4 SIP/2.0\r\n"
+                    "Via: SIP/2.0/UDP proxy.example.com;branch=z9hG4bKnashds8\r\n"
+                    "v: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bKnashds8\r\n"
+                    "To:   Bob <sip:bob@biloxi.com>\r\n"
+                    "f: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+                    "Call-ID: a84b4c76e66710\r\n"
+                    "CSeq: 314159 INVITE\r\n"
+                    "Max-Forwards: 69\r\n"
+                    "X-Custom: one,\r\n two\r\n"
+                    "Route: <sip:p2.example.com;lr>\r\n"
+                    "Contact: <sip:alice@pc33.atlanta.com>\r\n"
+                    "Content-Type: text/plain\r\n"
+                    "Record-Route: <sip:proxy.example.com;lr>\r\n"
+                    "X-Added: 2\r\n"
+                    "Content-Length: 5\r\n"
+                    "\r\n"
+                    "hello");
+      Data encoded = Data::from(*msg);
+      assert(encoded == expected);
+
+      // Copies keep their own copy of the received lines.
+      unique_ptr<SipMessage> copy(new SipMessage(*msg));
+      msg.reset();
+      assert(Data::from(*copy) == expected);
+      copy->header(h_CSeq).sequence()++;
+      SipMessage copyOfCopy(*copy);
+      copy.reset();
+      assert(Data::from(copyOfCopy).find("CSeq: 314160 INVITE\r\nMax-Forwards: 69\r\n") != Data::npos);
+
+      // Only messages scanned from a single buffer get this.
+      SipMessage::reuseWireEncoding = false;
+      unique_ptr<SipMessage> plain(TestSupport::makeMessage(txt));
+      assert(Data::from(*plain) != txt);
+   }
+
+   {
+      // Copying a received message with reuseWireEncoding leaves the values
+      // that were parsed but not changed (and the start line) to be parsed
+      // again from the copy's buffer, so what they parse to points into it
+      // until it is written to. Changed values are copied as they are.
+      SipMessage::reuseWireEncoding = true;
+      Data txt("INVITE sip:bob@biloxi.example.com SIP/2.0\r\n"
+               "Via: SIP/2.0/UDP pc33.atlanta.example.com;branch=z9hG4bKnashds8;received=192.0.2.1\r\n"
+               "To: Bob <sip:bob@biloxi.example.com>\r\n"
+               "From: Alice <sip:alice@atlanta.example.com>;tag=1928301774\r\n"
+               "Call-ID: a84b4c76e66710@pc33.atlanta.example.com\r\n"
+               "CSeq: 314159 INVITE\r\n"
+               "Max-Forwards: 70\r\n"
+               "Content-Length: 0\r\n"
+               "\r\n");
+
+      unique_ptr<SipMessage> msg(TestSupport::makeMessage(txt));
+      assert(msg->const_header(h_RequestLine).uri().host() == "biloxi.example.com");
+      assert(msg->const_header(h_Vias).front().sentHost() == "pc33.atlanta.example.com");
+      assert(msg->const_header(h_From).param(p_tag) == "1928301774");
+      assert(msg->const_header(h_From).uri().getAor() == "alice@atlanta.example.com");
+      msg->header(h_To).displayName() = "Robert";
+
+      unique_ptr<SipMessage> copy(new SipMessage(*msg));
+      msg.reset();
+
+      assert(copy->const_header(h_To).displayName() == "Robert");
+      assert(copy->const_header(h_To).uri().host() == "biloxi.example.com");
+
+      const Via& via = copy->const_header(h_Vias).front();
+      assert(via.sentHost().isShared());
+      assert(via.sentHost() == "pc33.atlanta.example.com");
+      assert(via.param(p_branch).getTransactionId() == "nashds8");
+      assert(via.param(p_received) == "192.0.2.1");
+      const NameAddr& from = copy->const_header(h_From);
+      assert(from.uri().host().isShared());
+      assert(from.displayName() == "Alice");
+      assert(from.param(p_tag) == "1928301774");
+      assert(from.uri().getAor() == "alice@atlanta.example.com");
+      assert(copy->const_header(h_RequestLine).uri().host().isShared());
+      assert(copy->const_header(h_RequestLine).uri().host() == "biloxi.example.com");
+
+      // Writing to a field gives it its own buffer; the others stay put.
+      copy->header(h_From).uri().host() = "example.net";
+      assert(!copy->const_header(h_From).uri().host().isShared());
+      assert(copy->const_header(h_Vias).front().sentHost().isShared());
+      assert(Data::from(*copy).find("From: \"Alice\"<sip:alice@example.net>;tag=1928301774\r\n") != Data::npos);
+
+      // A parsed field copied out of the message owns its bytes.
+      Uri target(copy->const_header(h_RequestLine).uri());
+      copy.reset();
+      assert(!target.host().isShared());
+      assert(target.host() == "biloxi.example.com");
+      SipMessage::reuseWireEncoding = false;
+   }
+
    resipCerr << "\nTEST OK" << endl;
    return 0;
 }
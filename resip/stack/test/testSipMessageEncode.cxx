@@ -14,16 +14,47 @@ class Args
 {
 public:
 
-	Args(void):runs(100000),runFs(false),runDs(true)
+	Args(void):runs(100000),runFs(false),runDs(true),runFwd(true)
 	{}
 
 	int runs;
 	bool runFs;
 	bool runDs;
+	bool runFwd;
 };
 
 void processArgs(int argc, char* argv[],Args &args);
 
+// Copies and encodes the message the way a proxy forwards it: new
+// Request-URI, one more Via, one less Max-Forwards.
+double forward(const Data& txt, const Args& args, bool reuseWireEncoding)
+{
+	SipMessage::reuseWireEncoding = reuseWireEncoding;
+	SipMessage *msg = SipMessage::make(txt);
+	msg->const_header(h_Vias).front().param(p_branch);
+	msg->const_header(h_CSeq).method();
+
+	Data data;
+	DataStream resipStr(data);
+	uint64_t startTime = Timer::getTimeMs();
+	for(int i=0; i<args.runs; i++)
+	{
+		SipMessage fwd(*msg);
+		fwd.header(h_RequestLine).uri().host() = "192.168.2.93";
+		Via via;
+		via.sentHost() = "192.168.2.221";
+		fwd.header(h_Vias).push_front(via);
+		fwd.header(h_MaxForwards).value()--;
+		fwd.encode(resipStr);
+		resipStr.flush();
+		data.clear();
+	}
+	uint64_t elapsed = Timer::getTimeMs() - startTime;
+	delete msg;
+	SipMessage::reuseWireEncoding = false;
+	return ((double) elapsed / 1000.0);
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -31,7 +62,7 @@ main(int argc, char* argv[])
 
 	cout << "\r\n------------------------------------------------------\r\n";
 	cout << "Resiprocate resip::SipMessage encoder speed test rev 1.0\r\n";
-	cout << "Args: [-r <number of runs>] [-runfs=(yes|no)] [-runds=(yes|no)]\r\n";
+	cout << "Args: [-r <number of runs>] [-runfs=(yes|no)] [-runds=(yes|no)] [-runfwd=(yes|no)]\r\n";
 	cout << "Example: -r 100000 -runfs=yes -runds=no\r\n";
 	cout << "------------------------------------------------------------\r\n";
 
@@ -127,6 +158,15 @@ main(int argc, char* argv[])
 		cout << "\r\nOutput to resip::DataStream completed, elapsed time= " << secs << " seconds.\r\n";
 	}
 
+	if( args.runFwd )
+	{
+		cout << "\r\nCopy, modify and encode as forwarded, runs = " << args.runs << ", ...\r\n";
+		secs = forward(txt, args, false);
+		cout << "\r\nForwarding completed, elapsed time= " << secs << " seconds.\r\n";
+		secs = forward(txt, args, true);
+		cout << "\r\nForwarding with reuseWireEncoding completed, elapsed time= " << secs << " seconds.\r\n";
+	}
+
 	cout << "Test complete.\r\n";
 
 	return 0;
@@ -181,5 +221,16 @@ void processArgs(int argc, char* argv[],Args &args)
 				args.runDs = false;
 			}
 		}
+		else if( arg.substr(0,8) == "-runfwd=" )
+		{
+			if( arg.substr(8) == "yes" )
+			{
+				args.runFwd = true;
+			}
+			else
+			{
+				args.runFwd = false;
+			}
+		}
 	}
 }
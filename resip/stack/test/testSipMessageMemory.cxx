@@ -2,15 +2,121 @@
 #include "resip/stack/Uri.hxx"
 #include "resip/stack/test/TestSupport.hxx"
 
+#include "rutil/DataStream.hxx"
+
 #include <iostream>
 #include <memory>
+#include <new>
+#include <stdlib.h>
 
 using namespace resip;
 using namespace std;
 
+// Count every heap allocation made by the process, library included.
+static size_t numAllocations = 0;
+
+void* operator new(size_t size)
+{
+   ++numAllocations;
+   void* p = malloc(size ? size : 1);
+   if (!p)
+   {
+      throw std::bad_alloc();
+   }
+   return p;
+}
+
+void* operator new[](size_t size)
+{
+   return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+   free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+   free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+   free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+   free(p);
+}
+
+// Average number of heap allocations made to parse, fully decode and
+// re-encode (as a proxy would) one message.
+static double
+allocationsPerMessage(const Data& txt)
+{
+   const int numMessages = 1000;
+   Data encoded;
+   encoded.reserve(txt.size() * 2);
+   size_t start = numAllocations;
+   for (int i = 0; i < numMessages; ++i)
+   {
+      unique_ptr<SipMessage> msg(SipMessage::make(txt));
+      msg->parseAllHeaders();
+      encoded.truncate(0);
+      {
+         DataStream ds(encoded);
+         msg->encode(ds);
+      }
+   }
+   return double(numAllocations - start) / numMessages;
+}
+
 int
 main()
 {
+   {
+      resipCerr << "Testing allocations per message" << endl;
+
+      const Data txt("INVITE sip:bob@biloxi.example.com SIP/2.0\r\n"
+                     "Via: SIP/2.0/UDP proxy2.example.com:5060;branch=z9hG4bK721e4.1;received=192.0.2.3\r\n"
+                     "Via: SIP/2.0/UDP proxy1.example.com:5060;branch=z9hG4bK2d4790.1;received=192.0.2.2\r\n"
+                     "Via: SIP/2.0/UDP pc33.atlanta.example.com;branch=z9hG4bKnashds8;received=192.0.2.1\r\n"
+                     "Max-Forwards: 68\r\n"
+                     "Record-Route: <sip:proxy2.example.com;lr>, <sip:proxy1.example.com;lr>\r\n"
+                     "Route: <sip:edge1.biloxi.example.com;lr>, <sip:edge2.biloxi.example.com;lr>\r\n"
+                     "To: Bob <sip:bob@biloxi.example.com>\r\n"
+                     "From: Alice <sip:alice@atlanta.example.com>;tag=1928301774\r\n"
+                     "Call-ID: a84b4c76e66710@pc33.atlanta.example.com\r\n"
+                     "CSeq: 314159 INVITE\r\n"
+                     "Contact: <sip:alice@pc33.atlanta.example.com;transport=udp>;+sip.instance=\"<urn:uuid:00000000-0000-1000-8000-000A95A0E128>\"\r\n"
+                     "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE, SUBSCRIBE, INFO\r\n"
+                     "Supported: replaces, outbound, gruu, timer\r\n"
+                     "User-Agent: testSipMessageMemory\r\n"
+                     "X-Unknown-Header: something odd\r\n"
+                     "Content-Type: application/sdp\r\n"
+                     "Content-Length: 149\r\n"
+                     "\r\n"
+                     "v=0\r\n"
+                     "o=alice 2890844526 2890844526 IN IP4 pc33.atlanta.example.com\r\n"
+                     "s=-\r\n"
+                     "c=IN IP4 192.0.2.101\r\n"
+                     "t=0 0\r\n"
+                     "m=audio 49172 RTP/AVP 0\r\n"
+                     "a=rtpmap:0 PCMU/8000\r\n");
+
+      SipMessage::useArena = false;
+      double pooled = allocationsPerMessage(txt);
+      SipMessage::useArena = true;
+      double arena = allocationsPerMessage(txt);
+      SipMessage::useArena = false;
+
+      resipCerr << "allocations per message: " << pooled << " without arena, "
+                << arena << " with arena" << endl;
+      assert(arena < pooled);
+   }
+
    {
       const char *txt1 = "REGISTER sip:registrar.biloxi.com SIP/2.0\r\nVia: SIP/2.0/UDP bobspc.biloxi.com:5060;branch=z9hG4bKnashds7\r\nMax-Forwards: 70\r\nTo: Bob <sip:bob@biloxi.com>\r\nFrom: Bob <sip:bob@biloxi.com>;tag=456248\r\nCall-ID: 843817637684230@998sdasdh09\r\nCSeq: 1826 REGISTER\r\nContact: <sip:bob@192.0.2.4>\r\nExpires: 7200\r\nContent-Length: 0\r\n\r\n";
 
@@ -159,7 +159,8 @@ class SipStackAndThread
    public:
       SipStackAndThread(const char *tType,
         AsyncProcessHandler *notifyDn=0,
-        AsyncProcessHandler *notifyUp=0);
+        AsyncProcessHandler *notifyUp=0,
+        unsigned int shards=1);
          ~SipStackAndThread() {
          destroy();
       }
@@ -207,7 +208,8 @@ class SipStackAndThread
 
 
 SipStackAndThread::SipStackAndThread(const char *tType,
- AsyncProcessHandler *notifyDn, AsyncProcessHandler *notifyUp)
+ AsyncProcessHandler *notifyDn, AsyncProcessHandler *notifyUp,
+ unsigned int shards)
   : mStack(0), 
       mThread(0), 
       mSelIntr(0), 
@@ -253,6 +255,7 @@ SipStackAndThread::SipStackAndThread(const char *tType,
    options.mAsyncProcessHandler = mEventIntr?mEventIntr
       :(mSelIntr?mSelIntr:notifyDn);
    options.mPollGrp = mPollGrp;
+   options.mTransactionShards = shards;
    mStack = new SipStack(options);
    
    mStack->setFallbackPostNotify(notifyUp);
@@ -619,6 +622,9 @@ main(int argc, char* argv[])
    int sendSleepMs = 0;
    int cManager=0;
    int statisticsInterval=60;
+   int shards = 1;
+   int udpBatch = 1;
+   int numSockets = 1;
 
 #if defined(HAVE_POPT_H)
 
@@ -646,6 +652,9 @@ main(int argc, char* argv[])
       {"use-congestion-manager",0, POPT_ARG_NONE, &cManager ,   0, "use a CongestionManager", 0},
       {"statistics-interval",       0,   POPT_ARG_INT,    &statisticsInterval,0, "time in seconds between statistics logging", 0},
       {"domain",      'd', POPT_ARG_STRING, &domain,    0, "the SIP domain to use", nullptr},
+      {"shards",      0,   POPT_ARG_INT,    &shards,    0, "number of transaction shards (one thread each with multithreadedstack)", 0},
+      {"udp-batch",   0,   POPT_ARG_INT,    &udpBatch,  0, "datagrams per recvmmsg/sendmmsg on UDP transports", 0},
+      {"sockets",     0,   POPT_ARG_INT,    &numSockets, 0, "SO_REUSEPORT sockets (each with own thread) per receiver UDP/TCP transport", 0},
       POPT_AUTOHELP
       { NULL, 0, 0, NULL, 0 }
    };
@@ -685,6 +694,9 @@ main(int argc, char* argv[])
      <<" listen="<<doListen
      <<" tf="<<tpFlags
      <<" domain="<<sipDomain
+     <<" shards="<<shards
+     <<" udpbatch="<<udpBatch
+     <<" sockets="<<numSockets
      <<"." << endl;
 
    const char *eachThreadType = threadType;
@@ -717,8 +729,8 @@ main(int argc, char* argv[])
    {
       notifyUp = &sharedUp;
    }
-   SipStackAndThread receiver(eachThreadType, commonIntr, notifyUp);
-   SipStackAndThread sender(eachThreadType, commonIntr, notifyUp);
+   SipStackAndThread receiver(eachThreadType, commonIntr, notifyUp, shards);
+   SipStackAndThread sender(eachThreadType, commonIntr, notifyUp, shards);
    receiver.getStack().setStatisticsInterval(statisticsInterval);
    sender.getStack().setStatisticsInterval(statisticsInterval);
 
@@ -821,7 +833,13 @@ main(int argc, char* argv[])
                              /*sipDomain*/Data::Empty, 
                              /*keypass*/Data::Empty, 
                              SecurityTypes::SSLv23,
-                             tpFlags));
+                             tpFlags,
+                             /*cert*/"", /*key*/"",
+                             SecurityTypes::None,
+                             /*useEmailAsSIP*/false,
+                             nullptr, nullptr,
+                             /*netNs*/Data::Empty,
+                             numSockets));
 
       transports.push_back(receiver->addTransport(TCP, 
                              registrarPort+idx, 
@@ -831,7 +849,13 @@ main(int argc, char* argv[])
                              /*sipDomain*/Data::Empty, 
                              /*keypass*/Data::Empty, 
                              SecurityTypes::SSLv23,
-                             tpFlags));
+                             tpFlags,
+                             /*cert*/"", /*key*/"",
+                             SecurityTypes::None,
+                             /*useEmailAsSIP*/false,
+                             nullptr, nullptr,
+                             /*netNs*/Data::Empty,
+                             numSockets));
 
 #ifdef USE_SSL
       if (idx == 0)
@@ -866,6 +890,14 @@ main(int argc, char* argv[])
 #endif /* USE_SSL */
    }
 
+   if(udpBatch > 1)
+   {
+      for(std::vector<Transport*>::iterator t = transports.begin(); t != transports.end(); ++t)
+      {
+         (*t)->setBatchSize(udpBatch);
+      }
+   }
+
    std::unique_ptr<CongestionManager> senderCongestionManager;
    std::unique_ptr<CongestionManager> receiverCongestionManager;
    if(cManager)
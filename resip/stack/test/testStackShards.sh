@@ -0,0 +1,20 @@
+#!/bin/sh
+
+# Runs testStack with an increasing number of transaction shards, so that
+# the effect of SipStackOptions::mTransactionShards on throughput can be
+# compared. The stack and the transports run in their own threads; on a
+# single-core machine the rate should stay flat, on a multi-core machine it
+# should rise until the transport or TU threads become the bottleneck.
+#
+# Extra arguments are passed to each testStack run, e.g.:
+#   ./testStackShards.sh --protocol=tcp --num-runs=100000
+
+set -e
+
+for SHARDS in 1 2 4 8
+do
+   echo "Running UDP REGISTER test with ${SHARDS} transaction shard(s)"
+   ./testStack --protocol=udp --thread-type=multithreadedstack --tf=32 \
+      --num-runs=50000 --window-size=500 --shards=${SHARDS} "$@" \
+      | grep "performed in"
+done
@@ -238,6 +238,45 @@ main(int argc, char* argv[])
    cout << runs << " calls performed in " << elapsed << " ms, a rate of "
         << runs / ((float) elapsed / 1000.0) << " calls per second.]" << endl;
 
+   {
+      // A burst of small messages queued on one connection is gathered into
+      // few writes; they must still arrive whole and in order.
+      const unsigned int burst = 200;
+      for (unsigned int i=0; i<burst; i++)
+      {
+         std::unique_ptr<SipMessage> m(Helper::makeInvite( target, from, from));
+         m->header(h_Vias).front().transport() = Tuple::toData(sender->transport());
+         m->header(h_Vias).front().sentHost() = "localhost";
+         m->header(h_Vias).front().sentPort() = sender->port();
+         m->header(h_CSeq).sequence() = i;
+         Data encoded;
+         {
+            DataStream strm(encoded);
+            m->encode(strm);
+         }
+         std::unique_ptr<SendData> toSend(sender->makeSendData(dest, encoded, Data(tid++), Data::Empty));
+         sender->send(std::move(toSend));
+      }
+
+      unsigned int received = 0;
+      for (int p=0; p < 1000 && received < burst; ++p)
+      {
+         process(sender, receiver);
+         while (rxFifo.messageAvailable())
+         {
+            std::unique_ptr<Message> msg(rxFifo.getNext());
+            SipMessage* sip = dynamic_cast<SipMessage*>(msg.get());
+            if (sip)
+            {
+               assert (sip->header(h_CSeq).sequence() == received);
+               ++received;
+            }
+         }
+      }
+      assert(received == burst);
+      cout << burst << " queued messages received in order." << endl;
+   }
+
    SipMessage::checkContentLength=false;
    {
       uint64_t startTime = Timer::getTimeMs();
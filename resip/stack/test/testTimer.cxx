@@ -118,6 +118,38 @@ main()
    timer.process();   
    assert(r.size() == 5);
 
+   const bool useTimerWheel = TimerQueueBase::useTimerWheel;
+   {
+      // Timers in the heap cannot be cancelled; their handles are 0.
+      TimerQueueBase::useTimerWheel = false;
+      TransactionTimerQueue heap(r);
+      assert(heap.add(Timer::TimerB, "heap", 100) == 0);
+      assert(!heap.cancel(0));
+      assert(heap.size() == 1);
+   }
+
+   {
+      TimerQueueBase::useTimerWheel = true;
+      TransactionTimerQueue wheel(r);
+
+      TransactionTimerQueue::Handle kept = wheel.add(Timer::TimerA, "kept", 100);
+      TransactionTimerQueue::Handle cancelled = wheel.add(Timer::TimerB, "cancelled", 100);
+      assert(kept && cancelled);
+      assert(wheel.isPending(cancelled));
+      assert(wheel.cancel(cancelled));
+      assert(!wheel.isPending(cancelled));
+      assert(!wheel.cancel(cancelled));
+      assert(wheel.size() == 1);
+
+      usleep(300*1000);
+      wheel.process();
+      assert(r.size() == 6);
+      assert(!wheel.isPending(kept));
+      assert(!wheel.cancel(kept));
+      assert(wheel.empty());
+   }
+   TimerQueueBase::useTimerWheel = useTimerWheel;
+
    cerr << "All OK" << endl;
    return 0;
 }
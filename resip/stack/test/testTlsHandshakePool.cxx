@@ -0,0 +1,276 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "resip/stack/Helper.hxx"
+#include "resip/stack/SipMessage.hxx"
+#include "resip/stack/TransportFailure.hxx"
+#include "resip/stack/Uri.hxx"
+#include "resip/stack/ssl/Security.hxx"
+#include "resip/stack/ssl/TlsConnection.hxx"
+#include "resip/stack/ssl/TlsTransport.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/DataStream.hxx"
+#include "rutil/FdPoll.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/ResipAssert.h"
+#include "rutil/Timer.hxx"
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#include "testPortOffset.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+namespace
+{
+
+const int NumClients = 8;
+
+// Writes a self-signed certificate and key for localhost into directory,
+// named as Security looks for them; returns the certificate.
+Data
+makeDomainCert(const Data& directory)
+{
+   EVP_PKEY_CTX* kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, 0);
+   assert(kctx);
+   EVP_PKEY_keygen_init(kctx);
+   EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1);
+   EVP_PKEY* key = 0;
+   EVP_PKEY_keygen(kctx, &key);
+   assert(key);
+   EVP_PKEY_CTX_free(kctx);
+
+   X509* cert = X509_new();
+   X509_set_version(cert, 2);
+   ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+   X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+   X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+   X509_set_pubkey(cert, key);
+   X509_NAME* name = X509_get_subject_name(cert);
+   X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"localhost", -1, -1, 0);
+   X509_set_issuer_name(cert, name);
+   X509V3_CTX v3;
+   X509V3_set_ctx(&v3, cert, cert, 0, 0, 0);
+   X509_EXTENSION* ext = X509V3_EXT_conf_nid(0, &v3, NID_subject_alt_name, (char*)"DNS:localhost");
+   assert(ext);
+   X509_add_ext(cert, ext, -1);
+   X509_EXTENSION_free(ext);
+   ext = X509V3_EXT_conf_nid(0, &v3, NID_basic_constraints, (char*)"critical,CA:TRUE");
+   assert(ext);
+   X509_add_ext(cert, ext, -1);
+   X509_EXTENSION_free(ext);
+   int signedLength = X509_sign(cert, key, EVP_sha256());
+   assert(signedLength > 0);
+
+   BIO* bio = BIO_new(BIO_s_mem());
+   PEM_write_bio_X509(bio, cert);
+   char* pem = 0;
+   long pemLength = BIO_get_mem_data(bio, &pem);
+   Data certPEM(pem, (Data::size_type)pemLength);
+   BIO_free(bio);
+
+   bio = BIO_new(BIO_s_mem());
+   PEM_write_bio_PrivateKey(bio, key, 0, 0, 0, 0, 0);
+   pemLength = BIO_get_mem_data(bio, &pem);
+   Data keyPEM(pem, (Data::size_type)pemLength);
+   BIO_free(bio);
+
+   X509_free(cert);
+   EVP_PKEY_free(key);
+
+   ofstream((directory + "/domain_cert_localhost.pem").c_str()) << certPEM;
+   ofstream((directory + "/domain_key_localhost.pem").c_str()) << keyPEM;
+   return certPEM;
+}
+
+// Connects NumClients TLS transports to one server transport, all on one
+// FdPollGrp, and checks that a request from each arrives.
+void
+runClients(const Data& certDirectory, const Data& certPEM)
+{
+   unique_ptr<FdPollGrp> pollGrp(FdPollGrp::create());
+   Security serverSecurity(certDirectory);
+   Security clientSecurity(certDirectory);
+   clientSecurity.addRootCertPEM(certPEM);
+
+   Fifo<TransactionMessage> rxFifo;
+   const int serverPort = resipTestPort(5960);
+   unique_ptr<TlsTransport> server(new TlsTransport(rxFifo, serverPort, V4, "127.0.0.1",
+                                                    serverSecurity, "localhost", SecurityTypes::SSLv23));
+   server->setPollGrp(pollGrp.get());
+
+   Fifo<TransactionMessage> txFifo;
+   vector<TlsTransport*> clients;
+   for (int i = 0; i < NumClients; ++i)
+   {
+      TlsTransport* client = new TlsTransport(txFifo, serverPort + 1 + i, V4, "127.0.0.1",
+                                              clientSecurity, Data::Empty, SecurityTypes::SSLv23);
+      client->setPollGrp(pollGrp.get());
+      clients.push_back(client);
+   }
+
+   NameAddr target;
+   target.uri().scheme() = "sip";
+   target.uri().user() = "fluffy";
+   target.uri().host() = "localhost";
+   target.uri().port() = serverPort;
+   target.uri().param(p_transport) = "tls";
+   Tuple dest(Data("127.0.0.1"), serverPort, V4, TLS, "localhost");
+
+   for (int i = 0; i < NumClients; ++i)
+   {
+      NameAddr from = target;
+      from.uri().port() = clients[i]->port();
+      unique_ptr<SipMessage> m(Helper::makeRequest(target, from, OPTIONS));
+      m->header(h_Vias).front().transport() = "TLS";
+      m->header(h_Vias).front().sentHost() = "localhost";
+      m->header(h_Vias).front().sentPort() = clients[i]->port();
+      Data encoded;
+      {
+         DataStream strm(encoded);
+         m->encode(strm);
+      }
+      clients[i]->send(clients[i]->makeSendData(dest, encoded, Data(i), Data::Empty));
+   }
+
+   int received = 0;
+   uint64_t deadline = Timer::getTimeMs() + 10000;
+   while (received < NumClients && Timer::getTimeMs() < deadline)
+   {
+      pollGrp->waitAndProcess(10);
+      server->process();
+      for (int i = 0; i < NumClients; ++i)
+      {
+         clients[i]->process();
+      }
+      while (rxFifo.messageAvailable())
+      {
+         unique_ptr<Message> msg(rxFifo.getNext());
+         SipMessage* request = dynamic_cast<SipMessage*>(msg.get());
+         if (request)
+         {
+            assert(request->method() == OPTIONS);
+            assert(request->header(h_To).uri().host() == "localhost");
+            ++received;
+         }
+      }
+      // No handshake may fail, e.g. on the certificate's name
+      while (txFifo.messageAvailable())
+      {
+         unique_ptr<Message> msg(txFifo.getNext());
+         assert(dynamic_cast<TransportFailure*>(msg.get()) == 0);
+      }
+   }
+   cerr << "   " << received << " of " << NumClients << " requests received" << endl;
+   assert(received == NumClients);
+
+   for (int i = 0; i < NumClients; ++i)
+   {
+      delete clients[i];
+   }
+   server.reset();
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+#ifndef WIN32
+   signal(SIGPIPE, SIG_IGN);
+#endif
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   char directory[] = "/tmp/testTlsHandshakePoolXXXXXX";
+   bool madeDirectory = mkdtemp(directory) != 0;
+   assert(madeDirectory);
+   Data certPEM = makeDomainCert(directory);
+
+   {
+      cerr << "!! Test handshakes on the transport thread" << endl;
+      runClients(directory, certPEM);
+   }
+
+   {
+      cerr << "!! Test handshakes on a handshake pool" << endl;
+      TlsConnection::setHandshakeThreads(2);
+      runClients(directory, certPEM);
+   }
+
+   {
+      cerr << "!! Test a full handshake pool falls back to the transport thread" << endl;
+      TlsConnection::setHandshakeThreads(1, 0);
+      runClients(directory, certPEM);
+      TlsConnection::setHandshakeThreads(0);
+   }
+
+   unlink((Data(directory) + "/domain_cert_localhost.pem").c_str());
+   unlink((Data(directory) + "/domain_key_localhost.pem").c_str());
+   rmdir(directory);
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
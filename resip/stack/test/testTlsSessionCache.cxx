@@ -0,0 +1,302 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <iostream>
+#include <unistd.h>
+
+#include "resip/stack/ssl/TlsSessionCache.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/ResipAssert.h"
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <openssl/ssl.h>
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+namespace
+{
+
+SSL_CTX*
+makeServerCtx(EVP_PKEY* key, X509* cert, const Data& domain = "example.com")
+{
+   SSL_CTX* ctx = SSL_CTX_new(TLS_method());
+   assert(ctx);
+   SSL_CTX_use_certificate(ctx, cert);
+   SSL_CTX_use_PrivateKey(ctx, key);
+   assert(SSL_CTX_check_private_key(ctx) == 1);
+   TlsSessionCache::configure(ctx, domain);
+   return ctx;
+}
+
+void
+makeCert(EVP_PKEY*& key, X509*& cert)
+{
+   EVP_PKEY_CTX* kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, 0);
+   assert(kctx);
+   EVP_PKEY_keygen_init(kctx);
+   EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1);
+   key = 0;
+   EVP_PKEY_keygen(kctx, &key);
+   assert(key);
+   EVP_PKEY_CTX_free(kctx);
+
+   cert = X509_new();
+   X509_set_version(cert, 2);
+   ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+   X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+   X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+   X509_set_pubkey(cert, key);
+   X509_NAME* name = X509_get_subject_name(cert);
+   X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"example.com", -1, -1, 0);
+   X509_set_issuer_name(cert, name);
+   int signedLength = X509_sign(cert, key, EVP_sha256());
+   assert(signedLength > 0);
+}
+
+// Our certificate is self-signed; trust it, as a verifying server would a
+// client's.
+int
+acceptAny(int ok, X509_STORE_CTX* store)
+{
+   return 1;
+}
+
+// Handshakes a client from clientCtx with a server from serverCtx over a
+// BIO pair, offering session (if any). The server verifies clients with
+// verifyMode, as TlsConnection does. Returns whether the server resumed,
+// and the client's session afterwards in session.
+bool
+handshake(SSL_CTX* serverCtx, SSL_CTX* clientCtx, SSL_SESSION*& session,
+          int verifyMode = SSL_VERIFY_NONE)
+{
+   SSL* server = SSL_new(serverCtx);
+   SSL* client = SSL_new(clientCtx);
+   if (verifyMode != SSL_VERIFY_NONE)
+   {
+      SSL_set_verify(server, verifyMode, acceptAny);
+      TlsSessionCache::setSessionContext(server);
+   }
+   BIO* serverBio = 0;
+   BIO* clientBio = 0;
+   BIO_new_bio_pair(&serverBio, 0, &clientBio, 0);
+   assert(serverBio && clientBio);
+   SSL_set_bio(server, serverBio, serverBio);
+   SSL_set_bio(client, clientBio, clientBio);
+   SSL_set_accept_state(server);
+   SSL_set_connect_state(client);
+   if (session)
+   {
+      SSL_set_session(client, session);
+      SSL_SESSION_free(session);
+      session = 0;
+   }
+
+   bool serverDone = false;
+   bool clientDone = false;
+   for (int i = 0; i < 100 && !(serverDone && clientDone); ++i)
+   {
+      if (!clientDone)
+      {
+         clientDone = SSL_do_handshake(client) == 1;
+      }
+      if (!serverDone)
+      {
+         serverDone = SSL_do_handshake(server) == 1;
+      }
+   }
+   assert(serverDone && clientDone);
+   TlsSessionCache::onHandshakeDone(server);
+
+   // TLS 1.3 tickets arrive after the handshake; let the client read them.
+   char byte = 'x';
+   int written = SSL_write(server, &byte, 1);
+   int read = SSL_read(client, &byte, 1);
+   assert(written == 1 && read == 1);
+
+   bool resumed = SSL_session_reused(server) != 0;
+   assert(resumed == (SSL_session_reused(client) != 0));
+   session = SSL_get1_session(client);
+   assert(session);
+
+   // An SSL freed without a shutdown marks its session as not resumable.
+   SSL_shutdown(client);
+   SSL_shutdown(server);
+   SSL_free(client);
+   SSL_free(server);
+   return resumed;
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   EVP_PKEY* key;
+   X509* cert;
+   makeCert(key, cert);
+
+   // Two listeners, as with two TlsTransports.
+   SSL_CTX* serverA = makeServerCtx(key, cert);
+   SSL_CTX* serverB = makeServerCtx(key, cert);
+   SSL_CTX* client = SSL_CTX_new(TLS_method());
+   assert(client);
+   bool resumed;
+
+   {
+      cerr << "!! Test resumption from a session ticket" << endl;
+      SSL_SESSION* session = 0;
+      resumed = handshake(serverA, client, session);
+      assert(!resumed);
+      resumed = handshake(serverA, client, session);
+      assert(resumed);
+      // The ticket key is shared, so another listener takes it too.
+      resumed = handshake(serverB, client, session);
+      assert(resumed);
+      SSL_SESSION_free(session);
+      assert(TlsSessionCache::fullHandshakes() == 1);
+      assert(TlsSessionCache::resumedHandshakes() == 2);
+   }
+
+   {
+      cerr << "!! Test resumption from the shared session cache" << endl;
+      SSL_CTX* noTickets = SSL_CTX_new(TLS_method());
+      SSL_CTX_set_max_proto_version(noTickets, TLS1_2_VERSION);
+      SSL_CTX_set_options(noTickets, SSL_OP_NO_TICKET);
+      SSL_SESSION* session = 0;
+      resumed = handshake(serverA, noTickets, session);
+      assert(!resumed);
+      resumed = handshake(serverB, noTickets, session);
+      assert(resumed);
+
+      // A cleared cache no longer knows the session.
+      TlsSessionCache::clear();
+      resumed = handshake(serverB, noTickets, session);
+      assert(!resumed);
+      SSL_SESSION_free(session);
+      SSL_CTX_free(noTickets);
+      assert(TlsSessionCache::fullHandshakes() == 3);
+      assert(TlsSessionCache::resumedHandshakes() == 3);
+   }
+
+   {
+      cerr << "!! Test ticket key rotation" << endl;
+      TlsSessionCache::setTicketKeyLifetime(1);
+      SSL_SESSION* session = 0;
+      resumed = handshake(serverA, client, session);
+      assert(!resumed);
+      sleep(1);
+      // Sealed with a key past its lifetime: still accepted, and reissued
+      // with a new key.
+      resumed = handshake(serverA, client, session);
+      assert(resumed);
+      sleep(3);
+      // Past twice the lifetime, a ticket is no longer accepted.
+      resumed = handshake(serverA, client, session);
+      assert(!resumed);
+      SSL_SESSION_free(session);
+      TlsSessionCache::setTicketKeyLifetime(12*60*60);
+   }
+
+   {
+      cerr << "!! Test sessions are not resumed with a different client verification" << endl;
+      const int mandatory = SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT;
+      SSL_CTX* withCert = SSL_CTX_new(TLS_method());
+      SSL_CTX_use_certificate(withCert, cert);
+      SSL_CTX_use_PrivateKey(withCert, key);
+      SSL_CTX* noTickets = SSL_CTX_new(TLS_method());
+      SSL_CTX_use_certificate(noTickets, cert);
+      SSL_CTX_use_PrivateKey(noTickets, key);
+      SSL_CTX_set_max_proto_version(noTickets, TLS1_2_VERSION);
+      SSL_CTX_set_options(noTickets, SSL_OP_NO_TICKET);
+      SSL_CTX* otherDomain = makeServerCtx(key, cert, "example.org");
+
+      SSL_CTX* clients[] = { withCert, noTickets };
+      for (int i = 0; i < 2; ++i)
+      {
+         // Set up without asking for a certificate; a transport that
+         // requires one must not take it.
+         SSL_SESSION* session = 0;
+         resumed = handshake(serverA, clients[i], session);
+         assert(!resumed);
+         resumed = handshake(serverB, clients[i], session, mandatory);
+         assert(!resumed);
+         resumed = handshake(serverB, clients[i], session, SSL_VERIFY_PEER);
+         assert(!resumed);
+         // Between transports that verify alike it still resumes.
+         resumed = handshake(serverA, clients[i], session, SSL_VERIFY_PEER);
+         assert(resumed);
+         // Nor is a session taken by another domain's context.
+         resumed = handshake(otherDomain, clients[i], session, SSL_VERIFY_PEER);
+         assert(!resumed);
+         SSL_SESSION_free(session);
+      }
+
+      SSL_CTX_free(otherDomain);
+      SSL_CTX_free(noTickets);
+      SSL_CTX_free(withCert);
+   }
+
+   SSL_CTX_free(client);
+   SSL_CTX_free(serverB);
+   SSL_CTX_free(serverA);
+   X509_free(cert);
+   EVP_PKEY_free(key);
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
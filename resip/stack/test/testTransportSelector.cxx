@@ -820,6 +820,64 @@ testFindTransportByDest()
       resip_assert(t == nullptr);
 #endif // USE_IPV6
    }
+
+   {
+      // Target does not have the transport key, and more than one transport matches.
+      resipCout << "test transport selection by destination within V4 interfaces lookup - "
+                << "target without the transport key, ambiguous" << std::endl;
+
+      TestTransportSelector ts;
+      ts.addTransport("192.168.1.1", 5060, V4, UDP);
+      ts.addTransport("192.168.1.1", 5100, V4, UDP);
+      ts.addTransport("192.168.1.1", 5060, V4, TCP);
+
+      Tuple tuple1 { "1.2.3.4", 6070, V4, UDP };
+      Transport *t = ts.findTransportByDest(tuple1);
+      resip_assert(t == nullptr);
+
+      Tuple tuple2 { "1.2.3.4", 6070, V4, TCP };
+      t = ts.findTransportByDest(tuple2);
+      resip_assert(t != nullptr);
+      resip_assert(t->port() == 5060);
+   }
+}
+
+void
+testManyTransports()
+{
+   // Enough transports to grow the lookup index several times.
+   resipCout << "test transport selection with many transports" << std::endl;
+
+   SipMessage msg;
+   TestTransportSelector ts;
+   for (int port = 25000; port < 25040; ++port)
+   {
+      ts.addTransport("192.168.1.1", port, V4, UDP);
+      ts.addTransport("192.168.1.2", port, V4, TCP);
+   }
+
+   for (int port = 25000; port < 25040; ++port)
+   {
+      Tuple tuple1 { "192.168.1.1", port, V4, UDP };
+      Transport *t = ts.findTransportBySource(tuple1, &msg);
+      resip_assert(t != nullptr);
+      resip_assert(t->port() == port);
+      resip_assert(t->transport() == UDP);
+
+      Tuple tuple2 { "192.168.1.2", port, V4, TCP };
+      t = ts.findTransportBySource(tuple2, &msg);
+      resip_assert(t != nullptr);
+      resip_assert(t->port() == port);
+      resip_assert(t->transport() == TCP);
+
+      Tuple tuple3 { "192.168.1.2", port, V4, UDP };
+      t = ts.findTransportBySource(tuple3, &msg);
+      resip_assert(t == nullptr);
+   }
+
+   Tuple tuple4 { "192.168.1.1", 25040, V4, UDP };
+   Transport *t = ts.findTransportBySource(tuple4, &msg);
+   resip_assert(t == nullptr);
 }
 
 int
@@ -832,6 +890,7 @@ main(int argc, char** argv)
    testFindTransportBySourceTlsTransport();
 #endif // USE_SSL
    testFindTransportByDest();
+   testManyTransports();
 
    return 0;
 }
@@ -2,12 +2,14 @@
 #define RESIP_AbstractFifo_hxx 
 
 #include "rutil/ResipAssert.h"
+#include <atomic>
 #include <deque>
 
 #include "rutil/Mutex.hxx"
 #include "rutil/Condition.hxx"
 #include "rutil/Lock.hxx"
 #include "rutil/CongestionManager.hxx"
+#include "rutil/MpscQueue.hxx"
 
 #include "rutil/compat.hxx"
 #include "rutil/Timer.hxx"
@@ -116,6 +118,9 @@ class FifoStatsInterface
    (aka template hoist) 
    AbstractFifo's get operations are all threadsafe; AbstractFifo does not 
    define any put operations (these are defined in subclasses).
+
+   A fifo that only ever has one consumer thread can be switched to a
+   lock-free queue with setLockFree().
    @note Users of the resip stack will not need to interact with this class 
       directly in most cases. Look at Fifo and TimeLimitFifo instead.
 
@@ -134,11 +139,34 @@ class AbstractFifo : public FifoStatsInterface
             mLastSampleTakenMicroSec(0),
             mCounter(0),
             mAverageServiceTimeMicroSec(0),
-            mSize(0)
+            mSize(0),
+            mLockFree(0)
       {}
 
       virtual ~AbstractFifo()
       {
+         delete mLockFree;
+      }
+
+      /**
+         @brief Switches this fifo to a lock-free queue.
+         @details Any number of threads may still add to the fifo, but only
+         one thread may take messages from it. Producers no longer contend on
+         mMutex, and the consumer drains everything that is ready in one go
+         in getMultiple(). size() and the FifoStatsInterface metrics are kept
+         up to date with atomic counters, so they stay as approximate as they
+         were. Must be called before the fifo is shared between threads.
+         Fifo and TimeLimitFifo support this.
+      */
+      void setLockFree()
+      {
+         resip_assert(mFifo.empty() && !mLockFree);
+         mLockFree = new MpscQueue<T>;
+      }
+
+      bool isLockFree() const
+      {
+         return mLockFree != 0;
       }
 
       /** 
@@ -147,6 +175,10 @@ class AbstractFifo : public FifoStatsInterface
        **/
       bool empty() const
       {
+         if(mLockFree)
+         {
+            return mSize == 0;
+         }
          Lock lock(mMutex); (void)lock;
          return mFifo.empty();
       }
@@ -160,6 +192,10 @@ class AbstractFifo : public FifoStatsInterface
        */
       virtual unsigned int size() const
       {
+         if(mLockFree)
+         {
+            return mSize;
+         }
          Lock lock(mMutex); (void)lock;
          return (unsigned int)mFifo.size();
       }
@@ -171,6 +207,12 @@ class AbstractFifo : public FifoStatsInterface
        
       bool messageAvailable() const
       {
+         if(mLockFree)
+         {
+            // May briefly be true before the message can be taken; getNext()
+            // then waits for the producer to finish linking it in.
+            return mSize != 0;
+         }
          Lock lock(mMutex); (void)lock;
          return !mFifo.empty();
       }
@@ -215,6 +257,16 @@ class AbstractFifo : public FifoStatsInterface
        */
       T getNext()
       {
+         if(mLockFree)
+         {
+            onFifoPolled();
+            waitLockFree(RESIP_FIFO_FOREVER);
+            T firstMessage(*mLockFree->front());
+            mLockFree->pop_front();
+            onMessagePopped();
+            return firstMessage;
+         }
+
          Lock lock(mMutex); (void)lock;
          onFifoPolled();
 
@@ -250,6 +302,19 @@ class AbstractFifo : public FifoStatsInterface
             return true;
          }
 
+         if(mLockFree)
+         {
+            onFifoPolled();
+            if(!waitLockFree(ms))
+            {
+               return false;
+            }
+            toReturn = *mLockFree->front();
+            mLockFree->pop_front();
+            onMessagePopped();
+            return true;
+         }
+
          if(ms < 0)
          {
             Lock lock(mMutex); (void)lock;
@@ -300,6 +365,15 @@ class AbstractFifo : public FifoStatsInterface
 
       void getMultiple(Messages& other, unsigned int max)
       {
+         if(mLockFree)
+         {
+            onFifoPolled();
+            resip_assert(other.empty());
+            waitLockFree(RESIP_FIFO_FOREVER);
+            onMessagePopped(mLockFree->popMultiple(other, max));
+            return;
+         }
+
          Lock lock(mMutex); (void)lock;
          onFifoPolled();
          resip_assert(other.empty());
@@ -334,6 +408,17 @@ class AbstractFifo : public FifoStatsInterface
          }
 
          resip_assert(other.empty());
+         if(mLockFree)
+         {
+            onFifoPolled();
+            if(!waitLockFree(ms))
+            {
+               return false;
+            }
+            onMessagePopped(mLockFree->popMultiple(other, max));
+            return true;
+         }
+
          const auto begin = std::chrono::steady_clock::now();
          const auto end = begin + std::chrono::milliseconds(ms); // !kh! ms should've been unsigned :(
          Lock lock(mMutex); (void)lock;
@@ -380,6 +465,15 @@ class AbstractFifo : public FifoStatsInterface
 
       size_t add(const T& item)
       {
+         if(mLockFree)
+         {
+            // Count first, so that mSize never drops below what the consumer
+            // can see.
+            size_t size = mSize.fetch_add(1) + 1;
+            mLockFree->push(item);
+            return size;
+         }
+
          Lock lock(mMutex); (void)lock;
          mFifo.push_back(item);
          mCondition.notify_one();
@@ -389,6 +483,14 @@ class AbstractFifo : public FifoStatsInterface
 
       size_t addMultiple(Messages& items)
       {
+         if(mLockFree)
+         {
+            uint32_t num = (uint32_t)items.size();
+            size_t size = mSize.fetch_add(num) + num;
+            mLockFree->pushMultiple(items);
+            return size;
+         }
+
          Lock lock(mMutex); (void)lock;
          size_t size=items.size();
          if(mFifo.empty())
@@ -422,15 +524,68 @@ class AbstractFifo : public FifoStatsInterface
       mutable uint32_t mAverageServiceTimeMicroSec;
       // std::deque has to perform some amount of traversal to calculate its 
       // size; we maintain this count so that it can be queried without locking, 
-      // in situations where it being off by a small amount is ok.
-      uint32_t mSize;
+      // in situations where it being off by a small amount is ok. In lock-free
+      // mode this is the only count there is.
+      std::atomic<uint32_t> mSize;
+      /** @brief the queue used instead of mFifo after setLockFree() */
+      MpscQueue<T>* mLockFree;
+
+      /**
+         Lock-free mode only: waits until the consumer end has a message, for
+         up to ms milliseconds (negative: not at all, RESIP_FIFO_FOREVER: for
+         as long as it takes).
+         Returns false if none arrived.
+      */
+      bool waitLockFree(int ms)
+      {
+         if(mLockFree->front())
+         {
+            return true;
+         }
+         if(ms < 0)
+         {
+            return false;
+         }
+
+         const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+         while(!mLockFree->front())
+         {
+            if(ms == RESIP_FIFO_FOREVER)
+            {
+               mLockFree->wait();
+            }
+            else if(std::chrono::steady_clock::now() >= end)
+            {
+               return false;
+            }
+            else
+            {
+               mLockFree->wait_until(end);
+            }
+         }
+         return true;
+      }
+
+      // Caller holds mMutex, or is the consumer of a lock-free fifo.
+      bool fifoEmpty() const
+      {
+         return mLockFree ? mSize == 0 : mFifo.empty();
+      }
 
       virtual void onFifoPolled()
       {
+         if(mLockFree && !mLastSampleTakenMicroSec && mSize != 0)
+         {
+            // Producers leave the sampling state alone in lock-free mode, so
+            // the sample starts when the consumer first finds work waiting.
+            mLastSampleTakenMicroSec=Timer::getTimeMicroSec();
+            return;
+         }
+
          // !bwc! TODO allow this sampling frequency to be tweaked
          if(mLastSampleTakenMicroSec &&
             mCounter &&
-            (mCounter >= 64 || mFifo.empty()))
+            (mCounter >= 64 || fifoEmpty()))
          {
             uint64_t now(Timer::getTimeMicroSec());
             uint64_t diff = now-mLastSampleTakenMicroSec;
@@ -448,7 +603,7 @@ class AbstractFifo : public FifoStatsInterface
                      4096U);
             }
             mCounter=0;
-            if(mFifo.empty())
+            if(fifoEmpty())
             {
                mLastSampleTakenMicroSec=0;
             }
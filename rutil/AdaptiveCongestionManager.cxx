@@ -0,0 +1,273 @@
+#include "rutil/AdaptiveCongestionManager.hxx"
+
+#include "rutil/AbstractFifo.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
+
+#include <thread>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::STATS
+
+namespace resip
+{
+
+static const char* workClassNames[] = {"NewWork", "ContinuingWork", "EssentialWork"};
+
+AdaptiveCongestionManager::AdaptiveCongestionManager(MetricType defaultMetric,
+                                                     uint32_t defaultMaxTolerance,
+                                                     unsigned int maxCpuPercent) :
+   GeneralCongestionManager(defaultMetric, defaultMaxTolerance),
+   mMaxCpuPercent(maxCpuPercent),
+   mNumCpus(std::thread::hardware_concurrency()),
+   mMinRetryAfter(2),
+   mMaxRetryAfter(30),
+   mLoadPercent(0),
+   mCpuPercent(0),
+   mNextSampleMs(0),
+   mRetryCounter(0),
+   mLastSampleMs(0),
+   mLastCpuTimeMicroSec(0)
+{
+   if(mNumCpus == 0)
+   {
+      mNumCpus = 1;
+   }
+   for(int i=NEW_WORK; i<=ESSENTIAL_WORK; ++i)
+   {
+      mShedding[i].seen=0;
+      mShedding[i].shed=0;
+   }
+   setShedding(NEW_WORK, 50, 100);
+   setShedding(CONTINUING_WORK, 100, 150);
+   setShedding(ESSENTIAL_WORK, 200, 300);
+}
+
+AdaptiveCongestionManager::~AdaptiveCongestionManager()
+{}
+
+void
+AdaptiveCongestionManager::setShedding(WorkClass work, uint16_t startPercent, uint16_t fullPercent)
+{
+   resip_assert(fullPercent > startPercent);
+   mShedding[work].start=startPercent;
+   mShedding[work].full=fullPercent;
+}
+
+void
+AdaptiveCongestionManager::setRetryAfter(uint32_t minSecs, uint32_t maxSecs)
+{
+   resip_assert(maxSecs >= minSecs);
+   mMinRetryAfter=minSecs;
+   mMaxRetryAfter=maxSecs;
+}
+
+CongestionManager::RejectionBehavior
+AdaptiveCongestionManager::getRejectionBehaviorForWork(const FifoStatsInterface *fifo,
+                                                       WorkClass work) const
+{
+   // The fifo is not looked at on its own: its load is already part of the
+   // sampled one, and work arriving at a fifo that is keeping up still has 
+   // to be shed while a stage behind it is backed up. Reading its load here 
+   // would also take the lock on the fifo list for every message.
+   const Shedding& shedding=mShedding[work];
+   uint16_t load=getLoadPercent();
+   uint32_t seen=shedding.seen++;
+
+   if(load < shedding.start)
+   {
+      return NORMAL;
+   }
+   if(load < shedding.full)
+   {
+      // Reject share percent of this work, spread evenly over what we see 
+      // rather than in bursts.
+      uint32_t share=100*(uint32_t)(load-shedding.start)/(shedding.full-shedding.start);
+      if((seen*share)%100 >= share)
+      {
+         return NORMAL;
+      }
+   }
+
+   ++shedding.shed;
+   return work == ESSENTIAL_WORK ? REJECTING_NON_ESSENTIAL : REJECTING_NEW_WORK;
+}
+
+uint32_t
+AdaptiveCongestionManager::getRetryAfter(const FifoStatsInterface *fifo) const
+{
+   uint32_t load=getLoadPercent();
+   uint32_t start=mShedding[NEW_WORK].start;
+   uint32_t top=start < 200 ? 200 : start+1;
+
+   uint32_t retryAfter=mMinRetryAfter;
+   if(load > start)
+   {
+      retryAfter+=(mMaxRetryAfter-mMinRetryAfter)*((load < top ? load : top)-start)/(top-start);
+   }
+
+   uint32_t expectedWait=(uint32_t)fifo->expectedWaitTimeMilliSec()/1000;
+   if(expectedWait > retryAfter)
+   {
+      retryAfter=expectedWait;
+   }
+
+   uint32_t spread=retryAfter/4;
+   if(spread)
+   {
+      retryAfter+=mRetryCounter++%(spread+1);
+   }
+   return retryAfter;
+}
+
+uint16_t
+AdaptiveCongestionManager::getLoadPercent() const
+{
+   sample();
+   return mLoadPercent;
+}
+
+void
+AdaptiveCongestionManager::sample() const
+{
+   uint64_t now=Timer::getTimeMs();
+   uint64_t next=mNextSampleMs;
+   if(now < next ||
+      !mNextSampleMs.compare_exchange_strong(next, now+SAMPLE_INTERVAL_MS))
+   {
+      return;
+   }
+
+   // Only one thread gets here per interval.
+   uint32_t load=getMaxCongestionPercent();
+   if(mMaxCpuPercent)
+   {
+      uint64_t cpuTime=getProcessCpuTimeMicroSec();
+      if(mLastSampleMs && now > mLastSampleMs)
+      {
+         // usec of CPU over msec of wall time, as a percent of all CPUs.
+         uint64_t cpu=(cpuTime-mLastCpuTimeMicroSec)/(10*(now-mLastSampleMs)*mNumCpus);
+         mCpuPercent=(uint16_t)(cpu < 100 ? cpu : 100);
+      }
+      mLastCpuTimeMicroSec=cpuTime;
+
+      uint32_t cpuLoad=100*(uint32_t)mCpuPercent/mMaxCpuPercent;
+      if(cpuLoad > load)
+      {
+         load=cpuLoad;
+      }
+   }
+   mLastSampleMs=now;
+   mLoadPercent=(uint16_t)(load < 0xFFFF ? load : 0xFFFF);
+}
+
+uint64_t
+AdaptiveCongestionManager::getProcessCpuTimeMicroSec()
+{
+#ifdef WIN32
+   FILETIME creation, exit, kernel, user;
+   if(!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+   {
+      return 0;
+   }
+   // 100ns units
+   uint64_t total=((uint64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) +
+                  ((uint64_t)user.dwHighDateTime << 32 | user.dwLowDateTime);
+   return total/10;
+#else
+   struct rusage usage;
+   if(getrusage(RUSAGE_SELF, &usage) != 0)
+   {
+      return 0;
+   }
+   return (uint64_t)(usage.ru_utime.tv_sec+usage.ru_stime.tv_sec)*1000000 +
+          usage.ru_utime.tv_usec+usage.ru_stime.tv_usec;
+#endif
+}
+
+void
+AdaptiveCongestionManager::logCurrentState() const
+{
+   Data buffer;
+   {
+      DataStream strm(buffer);
+      strm << "Load=" << getLoadPercent() << "% Cpu=" << mCpuPercent.load() << "%";
+      for(int i=NEW_WORK; i<=ESSENTIAL_WORK; ++i)
+      {
+         strm << " " << workClassNames[i] << "Shed=" << mShedding[i].shed.load()
+              << "/" << mShedding[i].seen.load();
+      }
+   }
+   WarningLog(<< "CONGESTION " << buffer);
+   GeneralCongestionManager::logCurrentState();
+}
+
+EncodeStream&
+AdaptiveCongestionManager::encodeCurrentState(EncodeStream& strm) const
+{
+   strm << "Load=" << getLoadPercent() << "% Cpu=" << mCpuPercent.load() 
+        << "% MaxCpu=" << mMaxCpuPercent << "%" << std::endl;
+   for(int i=NEW_WORK; i<=ESSENTIAL_WORK; ++i)
+   {
+      strm << workClassNames[i] << ": ShedFrom=" << mShedding[i].start
+           << "% ShedAll=" << mShedding[i].full
+           << "% Seen=" << mShedding[i].seen.load()
+           << " Shed=" << mShedding[i].shed.load() << std::endl;
+   }
+   return GeneralCongestionManager::encodeCurrentState(strm);
+}
+
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ * 
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,168 @@
+#ifndef ADAPTIVE_CONGESTION_MANAGER_HXX
+#define ADAPTIVE_CONGESTION_MANAGER_HXX
+
+#include "rutil/GeneralCongestionManager.hxx"
+
+#include <atomic>
+
+namespace resip
+{
+/**
+   A congestion manager that sheds work by class, based on the load of the 
+   system as a whole rather than that of a single fifo.
+
+   The load is the higher of:
+   - the most congested fifo, measured against its tolerance as in 
+     GeneralCongestionManager (with the WAIT_TIME metric, this is each stage's 
+     service time per message times its backlog), and
+   - the CPU time used by the process, measured against maxCpuPercent.
+
+   Each class of work (see CongestionManager::WorkClass) has a load at which 
+   shedding starts and one by which all of it is shed; in between, a share 
+   that grows with the load is rejected. By default new work is shed from 
+   50 to 100 percent, continuing work from 100 to 150 percent, and essential 
+   work only from 200 to 300 percent, so that established calls stay up 
+   while new ones are turned away. Essential work is rejected as 
+   REJECTING_NON_ESSENTIAL, everything else as REJECTING_NEW_WORK.
+
+   The Retry-After for rejected work grows with the load, from a minimum at 
+   the start of shedding of new work to a maximum at twice the tolerance, 
+   and is spread over up to a quarter more so that rejected clients do not 
+   all come back at once.
+
+   The fifo passed to getRejectionBehaviorForWork() does not change the 
+   outcome: what is shed depends only on the load of the system and the 
+   class of work. The class-blind getRejectionBehavior() is that of 
+   GeneralCongestionManager.
+
+   @ingroup message_passing
+*/
+class AdaptiveCongestionManager : public GeneralCongestionManager
+{
+   public:
+      /**
+         @param defaultMetric The metric for each fifo's load; see 
+            GeneralCongestionManager.
+         @param defaultMaxTolerance The tolerance at which a fifo counts as 
+            fully (100 percent) loaded.
+         @param maxCpuPercent The CPU use of the process, as a percent of all 
+            CPUs, that counts as fully loaded. 0 leaves CPU use out of the load.
+      */
+      AdaptiveCongestionManager(MetricType defaultMetric,
+                                uint32_t defaultMaxTolerance,
+                                unsigned int maxCpuPercent=90);
+      virtual ~AdaptiveCongestionManager();
+
+      /**
+         Sets the loads, in percent, between which work of this class is 
+         shed. fullPercent must be greater than startPercent.
+      */
+      void setShedding(WorkClass work, uint16_t startPercent, uint16_t fullPercent);
+
+      /**
+         Sets the range of the Retry-After, in seconds, for rejected work.
+      */
+      void setRetryAfter(uint32_t minSecs, uint32_t maxSecs);
+
+      virtual RejectionBehavior getRejectionBehaviorForWork(const FifoStatsInterface *fifo,
+                                                            WorkClass work) const;
+      virtual bool usesWorkClasses() const { return true; }
+      virtual uint32_t getRetryAfter(const FifoStatsInterface *fifo) const;
+
+      /**
+         @brief Returns the current load, in percent.
+      */
+      uint16_t getLoadPercent() const;
+
+      /**
+         @brief Returns the CPU use of the process over the last sample, as a 
+            percent of all CPUs.
+      */
+      uint16_t getCpuPercent() const { return mCpuPercent; }
+
+      virtual void logCurrentState() const;
+      virtual EncodeStream& encodeCurrentState(EncodeStream& strm) const;
+
+   private:
+      static const uint64_t SAMPLE_INTERVAL_MS = 200;
+
+      void sample() const;
+      static uint64_t getProcessCpuTimeMicroSec();
+
+      struct Shedding
+      {
+         uint16_t start;
+         uint16_t full;
+         mutable std::atomic<uint32_t> seen;
+         mutable std::atomic<uint32_t> shed;
+      };
+
+      Shedding mShedding[ESSENTIAL_WORK+1];
+      unsigned int mMaxCpuPercent;
+      unsigned int mNumCpus;
+      uint32_t mMinRetryAfter;
+      uint32_t mMaxRetryAfter;
+
+      mutable std::atomic<uint16_t> mLoadPercent;
+      mutable std::atomic<uint16_t> mCpuPercent;
+      mutable std::atomic<uint64_t> mNextSampleMs;
+      mutable std::atomic<uint32_t> mRetryCounter;
+      mutable uint64_t mLastSampleMs;
+      mutable uint64_t mLastCpuTimeMicroSec;
+
+      // disabled
+      AdaptiveCongestionManager();
+      AdaptiveCongestionManager(const AdaptiveCongestionManager& orig);
+      AdaptiveCongestionManager& operator=(const AdaptiveCongestionManager& rhs);
+};
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ * 
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,198 @@
+#ifndef ArenaPool_Include_Guard
+#define ArenaPool_Include_Guard
+
+#include <limits>
+#include <memory>
+#include <new>
+#include <stddef.h>
+
+#include "rutil/PoolBase.hxx"
+
+namespace resip
+{
+/**
+   A DinkyPool that can optionally grow.  The first S bytes are allocated from
+   a buffer inside the pool itself.  After that, a non-growable pool falls back
+   to the system new/delete for each allocation (exactly like DinkyPool), while
+   a growable pool carves further allocations out of heap blocks that it
+   allocates itself, each at least twice the size of the one before, and frees
+   all at once when the pool goes away.  In either case, deallocating a pool
+   allocated object does _not_ free up room in the pool.
+
+   The growable mode is meant for objects, like SipMessage, whose allocations
+   all die together, and turns a few dozen allocations over an object's
+   lifetime into one or two.
+*/
+template<unsigned int S>
+class ArenaPool : public PoolBase
+{
+   public:
+      explicit ArenaPool(bool growable=false) :
+         count(0),
+         heapBytes(0),
+         mGrowable(growable),
+         mBlocks(0),
+         mBlockFree(0),
+         mBlockEnd(0),
+         mArenaBytes(0),
+         mNumBlocks(0)
+      {}
+
+      ~ArenaPool()
+      {
+         while(mBlocks)
+         {
+            Block* next = mBlocks->next;
+            ::operator delete(mBlocks);
+            mBlocks = next;
+         }
+      }
+
+      void* allocate(size_t size)
+      {
+         if((8*count)+size <= S)
+         {
+            void* result=mBuf[count];
+            count+=(size+7)/8;
+            return result;
+         }
+         if(!mGrowable)
+         {
+            heapBytes += size;
+            return ::operator new(size);
+         }
+         size = (size+7) & ~(size_t)7;
+         if((size_t)(mBlockEnd - mBlockFree) < size)
+         {
+            grow(size);
+         }
+         void* result = mBlockFree;
+         mBlockFree += size;
+         mArenaBytes += size;
+         return result;
+      }
+
+      // Objects allocated elsewhere are sometimes handed back to a pool, so
+      // anything not found in the pool is returned to the heap.
+      void deallocate(void* ptr)
+      {
+         if(ptr >= (void*)mBuf[0] && ptr < (void*)mBuf[(S+7)/8])
+         {
+            return;
+         }
+         for(Block* block = mBlocks; block; block = block->next)
+         {
+            if(ptr >= (void*)(block + 1) &&
+               ptr < (void*)(reinterpret_cast<char*>(block + 1) + block->size))
+            {
+               return;
+            }
+         }
+         ::operator delete(ptr);
+      }
+
+      size_t max_size() const
+      {
+         return std::numeric_limits<size_t>::max();
+      }
+
+      bool isGrowable() const { return mGrowable; }
+      size_t getHeapBytes() const { return heapBytes; }
+      size_t getPoolBytes() const { return count*8; }
+      size_t getPoolSizeBytes() const { return sizeof(mBuf); }
+      /// Bytes handed out from blocks beyond the first S bytes (growable only).
+      size_t getArenaBytes() const { return mArenaBytes; }
+      /// Number of heap blocks the arena has allocated (growable only).
+      size_t getNumBlocks() const { return mNumBlocks; }
+
+   private:
+      // disabled
+      ArenaPool& operator=(const ArenaPool& rhs);
+      ArenaPool(const ArenaPool& other);
+
+      struct Block
+      {
+         Block* next;
+         size_t size;
+      };
+
+      void grow(size_t size)
+      {
+         size_t blockSize = mBlocks ? 2*mBlocks->size : 2*(size_t)S;
+         if(blockSize < size)
+         {
+            blockSize = size;
+         }
+         // Block is 16 bytes, so the data following it stays 8-byte aligned.
+         Block* block = static_cast<Block*>(::operator new(sizeof(Block) + blockSize));
+         block->next = mBlocks;
+         block->size = blockSize;
+         mBlocks = block;
+         mBlockFree = reinterpret_cast<char*>(block + 1);
+         mBlockEnd = mBlockFree + blockSize;
+         ++mNumBlocks;
+      }
+
+      size_t count; // 8-byte chunks alloced so far
+      char mBuf[(S+7)/8][8]; // 8-byte chunks for alignment
+      size_t heapBytes;
+
+      const bool mGrowable;
+      Block* mBlocks;    // most recent first
+      char* mBlockFree;
+      char* mBlockEnd;
+      size_t mArenaBytes;
+      size_t mNumBlocks;
+};
+
+}
+#endif
+
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -63,6 +63,17 @@ class CongestionManager
                                  Otherwise, reject it.) */
    } RejectionBehavior;
 
+   typedef enum
+   {
+      NEW_WORK=0, /**< Work that creates new state, like an out-of-dialog 
+                       INVITE, REGISTER or SUBSCRIBE. */
+      CONTINUING_WORK=1, /**< Work within existing state, like an in-dialog 
+                              re-INVITE, INFO or NOTIFY. */
+      ESSENTIAL_WORK=2 /**< Work that completes or tears down existing state, 
+                            like a response, ACK, BYE or CANCEL. Dropping it 
+                            leaves state behind. */
+   } WorkClass;
+
    /**
       Return the current rejection behavior for this fifo.
       This is the primary functionality provided by this class. Implementors may
@@ -73,6 +84,33 @@ class CongestionManager
    */
    virtual RejectionBehavior getRejectionBehavior(const FifoStatsInterface *fifo) const=0;
 
+   /**
+      Return the current rejection behavior for work of the given class 
+      arriving at this fifo. Callers apply the result just as they would that 
+      of getRejectionBehavior(); this lets an implementor keep established 
+      work flowing while new work is being shed. The default ignores the 
+      class of work.
+      @param fifo The fifo in question.
+      @param work The class of the work in question.
+      @return The current desired RejectionBehavior for this work.
+   */
+   virtual RejectionBehavior getRejectionBehaviorForWork(const FifoStatsInterface *fifo,
+                                                         WorkClass work) const;
+
+   /**
+      Whether getRejectionBehaviorForWork() looks at the class of work. If 
+      not, callers can skip classifying it, which means parsing headers of 
+      every incoming message. The default is false.
+   */
+   virtual bool usesWorkClasses() const { return false; }
+
+   /**
+      Return how long, in seconds, a client should wait before retrying work 
+      that was rejected at this fifo (ie, the Retry-After of a 503). The 
+      default is the fifo's expected wait time.
+   */
+   virtual uint32_t getRetryAfter(const FifoStatsInterface *fifo) const;
+
    /**
       Registers a fifo with the congestion manager. May be a no-op, or may 
       assign a role number to the fifo.
@@ -345,6 +345,15 @@ class Data
          return setBuf(se, str, (size_type)strlen(str));
       };
 
+      /**
+        Returns true if this Data is using someone else's buffer read-only
+        (see Share).
+      **/
+      bool isShared() const
+      {
+         return mShareEnum == Share;
+      }
+
 
       /**
         Take the data from {other}. Any current buffer is released.
@@ -88,6 +88,18 @@ template <class Msg>
 void
 Fifo<Msg>::clear()
 {
+   if(this->mLockFree)
+   {
+      // Only the consumer (or the destructor) may do this.
+      while(Msg** front = this->mLockFree->front())
+      {
+         delete *front;
+         this->mLockFree->pop_front();
+         this->onMessagePopped();
+      }
+      return;
+   }
+
    Lock lock(mMutex); (void)lock;
    while ( ! mFifo.empty() )
    {
@@ -141,6 +141,26 @@ GeneralCongestionManager::getCongestionPercent(const FifoStatsInterface* fifo) c
     return getCongestionPercentInternal(fifo);
 }
 
+uint16_t
+GeneralCongestionManager::getMaxCongestionPercent() const
+{
+   Lock lock(mFifosMutex);
+   uint16_t result=0;
+   for(std::vector<FifoInfo>::const_iterator i=mFifos.begin();
+         i!=mFifos.end();++i)
+   {
+      if(i->fifo)
+      {
+         uint16_t percent=getCongestionPercentInternal(i->fifo);
+         if(percent > result)
+         {
+            result=percent;
+         }
+      }
+   }
+   return result;
+}
+
 uint16_t
 GeneralCongestionManager::getCongestionPercentInternal(const FifoStatsInterface* fifo) const
 {
@@ -142,6 +142,13 @@ class GeneralCongestionManager : public CongestionManager
       virtual void logCurrentState() const;
       virtual EncodeStream& encodeCurrentState(EncodeStream& strm) const;
 
+   protected:
+      /**
+         @brief Returns the highest percent of maximum tolerance that any 
+            registered fifo is at.
+      */
+      uint16_t getMaxCongestionPercent() const;
+
    private:
       virtual RejectionBehavior getRejectionBehaviorInternal(const FifoStatsInterface *fifo) const;
       uint16_t getCongestionPercentInternal(const FifoStatsInterface* fifo) const;
@@ -0,0 +1,229 @@
+#include "rutil/LatencyHistogram.hxx"
+
+using namespace resip;
+
+LatencyHistogram::Snapshot::Snapshot()
+   : mCounts(NumBuckets, 0),
+     mCount(0),
+     mSum(0),
+     mMin(UINT64_MAX),
+     mMax(0)
+{
+}
+
+uint64_t
+LatencyHistogram::Snapshot::valueAtPercentile(double percent) const
+{
+   if (!mCount)
+   {
+      return 0;
+   }
+   if (percent > 100)
+   {
+      percent = 100;
+   }
+
+   // The rank of the value we want, counting from 1.
+   uint64_t rank = (uint64_t)(percent*mCount/100 + 0.5);
+   if (rank == 0)
+   {
+      rank = 1;
+   }
+
+   uint64_t seen = 0;
+   for (unsigned int i = 0; i < NumBuckets; ++i)
+   {
+      seen += mCounts[i];
+      if (seen >= rank)
+      {
+         uint64_t top = bucketTop(i);
+         return top < mMax ? top : mMax;
+      }
+   }
+   return mMax;
+}
+
+void
+LatencyHistogram::Snapshot::merge(const Snapshot& other)
+{
+   for (unsigned int i = 0; i < NumBuckets; ++i)
+   {
+      mCounts[i] += other.mCounts[i];
+   }
+   mCount += other.mCount;
+   mSum += other.mSum;
+   if (other.mMin < mMin)
+   {
+      mMin = other.mMin;
+   }
+   if (other.mMax > mMax)
+   {
+      mMax = other.mMax;
+   }
+}
+
+EncodeStream&
+LatencyHistogram::Snapshot::encode(EncodeStream& strm) const
+{
+   strm << "count=" << count()
+        << " min=" << min()
+        << " mean=" << mean()
+        << " p50=" << valueAtPercentile(50)
+        << " p90=" << valueAtPercentile(90)
+        << " p99=" << valueAtPercentile(99)
+        << " p99.9=" << valueAtPercentile(99.9)
+        << " max=" << max();
+   return strm;
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+   reset();
+}
+
+unsigned int
+LatencyHistogram::bucketIndex(uint64_t value)
+{
+   if (value < SubBuckets)
+   {
+      return (unsigned int)value;
+   }
+
+#if defined(__GNUC__)
+   unsigned int msb = 63 - __builtin_clzll(value);
+#else
+   unsigned int msb = 0;
+   while (value >> (msb + 1))
+   {
+      ++msb;
+   }
+#endif
+
+   // Keep the top 5 bits (16 to 31), and count how far we shifted them.
+   unsigned int shift = msb - 4;
+   return SubBuckets + (shift - 1)*(SubBuckets/2) +
+          (unsigned int)(value >> shift) - SubBuckets/2;
+}
+
+uint64_t
+LatencyHistogram::bucketTop(unsigned int index)
+{
+   if (index < SubBuckets)
+   {
+      return index;
+   }
+   unsigned int shift = (index - SubBuckets)/(SubBuckets/2) + 1;
+   uint64_t sub = (index - SubBuckets)%(SubBuckets/2) + SubBuckets/2;
+   return ((sub + 1) << shift) - 1;
+}
+
+void
+LatencyHistogram::record(uint64_t value)
+{
+   Shard& shard = mShards[ShardedCounter::shardIndex() % Shards];
+   shard.mCounts[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+   shard.mSum.fetch_add(value, std::memory_order_relaxed);
+
+   uint64_t current = shard.mMax.load(std::memory_order_relaxed);
+   while (value > current &&
+          !shard.mMax.compare_exchange_weak(current, value, std::memory_order_relaxed))
+   {
+   }
+   current = shard.mMin.load(std::memory_order_relaxed);
+   while (value < current &&
+          !shard.mMin.compare_exchange_weak(current, value, std::memory_order_relaxed))
+   {
+   }
+}
+
+LatencyHistogram::Snapshot
+LatencyHistogram::snapshot() const
+{
+   Snapshot result;
+   for (unsigned int s = 0; s < Shards; ++s)
+   {
+      const Shard& shard = mShards[s];
+      for (unsigned int i = 0; i < NumBuckets; ++i)
+      {
+         uint64_t count = shard.mCounts[i].load(std::memory_order_relaxed);
+         result.mCounts[i] += count;
+         result.mCount += count;
+      }
+      result.mSum += shard.mSum.load(std::memory_order_relaxed);
+      uint64_t min = shard.mMin.load(std::memory_order_relaxed);
+      if (min < result.mMin)
+      {
+         result.mMin = min;
+      }
+      uint64_t max = shard.mMax.load(std::memory_order_relaxed);
+      if (max > result.mMax)
+      {
+         result.mMax = max;
+      }
+   }
+   return result;
+}
+
+void
+LatencyHistogram::reset()
+{
+   for (unsigned int s = 0; s < Shards; ++s)
+   {
+      Shard& shard = mShards[s];
+      for (unsigned int i = 0; i < NumBuckets; ++i)
+      {
+         shard.mCounts[i].store(0, std::memory_order_relaxed);
+      }
+      shard.mSum.store(0, std::memory_order_relaxed);
+      shard.mMin.store(UINT64_MAX, std::memory_order_relaxed);
+      shard.mMax.store(0, std::memory_order_relaxed);
+   }
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
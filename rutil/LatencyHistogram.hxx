@@ -0,0 +1,166 @@
+#if !defined(RESIP_LATENCYHISTOGRAM_HXX)
+#define RESIP_LATENCYHISTOGRAM_HXX
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+#include "rutil/ShardedCounter.hxx"
+#include "rutil/resipfaststreams.hxx"
+
+namespace resip
+{
+
+/**
+   @brief A histogram of latencies (or any other non-negative values) that
+   any number of threads can record into without taking a lock.
+
+   Buckets are laid out as in an HDR histogram: values below 32 each get a
+   bucket of their own, and every power of two above that is split into 16
+   equal buckets, so any recorded value is known to within about 6 percent
+   over the whole 64-bit range, with a fixed 976 buckets. Recording is a
+   couple of relaxed atomic adds.
+
+   Like ShardedCounter, the histogram is kept in shards, and each thread
+   only records into the one picked by ShardedCounter::shardIndex(), so
+   threads recording at once do not fight over the sum, min and max, or
+   over the bucket holding the typical value. Each shard is almost 8kB, so
+   there are only Shards of them rather than one per ShardedCounter shard;
+   threads that share one still only touch the same lines now and then.
+
+   snapshot() copies the buckets out, and may be called from any thread
+   while others are recording. The copy is not atomic as a whole, so a
+   snapshot taken under load may be off by the handful of values that were
+   being recorded while it was taken.
+
+   Units are up to the user; the stack records microseconds.
+
+   @ingroup data_structures
+*/
+class LatencyHistogram
+{
+   public:
+      enum { SubBuckets = 32, NumBuckets = 976, Shards = 4 };
+
+      class Snapshot
+      {
+         public:
+            Snapshot();
+
+            uint64_t count() const { return mCount; }
+            uint64_t min() const { return mCount ? mMin : 0; }
+            uint64_t max() const { return mMax; }
+            uint64_t mean() const { return mCount ? mSum/mCount : 0; }
+
+            /**
+               Returns the value that percent percent of the recorded values 
+               are at or below, rounded up to the top of its bucket (but no 
+               more than max()).
+            */
+            uint64_t valueAtPercentile(double percent) const;
+
+            /// Adds the values of another snapshot to this one.
+            void merge(const Snapshot& other);
+
+            /// count, min, mean, p50, p90, p99, p99.9 and max on one line.
+            EncodeStream& encode(EncodeStream& strm) const;
+
+         private:
+            friend class LatencyHistogram;
+            std::vector<uint64_t> mCounts;
+            uint64_t mCount;
+            uint64_t mSum;
+            uint64_t mMin;
+            uint64_t mMax;
+      };
+
+      LatencyHistogram();
+
+      /// Any thread.
+      void record(uint64_t value);
+
+      /// Any thread.
+      Snapshot snapshot() const;
+
+      /// Values recorded while this runs may or may not be lost.
+      void reset();
+
+      static unsigned int bucketIndex(uint64_t value);
+      /// The largest value that falls in this bucket.
+      static uint64_t bucketTop(unsigned int index);
+
+   private:
+      struct Shard
+      {
+         std::atomic<uint64_t> mCounts[NumBuckets];
+         std::atomic<uint64_t> mSum;
+         std::atomic<uint64_t> mMin;
+         std::atomic<uint64_t> mMax;
+         // keeps the end of one shard off the cache line the next starts on
+         char mPad[64];
+      };
+
+      Shard mShards[Shards];
+
+      // disabled
+      LatencyHistogram(const LatencyHistogram&);
+      LatencyHistogram& operator=(const LatencyHistogram&);
+};
+
+inline EncodeStream&
+operator<<(EncodeStream& strm, const LatencyHistogram::Snapshot& snapshot)
+{
+   return snapshot.encode(strm);
+}
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -2,10 +2,13 @@
 
 #include "rutil/ResipAssert.h"
 #include <chrono>
+#include <cstdlib>
 #include <iomanip>
 #include <iostream>
 #include <fstream>
 #include <stdio.h>
+#include <thread>
+#include <vector>
 #include "rutil/Data.hxx"
 
 #ifndef WIN32
@@ -21,6 +24,8 @@
 #include "rutil/ThreadIf.hxx"
 #include "rutil/Subsystem.hxx"
 #include "rutil/SysLogStream.hxx"
+#include "rutil/Condition.hxx"
+#include "rutil/Time.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
 #ifdef USE_FMT
@@ -89,6 +94,234 @@ Log::mSyslogPriority[] = { 0, LOG_CRIT, LOG_CRIT, LOG_CRIT, LOG_ERR, LOG_WARNING
 
 Mutex Log::_mutex;
 
+/**
+   The writer thread for Log::setAsynchronous(). Lines go through a bounded 
+   ring (Vyukov's bounded MPMC queue, used here with a single consumer): 
+   each cell carries a sequence number that says whether it is free for the 
+   producer that claimed its position, or full for the consumer. Cells, and 
+   the Data buffers in them, are reused, so queuing a line does not allocate 
+   once the ring has warmed up.
+
+   Once created, a writer is never deleted, since a logging thread may still 
+   hold a pointer to it; disabling just stops new lines from being queued.
+*/
+class Log::AsyncWriter : public ThreadIf
+{
+   public:
+      explicit AsyncWriter(unsigned int queueSize)
+         : mMask(0),
+           mEnqueuePos(0),
+           mDequeuePos(0),
+           mWritten(0),
+           mDropped(0),
+           mUnreportedDrops(0),
+           mSleeping(false)
+      {
+         size_t size = 2;
+         while (size < queueSize)
+         {
+            size <<= 1;
+         }
+         mCells = new Cell[size];
+         for (size_t i = 0; i < size; ++i)
+         {
+            mCells[i].mSequence.store(i, std::memory_order_relaxed);
+         }
+         mMask = size - 1;
+      }
+
+      // Any thread.
+      void post(ThreadData& target, Level level, const Data& text)
+      {
+         while (!tryPush(target, level, text))
+         {
+            if (level > Warning)
+            {
+               ++mDropped;
+               ++mUnreportedDrops;
+               return;
+            }
+            wake();
+            std::this_thread::yield();
+         }
+
+         // Pairs with the fence in thread(): either we see it is going to 
+         // sleep, or it sees our line.
+         std::atomic_thread_fence(std::memory_order_seq_cst);
+         if (mSleeping.load(std::memory_order_relaxed))
+         {
+            wake();
+         }
+      }
+
+      // Any thread but the writer.
+      void flush()
+      {
+         uint64_t target = mEnqueuePos.load();
+         while (mWritten.load() < target)
+         {
+            wake();
+            sleepMs(1);
+         }
+      }
+
+      uint64_t droppedCount() const
+      {
+         return mDropped.load(std::memory_order_relaxed);
+      }
+
+   protected:
+      virtual void thread()
+      {
+         while (!isShutdown())
+         {
+            if (drain())
+            {
+               continue;
+            }
+
+            mSleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            {
+               Lock lock(mWakeMutex);
+               if (!front())
+               {
+                  mWake.wait_for(lock, std::chrono::milliseconds(100));
+               }
+            }
+            mSleeping.store(false, std::memory_order_relaxed);
+         }
+      }
+
+   private:
+      struct Cell
+      {
+         std::atomic<uint64_t> mSequence;
+         ThreadData* mTarget;
+         Level mLevel;
+         Data mText;
+      };
+
+      bool tryPush(ThreadData& target, Level level, const Data& text)
+      {
+         uint64_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+         Cell* cell;
+         for (;;)
+         {
+            cell = &mCells[pos & mMask];
+            uint64_t sequence = cell->mSequence.load(std::memory_order_acquire);
+            if (sequence == pos)
+            {
+               if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+               {
+                  break;
+               }
+            }
+            else if (sequence < pos)
+            {
+               // Still holds a line from the last time round.
+               return false;
+            }
+            else
+            {
+               pos = mEnqueuePos.load(std::memory_order_relaxed);
+            }
+         }
+
+         cell->mTarget = &target;
+         cell->mLevel = level;
+         cell->mText = text;
+         cell->mSequence.store(pos + 1, std::memory_order_release);
+         return true;
+      }
+
+      Cell* front() const
+      {
+         Cell* cell = &mCells[mDequeuePos & mMask];
+         if (cell->mSequence.load(std::memory_order_acquire) != mDequeuePos + 1)
+         {
+            return 0;
+         }
+         return cell;
+      }
+
+      void pop(Cell* cell)
+      {
+         cell->mSequence.store(mDequeuePos + mMask + 1, std::memory_order_release);
+         ++mDequeuePos;
+      }
+
+      void wake()
+      {
+         Lock lock(mWakeMutex);
+         mWake.notify_one();
+      }
+
+      // Writes out what is queued; returns false if there was nothing.
+      bool drain()
+      {
+         Cell* cell = front();
+         if (!cell)
+         {
+            return false;
+         }
+
+         ThreadData* last = 0;
+         Lock lock(Log::_mutex);
+
+         uint64_t dropped = mUnreportedDrops.exchange(0);
+         if (dropped)
+         {
+            cell->mTarget->Instance(64) << dropped 
+                                        << " log lines dropped; the asynchronous log queue was full" 
+                                        << std::endl;
+         }
+
+         for (; cell; cell = front())
+         {
+            ThreadData& target = *cell->mTarget;
+            if (last && last != &target)
+            {
+               last->flush();
+            }
+            last = &target;
+
+            std::ostream& out = target.Instance((unsigned int)cell->mText.size() + 2);
+            if (target.type() == Log::Syslog)
+            {
+               // endl is magic in syslog
+               out << cell->mLevel << cell->mText << std::endl;
+            }
+            else
+            {
+               out << cell->mText << '\n';
+            }
+            pop(cell);
+            mWritten.store(mDequeuePos, std::memory_order_release);
+         }
+
+         if (last)
+         {
+            last->flush();
+         }
+         return true;
+      }
+
+      Cell* mCells;
+      uint64_t mMask;
+      std::atomic<uint64_t> mEnqueuePos;
+      uint64_t mDequeuePos; // writer only
+      std::atomic<uint64_t> mWritten;
+      std::atomic<uint64_t> mDropped;
+      std::atomic<uint64_t> mUnreportedDrops;
+
+      std::atomic<bool> mSleeping;
+      Mutex mWakeMutex;
+      Condition mWake;
+};
+
+std::atomic<Log::AsyncWriter*> Log::mAsyncWriter(0);
+
 extern "C"
 {
    void freeThreadSetting(void* setting)
@@ -412,6 +645,11 @@ Log::initialize(const ConfigParse& configParse, const Data& appName, ExternalLog
 
    unsigned int loggingFileMaxLineCount = configParse.getConfigUnsignedLong("LogFileMaxLines", RESIP_LOG_MAX_LINE_COUNT_DEFAULT);
    Log::setMaxLineCount(loggingFileMaxLineCount);
+
+   if (configParse.getConfigBool("LogAsynchronous", false))
+   {
+      Log::setAsynchronous(true, configParse.getConfigUnsignedLong("LogAsynchronousQueueSize", 8192));
+   }
 }
 
 void
@@ -467,8 +705,7 @@ Log::level(Log::LocalLoggerId loggerId)
    }
    else
    {
-      Lock lock(_mutex);
-      level = mDefaultLoggerData.mLevel;
+      level = mDefaultLoggerData.mLevel.load(std::memory_order_relaxed);
    }
    return level;
 }
@@ -533,6 +770,61 @@ Log::setMaxByteCount(unsigned int maxByteCount, Log::LocalLoggerId loggerId)
    }
 }
 
+extern "C"
+{
+   static void flushLogAtExit()
+   {
+      Log::flush();
+   }
+}
+
+void
+Log::setAsynchronous(bool enable, unsigned int queueSize)
+{
+   static Mutex writerMutex;
+   static AsyncWriter* writer = 0;
+
+   Lock lock(writerMutex);
+   if (enable)
+   {
+      if (!writer)
+      {
+         writer = new AsyncWriter(queueSize);
+         writer->run();
+         atexit(flushLogAtExit);
+      }
+      mAsyncWriter.store(writer);
+   }
+   else if (mAsyncWriter.load())
+   {
+      mAsyncWriter.store(0);
+      writer->flush();
+   }
+}
+
+bool
+Log::isAsynchronous()
+{
+   return mAsyncWriter.load() != 0;
+}
+
+void
+Log::flush()
+{
+   AsyncWriter* writer = mAsyncWriter.load();
+   if (writer)
+   {
+      writer->flush();
+   }
+}
+
+uint64_t
+Log::droppedCount()
+{
+   AsyncWriter* writer = mAsyncWriter.load();
+   return writer ? writer->droppedCount() : 0;
+}
+
 void
 Log::setKeepAllLogFiles(bool keepAllLogFiles)
 {
@@ -963,13 +1255,16 @@ Log::droppingPrivileges(uid_t uid, pid_t pid)
 bool
 Log::isLogging(Log::Level level, const resip::Subsystem& sub)
 {
-   if (sub.getLevel() != Log::None)
+   // No lock here; levels are atomic, and a change made by another thread 
+   // only needs to show up eventually.
+   Log::Level subsystemLevel = sub.getLevel();
+   if (subsystemLevel != Log::None)
    {
-      return level <= sub.getLevel();
+      return level <= subsystemLevel;
    }
    else
    {
-      return (level <= Log::getLoggerData().mLevel);
+      return (level <= Log::getLoggerData().mLevel.load(std::memory_order_relaxed));
    }
 }
 
@@ -1010,6 +1305,8 @@ int Log::LocalLoggerMap::reinitialize(Log::LocalLoggerId loggerId,
                                       ExternalLogger* externalLogger,
                                       MessageStructure messageStructure)
 {
+   // Lines already queued for this logger must go where it pointed to.
+   Log::flush();
    Lock lock(mLoggerInstancesMapMutex);
    LoggerInstanceMap::iterator it = mLoggerInstancesMap.find(loggerId);
    if (it == mLoggerInstancesMap.end())
@@ -1025,6 +1322,8 @@ int Log::LocalLoggerMap::reinitialize(Log::LocalLoggerId loggerId,
 
 int Log::LocalLoggerMap::remove(Log::LocalLoggerId loggerId)
 {
+   // The writer thread may still have lines for this logger.
+   Log::flush();
    Lock lock(mLoggerInstancesMapMutex);
    LoggerInstanceMap::iterator it = mLoggerInstancesMap.find(loggerId);
    if (it == mLoggerInstancesMap.end())
@@ -1164,7 +1463,8 @@ Log::Guard::~Guard()
       }
    }
     
-   Type logType = resip::Log::getLoggerData().mType;
+   ThreadData& loggerData = resip::Log::getLoggerData();
+   Type logType = loggerData.mType;
 
    if(logType == resip::Log::OnlyExternal ||
       logType == resip::Log::OnlyExternalNoHeaders) 
@@ -1172,6 +1472,16 @@ Log::Guard::~Guard()
       return;
    }
 
+   if(logType != resip::Log::VSDebugWindow)
+   {
+      AsyncWriter* writer = mAsyncWriter.load(std::memory_order_acquire);
+      if(writer)
+      {
+         writer->post(loggerData, mLevel, mData);
+         return;
+      }
+   }
+
    resip::Lock lock(resip::Log::_mutex);
    // !dlb! implement VSDebugWindow as an external logger
    if (logType == resip::Log::VSDebugWindow)
@@ -1292,6 +1602,26 @@ Log::ThreadData::set(Type type, Level level,
    mInstanceName = instanceName;
 }
 
+void
+Log::ThreadData::flush()
+{
+   switch (mType)
+   {
+      case Log::Cout:
+         std::cout.flush();
+         break;
+      case Log::Cerr:
+         std::cerr.flush();
+         break;
+      default:
+         if (mLogger)
+         {
+            mLogger->flush();
+         }
+         break;
+   }
+}
+
 void 
 Log::ThreadData::reset()
 {
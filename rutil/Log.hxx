@@ -8,6 +8,7 @@
 #include <unistd.h>
 #endif
 
+#include <atomic>
 #include <set>
 
 #include "rutil/ConfigParse.hxx"
@@ -217,16 +218,42 @@ class Log
       /** @brief Return logging level for current thread.
       * If thread has no local logger attached, then return global logging level.
       */
-      static Level level() { Lock lock(_mutex); return getLoggerData().mLevel; }
+      static Level level() { return getLoggerData().mLevel.load(std::memory_order_relaxed); }
       /** Return logging level for given local logger. Use 0 to set global logging level. */
       static Level level(LocalLoggerId loggerId);
-      static LocalLoggerId id() { Lock lock(_mutex); return getLoggerData().id(); }
+      static LocalLoggerId id() { return getLoggerData().id(); }
       static void setMaxLineCount(unsigned int maxLineCount);
       static void setMaxLineCount(unsigned int maxLineCount, LocalLoggerId loggerId);
       static void setMaxByteCount(unsigned int maxByteCount);
       static void setMaxByteCount(unsigned int maxByteCount, LocalLoggerId loggerId);
       static void setKeepAllLogFiles(bool keepAllLogFiles);
       static void setKeepAllLogFiles(bool keepAllLogFiles, LocalLoggerId loggerId);
+
+      /**
+         @brief Writes log lines from a background thread instead of from the
+            thread that logs them.
+
+         Each line is still formatted by the thread that logs it, and is 
+         still handed to the ExternalLogger (if any) from that thread. Only 
+         the write to cout, cerr, the log file or syslog is moved: lines go 
+         through a fixed-size lock-free ring to a writer thread, which takes 
+         the log mutex and flushes once per batch rather than once per line.
+
+         When the ring is full, lines below Warning are dropped (and 
+         counted; see droppedCount()), while Warning and above wait for 
+         room. A line noting how many were dropped is written once there is 
+         room again.
+
+         @param queueSize The number of lines that can be waiting at once, 
+            rounded up to a power of two. Only used the first time this is 
+            enabled.
+      */
+      static void setAsynchronous(bool enable, unsigned int queueSize = 8192);
+      static bool isAsynchronous();
+      /// Waits for every line logged so far to be written.
+      static void flush();
+      /// The number of lines dropped because the ring was full.
+      static uint64_t droppedCount();
       static Level toLevel(const Data& l);
       static Type toType(const Data& t);
       static Data toString(Level l);
@@ -293,6 +320,10 @@ class Log
       static unsigned int MaxByteCount;
       static bool KeepAllLogFiles;
 
+      class AsyncWriter;
+      friend class AsyncWriter;
+      static std::atomic<AsyncWriter*> mAsyncWriter;
+
       class ThreadData
       {
          public:
@@ -336,11 +367,12 @@ class Log
             void setKeepAllLogFiles(bool keepAllLogFiles) { mKeepAllLogFiles = keepAllLogFiles; mKeepAllLogFilesSet = true; }
 
             std::ostream& Instance(unsigned int bytesToWrite); ///< Return logger stream instance, creating it if needed.
+            void flush(); ///< Flushes the logger stream, if there is one
             void reset(); ///< Frees logger stream
 #ifndef WIN32
             void droppingPrivileges(uid_t uid, pid_t pid);
 #endif
-            volatile Level mLevel;
+            std::atomic<Level> mLevel;
             volatile unsigned int mMaxLineCount;
             volatile unsigned int mMaxByteCount;
             ExternalLogger* mExternalLogger;
@@ -140,6 +140,20 @@ GenericLog(RESIPROCATE_SUBSYSTEM, resip::Log::Err, args_)
 #define CritLog(args_) \
 GenericLog(RESIPROCATE_SUBSYSTEM, resip::Log::Crit, args_)
 
+/**
+   Logging statements below this level are compiled out; they cost nothing 
+   at runtime, not even a level check. Set it with the 
+   RESIP_LOG_COMPILE_LEVEL CMake option, or define it to a resip::Log::Level 
+   before including this file. NO_DEBUG is the same as resip::Log::Info.
+*/
+#ifndef RESIP_LOG_COMPILE_LEVEL
+#ifdef NO_DEBUG
+#define RESIP_LOG_COMPILE_LEVEL resip::Log::Info
+#else
+#define RESIP_LOG_COMPILE_LEVEL resip::Log::Stack
+#endif
+#endif
+
 static inline bool
 genericLogCheckLevel(resip::Log::Level level, const resip::Subsystem& sub)
 {
@@ -150,7 +164,8 @@ genericLogCheckLevel(resip::Log::Level level, const resip::Subsystem& sub)
 #define GenericLog(system_, level_, args_)                              \
    do                                                                   \
    {                                                                    \
-      if (genericLogCheckLevel(level_, system_))                        \
+      if ((level_) <= RESIP_LOG_COMPILE_LEVEL &&                        \
+          genericLogCheckLevel(level_, system_))                        \
       {                                                                 \
          resip::Log::Guard _resip_log_guard(level_, system_, __FILE__, __LINE__, __func__); \
          _resip_log_guard.asStream()  args_;                            \
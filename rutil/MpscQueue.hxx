@@ -0,0 +1,290 @@
+#if !defined(RESIP_MPSCQUEUE_HXX)
+#define RESIP_MPSCQUEUE_HXX
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <new>
+
+#include "rutil/ResipAssert.h"
+
+#if defined(__linux__)
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#else
+#include "rutil/Mutex.hxx"
+#include "rutil/Condition.hxx"
+#include "rutil/Lock.hxx"
+#endif
+
+namespace resip
+{
+
+/**
+   @brief An unbounded queue that any number of threads may push to without
+   taking a lock, and that exactly one thread (the consumer) pops from.
+
+   Producers link a node in with a single atomic exchange of the tail
+   (Vyukov's intrusive MPSC queue), so they never wait on each other or on
+   the consumer. A producer that has swapped the tail but not yet linked its
+   node hides it, and everything pushed after it, from the consumer for that
+   moment; front() just reports the queue as empty until the link is made.
+
+   The consumer sleeps in wait() on a futex on Linux, or on a Condition
+   elsewhere. Producers only make a system call when the consumer has
+   announced that it is about to sleep.
+
+   front(), pop_front(), popMultiple() and wait() must only be called by the
+   consumer thread.
+
+   @see AbstractFifo::setLockFree()
+   @ingroup message_passing
+*/
+template <typename T>
+class MpscQueue
+{
+   public:
+      MpscQueue()
+         : mHead(new Node),
+           mSleeping(0)
+      {
+         mTail.store(mHead, std::memory_order_relaxed);
+      }
+
+      ~MpscQueue()
+      {
+         while (front())
+         {
+            pop_front();
+         }
+         delete mHead;
+      }
+
+      /// Any thread.
+      void push(const T& item)
+      {
+         Node* node = new Node;
+         new (node->mStorage) T(item);
+         link(node, node);
+      }
+
+      /// Any thread. Moves all of items in with one exchange of the tail.
+      void pushMultiple(std::deque<T>& items)
+      {
+         if (items.empty())
+         {
+            return;
+         }
+         Node* first = 0;
+         Node* last = 0;
+         for (typename std::deque<T>::const_iterator i = items.begin(); i != items.end(); ++i)
+         {
+            Node* node = new Node;
+            new (node->mStorage) T(*i);
+            if (last)
+            {
+               last->mNext.store(node, std::memory_order_relaxed);
+            }
+            else
+            {
+               first = node;
+            }
+            last = node;
+         }
+         items.clear();
+         link(first, last);
+      }
+
+      /// Consumer only. The oldest item, or 0 if none is linked in yet.
+      T* front() const
+      {
+         Node* next = mHead->mNext.load(std::memory_order_acquire);
+         return next ? next->value() : 0;
+      }
+
+      /// Consumer only. Requires front() != 0.
+      void pop_front()
+      {
+         Node* next = mHead->mNext.load(std::memory_order_relaxed);
+         resip_assert(next);
+         // The node that held the item becomes the new (empty) head.
+         next->value()->~T();
+         delete mHead;
+         mHead = next;
+      }
+
+      /// Consumer only. Moves up to max items to the back of other.
+      unsigned int popMultiple(std::deque<T>& other, unsigned int max)
+      {
+         unsigned int num = 0;
+         T* item;
+         while (num < max && (item = front()) != 0)
+         {
+            other.push_back(*item);
+            pop_front();
+            ++num;
+         }
+         return num;
+      }
+
+      /**
+         Consumer only. Sleeps until a producer pushes something. Wakeups
+         may be spurious, so check front() again afterwards.
+      */
+      void wait()
+      {
+         block(0);
+      }
+
+      /// Consumer only. As wait(), but gives up at end.
+      void wait_until(const std::chrono::steady_clock::time_point& end)
+      {
+         block(&end);
+      }
+
+   private:
+      struct Node
+      {
+         Node() : mNext(0) {}
+         T* value() { return reinterpret_cast<T*>(mStorage); }
+
+         std::atomic<Node*> mNext;
+         alignas(T) unsigned char mStorage[sizeof(T)];
+      };
+
+      void link(Node* first, Node* last)
+      {
+         Node* prev = mTail.exchange(last, std::memory_order_acq_rel);
+         prev->mNext.store(first, std::memory_order_release);
+
+         // Pairs with the fence in block(): either the consumer sees our node
+         // or we see that it is going to sleep.
+         std::atomic_thread_fence(std::memory_order_seq_cst);
+         if (mSleeping.load(std::memory_order_relaxed) &&
+             mSleeping.exchange(0, std::memory_order_relaxed))
+         {
+#if defined(__linux__)
+            syscall(SYS_futex, reinterpret_cast<int*>(&mSleeping), FUTEX_WAKE_PRIVATE, 1, 0, 0, 0);
+#else
+            Lock lock(mMutex); (void)lock;
+            mCondition.notify_one();
+#endif
+         }
+      }
+
+      void block(const std::chrono::steady_clock::time_point* end)
+      {
+         mSleeping.store(1, std::memory_order_relaxed);
+         std::atomic_thread_fence(std::memory_order_seq_cst);
+         if (front())
+         {
+            mSleeping.store(0, std::memory_order_relaxed);
+            return;
+         }
+
+#if defined(__linux__)
+         struct timespec timeout;
+         struct timespec* ptimeout = 0;
+         if (end)
+         {
+            std::chrono::steady_clock::duration left = *end - std::chrono::steady_clock::now();
+            if (left <= std::chrono::steady_clock::duration::zero())
+            {
+               mSleeping.store(0, std::memory_order_relaxed);
+               return;
+            }
+            long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+            timeout.tv_sec = (time_t)(ns / 1000000000);
+            timeout.tv_nsec = (long)(ns % 1000000000);
+            ptimeout = &timeout;
+         }
+         // Returns straight away if a producer has already cleared the flag.
+         syscall(SYS_futex, reinterpret_cast<int*>(&mSleeping), FUTEX_WAIT_PRIVATE, 1, ptimeout, 0, 0);
+#else
+         {
+            Lock lock(mMutex); (void)lock;
+            while (mSleeping.load(std::memory_order_relaxed))
+            {
+               if (!end)
+               {
+                  mCondition.wait(lock);
+               }
+               else if (mCondition.wait_until(lock, *end) == std::cv_status::timeout)
+               {
+                  break;
+               }
+            }
+         }
+#endif
+         mSleeping.store(0, std::memory_order_relaxed);
+      }
+
+      // Keep the consumer's and the producers' ends on different cache lines.
+      Node* mHead;
+      char mPad1[64];
+      std::atomic<Node*> mTail;
+      char mPad2[64];
+      std::atomic<int> mSleeping;
+#if !defined(__linux__)
+      Mutex mMutex;
+      Condition mCondition;
+#endif
+
+      // no value semantics
+      MpscQueue(const MpscQueue&);
+      MpscQueue& operator=(const MpscQueue&);
+};
+
+} // namespace resip
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,137 @@
+#if !defined(RESIP_SHARDEDCOUNTER_HXX)
+#define RESIP_SHARDEDCOUNTER_HXX
+
+#include <atomic>
+#include <stdint.h>
+
+namespace resip
+{
+
+/**
+   @brief A counter that any number of threads can bump without contending
+   with each other.
+
+   The count is split over a number of cache-line sized shards; each thread
+   is given one of them the first time it touches any ShardedCounter, and
+   only ever adds to that one, so threads bumping the same counter do not
+   bounce a cache line between them. add() is a single relaxed atomic add.
+   value() sums the shards, and so may be called from any thread at any
+   time, but is not a snapshot of all the adds made so far by other threads.
+
+   @ingroup data_structures
+*/
+class ShardedCounter
+{
+   public:
+      enum { Shards = 16 };
+
+      ShardedCounter()
+      {
+         reset();
+      }
+
+      /// Any thread.
+      void add(uint64_t n = 1)
+      {
+         mShards[shardIndex()].mValue.fetch_add(n, std::memory_order_relaxed);
+      }
+
+      ShardedCounter& operator++()
+      {
+         add(1);
+         return *this;
+      }
+
+      /// Any thread.
+      uint64_t value() const
+      {
+         uint64_t sum = 0;
+         for (unsigned int i = 0; i < Shards; ++i)
+         {
+            sum += mShards[i].mValue.load(std::memory_order_relaxed);
+         }
+         return sum;
+      }
+
+      /// Adds made while this runs may or may not be lost.
+      void reset()
+      {
+         for (unsigned int i = 0; i < Shards; ++i)
+         {
+            mShards[i].mValue.store(0, std::memory_order_relaxed);
+         }
+      }
+
+      /// The shard this thread adds to, in [0, Shards).
+      static unsigned int shardIndex()
+      {
+         static std::atomic<unsigned int> next(0);
+         static thread_local unsigned int index = next.fetch_add(1, std::memory_order_relaxed) % Shards;
+         return index;
+      }
+
+   private:
+      struct Shard
+      {
+         std::atomic<uint64_t> mValue;
+         char mPad[64 - sizeof(std::atomic<uint64_t>)];
+      };
+
+      Shard mShards[Shards];
+
+      // disabled
+      ShardedCounter(const ShardedCounter&);
+      ShardedCounter& operator=(const ShardedCounter&);
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -3,6 +3,7 @@
 
 #include <limits>
 #include <memory>
+#include <utility>
 #include <stddef.h>
 
 // .bwc. gcc 4.2 and above support stateful allocators. I don't know about other 
@@ -138,6 +139,14 @@ class StlPoolAllocator
          new (p) T(orig);
       }
 
+      // Lets containers move elements (eg when a vector grows) instead of
+      // copying them.
+      template<class U, class... Args>
+      void construct(U* p, Args&&... args)
+      {
+         new ((void*)p) U(std::forward<Args>(args)...);
+      }
+
       void destroy(pointer ptr)
       {
          ptr->~T();
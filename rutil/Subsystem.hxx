@@ -1,6 +1,7 @@
 #if !defined(RESIP_SUBSYSTEM_HXX)
 #define RESIP_SUBSYSTEM_HXX 
 
+#include <atomic>
 #include <iostream>
 #include "rutil/Data.hxx"
 #include "rutil/Log.hxx"
@@ -53,15 +54,16 @@ class Subsystem
       static Subsystem QPIDPROTON;
       
       const Data& getSubsystem() const;
-      Log::Level getLevel() const { return mLevel; }
-      void setLevel(Log::Level level) { mLevel = level; }
+      // Read on every logging statement, from any thread, so lock-free.
+      Log::Level getLevel() const { return mLevel.load(std::memory_order_relaxed); }
+      void setLevel(Log::Level level) { mLevel.store(level, std::memory_order_relaxed); }
    protected:
       explicit Subsystem(const char* rhs) : mSubsystem(rhs), mLevel(Log::None) {};
       explicit Subsystem(const Data& rhs) : mSubsystem(rhs), mLevel(Log::None) {};
       Subsystem& operator=(const Data& rhs);
 
       Data mSubsystem;
-      Log::Level mLevel;
+      std::atomic<Log::Level> mLevel;
 
       friend EncodeStream& operator<<(EncodeStream& strm, const Subsystem& ss);
 };
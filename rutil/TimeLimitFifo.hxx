@@ -2,6 +2,7 @@
 #define RESIP_TimeLimitFifo_hxx 
 
 #include "rutil/ResipAssert.h"
+#include <atomic>
 #include <memory>
 #include "rutil/AbstractFifo.hxx"
 #include <iostream>
@@ -209,12 +210,21 @@ class TimeLimitFifo : public AbstractFifo< Timestamped<Msg*> >
    private:
       time_t timeDepthInternal() const;
       inline bool wouldAcceptInteral(DepthUsage usage) const;
+      virtual void onMessagePopped(unsigned int num=1);
       TimeLimitFifo(const TimeLimitFifo& rhs);
       TimeLimitFifo& operator=(const TimeLimitFifo& rhs);
 
       time_t mMaxDurationSecs;
       unsigned int mMaxSize;
       unsigned int mUnreservedMaxSize;
+      // Lock-free mode: the timestamp of the oldest message, or 0 when empty.
+      // Producers set it when they find it 0, before their message can be
+      // taken, and the consumer recomputes it from the queue after every pop,
+      // so it never outlives the message it belongs to. If the consumer pops
+      // between a producer setting it and linking its message in, it is left
+      // 0 with that message queued until the next pop, so it can only make
+      // the time depth look smaller.
+      std::atomic<time_t> mFrontTime;
 };
 
 template <class Msg>
@@ -223,7 +233,8 @@ TimeLimitFifo<Msg>::TimeLimitFifo(unsigned int maxDurationSecs,
    : AbstractFifo< Timestamped<Msg*> >(),
      mMaxDurationSecs(maxDurationSecs),
      mMaxSize(maxSize),
-     mUnreservedMaxSize((int)((maxSize*8)/10)) // !dlb! random guess
+     mUnreservedMaxSize((int)((maxSize*8)/10)), // !dlb! random guess
+     mFrontTime(0)
 {}
 
 template <class Msg>
@@ -238,6 +249,22 @@ bool
 TimeLimitFifo<Msg>::add(Msg* msg,
                         DepthUsage usage)
 {
+   if(this->mLockFree)
+   {
+      // The limits are checked against counts that other producers may be
+      // changing, so a burst can overshoot them by a message or so per
+      // producer.
+      if (!wouldAcceptInteral(usage))
+      {
+         return false;
+      }
+      time_t n = time(0);
+      time_t none = 0;
+      mFrontTime.compare_exchange_strong(none, n);
+      AbstractFifo< Timestamped<Msg*> >::add(Timestamped<Msg*>(msg, n));
+      return true;
+   }
+
    Lock lock(mMutex); (void)lock;
 
    if (wouldAcceptInteral(usage))
@@ -258,6 +285,11 @@ template <class Msg>
 bool
 TimeLimitFifo<Msg>::wouldAccept(DepthUsage usage) const
 {
+   if(this->mLockFree)
+   {
+      return wouldAcceptInteral(usage);
+   }
+
    Lock lock(mMutex); (void)lock;
 
    return wouldAcceptInteral(usage);
@@ -287,6 +319,12 @@ template <class Msg>
 time_t
 TimeLimitFifo<Msg>::timeDepthInternal() const
 {
+   if(this->mLockFree)
+   {
+      time_t front = mFrontTime.load(std::memory_order_relaxed);
+      return front ? time(0) - front : 0;
+   }
+
    if(mFifo.empty())
    {
       return 0;
@@ -299,8 +337,9 @@ template <class Msg>
 bool
 TimeLimitFifo<Msg>::wouldAcceptInteral(DepthUsage usage) const
 {
+   const unsigned int count = this->mLockFree ? (unsigned int)this->mSize : (unsigned int)mFifo.size();
    if ((mMaxSize != 0 &&
-        mFifo.size() >= mMaxSize))
+        count >= mMaxSize))
    {
       return false;
    }
@@ -311,7 +350,7 @@ TimeLimitFifo<Msg>::wouldAcceptInteral(DepthUsage usage) const
    }
 
    if (mUnreservedMaxSize != 0 &&
-       mFifo.size() >= mUnreservedMaxSize)
+       count >= mUnreservedMaxSize)
    {
       return false;
    }
@@ -323,7 +362,7 @@ TimeLimitFifo<Msg>::wouldAcceptInteral(DepthUsage usage) const
 
    resip_assert(usage == EnforceTimeDepth);
 
-   if (mFifo.size() == 0 ||
+   if (count == 0 ||
        mMaxDurationSecs == 0 ||
        timeDepthInternal() < mMaxDurationSecs)
    {
@@ -337,6 +376,11 @@ template <class Msg>
 time_t
 TimeLimitFifo<Msg>::timeDepth() const
 {
+   if(this->mLockFree)
+   {
+      return timeDepthInternal();
+   }
+
    Lock lock(mMutex); (void)lock;
    return timeDepthInternal();
 }
@@ -345,6 +389,19 @@ template <class Msg>
 void
 TimeLimitFifo<Msg>::clear()
 {
+   if(this->mLockFree)
+   {
+      // Only the consumer (or the destructor) may do this.
+      while(const Timestamped<Msg*>* front = this->mLockFree->front())
+      {
+         delete front->getMsg();
+         this->mLockFree->pop_front();
+         this->onMessagePopped();
+      }
+      mFrontTime.store(0, std::memory_order_relaxed);
+      return;
+   }
+
    Lock lock(mMutex); (void)lock;
 
    while (!mFifo.empty())
@@ -354,6 +411,18 @@ TimeLimitFifo<Msg>::clear()
    }
 }
 
+template <class Msg>
+void
+TimeLimitFifo<Msg>::onMessagePopped(unsigned int num)
+{
+   AbstractFifo< Timestamped<Msg*> >::onMessagePopped(num);
+   if(this->mLockFree)
+   {
+      const Timestamped<Msg*>* front = this->mLockFree->front();
+      mFrontTime.store(front ? front->getTime() : 0, std::memory_order_relaxed);
+   }
+}
+
 template <class Msg>
 size_t
 TimeLimitFifo<Msg>::getCountDepth() const
@@ -0,0 +1,600 @@
+#if !defined(RESIP_TIMERWHEEL_HXX)
+#define RESIP_TIMERWHEEL_HXX
+
+#include <new>
+#include <vector>
+#include <string.h>
+
+#include "rutil/compat.hxx"
+#include "rutil/ResipAssert.h"
+
+namespace resip
+{
+
+/**
+   @brief A hierarchical timing wheel with millisecond resolution.
+
+   Holds timers of any copyable type T with a uint64_t getWhen() const
+   returning the expiry time in ms, and offers the same push()/top()/pop()
+   interface as the std::priority_queue it can replace, plus O(1) cancel().
+
+   There are four levels of 256 slots. Level 0 holds the timers due in the
+   current 256 ms window, one slot per ms; level 1 the rest of the current
+   65.5 s window, one slot per 256 ms; and so on up to about 49 days. Later
+   timers go on an overflow list. Adding or cancelling a timer is a list
+   link/unlink. As the wheel is advanced, each slot of a higher level is
+   redistributed over the levels below it once, when its window starts, so a
+   timer moves at most four times before it expires; windows with nothing to
+   redistribute are skipped.
+
+   The wheel only knows the time it is told through advance(). Timers that
+   are due by then are moved, a whole slot at a time and in order of expiry,
+   to a due list from which top() and pop() serve them; a timer pushed with
+   an expiry that has already been reached goes to the end of the due list.
+   Otherwise top() is the earliest timer: the next occupied level 0 slot if
+   any, else the earliest timer of the next occupied slot of a higher level.
+   The earliest timer of each higher slot is kept track of as timers are
+   added, and only looked for again after it has been cancelled.
+
+   Timers live in chunks of nodes that are linked by index and recycled
+   through a free list, so the wheel allocates only when it grows.
+*/
+template <class T>
+class TimerWheel
+{
+   public:
+      /// Identifies a pushed timer for cancel(); never 0.
+      typedef uint64_t Handle;
+
+      /// @param now the current time in ms; no timer expires before it.
+      explicit TimerWheel(uint64_t now)
+         : mCurrent(now),
+           mSize(0),
+           mNumNodes(0),
+           mFree(Nil)
+      {
+         for (unsigned int i = 0; i < NumLists; ++i)
+         {
+            mHeads[i] = Nil;
+            mTails[i] = Nil;
+            mEarliest[i] = Nil;
+         }
+         memset(mBits, 0, sizeof(mBits));
+      }
+
+      ~TimerWheel()
+      {
+         for (size_t c = 0; c < mChunks.size(); ++c)
+         {
+            Node* chunk = mChunks[c];
+            for (unsigned int i = 0; i < ChunkSize; ++i)
+            {
+               if (chunk[i].list != FreeList)
+               {
+                  chunk[i].timer().~T();
+               }
+            }
+            delete [] chunk;
+         }
+      }
+
+      Handle push(const T& timer)
+      {
+         uint32_t index = allocateNode();
+         Node& n = node(index);
+         new (n.storage) T(timer);
+         insert(index, timer.getWhen());
+         ++mSize;
+         return (Handle(n.generation) << 32) | index;
+      }
+
+      /// Removes a pushed timer that has not been popped yet.
+      /// @return false if the timer is no longer in the wheel
+      bool cancel(Handle handle)
+      {
+         if (!contains(handle))
+         {
+            return false;
+         }
+         removeNode(uint32_t(handle));
+         return true;
+      }
+
+      /// True if the timer has been pushed and not popped or cancelled.
+      bool contains(Handle handle) const
+      {
+         uint32_t index = uint32_t(handle);
+         if (index >= mNumNodes)
+         {
+            return false;
+         }
+         const Node& n = node(index);
+         return n.list != FreeList && n.generation == uint32_t(handle >> 32);
+      }
+
+      /// Moves the timers that expire by now to the due list.
+      void advance(uint64_t now)
+      {
+         while (mCurrent < now)
+         {
+            int slot = nextSlot(0, (unsigned int)(mCurrent & SlotMask) + 1);
+            if (slot >= 0)
+            {
+               uint64_t when = (mCurrent & ~uint64_t(SlotMask)) | (uint64_t)slot;
+               if (when > now)
+               {
+                  mCurrent = now;
+                  break;
+               }
+               mCurrent = when;
+               expire(slot);
+               continue;
+            }
+
+            uint64_t windowStart = nextWindow();
+            if (windowStart > now)
+            {
+               mCurrent = now;
+               break;
+            }
+            mCurrent = windowStart;
+            if ((mCurrent & 0xFFFFFFFFULL) == 0)
+            {
+               cascade(OverflowList);
+            }
+            if ((mCurrent & 0xFFFFFFULL) == 0)
+            {
+               cascade(3*NumSlots + (unsigned int)((mCurrent >> 24) & SlotMask));
+            }
+            if ((mCurrent & 0xFFFFULL) == 0)
+            {
+               cascade(2*NumSlots + (unsigned int)((mCurrent >> 16) & SlotMask));
+            }
+            cascade(NumSlots + (unsigned int)((mCurrent >> 8) & SlotMask));
+         }
+      }
+
+      /// The timer that expires first, or the first one on the due list.
+      const T& top() const
+      {
+         resip_assert(mSize);
+         return node(topIndex()).timer();
+      }
+
+      void pop()
+      {
+         resip_assert(mSize);
+         removeNode(topIndex());
+      }
+
+      /// Some timer, in no particular order; cheaper than top() when the
+      /// order does not matter, e.g. to drain the wheel.
+      const T& front() const
+      {
+         resip_assert(mSize);
+         return node(anyIndex()).timer();
+      }
+
+      void pop_front()
+      {
+         resip_assert(mSize);
+         removeNode(anyIndex());
+      }
+
+      bool empty() const
+      {
+         return mSize == 0;
+      }
+
+      size_t size() const
+      {
+         return mSize;
+      }
+
+      /// The time the wheel has been advanced to.
+      uint64_t getCurrent() const
+      {
+         return mCurrent;
+      }
+
+   private:
+      // disabled
+      TimerWheel(const TimerWheel&);
+      TimerWheel& operator=(const TimerWheel&);
+
+      enum
+      {
+         NumLevels = 4,
+         NumSlots = 256,
+         SlotMask = NumSlots - 1,
+         OverflowList = NumLevels*NumSlots,
+         DueList = OverflowList + 1,
+         NumLists = DueList + 1,
+         FreeList = 0xFFFF,
+         ChunkBits = 12,
+         ChunkSize = 1 << ChunkBits
+      };
+      static const uint32_t Nil = 0xFFFFFFFF;
+
+      struct Node
+      {
+         Node() : next(Nil), prev(Nil), generation(1), list(FreeList) {}
+
+         T& timer() { return *reinterpret_cast<T*>(storage); }
+         const T& timer() const { return *reinterpret_cast<const T*>(storage); }
+
+         uint32_t next;
+         uint32_t prev;
+         uint32_t generation;
+         uint16_t list;
+         alignas(T) unsigned char storage[sizeof(T)];
+      };
+
+      Node& node(uint32_t index)
+      {
+         return mChunks[index >> ChunkBits][index & (ChunkSize - 1)];
+      }
+
+      const Node& node(uint32_t index) const
+      {
+         return mChunks[index >> ChunkBits][index & (ChunkSize - 1)];
+      }
+
+      uint32_t allocateNode()
+      {
+         if (mFree != Nil)
+         {
+            uint32_t index = mFree;
+            mFree = node(index).next;
+            return index;
+         }
+         if ((mNumNodes & (ChunkSize - 1)) == 0)
+         {
+            mChunks.push_back(new Node[ChunkSize]);
+         }
+         return mNumNodes++;
+      }
+
+      void removeNode(uint32_t index)
+      {
+         unlink(index);
+         Node& n = node(index);
+         n.timer().~T();
+         n.list = FreeList;
+         if (++n.generation == 0)
+         {
+            n.generation = 1;
+         }
+         n.next = mFree;
+         mFree = index;
+         --mSize;
+      }
+
+      // Puts the node in the slot its expiry falls in, as seen from mCurrent.
+      void insert(uint32_t index, uint64_t when)
+      {
+         if (when <= mCurrent)
+         {
+            appendDue(index);
+            return;
+         }
+
+         uint64_t diff = when ^ mCurrent;
+         unsigned int list;
+         if (diff < (1ULL << 8))
+         {
+            list = (unsigned int)(when & SlotMask);
+         }
+         else if (diff < (1ULL << 16))
+         {
+            list = NumSlots + (unsigned int)((when >> 8) & SlotMask);
+         }
+         else if (diff < (1ULL << 24))
+         {
+            list = 2*NumSlots + (unsigned int)((when >> 16) & SlotMask);
+         }
+         else if (diff < (1ULL << 32))
+         {
+            list = 3*NumSlots + (unsigned int)((when >> 24) & SlotMask);
+         }
+         else
+         {
+            list = OverflowList;
+         }
+
+         if (list >= NumSlots)
+         {
+            if (mHeads[list] == Nil)
+            {
+               mEarliest[list] = index;
+            }
+            else if (mEarliest[list] != Nil && when < node(mEarliest[list]).timer().getWhen())
+            {
+               mEarliest[list] = index;
+            }
+         }
+         append(index, list);
+         if (list < OverflowList)
+         {
+            mBits[list >> 6] |= 1ULL << (list & 63);
+         }
+      }
+
+      void appendDue(uint32_t index)
+      {
+         append(index, DueList);
+      }
+
+      void append(uint32_t index, unsigned int list)
+      {
+         Node& n = node(index);
+         n.list = (uint16_t)list;
+         n.next = Nil;
+         n.prev = mTails[list];
+         if (n.prev != Nil)
+         {
+            node(n.prev).next = index;
+         }
+         else
+         {
+            mHeads[list] = index;
+         }
+         mTails[list] = index;
+      }
+
+      void unlink(uint32_t index)
+      {
+         Node& n = node(index);
+         // Expired level 0 slots are spliced onto the due list wholesale,
+         // so their nodes still name the slot; but only due timers have
+         // expiry times that have been reached.
+         unsigned int list = n.timer().getWhen() <= mCurrent ? (unsigned int)DueList : n.list;
+         if (mEarliest[list] == index)
+         {
+            mEarliest[list] = Nil;
+         }
+         if (n.prev != Nil)
+         {
+            node(n.prev).next = n.next;
+         }
+         else
+         {
+            mHeads[list] = n.next;
+         }
+
+         if (n.next != Nil)
+         {
+            node(n.next).prev = n.prev;
+         }
+         else
+         {
+            mTails[list] = n.prev;
+         }
+
+         if (list < OverflowList && mHeads[list] == Nil)
+         {
+            mBits[list >> 6] &= ~(1ULL << (list & 63));
+         }
+      }
+
+      // Detaches a list, so its nodes can be relinked one by one.
+      uint32_t takeList(unsigned int list)
+      {
+         uint32_t head = mHeads[list];
+         mHeads[list] = Nil;
+         mTails[list] = Nil;
+         mEarliest[list] = Nil;
+         if (list < OverflowList)
+         {
+            mBits[list >> 6] &= ~(1ULL << (list & 63));
+         }
+         return head;
+      }
+
+      // Level 0 slots hold timers for one ms, so the whole slot is due and
+      // is moved to the end of the due list as it is.
+      void expire(unsigned int slot)
+      {
+         uint32_t tail = mTails[slot];
+         uint32_t head = takeList(slot);
+         if (head == Nil)
+         {
+            return;
+         }
+         if (mTails[DueList] != Nil)
+         {
+            node(mTails[DueList]).next = head;
+            node(head).prev = mTails[DueList];
+         }
+         else
+         {
+            mHeads[DueList] = head;
+         }
+         mTails[DueList] = tail;
+      }
+
+      void cascade(unsigned int list)
+      {
+         for (uint32_t index = takeList(list); index != Nil; )
+         {
+            Node& n = node(index);
+            uint32_t next = n.next;
+            insert(index, n.timer().getWhen());
+            index = next;
+         }
+      }
+
+      // The first occupied slot of the level at or after start, or -1.
+      int nextSlot(unsigned int level, unsigned int start) const
+      {
+         if (start >= NumSlots)
+         {
+            return -1;
+         }
+         unsigned int word = start >> 6;
+         uint64_t bits = mBits[level*4 + word] & (~0ULL << (start & 63));
+         for (;;)
+         {
+            if (bits)
+            {
+               return (int)(word*64 + lowestBit(bits));
+            }
+            if (++word == 4)
+            {
+               return -1;
+            }
+            bits = mBits[level*4 + word];
+         }
+      }
+
+      static unsigned int lowestBit(uint64_t bits)
+      {
+#if defined(__GNUC__)
+         return (unsigned int)__builtin_ctzll(bits);
+#else
+         unsigned int bit = 0;
+         while (!(bits & 1))
+         {
+            bits >>= 1;
+            ++bit;
+         }
+         return bit;
+#endif
+      }
+
+      // The start of the next window whose slot on a higher level has
+      // timers, or of the next 2^32 ms window for the overflow list. The
+      // windows in between have nothing to cascade and are skipped.
+      uint64_t nextWindow() const
+      {
+         for (unsigned int level = 1; level < NumLevels; ++level)
+         {
+            int slot = nextSlot(level, (unsigned int)((mCurrent >> (8*level)) & SlotMask) + 1);
+            if (slot >= 0)
+            {
+               uint64_t windowMask = (1ULL << (8*(level + 1))) - 1;
+               return (mCurrent & ~windowMask) | ((uint64_t)slot << (8*level));
+            }
+         }
+         return (mCurrent | 0xFFFFFFFFULL) + 1;
+      }
+
+      uint32_t earliest(unsigned int list) const
+      {
+         if (mEarliest[list] != Nil)
+         {
+            return mEarliest[list];
+         }
+         uint32_t index = mHeads[list];
+         uint32_t result = index;
+         for (; index != Nil; index = node(index).next)
+         {
+            if (node(index).timer().getWhen() < node(result).timer().getWhen())
+            {
+               result = index;
+            }
+         }
+         return mEarliest[list] = result;
+      }
+
+      uint32_t topIndex() const
+      {
+         if (mHeads[DueList] != Nil)
+         {
+            return mHeads[DueList];
+         }
+
+         int slot = nextSlot(0, (unsigned int)(mCurrent & SlotMask) + 1);
+         if (slot >= 0)
+         {
+            return mHeads[slot];
+         }
+         for (unsigned int level = 1; level < NumLevels; ++level)
+         {
+            slot = nextSlot(level, (unsigned int)((mCurrent >> (8*level)) & SlotMask) + 1);
+            if (slot >= 0)
+            {
+               return earliest(level*NumSlots + slot);
+            }
+         }
+         return earliest(OverflowList);
+      }
+
+      uint32_t anyIndex() const
+      {
+         if (mHeads[DueList] != Nil)
+         {
+            return mHeads[DueList];
+         }
+         for (unsigned int word = 0; word < NumLevels*4; ++word)
+         {
+            if (mBits[word])
+            {
+               return mHeads[word*64 + lowestBit(mBits[word])];
+            }
+         }
+         return mHeads[OverflowList];
+      }
+
+      uint64_t mCurrent;
+      size_t mSize;
+      uint32_t mNumNodes;
+      uint32_t mFree;
+      uint32_t mHeads[NumLists];
+      uint32_t mTails[NumLists];
+      mutable uint32_t mEarliest[NumLists];
+      uint64_t mBits[NumLevels*4];
+      std::vector<Node*> mChunks;
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -88,7 +88,11 @@ DnsStub::DnsStub(const NameserverList& additional,
    mTransform(0),
    mDnsProvider(ExternalDnsFactory::createExternalDns()),
    mPollGrp(0),
-   mAsyncProcessHandler(asyncProcessHandler)
+   mAsyncProcessHandler(asyncProcessHandler),
+   mCacheHits(0),
+   mCacheMisses(0),
+   mCacheStaleHits(0),
+   mCachePrefetches(0)
 {
    setPollGrp(pollGrp);
 
@@ -115,6 +119,10 @@ DnsStub::~DnsStub()
    {
       delete *it;
    }
+   for (set<Prefetch*>::iterator it = mPrefetches.begin(); it != mPrefetches.end(); ++it)
+   {
+      delete *it;
+   }
 
    setPollGrp(0);
    delete mDnsProvider;
@@ -426,11 +434,60 @@ DnsStub::Query::Query(DnsStub& stub, ResultTransform* transform, ResultConverter
    resip_assert(s);
 }
 
+Data
+DnsStub::inFlightKey(int rrType, const Data& target)
+{
+   Data key(Data(rrType) + ":" + target + "/");
+   key.lowercase();
+   return key;
+}
+
 DnsStub::Query::~Query()
 {
+   if (!mInFlightKey.empty())
+   {
+      mStub.mInFlight.erase(mInFlightKey);
+   }
    delete mResultConverter; //.dcm. flyweight?
 }
 
+void
+DnsStub::Query::notify(int status, const Data& msg, const DnsResourceRecordsByPtr& records)
+{
+   if (!mInFlightKey.empty())
+   {
+      mStub.mInFlight.erase(mInFlightKey);
+      mInFlightKey.clear();
+   }
+
+   std::vector<Query*> followers;
+   followers.swap(mFollowers);
+   for (std::vector<Query*>::iterator it = followers.begin(); it != followers.end(); ++it)
+   {
+      (*it)->deliver(status, msg, records);
+      mStub.removeQuery(*it);
+      delete *it;
+   }
+
+   deliver(status, msg, records);
+}
+
+void
+DnsStub::Query::deliver(int status, const Data& msg, const DnsResourceRecordsByPtr& records)
+{
+   if (mTransform && !records.empty())
+   {
+      // The transform may reorder the records, so each query gets its own copy.
+      DnsResourceRecordsByPtr result(records);
+      mTransform->transform(mTarget, mRRType, result);
+      mResultConverter->notifyUser(mTarget, status, msg, result, mSink);
+   }
+   else
+   {
+      mResultConverter->notifyUser(mTarget, status, msg, records, mSink);
+   }
+}
+
 static Data
 typeToData(int rr)
 {
@@ -474,7 +531,13 @@ DnsStub::Query::go()
    Data targetToQuery = mTarget;
    bool newTargetToQuery = false;
 
-   cached = mStub.mRRCache.lookup(mTarget, mRRType, mProto, records, status);
+   bool refresh = false;
+   bool stale = false;
+   cached = mStub.mRRCache.lookup(mTarget, mRRType, mProto, records, status, &refresh, &stale);
+   if (refresh)
+   {
+      mStub.prefetch(mTarget, mRRType);
+   }
    if (!cached)
    {
       if (mRRType != T_CNAME)
@@ -500,11 +563,16 @@ DnsStub::Query::go()
    if (newTargetToQuery)
    {
       StackLog(<< mTarget << " mapped to CNAME " << targetToQuery);
-      cached = mStub.mRRCache.lookup(targetToQuery, mRRType, mProto, records, status);
+      cached = mStub.mRRCache.lookup(targetToQuery, mRRType, mProto, records, status, &refresh, &stale);
+      if (refresh)
+      {
+         mStub.prefetch(targetToQuery, mRRType);
+      }
    }
 
    if (!cached)
    {
+      ++mStub.mCacheMisses;
       if(mStub.mDnsProvider && mStub.mDnsProvider->hostFileLookupLookupOnlyMode())
       {
          resip_assert(mRRType == T_A);
@@ -517,16 +585,12 @@ DnsStub::Query::go()
             int queryStatus = 0;
 
             mStub.mRRCache.lookup(mTarget, mRRType, mProto, result, queryStatus);
-            if (mTransform)
-            {
-                mTransform->transform(mTarget, mRRType, result);
-            }
-            mResultConverter->notifyUser(mTarget, queryStatus, mStub.errorMessage(queryStatus), result, mSink);
+            notify(queryStatus, mStub.errorMessage(queryStatus), result);
          }
          else
          {
             // Not in hosts file - return error - or.. we could fallback to doing the lookupRecords call on the local named
-            mResultConverter->notifyUser(mTarget, ARES_ENOTFOUND, mStub.errorMessage(ARES_ENOTFOUND), Empty, mSink);
+            notify(ARES_ENOTFOUND, mStub.errorMessage(ARES_ENOTFOUND), Empty);
          }
          mReQuery = 0;
          mStub.removeQuery(this);
@@ -535,17 +599,38 @@ DnsStub::Query::go()
       }
       else
       {
+         Data prefetchKey(inFlightKey(mRRType, targetToQuery));
+         InFlightMap::iterator inFlight = mStub.mInFlight.find(prefetchKey);
+         if (inFlight != mStub.mInFlight.end())
+         {
+            StackLog (<< targetToQuery << " not cached. Waiting on refresh in progress, type=" << typeToData(mRRType));
+            inFlight->second.prefetch->mWaiting.push_back(this);
+            return;
+         }
+
+         Data key(prefetchKey + Data(mProto) + ":" + Data(mFollowCname));
+         inFlight = mStub.mInFlight.find(key);
+         if (inFlight != mStub.mInFlight.end())
+         {
+            StackLog (<< targetToQuery << " not cached. Waiting on lookup in progress, type=" << typeToData(mRRType));
+            inFlight->second.query->mFollowers.push_back(this);
+            return;
+         }
+
          StackLog (<< targetToQuery << " not cached. Doing external dns lookup, type=" << typeToData(mRRType));
+         mInFlightKey = key;
+         mStub.mInFlight[key].query = this;
          mStub.lookupRecords(targetToQuery, mRRType, this);
       }
    }
    else // is cached
    {
-      if (mTransform && !records.empty())
+      ++mStub.mCacheHits;
+      if (stale)
       {
-         mTransform->transform(mTarget, mRRType, records);
+         ++mStub.mCacheStaleHits;
       }
-      mResultConverter->notifyUser(mTarget, status, mStub.errorMessage(status), records, mSink);
+      notify(status, mStub.errorMessage(status), records);
 
       mStub.removeQuery(this);
       delete this;
@@ -576,11 +661,7 @@ DnsStub::Query::process(int status, const unsigned char* abuf, const int alen)
                   int queryStatus = 0;
 
                   mStub.mRRCache.lookup(mTarget, mRRType, mProto, result, queryStatus);
-                  if (mTransform)
-                  {
-                     mTransform->transform(mTarget, mRRType, result);
-                  }
-                  mResultConverter->notifyUser(mTarget, queryStatus, mStub.errorMessage(queryStatus), result, mSink);
+                  notify(queryStatus, mStub.errorMessage(queryStatus), result);
                   mStub.removeQuery(this);
                   delete this;
                   return;
@@ -633,7 +714,7 @@ DnsStub::Query::process(int status, const unsigned char* abuf, const int alen)
 
       // For other error status values, we may also want to cacheTTL to delay
       // requeries. Especially if the server refuses.
-      mResultConverter->notifyUser(mTarget, status, mStub.errorMessage(status), Empty, mSink);
+      notify(status, mStub.errorMessage(status), Empty);
       mReQuery = 0;
       mStub.removeQuery(this);
       delete this;
@@ -655,7 +736,7 @@ DnsStub::Query::process(int status, const unsigned char* abuf, const int alen)
       catch (BaseException& e)
       {
          ErrLog(<< "Error parsing DNS record for " << mTarget << ": " << e.getMessage());
-         mResultConverter->notifyUser(mTarget, ARES_EFORMERR, e.getMessage(), Empty, mSink);
+         notify(ARES_EFORMERR, e.getMessage(), Empty);
          mStub.removeQuery(this);
          delete this;
          return;
@@ -665,7 +746,7 @@ DnsStub::Query::process(int status, const unsigned char* abuf, const int alen)
    int ancount = DNS_HEADER_ANCOUNT(abuf);
    if (ancount == 0)
    {
-      mResultConverter->notifyUser(mTarget, 0, mStub.errorMessage(0), Empty, mSink);
+      notify(0, mStub.errorMessage(0), Empty);
    }
    else
    {
@@ -681,11 +762,7 @@ DnsStub::Query::process(int status, const unsigned char* abuf, const int alen)
 
          if (mTarget != targetToQuery) DebugLog (<< mTarget << " mapped to " << targetToQuery << " and returned result");
          mStub.mRRCache.lookup(targetToQuery, mRRType, mProto, result, queryStatus);
-         if (mTransform)
-         {
-            mTransform->transform(mTarget, mRRType, result);
-         }
-         mResultConverter->notifyUser(mTarget, queryStatus, mStub.errorMessage(queryStatus), result, mSink);
+         notify(queryStatus, mStub.errorMessage(queryStatus), result);
       }
    }
 
@@ -702,6 +779,104 @@ DnsStub::Query::onDnsRaw(int status, const unsigned char* abuf, int alen)
    process(status, abuf, alen);
 }
 
+DnsStub::Prefetch::Prefetch(DnsStub& stub, const Data& target, int rrType)
+   : mStub(stub),
+     mTarget(target),
+     mRRType(rrType)
+{
+}
+
+DnsStub::Prefetch::~Prefetch()
+{
+   if (!mInFlightKey.empty())
+   {
+      mStub.mInFlight.erase(mInFlightKey);
+   }
+}
+
+void
+DnsStub::Prefetch::onDnsRaw(int status, const unsigned char* abuf, int alen)
+{
+   // Only a positive answer replaces the entry; otherwise it is left to
+   // expire, and is offered for refresh again on its next lookup.
+   if (status == 0 && DNS_HEADER_ANCOUNT(abuf) > 0)
+   {
+      try
+      {
+         const unsigned char* aptr = abuf + HFIXEDSZ;
+         int qdcount = DNS_HEADER_QDCOUNT(abuf);
+         for (int i = 0; i < qdcount && aptr; ++i)
+         {
+            aptr = mStub.skipDNSQuestion(aptr, abuf, alen);
+         }
+
+         char* name = 0;
+         long len = 0;
+         if (ARES_SUCCESS == ares_expand_name(aptr, abuf, alen, &name, &len))
+         {
+            Data owner(name);
+            free(name);
+            mStub.cache(owner, abuf, alen);
+            StackLog(<< "Refreshed cache entry: target=" << mTarget << ", type=" << typeToData(mRRType));
+         }
+      }
+      catch (BaseException& e)
+      {
+         ErrLog(<< "Failed to refresh cache entry for " << mTarget << ": " << e.getMessage());
+      }
+   }
+   else
+   {
+      DebugLog(<< "Cache refresh for " << mTarget << " failed: " << mStub.errorMessage(status));
+   }
+
+   mStub.mRRCache.refreshDone(mTarget, mRRType);
+   mStub.mPrefetches.erase(this);
+   std::vector<Query*> waiting;
+   waiting.swap(mWaiting);
+   delete this;
+
+   // Mostly answered from the cache now; if the refresh failed they send
+   // their own lookups.
+   for (std::vector<Query*>::iterator it = waiting.begin(); it != waiting.end(); ++it)
+   {
+      (*it)->go();
+   }
+}
+
+void
+DnsStub::prefetch(const Data& target, int rrType)
+{
+   if (mDnsProvider->hostFileLookupLookupOnlyMode())
+   {
+      // Host file entries are refreshed by the lookup that finds them gone.
+      mRRCache.refreshDone(target, rrType);
+      return;
+   }
+
+   Data key(inFlightKey(rrType, target));
+   InFlightMap::iterator inFlight = mInFlight.lower_bound(key);
+   if (inFlight != mInFlight.end() && inFlight->first.prefix(key))
+   {
+      // A query or refresh for these records is already on its way, and
+      // will refresh the cache.
+      StackLog(<< "Refresh of " << target << " already in progress, type=" << typeToData(rrType));
+      if (!inFlight->second.prefetch)
+      {
+         mRRCache.refreshDone(target, rrType);
+      }
+      return;
+   }
+
+   StackLog(<< "Refreshing cache entry: target=" << target << ", type=" << typeToData(rrType));
+   ++mCachePrefetches;
+   Prefetch* prefetch = new Prefetch(*this, target, rrType);
+   mPrefetches.insert(prefetch);
+   prefetch->mInFlightKey = key;
+   mInFlight[key].prefetch = prefetch;
+   lookupRecords(target, rrType, prefetch);
+}
+
 void
 DnsStub::Query::followCname(const unsigned char* aptr, const unsigned char*abuf, const int alen, bool& bGotAnswers, bool& bDeleteThis, Data& targetToQuery)
 {
@@ -714,7 +889,7 @@ DnsStub::Query::followCname(const unsigned char* aptr, const unsigned char*abuf,
    if (ARES_SUCCESS != ares_expand_name(aptr, abuf, alen, &name, &len))
    {
       ErrLog(<< "Failed DNS preparse for " << targetToQuery);
-      mResultConverter->notifyUser(mTarget, ARES_EFORMERR, "Failed DNS preparse", Empty, mSink);
+      notify(ARES_EFORMERR, "Failed DNS preparse", Empty);
       bGotAnswers = false;
       return;
    }
@@ -729,7 +904,7 @@ DnsStub::Query::followCname(const unsigned char* aptr, const unsigned char*abuf,
    catch (BaseException& e)
    {
       ErrLog(<< "Failed to cache result for " << targetToQuery << ": " << e.getMessage());
-      mResultConverter->notifyUser(mTarget, ARES_EFORMERR, e.getMessage(), Empty, mSink);
+      notify(ARES_EFORMERR, e.getMessage(), Empty);
       bGotAnswers = false;
       free(name);
       return;
@@ -771,7 +946,7 @@ DnsStub::Query::followCname(const unsigned char* aptr, const unsigned char*abuf,
          else
          {
             mReQuery = 0;
-            mResultConverter->notifyUser(mTarget, 1, mStub.errorMessage(1), Empty, mSink);
+            notify(1, mStub.errorMessage(1), Empty);
             bGotAnswers = false;
          }
       }
@@ -875,7 +1050,16 @@ DnsStub::doGetDnsCacheDump(std::pair<unsigned long, unsigned long> key, GetDnsCa
 {
    resip_assert(handler != 0);
    Data dnsCacheDump;
-   mRRCache.getCacheDump(dnsCacheDump);
+   {
+      DataStream strm(dnsCacheDump);
+      strm << "DNSCACHE: Hits=" << mCacheHits
+           << ", Misses=" << mCacheMisses
+           << ", StaleHits=" << mCacheStaleHits
+           << ", Prefetches=" << mCachePrefetches << endl;
+   }
+   Data entries;
+   mRRCache.getCacheDump(entries);
+   dnsCacheDump += entries;
    handler->onDnsCacheDumpRetrieved(key, dnsCacheDump);
 }
 
@@ -910,6 +1094,18 @@ DnsStub::setDnsCacheSize(int size)
    mRRCache.setSize(size);
 }
 
+void
+DnsStub::setDnsPrefetch(unsigned int minHits, unsigned int percent)
+{
+   mRRCache.setPrefetch(minHits, percent);
+}
+
+void
+DnsStub::setDnsMaxStale(unsigned int seconds)
+{
+   mRRCache.setMaxStale(seconds);
+}
+
 /* ====================================================================
  * The Vovida Software License, Version 1.0 
  * 
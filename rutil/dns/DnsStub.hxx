@@ -14,6 +14,7 @@
 #include "rutil/FdPoll.hxx"
 #include "rutil/Fifo.hxx"
 #include "rutil/GenericIPAddress.hxx"
+#include "rutil/HashMap.hxx"
 #include "rutil/Logger.hxx"
 #include "rutil/SelectInterruptor.hxx"
 #include "rutil/Socket.hxx"
@@ -181,6 +182,13 @@ class DnsStub : public ExternalDnsHandler
       void getDnsCacheDump(std::pair<unsigned long, unsigned long> key, GetDnsCacheDumpHandler* handler);
       void setDnsCacheTTL(int ttl);
       void setDnsCacheSize(int size);
+      // Refreshes a cached record in the background once it has been looked
+      // up at least minHits times and no more than percent of its TTL is
+      // left.  minHits of 0 (the default) turns this off.
+      void setDnsPrefetch(unsigned int minHits, unsigned int percent);
+      // Keeps answering from an expired record for up to seconds past its
+      // TTL while it is refreshed.  0 (the default) turns this off.
+      void setDnsMaxStale(unsigned int seconds);
       void reloadDnsServers();
       bool checkDnsChange();
       bool supportedType(int);
@@ -278,8 +286,13 @@ class DnsStub : public ExternalDnsHandler
             void process(int status, const unsigned char* abuf, const int alen);
             void onDnsRaw(int status, const unsigned char* abuf, int alen);
             void followCname(const unsigned char* aptr, const unsigned char*abuf, const int alen, bool& bGotAnswers, bool& bDeleteThis, Data& targetToQuery);
+            // Reports the result to this query's sink, and to those of any
+            // queries that were coalesced into it.
+            void notify(int status, const Data& msg, const DnsResourceRecordsByPtr& records);
 
          private:
+            void deliver(int status, const Data& msg, const DnsResourceRecordsByPtr& records);
+
             static DnsResourceRecordsByPtr Empty;
             int mRRType;
             DnsStub& mStub;
@@ -290,8 +303,32 @@ class DnsStub : public ExternalDnsHandler
             int mReQuery;
             DnsResultSink* mSink;
             bool mFollowCname;
+            // Set while this query's lookup is in mInFlight.
+            Data mInFlightKey;
+            std::vector<Query*> mFollowers;
+      };
+
+      // Background refresh of a cache entry; see setDnsPrefetch.
+      class Prefetch : public DnsRawSink
+      {
+         public:
+            Prefetch(DnsStub& stub, const Data& target, int rrType);
+            virtual ~Prefetch();
+            void onDnsRaw(int status, const unsigned char* abuf, int alen);
+
+            Data mInFlightKey;
+            // Queries that missed the cache while this was on its way; they
+            // are run again once it has refreshed the cache.
+            std::vector<Query*> mWaiting;
+
+         private:
+            DnsStub& mStub;
+            Data mTarget;
+            int mRRType;
       };
 
+      void prefetch(const Data& target, int rrType);
+
    private:
       DnsStub(const DnsStub&);   // disable copy ctor.
       DnsStub& operator=(const DnsStub&);
@@ -477,6 +514,22 @@ class DnsStub : public ExternalDnsHandler
       ExternalDns* mDnsProvider;
       FdPollGrp* mPollGrp;
       std::set<Query*> mQueries;
+      // Upstream lookups in progress, keyed by inFlightKey(): type and
+      // lowercased target, followed by the protocol and whether CNAMEs are
+      // followed for queries, and by nothing for prefetches.  Later queries
+      // for the same key, or that a prefetch of the records will answer,
+      // wait on that rather than sending their own lookup; a prefetch is not
+      // sent while a query for the same records is on its way.
+      struct InFlight
+      {
+         InFlight() : query(0), prefetch(0) {}
+         Query* query;
+         Prefetch* prefetch;
+      };
+      typedef std::map<Data, InFlight> InFlightMap;
+      InFlightMap mInFlight;
+      static Data inFlightKey(int rrType, const Data& target);
+      std::set<Prefetch*> mPrefetches;
 
       std::vector<Data> mEnumSuffixes; // where to do enum lookups
       std::map<Data,Data> mEnumDomains;
@@ -490,6 +543,12 @@ class DnsStub : public ExternalDnsHandler
 
       /// Dns Cache
       RRCache mRRCache;
+
+      // Reported by getDnsCacheDump.
+      uint64_t mCacheHits;
+      uint64_t mCacheMisses;
+      uint64_t mCacheStaleHits;
+      uint64_t mCachePrefetches;
 };
 
 typedef DnsStub::Protocol Protocol;
@@ -56,7 +56,10 @@ RRCache::RRCache()
    : mHead(),
      mLruHead(LruListType::makeList(&mHead)),
      mUserDefinedTTL(DEFAULT_USER_DEFINED_TTL),
-     mSize(DEFAULT_SIZE)
+     mSize(DEFAULT_SIZE),
+     mPrefetchHits(0),
+     mPrefetchPercent(0),
+     mMaxStale(0)
 {
    mFactoryMap[T_CNAME] = &mCnameRecordFactory;
    mFactoryMap[T_NAPTR] = &mNaptrRecordFacotry;
@@ -76,28 +79,22 @@ void
 RRCache::updateCacheFromHostFile(const DnsHostRecord &record)
 {
    //FactoryMap::iterator it = mFactoryMap.find(T_A);
-   RRList* key = new RRList(record, 3600);
-   RRSet::iterator lb = mRRSet.lower_bound(key);
-   if (lb != mRRSet.end() &&
-       !(mRRSet.key_comp()(key, *lb)))
+   RRMap::iterator lb = mRRMap.find(Key(T_A, record.name()));
+   if (lb != mRRMap.end())
    {
 #ifdef VERBOSE_DNS_STACK_LOGS
       StackLog(<< "Updating cache from hostfile: target=" << record.name() << ", host=" << record.host());
 #endif
-      (*lb)->update(record, 3600);
-      touch(*lb);
+      lb->second->update(record, 3600);
+      touch(lb->second);
    }
    else
    {
 #ifdef VERBOSE_DNS_STACK_LOGS
       StackLog(<< "Adding to cache from hostfile: target=" << record.name() << ", host=" << record.host());
 #endif
-      RRList* val = new RRList(record, 3600);
-      mRRSet.insert(val);
-      mLruHead->push_back(val);
-      purge();
+      insert(new RRList(record, 3600));
    }
-   delete key;
 }
 
 void 
@@ -110,20 +107,16 @@ RRCache::updateCache(const Data& target,
    FactoryMap::iterator it = mFactoryMap.find(rrType);
    if (it != mFactoryMap.end())  // If we don't understand rrType - ignore it
    {
-      RRList* key = new RRList(domain, rrType);
-      RRSet::iterator lb = mRRSet.lower_bound(key);
-      if (lb != mRRSet.end() &&
-         !(mRRSet.key_comp()(key, *lb)))
+      RRMap::iterator lb = mRRMap.find(Key(rrType, domain));
+      if (lb != mRRMap.end())
       {
-         (*lb)->update(it->second, begin, end, mUserDefinedTTL);
-         if ((*lb)->numRecords() == 0)
+         lb->second->update(it->second, begin, end, mUserDefinedTTL);
+         if (lb->second->numRecords() == 0)
          {
-            // *lb might be a RRList with no records if parsing failed - remove from cache
-            (*lb)->remove();
-            delete *lb;
-            mRRSet.erase(lb);
+            // lb->second might be a RRList with no records if parsing failed - remove from cache
+            erase(lb);
 #ifdef VERBOSE_DNS_STACK_LOGS
-            StackLog(<< "Update cache failed to parse, removed entry: target=" << target << ", type=" << AresDns::dnsRRTypeToString(rrType) << ", totalCachedEntries=" << mRRSet.size());
+            StackLog(<< "Update cache failed to parse, removed entry: target=" << target << ", type=" << AresDns::dnsRRTypeToString(rrType) << ", totalCachedEntries=" << mRRMap.size());
 #endif
          }
          else
@@ -132,7 +125,7 @@ RRCache::updateCache(const Data& target,
             StackLog(<< "Updated cache: target=" << target << ", type=" << AresDns::dnsRRTypeToString(rrType));
 #endif
             // update good - touch entry
-            touch(*lb);
+            touch(lb->second);
          }
       }
       else
@@ -148,15 +141,12 @@ RRCache::updateCache(const Data& target,
          }
          else
          {
-            mRRSet.insert(val);
-            mLruHead->push_back(val);
-            purge();
+            insert(val);
 #ifdef VERBOSE_DNS_STACK_LOGS
-            StackLog(<< "Updated cache with new entry: target=" << target << ", type=" << AresDns::dnsRRTypeToString(rrType) << ", totalCachedEntries=" << mRRSet.size());
+            StackLog(<< "Updated cache with new entry: target=" << target << ", type=" << AresDns::dnsRRTypeToString(rrType) << ", totalCachedEntries=" << mRRMap.size());
 #endif
          }
       }
-      delete key;
    }
 }
 
@@ -178,20 +168,15 @@ RRCache::cacheTTL(const Data& target,
       ttl = mUserDefinedTTL;
    }
 
-   RRList* val = new RRList(target, rrType, ttl, status);
-   RRSet::iterator it = mRRSet.find(val);
-   if (it != mRRSet.end())
+   RRMap::iterator it = mRRMap.find(Key(rrType, target));
+   if (it != mRRMap.end())
    {
-      (*it)->remove();
-      delete *it;
-      mRRSet.erase(it);
+      erase(it);
    }
-   mRRSet.insert(val);
-   mLruHead->push_back(val);
-   purge();
+   insert(new RRList(target, rrType, ttl, status));
 
 #ifdef VERBOSE_DNS_STACK_LOGS
-   StackLog(<< "Updated cache ttl: target=" << target << ", type=" << AresDns::dnsRRTypeToString(rrType) << ", status=" << status << ", ttl=" << ttl << ", totalCachedEntries=" << mRRSet.size());
+   StackLog(<< "Updated cache ttl: target=" << target << ", type=" << AresDns::dnsRRTypeToString(rrType) << ", status=" << status << ", ttl=" << ttl << ", totalCachedEntries=" << mRRMap.size());
 #endif
 }
 
@@ -200,45 +185,89 @@ RRCache::lookup(const Data& target,
                 const int type, 
                 const int protocol,
                 Result& records, 
-                int& status)
+                int& status,
+                bool* refresh,
+                bool* stale)
 {
    records.clear();
    status = 0;
-   RRList* key = new RRList(target, type);
-   RRSet::iterator it = mRRSet.find(key);
-   delete key;
-   if (it == mRRSet.end())
+   if (refresh) *refresh = false;
+   if (stale) *stale = false;
+   RRMap::iterator it = mRRMap.find(Key(type, target));
+   if (it == mRRMap.end())
    {
 #ifdef VERBOSE_DNS_STACK_LOGS
-      StackLog(<< "Cache lookup failed for: target=" << target << ", type=" << AresDns::dnsRRTypeToString(type) << ", protocol=" << protocol << ", totalCachedEntries=" << mRRSet.size());
+      StackLog(<< "Cache lookup failed for: target=" << target << ", type=" << AresDns::dnsRRTypeToString(type) << ", protocol=" << protocol << ", totalCachedEntries=" << mRRMap.size());
 #endif
       return false;
    }
    else
    {
-      if (Timer::getTimeSecs() >= (*it)->absoluteExpiry())
+      RRList* node = it->second;
+      uint64_t now = Timer::getTimeSecs();
+      bool expired = now >= node->absoluteExpiry();
+      if (expired && refresh && now < node->absoluteExpiry() + mMaxStale)
       {
+         // Serve the stale records while the entry is refreshed.
 #ifdef VERBOSE_DNS_STACK_LOGS
-         StackLog(<< "Cache lookup found expired entry for: target=" << target << ", type=" << AresDns::dnsRRTypeToString(type) << ", protocol=" << protocol << ", totalCachedEntries=" << mRRSet.size());
+         StackLog(<< "Cache lookup found stale entry for: target=" << target << ", type=" << AresDns::dnsRRTypeToString(type) << ", protocol=" << protocol << ", refreshing=" << node->refreshing());
 #endif
-         (*it)->remove();
-         delete *it;
-         mRRSet.erase(it);
+         if (stale) *stale = true;
+         if (!node->refreshing())
+         {
+            node->refreshing() = true;
+            *refresh = true;
+         }
+         records = node->records(protocol);
+         status = node->status();
+         touch(node);
+         return true;
+      }
+      else if (expired)
+      {
+#ifdef VERBOSE_DNS_STACK_LOGS
+         StackLog(<< "Cache lookup found expired entry for: target=" << target << ", type=" << AresDns::dnsRRTypeToString(type) << ", protocol=" << protocol << ", totalCachedEntries=" << mRRMap.size());
+#endif
+         erase(it);
          return false;
       }
       else
       {
 #ifdef VERBOSE_DNS_STACK_LOGS
-         StackLog(<< "Cache lookup success for: target=" << target << ", type=" << AresDns::dnsRRTypeToString(type) << ", protocol=" << protocol << ", totalCachedEntries=" << mRRSet.size());
+         StackLog(<< "Cache lookup success for: target=" << target << ", type=" << AresDns::dnsRRTypeToString(type) << ", protocol=" << protocol << ", totalCachedEntries=" << mRRMap.size());
 #endif
-         records = (*it)->records(protocol);
-         status = (*it)->status();
-         touch(*it);
+         records = node->records(protocol);
+         status = node->status();
+         ++node->hits();
+         if (refresh && mPrefetchHits && node->hits() >= mPrefetchHits && !node->refreshing() &&
+             (node->absoluteExpiry() - now) * 100 <= node->lifetime() * mPrefetchPercent)
+         {
+            node->refreshing() = true;
+            *refresh = true;
+         }
+         touch(node);
          return true;
       }
    }
 }
 
+void 
+RRCache::refreshDone(const Data& target, const int type)
+{
+   RRMap::iterator it = mRRMap.find(Key(type, target));
+   if (it != mRRMap.end())
+   {
+      it->second->refreshing() = false;
+   }
+}
+
+void 
+RRCache::setPrefetch(unsigned int minHits, unsigned int percent)
+{
+   mPrefetchHits = minHits;
+   mPrefetchPercent = percent;
+}
+
 void 
 RRCache::clearCache()
 {
@@ -252,17 +281,35 @@ RRCache::touch(RRList* node)
    mLruHead->push_back(node);
 }
 
+void 
+RRCache::insert(RRList* node)
+{
+   mRRMap.insert(RRMap::value_type(Key(node->rrType(), node->key()), node));
+   mLruHead->push_back(node);
+   purge();
+}
+
+void 
+RRCache::erase(RRMap::iterator it)
+{
+   RRList* node = it->second;
+   // The Key points into node, so it goes first.
+   mRRMap.erase(it);
+   node->remove();
+   delete node;
+}
+
 void 
 RRCache::cleanup()
 {
-   for (std::set<RRList*, CompareT>::iterator it = mRRSet.begin(); it != mRRSet.end(); it++)
+   for (RRMap::iterator it = mRRMap.begin(); it != mRRMap.end(); it++)
    {
-      (*it)->remove();
-      delete *it;
+      it->second->remove();
+      delete it->second;
    }
-   mRRSet.clear();
+   mRRMap.clear();
 #ifdef VERBOSE_DNS_STACK_LOGS
-   StackLog(<< "Cache emptied, totalCachedEntries=" << mRRSet.size());
+   StackLog(<< "Cache emptied, totalCachedEntries=" << mRRMap.size());
 #endif
 }
 
@@ -294,18 +341,21 @@ RRCache::getTTL(const RROverlay& overlay)
 void 
 RRCache::purge()
 {
-   if (mRRSet.size() < mSize) return;
-   RRList* lst = *(mLruHead->begin());
-   RRSet::iterator it = mRRSet.find(lst);
-   if (it != mRRSet.end()) // safety check incase code forgets to remove from LRU list when removing from mRRset
+   // Also trims the cache down after setSize() shrinks it.
+   while (mRRMap.size() >= mSize && !mLruHead->empty())
    {
+      RRList* lst = *(mLruHead->begin());
+      RRMap::iterator it = mRRMap.find(Key(lst->rrType(), lst->key()));
+      if (it == mRRMap.end() || it->second != lst) // safety check incase code forgets to remove from LRU list when removing from mRRMap
+      {
+         lst->remove();
+         continue;
+      }
 #ifdef VERBOSE_DNS_STACK_LOGS
-      StackLog(<< "Cache full purging LRU record, target=" << lst->key() << ", type=" << AresDns::dnsRRTypeToString(lst->rrType()) << ", status=" << lst->status() << ", totalCachedEntries=" << mRRSet.size() << ", maxSize=" << mSize);
+      StackLog(<< "Cache full purging LRU record, target=" << lst->key() << ", type=" << AresDns::dnsRRTypeToString(lst->rrType()) << ", status=" << lst->status() << ", totalCachedEntries=" << mRRMap.size() << ", maxSize=" << mSize);
 #endif
 
-      lst->remove();
-      delete* it;
-      mRRSet.erase(it);
+      erase(it);
    }
 }
 
@@ -322,19 +372,17 @@ RRCache::getCacheDump(Data& dnsCacheDump)
 {
    uint64_t now = Timer::getTimeSecs();
    DataStream strm(dnsCacheDump);
-   strm << "DNSCACHE: TotalEntries=" << mRRSet.size();
-   for (std::set<RRList*, CompareT>::iterator it = mRRSet.begin(); it != mRRSet.end(); )
+   strm << "DNSCACHE: TotalEntries=" << mRRMap.size();
+   for (RRMap::iterator it = mRRMap.begin(); it != mRRMap.end(); )
    {
-      if (now >= (*it)->absoluteExpiry())
+      if (now >= it->second->absoluteExpiry())
       {
-         (*it)->remove();
-         delete *it;
-         mRRSet.erase(it++);
+         erase(it++);
       }
       else
       {
          strm << endl;
-         (*it)->encodeRRList(strm);
+         it->second->encodeRRList(strm);
          ++it;
       }
    }
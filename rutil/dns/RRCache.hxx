@@ -2,9 +2,10 @@
 #define RESIP_RRCACHE_HXX
 
 #include <map>
-#include <set>
 #include <memory>
 
+#include "rutil/HashMap.hxx"
+
 #include "rutil/dns/RRFactory.hxx"
 #include "rutil/dns/DnsResourceRecord.hxx"
 #include "rutil/dns/DnsAAAARecord.hxx"
@@ -42,7 +43,22 @@ class RRCache
                     const int rrType,
                     const int status,
                     RROverlay overlay);
-      bool lookup(const Data& target, const int type, const int proto, Result& records, int& status);
+      // If refresh is given, it is set when the caller should re-query
+      // target in the background (see setPrefetch and setMaxStale); the entry
+      // is then not offered for refresh again until it is updated or
+      // refreshDone is called.  stale, if given, is set when the records
+      // returned are past their TTL.
+      bool lookup(const Data& target, const int type, const int proto, Result& records, int& status,
+                  bool* refresh = 0, bool* stale = 0);
+      void refreshDone(const Data& target, const int type);
+      // An entry looked up at least minHits times since it was cached is
+      // offered for refresh once no more than percent of its TTL is left.
+      // minHits of 0 (the default) turns prefetching off.
+      void setPrefetch(unsigned int minHits, unsigned int percent);
+      // An expired entry may still be returned for up to seconds past its
+      // TTL, to callers that will refresh it.  0 (the default) never returns
+      // stale records.
+      void setMaxStale(unsigned int seconds) { mMaxStale = seconds; }
       void clearCache();
       void logCache();
       void getCacheDump(Data& dnsCacheDump);
@@ -52,26 +68,41 @@ class RRCache
       static const int DEFAULT_USER_DEFINED_TTL = 10; // in seconds.
 
       static const int DEFAULT_SIZE = 512;
-      class CompareT
+      // Entries are keyed by (rrType, target), with target compared without
+      // regard to case.  A stored Key points at its RRList's own key() and
+      // hashes it once on insert; a lookup Key points at the caller's target,
+      // so neither a lookup nor a compare allocates.
+      class Key
       {
          public:
-            bool operator()(const RRList* lhs, const RRList* rhs) const
+            Key(int rrType, const Data& target)
+               : mRRType(rrType),
+                 mTarget(&target),
+                 mHash(target.caseInsensitivehash() * 31 + rrType)
+            {}
+
+            bool operator==(const Key& rhs) const
             {
-               if (lhs->rrType() < rhs->rrType())
-               {
-                  return true;
-               }
-               else if (lhs->rrType() > rhs->rrType())
-               {
-                  return false;
-               }
-               else
-               {
-                  return (Data(lhs->key())).lowercase() < (Data(rhs->key())).lowercase();
-               }
+               return mHash == rhs.mHash &&
+                  mRRType == rhs.mRRType &&
+                  isEqualNoCase(*mTarget, *rhs.mTarget);
             }
+
+            int mRRType;
+            const Data* mTarget;
+            size_t mHash;
+      };
+
+      class KeyHash
+      {
+         public:
+            size_t operator()(const Key& key) const { return key.mHash; }
       };
 
+      typedef HashMap<Key, RRList*, KeyHash> RRMap;
+
+      void insert(RRList* node);
+      void erase(RRMap::iterator it);
       void touch(RRList* node);
       void cleanup();
       int getTTL(const RROverlay& overlay);
@@ -81,8 +112,7 @@ class RRCache
       LruListType* mLruHead;                     
       Result Empty;
 
-      typedef std::set<RRList*, CompareT> RRSet;
-      RRSet mRRSet;
+      RRMap mRRMap;
 
       RRFactory<DnsHostRecord> mHostRecordFactory;
       RRFactory<DnsSrvRecord> mSrvRecordFactory;
@@ -95,6 +125,9 @@ class RRCache
       
       int mUserDefinedTTL; // used when the ttl in RR is 0 or less than default(10). in seconds.
       unsigned int mSize;
+      unsigned int mPrefetchHits;
+      unsigned int mPrefetchPercent;
+      unsigned int mMaxStale;
 };
 
 }
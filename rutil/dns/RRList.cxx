@@ -39,7 +39,7 @@ using namespace std;
 
 #define RESIPROCATE_SUBSYSTEM resip::Subsystem::DNS
 
-RRList::RRList() : mRRType(0), mStatus(0), mAbsoluteExpiry(ULONG_MAX) {}
+RRList::RRList() : mRRType(0), mStatus(0), mAbsoluteExpiry(ULONG_MAX), mLifetime(0), mHits(0), mRefreshing(false) {}
 
 RRList::RRList(const Data& key, 
                const int rrtype, 
@@ -48,10 +48,11 @@ RRList::RRList(const Data& key,
    : mKey(key), mRRType(rrtype), mStatus(status)
 {
    mAbsoluteExpiry = ttl + Timer::getTimeSecs();
+   cached();
 }
 
 RRList::RRList(const DnsHostRecord &record, int ttl)
-   : mKey(record.name()), mRRType(T_A), mStatus(0), mAbsoluteExpiry(ULONG_MAX)
+   : mKey(record.name()), mRRType(T_A), mStatus(0), mAbsoluteExpiry(ULONG_MAX), mLifetime(0), mHits(0), mRefreshing(false)
 {
    update(record, ttl);
 }
@@ -64,10 +65,11 @@ void RRList::update(const DnsHostRecord &record, int ttl)
    item.record = new DnsHostRecord(record);
    mRecords.push_back(item);
    mAbsoluteExpiry = Timer::getTimeSecs() + ttl;
+   cached();
 }
       
 RRList::RRList(const Data& key, int rrtype)
-   : mKey(key), mRRType(rrtype), mStatus(0), mAbsoluteExpiry(ULONG_MAX)
+   : mKey(key), mRRType(rrtype), mStatus(0), mAbsoluteExpiry(ULONG_MAX), mLifetime(0), mHits(0), mRefreshing(false)
 {}
 
 RRList::~RRList()
@@ -116,6 +118,15 @@ void RRList::update(const RRFactoryBase* factory, Itr begin, Itr end, int ttl)
    }
 
    mAbsoluteExpiry += Timer::getTimeSecs();
+   cached();
+}
+
+void RRList::cached()
+{
+   uint64_t now = Timer::getTimeSecs();
+   mLifetime = mAbsoluteExpiry > now ? mAbsoluteExpiry - now : 0;
+   mHits = 0;
+   mRefreshing = false;
 }
 
 RRList::Records RRList::records(const int protocol)
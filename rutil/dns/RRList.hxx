@@ -53,6 +53,12 @@ class RRList : public IntrusiveListElement<RRList*>
       int rrType() const { return mRRType; }
       uint64_t absoluteExpiry() const { return mAbsoluteExpiry; }
       uint64_t& absoluteExpiry() { return mAbsoluteExpiry; }
+      // TTL the entry was last cached with, in seconds.
+      uint64_t lifetime() const { return mLifetime; }
+      // Lookups since the entry was last cached.
+      unsigned int& hits() { return mHits; }
+      // Whether a background refresh of the entry is outstanding.
+      bool& refreshing() { return mRefreshing; }
       void log();
       EncodeStream& encodeRRList(EncodeStream& strm);
 
@@ -74,7 +80,11 @@ class RRList : public IntrusiveListElement<RRList*>
 
       int mStatus; // dns query status.
       uint64_t mAbsoluteExpiry;
+      uint64_t mLifetime;
+      unsigned int mHits;
+      bool mRefreshing;
 
+      void cached();
       RecordItr find(const Data&);
       void clear();
 };
@@ -0,0 +1,164 @@
+#include <cassert>
+#include <iostream>
+
+#include "rutil/AdaptiveCongestionManager.hxx"
+#include "rutil/Fifo.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Time.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+namespace
+{
+
+void
+fill(Fifo<int>& fifo, size_t depth)
+{
+   while (fifo.size() > depth)
+   {
+      delete fifo.getNext();
+   }
+   while (fifo.size() < depth)
+   {
+      fifo.add(new int(0));
+   }
+   // Let the manager take a new sample.
+   sleepMs(250);
+}
+
+int
+countShed(const CongestionManager& manager,
+          const FifoStatsInterface& fifo,
+          CongestionManager::WorkClass work)
+{
+   int shed = 0;
+   for (int i = 0; i < 100; ++i)
+   {
+      if (manager.getRejectionBehaviorForWork(&fifo, work) != CongestionManager::NORMAL)
+      {
+         ++shed;
+      }
+   }
+   return shed;
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   {
+      cerr << "!! Test the default sheds by fifo state only" << endl;
+      GeneralCongestionManager manager(GeneralCongestionManager::SIZE, 10);
+      assert(!manager.usesWorkClasses());
+      Fifo<int> fifo;
+      manager.registerFifo(&fifo);
+      fifo.add(new int(0));
+      assert(manager.getRejectionBehaviorForWork(&fifo, CongestionManager::NEW_WORK) == CongestionManager::NORMAL);
+      fill(fifo, 9);
+      assert(manager.getRejectionBehaviorForWork(&fifo, CongestionManager::ESSENTIAL_WORK) == CongestionManager::REJECTING_NEW_WORK);
+      manager.unregisterFifo(&fifo);
+   }
+
+   {
+      cerr << "!! Test work is shed by class as load grows" << endl;
+      // Leave CPU use out of it; the load is that of the fifo.
+      AdaptiveCongestionManager manager(GeneralCongestionManager::SIZE, 20, 0);
+      assert(manager.usesWorkClasses());
+      Fifo<int> fifo;
+      manager.registerFifo(&fifo);
+
+      fill(fifo, 5);
+      assert(manager.getLoadPercent() == 25);
+      assert(countShed(manager, fifo, CongestionManager::NEW_WORK) == 0);
+      assert(manager.getRetryAfter(&fifo) == 2);
+
+      fill(fifo, 15);
+      assert(manager.getLoadPercent() == 75);
+      assert(countShed(manager, fifo, CongestionManager::NEW_WORK) == 50);
+      assert(countShed(manager, fifo, CongestionManager::CONTINUING_WORK) == 0);
+      assert(countShed(manager, fifo, CongestionManager::ESSENTIAL_WORK) == 0);
+
+      fill(fifo, 25);
+      assert(manager.getLoadPercent() == 125);
+      assert(countShed(manager, fifo, CongestionManager::NEW_WORK) == 100);
+      assert(countShed(manager, fifo, CongestionManager::CONTINUING_WORK) == 50);
+      assert(countShed(manager, fifo, CongestionManager::ESSENTIAL_WORK) == 0);
+      assert(manager.getRejectionBehaviorForWork(&fifo, CongestionManager::NEW_WORK) == CongestionManager::REJECTING_NEW_WORK);
+
+      fill(fifo, 50);
+      assert(countShed(manager, fifo, CongestionManager::ESSENTIAL_WORK) == 50);
+      assert(manager.getRejectionBehaviorForWork(&fifo, CongestionManager::ESSENTIAL_WORK) == CongestionManager::REJECTING_NON_ESSENTIAL);
+
+      // Retry-After is at its maximum, spread over up to a quarter more.
+      bool spread = false;
+      for (int i = 0; i < 10; ++i)
+      {
+         uint32_t retryAfter = manager.getRetryAfter(&fifo);
+         assert(retryAfter >= 30 && retryAfter <= 37);
+         spread = spread || retryAfter != 30;
+      }
+      assert(spread);
+
+      manager.setShedding(CongestionManager::ESSENTIAL_WORK, 300, 400);
+      assert(countShed(manager, fifo, CongestionManager::ESSENTIAL_WORK) == 0);
+
+      manager.unregisterFifo(&fifo);
+   }
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -1,4 +1,6 @@
 #include <iostream>
+#include <thread>
+#include <vector>
 #include "rutil/Log.hxx"
 #include "rutil/Fifo.hxx"
 #include "rutil/FiniteFifo.hxx"
@@ -146,6 +148,104 @@ void Producer::thread()
    }
 }
 
+// Pushes its share of a range of numbers into a fifo as fast as it can.
+class Pusher: public ThreadIf
+{
+   public:
+      Pusher(Fifo<unsigned int>& fifo, unsigned int* values, unsigned int count) :
+         mFifo(fifo),
+         mValues(values),
+         mCount(count)
+      {}
+      virtual ~Pusher()
+      {
+         shutdown();
+         join();
+      }
+
+      void thread()
+      {
+         for (unsigned int i = 0; i < mCount; ++i)
+         {
+            mFifo.add(&mValues[i]);
+         }
+      }
+
+   private:
+      Fifo<unsigned int>& mFifo;
+      unsigned int* mValues;
+      unsigned int mCount;
+};
+
+// Several producers contend for one fifo while a single consumer drains it
+// in batches, the way the transaction layer drains its state machine fifo.
+// Also checks that each producer's messages come out in the order it added
+// them.
+void
+timeContention(bool lockFree, unsigned int numProducers, unsigned int perProducer)
+{
+   Fifo<unsigned int> fifo;
+   if (lockFree)
+   {
+      fifo.setLockFree();
+   }
+
+   unsigned int total = numProducers*perProducer;
+   vector<unsigned int> values(total);
+   for (unsigned int i = 0; i < total; ++i)
+   {
+      values[i] = i;
+   }
+   vector<unsigned int> next(numProducers, 0);
+
+   uint64_t start = Timer::getTimeMs();
+   vector<Pusher*> pushers;
+   for (unsigned int p = 0; p < numProducers; ++p)
+   {
+      pushers.push_back(new Pusher(fifo, &values[p*perProducer], perProducer));
+      pushers.back()->run();
+   }
+
+   unsigned int received = 0;
+   unsigned int batches = 0;
+   Fifo<unsigned int>::Messages batch;
+   while (received < total)
+   {
+      if (!fifo.getMultiple(1000, batch, 256))
+      {
+         continue;
+      }
+      ++batches;
+      for (Fifo<unsigned int>::Messages::const_iterator i = batch.begin(); i != batch.end(); ++i)
+      {
+         unsigned int p = **i / perProducer;
+         assert(**i % perProducer == next[p]);
+         ++next[p];
+      }
+      received += (unsigned int)batch.size();
+      batch.clear();
+   }
+   uint64_t done = Timer::getTimeMs();
+
+   for (unsigned int p = 0; p < numProducers; ++p)
+   {
+      delete pushers[p];
+   }
+   assert(fifo.empty());
+   assert(fifo.size() == 0);
+   cerr << (lockFree ? "lock-free: " : "locked:    ") << numProducers << " producers, "
+        << total << " messages in " << batches << " batches, " << done - start << " ms" << endl;
+}
+
+// getMultiple() is not public on TimeLimitFifo, but subclasses may use it.
+class BatchTimeLimitFifo : public TimeLimitFifo<Foo>
+{
+   public:
+      BatchTimeLimitFifo() : TimeLimitFifo<Foo>(5, 0) {}
+      using TimeLimitFifo<Foo>::Messages;
+      using TimeLimitFifo<Foo>::getMultiple;
+};
+
 bool
 isNear(int value, int reference, int epsilon=250)
 {
@@ -171,6 +271,17 @@ main()
       assert(abs(offMark) < 200);
    }
 
+   {
+      cerr << "!! test getNext(ms) empty lock-free fifo timing" << endl;
+      Fifo<Foo> fifo;
+      fifo.setLockFree();
+      uint64_t begin(Timer::getTimeMs());
+      assert(fifo.getNext(500) == 0);
+      uint64_t end(Timer::getTimeMs());
+      assert(isNear((int)(end - begin), 500, 200));
+      assert(fifo.getNext(RESIP_FIFO_NOWAIT) == 0);
+   }
+
    Fifo<Foo> f;
    FiniteFifo<Foo> ff(5);
 
@@ -336,6 +447,58 @@ main()
       assert(c);
    }
 
+   {
+      cerr << "!! Test lock-free limits" << endl;
+
+      TimeLimitFifo<Foo> tlfNS(2, 10); // 2 seconds, limit 10 (2 reserved)
+      tlfNS.setLockFree();
+      bool c;
+
+      assert(tlfNS.empty());
+      assert(tlfNS.timeDepth() == 0);
+
+      for (int i = 0; i < 8; ++i)
+      {
+         c = tlfNS.add(new Foo(Data("element") + Data(i)), TimeLimitFifo<Foo>::EnforceTimeDepth);
+         assert(c);
+      }
+      assert(tlfNS.size() == 8);
+      assert(tlfNS.getCountDepth() == 8);
+
+      c = tlfNS.add(new Foo("nope"), TimeLimitFifo<Foo>::IgnoreTimeDepth);
+      assert(!c);
+      c = tlfNS.add(new Foo("yep"), TimeLimitFifo<Foo>::InternalElement);
+      assert(c);
+      c = tlfNS.add(new Foo("yepAgain"), TimeLimitFifo<Foo>::InternalElement);
+      assert(c);
+      c = tlfNS.add(new Foo("hard nope!"), TimeLimitFifo<Foo>::InternalElement);
+      assert(!c);
+
+      for (int i = 0; i < 4; ++i)
+      {
+         Foo* fp = tlfNS.getNext();
+         assert(fp->mVal == Data("element") + Data(i));
+         delete fp;
+      }
+      assert(tlfNS.size() == 6);
+
+      sleepMS(3000);
+      assert(tlfNS.timeDepth() >= 2);
+      c = tlfNS.add(new Foo("nope"), TimeLimitFifo<Foo>::EnforceTimeDepth);
+      assert(!c);
+      c = tlfNS.add(new Foo("yep"), TimeLimitFifo<Foo>::IgnoreTimeDepth);
+      assert(c);
+
+      while (!tlfNS.empty())
+      {
+         delete tlfNS.getNext();
+      }
+      assert(tlfNS.timeDepth() == 0);
+
+      c = tlfNS.add(new Foo("first"), TimeLimitFifo<Foo>::EnforceTimeDepth);
+      assert(c);
+   }
+
    {
       cerr << "!! Test unlimited" << endl;
 
@@ -459,6 +622,86 @@ main()
       sleepMS(1000);
    }
 
+   {
+      cerr << "!! Test lock-free producers consumer" << endl;
+
+      TimeLimitFifo<Foo> tlfNS(20, 50000);
+      tlfNS.setLockFree();
+
+      Producer prod1(tlfNS);
+      Producer prod2(tlfNS);
+      Producer prod3(tlfNS);
+      Producer prod4(tlfNS);
+      Consumer cons(tlfNS);
+
+      cons.run();
+      prod1.run();
+      prod2.run();
+      prod3.run();
+      prod4.run();
+
+      prod1.join();
+      prod2.join();
+      prod3.join();
+      prod4.join();
+      cons.shutdown();
+      cons.join();
+   }
+
+   {
+      cerr << "!! Test lock-free time depth follows batch pops" << endl;
+      BatchTimeLimitFifo tlf;
+      tlf.setLockFree();
+      tlf.add(new Foo("old"), TimeLimitFifo<Foo>::EnforceTimeDepth);
+      sleepMS(2000);
+      tlf.add(new Foo("new"), TimeLimitFifo<Foo>::EnforceTimeDepth);
+      assert(tlf.timeDepth() >= 2);
+
+      BatchTimeLimitFifo::Messages batch;
+      tlf.getMultiple(batch, 1);
+      assert(batch.size() == 1);
+      delete batch.front().getMsg();
+      batch.clear();
+      assert(tlf.timeDepth() <= 1);
+
+      tlf.getMultiple(batch, 1);
+      delete batch.front().getMsg();
+      batch.clear();
+      assert(tlf.empty());
+      assert(tlf.timeDepth() == 0);
+   }
+
+   {
+      cerr << "!! Test lock-free time depth with a producer racing a pop" << endl;
+      // The consumer takes each message as soon as it is linked in, while
+      // the producer may still be in add(). Once both are done the fifo is
+      // empty, and must not be left holding a timestamp that will make it
+      // look older and older.
+      TimeLimitFifo<Foo> tlf(5, 0);
+      tlf.setLockFree();
+      uint64_t end = Timer::getTimeMs() + 2500;
+      while (Timer::getTimeMs() < end)
+      {
+         std::thread producer([&tlf]()
+         {
+            tlf.add(new Foo("racer"), TimeLimitFifo<Foo>::EnforceTimeDepth);
+         });
+         Foo* foo = tlf.getNext(1000);
+         producer.join();
+         assert(foo);
+         delete foo;
+         assert(tlf.empty());
+         assert(tlf.timeDepth() == 0);
+      }
+   }
+
+   {
+      cerr << "!! Test contention" << endl;
+
+      timeContention(false, 4, 250000);
+      timeContention(true, 4, 250000);
+   }
+
    cerr << "All OK" << endl;
    return 0;
 }
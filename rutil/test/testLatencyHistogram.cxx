@@ -0,0 +1,159 @@
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "rutil/LatencyHistogram.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/ShardedCounter.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   {
+      cerr << "!! Test buckets cover every value to within 1/16" << endl;
+      assert(LatencyHistogram::bucketIndex(0) == 0);
+      assert(LatencyHistogram::bucketIndex(31) == 31);
+      assert(LatencyHistogram::bucketIndex(32) == 32);
+      assert(LatencyHistogram::bucketIndex(33) == 32);
+      assert(LatencyHistogram::bucketIndex(34) == 33);
+      assert(LatencyHistogram::bucketIndex(UINT64_MAX) == LatencyHistogram::NumBuckets - 1);
+      assert(LatencyHistogram::bucketTop(LatencyHistogram::NumBuckets - 1) == UINT64_MAX);
+
+      uint64_t value = 1;
+      while (value < UINT64_MAX/3)
+      {
+         unsigned int index = LatencyHistogram::bucketIndex(value);
+         uint64_t top = LatencyHistogram::bucketTop(index);
+         assert(top >= value);
+         assert(top - value <= value/16);
+         assert(index == 0 || LatencyHistogram::bucketTop(index - 1) < value);
+         value = value*3 + 1;
+      }
+   }
+
+   {
+      cerr << "!! Test percentiles" << endl;
+      LatencyHistogram histogram;
+      assert(histogram.snapshot().count() == 0);
+      assert(histogram.snapshot().valueAtPercentile(50) == 0);
+
+      for (uint64_t i = 1; i <= 1000; ++i)
+      {
+         histogram.record(i*1000);
+      }
+      LatencyHistogram::Snapshot snapshot = histogram.snapshot();
+      assert(snapshot.count() == 1000);
+      assert(snapshot.min() == 1000);
+      assert(snapshot.max() == 1000000);
+      assert(snapshot.mean() == 500500);
+      uint64_t p50 = snapshot.valueAtPercentile(50);
+      assert(p50 >= 500000 && p50 <= 500000 + 500000/16);
+      uint64_t p99 = snapshot.valueAtPercentile(99);
+      assert(p99 >= 990000 && p99 <= 1000000);
+      assert(snapshot.valueAtPercentile(100) == 1000000);
+
+      LatencyHistogram::Snapshot merged;
+      merged.merge(snapshot);
+      merged.merge(snapshot);
+      assert(merged.count() == 2000);
+      assert(merged.valueAtPercentile(50) == p50);
+
+      histogram.reset();
+      assert(histogram.snapshot().count() == 0);
+      assert(histogram.snapshot().max() == 0);
+   }
+
+   {
+      cerr << "!! Test many threads at once" << endl;
+      LatencyHistogram histogram;
+      ShardedCounter counter;
+      const int threads = 8;
+      const int count = 100000;
+      vector<thread> workers;
+      for (int t = 0; t < threads; ++t)
+      {
+         workers.push_back(thread([&histogram, &counter, t]()
+         {
+            for (int i = 0; i < count; ++i)
+            {
+               ++counter;
+               histogram.record(t);
+            }
+         }));
+      }
+      // Reading while others write is allowed.
+      assert(counter.value() <= (uint64_t)threads*count);
+      for (size_t t = 0; t < workers.size(); ++t)
+      {
+         workers[t].join();
+      }
+
+      assert(counter.value() == (uint64_t)threads*count);
+      LatencyHistogram::Snapshot snapshot = histogram.snapshot();
+      assert(snapshot.count() == (uint64_t)threads*count);
+      assert(snapshot.min() == 0);
+      assert(snapshot.max() == threads - 1);
+
+      counter.reset();
+      assert(counter.value() == 0);
+   }
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
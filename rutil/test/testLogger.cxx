@@ -7,6 +7,11 @@
 #include "TestSubsystemLogLevel.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
+#include <cassert>
+#include <fstream>
+#include <thread>
+#include <vector>
+
 #ifdef WIN32
 #define usleep(x) Sleep(x/1000)
 #define sleep(x) Sleep(x*1000)
@@ -131,6 +136,67 @@ testThreadLocalLoggers(const char *appname)
    }
 }
 
+void
+testAsynchronousLogging(const char *appname)
+{
+   const char* fileName = "testLogger-async.txt";
+   remove(fileName);
+   Log::initialize(Log::File, Log::Info, appname, fileName);
+   Log::setAsynchronous(true, 64);
+   assert(Log::isAsynchronous());
+
+   const int threads = 4;
+   const int lines = 1000;
+   std::vector<std::thread> loggers;
+   for (int t = 0; t < threads; ++t)
+   {
+      loggers.push_back(std::thread([t]()
+      {
+         for (int i = 0; i < lines; ++i)
+         {
+            if (i % 100 == 0)
+            {
+               WarningLog(<< "async warning " << t << " " << i);
+            }
+            else
+            {
+               InfoLog(<< "async info " << t << " " << i);
+            }
+         }
+      }));
+   }
+   for (size_t t = 0; t < loggers.size(); ++t)
+   {
+      loggers[t].join();
+   }
+   Log::flush();
+   uint64_t dropped = Log::droppedCount();
+   Log::setAsynchronous(false);
+   assert(!Log::isAsynchronous());
+   Log::initialize(Log::Cout, Log::Info, appname);
+
+   // Everything is either written or counted as dropped; warnings are never 
+   // dropped.
+   std::ifstream in(fileName);
+   std::string line;
+   uint64_t written = 0;
+   int warnings = 0;
+   while (std::getline(in, line))
+   {
+      if (line.find("async ") != std::string::npos)
+      {
+         ++written;
+      }
+      if (line.find("async warning") != std::string::npos)
+      {
+         ++warnings;
+      }
+   }
+   InfoLog(<< "Asynchronous logging wrote " << written << " lines and dropped " << dropped);
+   assert(written + dropped == (uint64_t)threads*lines);
+   assert(warnings == threads*lines/100);
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -249,6 +315,8 @@ main(int argc, char* argv[])
    cout << endl;
    testThreadLocalLoggers(argv[0]);
 
+   testAsynchronousLogging(argv[0]);
+
    Log::initialize(Log::Cout, Log::Info, argv[0], 0, 0, "LOG_DAEMON", Log::MessageStructure::Unstructured, "TestDev");
    InfoLog(<<"This should appear-back to Cout");
 
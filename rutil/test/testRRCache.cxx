@@ -0,0 +1,385 @@
+#include <cassert>
+#include <iostream>
+
+#ifndef WIN32
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#endif
+
+#include <string.h>
+#include <vector>
+
+#include "rutil/Logger.hxx"
+#include "rutil/Time.hxx"
+#include "rutil/Timer.hxx"
+#include "rutil/dns/AresCompat.hxx"
+#include "rutil/dns/DnsStub.hxx"
+#include "rutil/dns/ExternalDns.hxx"
+#include "rutil/dns/ExternalDnsFactory.hxx"
+#include "rutil/dns/QueryTypes.hxx"
+#include "rutil/dns/RRCache.hxx"
+#include "rutil/dns/RROverlay.hxx"
+#include "rutil/ParseBuffer.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+namespace
+{
+
+void
+add(RRCache& cache, const Data& name, const char* address)
+{
+   in_addr addr;
+   inet_pton(AF_INET, address, &addr);
+   cache.updateCacheFromHostFile(DnsHostRecord(name, addr));
+}
+
+// Caches an A record for name as if received with the given TTL.
+void
+addFromWire(RRCache& cache, const Data& name, unsigned int ttl)
+{
+   std::vector<unsigned char> rr;
+   ParseBuffer pb(name);
+   while (!pb.eof())
+   {
+      const char* label = pb.position();
+      pb.skipToChar('.');
+      rr.push_back((unsigned char)(pb.position() - label));
+      rr.insert(rr.end(), label, (const char*)pb.position());
+      if (!pb.eof())
+      {
+         pb.skipChar();
+      }
+   }
+   const unsigned char fixed[] = { 0, T_A, 0, C_IN,
+                                   (unsigned char)(ttl >> 24), (unsigned char)(ttl >> 16),
+                                   (unsigned char)(ttl >> 8), (unsigned char)ttl,
+                                   0, 4, 10, 0, 0, 1 };
+   rr.push_back(0);
+   rr.insert(rr.end(), fixed, fixed + sizeof(fixed));
+
+   std::vector<RROverlay> overlays;
+   overlays.push_back(RROverlay(&rr[0], &rr[0], (int)rr.size()));
+   cache.updateCache(name, T_A, overlays.begin(), overlays.end());
+}
+
+bool
+lookup(RRCache& cache, const Data& name, Data* host = 0, bool* refresh = 0, bool* stale = 0)
+{
+   RRCache::Result records;
+   int status;
+   if (!cache.lookup(name, T_A, RRList::Protocol::Sip, records, status, refresh, stale))
+   {
+      return false;
+   }
+   assert(records.size() == 1);
+   if (host)
+   {
+      *host = static_cast<DnsHostRecord*>(records.front())->host();
+   }
+   return true;
+}
+
+// Sends nothing; records the lookups it is asked for, to be answered by the
+// test.
+class FakeDns : public ExternalDns
+{
+   public:
+      struct Lookup
+      {
+         Data target;
+         unsigned short type;
+         void* userData;
+      };
+      std::vector<Lookup> mLookups;
+
+      virtual int init(const std::vector<GenericIPAddress>&, AfterSocketCreationFuncPtr,
+                       int, int, unsigned int) { return Success; }
+      virtual int init(int, int, unsigned int) { return Success; }
+      virtual bool checkDnsChange() { return false; }
+      virtual unsigned int getTimeTillNextProcessMS() { return 1000; }
+      virtual void buildFdSet(fd_set&, fd_set&, int&) {}
+      virtual void process(fd_set&, fd_set&) {}
+      virtual void setPollGrp(FdPollGrp*) {}
+      virtual void processTimers() {}
+      virtual void freeResult(ExternalDnsRawResult) {}
+      virtual void freeResult(ExternalDnsHostResult) {}
+      virtual char* errorMessage(long errorCode)
+      {
+         char* message = new char[6];
+         strcpy(message, "error");
+         return message;
+      }
+      virtual void lookup(const char* target, unsigned short type, ExternalDnsHandler*, void* userData)
+      {
+         Lookup lookup = { target, type, userData };
+         mLookups.push_back(lookup);
+      }
+      virtual bool hostFileLookup(const char*, in_addr&) { return false; }
+      virtual bool hostFileLookupLookupOnlyMode() { return false; }
+};
+
+class FakeDnsCreator : public ExternalDnsCreator
+{
+   public:
+      FakeDnsCreator() : mDns(0) {}
+      virtual ExternalDns* createExternalDns()
+      {
+         mDns = new FakeDns;
+         return mDns;
+      }
+      FakeDns* mDns;
+};
+
+// Counts the results it is given
+class CountingSink : public DnsResultSink
+{
+   public:
+      CountingSink() : mResults(0), mStatus(0) {}
+      virtual void onDnsResult(const DNSResult<DnsHostRecord>& r) { ++mResults; mStatus = r.status; }
+      virtual void onDnsResult(const DNSResult<DnsAAAARecord>& r) { ++mResults; mStatus = r.status; }
+      virtual void onDnsResult(const DNSResult<DnsSrvRecord>& r) { ++mResults; mStatus = r.status; }
+      virtual void onDnsResult(const DNSResult<DnsNaptrRecord>& r) { ++mResults; mStatus = r.status; }
+      virtual void onDnsResult(const DNSResult<DnsCnameRecord>& r) { ++mResults; mStatus = r.status; }
+      int mResults;
+      int mStatus;
+};
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   {
+      cerr << "!! Test lookup ignores case" << endl;
+      RRCache cache;
+      add(cache, "Sip.Example.COM", "10.0.0.1");
+      Data host;
+      assert(lookup(cache, "sip.example.com", &host));
+      assert(host == "10.0.0.1");
+      assert(lookup(cache, "SIP.EXAMPLE.COM"));
+      assert(!lookup(cache, "sip.example.org"));
+
+      // An update in another case replaces the same entry.
+      add(cache, "sip.example.com", "10.0.0.2");
+      assert(lookup(cache, "Sip.Example.Com", &host));
+      assert(host == "10.0.0.2");
+   }
+
+   {
+      cerr << "!! Test least recently used entries are purged" << endl;
+      RRCache cache;
+      cache.setSize(4);
+      add(cache, "a.example.com", "10.0.0.1");
+      add(cache, "b.example.com", "10.0.0.2");
+      add(cache, "c.example.com", "10.0.0.3");
+      assert(lookup(cache, "a.example.com"));
+      add(cache, "d.example.com", "10.0.0.4");
+      // b was least recently used.
+      assert(!lookup(cache, "b.example.com"));
+      assert(lookup(cache, "a.example.com"));
+      assert(lookup(cache, "c.example.com"));
+      assert(lookup(cache, "d.example.com"));
+
+      // Shrinking the cache drops the oldest entries on the next insert.
+      cache.setSize(2);
+      add(cache, "e.example.com", "10.0.0.5");
+      assert(!lookup(cache, "a.example.com"));
+      assert(!lookup(cache, "c.example.com"));
+      assert(!lookup(cache, "d.example.com"));
+      assert(lookup(cache, "e.example.com"));
+   }
+
+   {
+      cerr << "!! Test hot entries are offered for refresh" << endl;
+      RRCache cache;
+      bool refresh;
+      add(cache, "hot.example.com", "10.0.0.1");
+      // Off by default.
+      for (int i = 0; i < 5; ++i)
+      {
+         assert(lookup(cache, "hot.example.com", 0, &refresh));
+         assert(!refresh);
+      }
+
+      // Any time left is within 100% of the TTL, so only hits count.
+      cache.setPrefetch(3, 100);
+      add(cache, "hot.example.com", "10.0.0.1");
+      assert(lookup(cache, "hot.example.com", 0, &refresh));
+      assert(!refresh);
+      assert(lookup(cache, "hot.example.com", 0, &refresh));
+      assert(!refresh);
+      assert(lookup(cache, "hot.example.com", 0, &refresh));
+      assert(refresh);
+      // Offered once until the refresh is done.
+      assert(lookup(cache, "hot.example.com", 0, &refresh));
+      assert(!refresh);
+      cache.refreshDone("hot.example.com", T_A);
+      assert(lookup(cache, "hot.example.com", 0, &refresh));
+      assert(refresh);
+
+      // Updating the entry starts counting again.
+      add(cache, "hot.example.com", "10.0.0.2");
+      assert(lookup(cache, "hot.example.com", 0, &refresh));
+      assert(!refresh);
+
+      // Nowhere near the end of its TTL.
+      cache.setPrefetch(1, 50);
+      assert(lookup(cache, "hot.example.com", 0, &refresh));
+      assert(!refresh);
+   }
+
+   {
+      cerr << "!! Test expired entries are served only within the max stale window" << endl;
+      RRCache cache;
+      cache.setMaxStale(2);
+      // Held for the minimum TTL, 10 seconds
+      addFromWire(cache, "stale.example.com", 0);
+      bool refresh;
+      bool stale;
+      assert(lookup(cache, "stale.example.com", 0, &refresh, &stale));
+      assert(!refresh && !stale);
+
+      uint64_t start = Timer::getTimeMs();
+      while (lookup(cache, "stale.example.com", 0, &refresh, &stale) && !stale)
+      {
+         assert(Timer::getTimeMs() - start < 12000);
+         sleepMs(50);
+      }
+      // Past its TTL: still served, to callers that refresh it, and offered
+      // for refresh once.
+      uint64_t expired = Timer::getTimeMs();
+      assert(stale && refresh);
+      assert(lookup(cache, "stale.example.com", 0, &refresh, &stale));
+      assert(stale && !refresh);
+
+      while (lookup(cache, "stale.example.com", 0, &refresh, &stale))
+      {
+         assert(stale);
+         assert(Timer::getTimeMs() - expired < 3000);
+         sleepMs(50);
+      }
+      // Past the window it is evicted.
+      assert(Timer::getTimeMs() - expired >= 1000);
+      assert(!lookup(cache, "stale.example.com", 0, &refresh, &stale));
+
+      // Callers that do not refresh never get stale records, and evict them.
+      cache.setMaxStale(3600);
+      addFromWire(cache, "stale.example.com", 0);
+      while (lookup(cache, "stale.example.com", 0, &refresh, &stale) && !stale)
+      {
+         sleepMs(50);
+      }
+      assert(!lookup(cache, "stale.example.com"));
+      assert(!lookup(cache, "stale.example.com", 0, &refresh, &stale));
+   }
+
+   {
+      cerr << "!! Test a large cache" << endl;
+      const int count = 100000;
+      RRCache cache;
+      cache.setSize(count + 1);
+      for (int i = 0; i < count; ++i)
+      {
+         add(cache, Data(i) + ".e164.example.com", "10.0.0.1");
+      }
+      for (int i = 0; i < count; ++i)
+      {
+         assert(lookup(cache, Data(i) + ".E164.example.com"));
+      }
+      assert(!lookup(cache, Data(count) + ".e164.example.com"));
+
+      cache.clearCache();
+      assert(!lookup(cache, "0.e164.example.com"));
+   }
+
+   {
+      cerr << "!! Test concurrent lookups of the same records share one query" << endl;
+      FakeDnsCreator creator;
+      ExternalDnsFactory::setExternalCreator(&creator);
+      {
+         DnsStub stub;
+         FakeDns& dns = *creator.mDns;
+         CountingSink first;
+         CountingSink second;
+         CountingSink other;
+         stub.query<RR_A>("sip.example.com", RRList::Protocol::Sip, &first);
+         stub.query<RR_A>("SIP.Example.com", RRList::Protocol::Sip, &second);
+         assert(dns.mLookups.size() == 1);
+         // Other records are queried for on their own.
+         stub.query<RR_SRV>("_sip._udp.example.com", RRList::Protocol::Sip, &other);
+         assert(dns.mLookups.size() == 2);
+         assert(dns.mLookups[1].type == T_SRV);
+
+         // Both get the one answer.
+         stub.handleDnsRaw(ExternalDnsRawResult(ARES_ETIMEOUT, 0, 0, dns.mLookups[0].userData));
+         assert(first.mResults == 1 && first.mStatus == ARES_ETIMEOUT);
+         assert(second.mResults == 1 && second.mStatus == ARES_ETIMEOUT);
+         assert(other.mResults == 0);
+
+         // Once answered, the next lookup is sent again.
+         stub.query<RR_A>("sip.example.com", RRList::Protocol::Sip, &first);
+         assert(dns.mLookups.size() == 3);
+         stub.handleDnsRaw(ExternalDnsRawResult(ARES_ETIMEOUT, 0, 0, dns.mLookups[2].userData));
+         stub.handleDnsRaw(ExternalDnsRawResult(ARES_ETIMEOUT, 0, 0, dns.mLookups[1].userData));
+         assert(first.mResults == 2 && other.mResults == 1);
+      }
+      ExternalDnsFactory::setExternalCreator(0);
+   }
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,352 @@
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <set>
+#include <vector>
+#include <stdlib.h>
+
+#include "rutil/TimerWheel.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+// Runs a check of the TimerWheel against a std::multiset with a simulated
+// clock, then times a heap and the wheel with 10M timers, or as many as
+// given on the command line. A multiset is timed too for up to 1M timers,
+// or for any number if a second argument is given:
+//   testTimerWheel [numTimers [multiset]]
+
+namespace
+{
+
+class TestTimer
+{
+   public:
+      TestTimer(uint64_t when, unsigned int id) : mWhen(when), mId(id) {}
+
+      uint64_t getWhen() const { return mWhen; }
+      unsigned int getId() const { return mId; }
+
+      bool operator<(const TestTimer& rhs) const
+      {
+         return mWhen < rhs.mWhen || (mWhen == rhs.mWhen && mId < rhs.mId);
+      }
+      bool operator>(const TestTimer& rhs) const
+      {
+         return rhs < *this;
+      }
+
+   private:
+      uint64_t mWhen;
+      unsigned int mId;
+};
+
+// Deterministic, so that a failure can be reproduced.
+unsigned int seed = 1;
+unsigned int
+nextRandom()
+{
+   seed = seed*1103515245 + 12345;
+   return (seed >> 8) & 0xFFFFFF;
+}
+
+// Spread over every level of the wheel and the overflow list.
+uint64_t
+randomDelay()
+{
+   switch (nextRandom() % 6)
+   {
+      case 0:
+         return nextRandom() % 4;
+      case 1:
+         return nextRandom() % 256;
+      case 2:
+         return nextRandom() % 65536;
+      case 3:
+         return (uint64_t)nextRandom() * 64;
+      case 4:
+         return (uint64_t)nextRandom() * 512;
+      default:
+         return ((uint64_t)nextRandom() << 16) + nextRandom();
+   }
+}
+
+// What the stack sets most: T1 retransmissions, 32 s transaction timeouts
+// and the odd Timer C, spread over a second as transactions come and go.
+unsigned long
+sipDelay(unsigned int i)
+{
+   static const unsigned long delays[] = { 500, 1000, 2000, 4000, 32000, 32000, 5000, 180000 };
+   return delays[i & 7] + nextRandom() % 1000;
+}
+
+void
+checkAgainstMultiset()
+{
+   // Start close to the end of a 2^32 ms window so the overflow list gets
+   // redistributed too.
+   uint64_t now = 0xFFFFF000ULL;
+   TimerWheel<TestTimer> wheel(now);
+   multiset<TestTimer> reference;
+   vector<TimerWheel<TestTimer>::Handle> handles;
+   vector<TestTimer> timers;
+   unsigned int id = 0;
+
+   for (int round = 0; round < 20000; ++round)
+   {
+      for (unsigned int n = nextRandom() % 20; n > 0; --n)
+      {
+         TestTimer t(now + randomDelay(), id++);
+         handles.push_back(wheel.push(t));
+         timers.push_back(t);
+         reference.insert(t);
+      }
+
+      if (!handles.empty() && nextRandom() % 3 == 0)
+      {
+         unsigned int i = nextRandom() % handles.size();
+         bool pending = reference.erase(timers[i]) > 0;
+         assert(wheel.contains(handles[i]) == pending);
+         assert(wheel.cancel(handles[i]) == pending);
+         assert(!wheel.contains(handles[i]));
+         assert(!wheel.cancel(handles[i]));
+      }
+
+      switch (nextRandom() % 4)
+      {
+         case 0:
+            break;
+         case 1:
+            now += nextRandom() % 8;
+            break;
+         case 2:
+            now += nextRandom() % 1000;
+            break;
+         default:
+            now += nextRandom() * 16;
+            break;
+      }
+
+      wheel.advance(now);
+      vector<TestTimer> fired;
+      while (!wheel.empty() && wheel.top().getWhen() <= now)
+      {
+         fired.push_back(wheel.top());
+         wheel.pop();
+      }
+      vector<TestTimer> expected;
+      while (!reference.empty() && reference.begin()->getWhen() <= now)
+      {
+         expected.push_back(*reference.begin());
+         reference.erase(reference.begin());
+      }
+
+      // Timers that expire in the same ms may come out in any order.
+      sort(fired.begin(), fired.end());
+      assert(fired.size() == expected.size());
+      for (size_t i = 0; i < fired.size(); ++i)
+      {
+         assert(fired[i].getId() == expected[i].getId());
+      }
+
+      assert(wheel.size() == reference.size());
+      if (!wheel.empty())
+      {
+         assert(wheel.top().getWhen() == reference.begin()->getWhen());
+      }
+   }
+
+   while (!wheel.empty())
+   {
+      wheel.pop_front();
+   }
+   cerr << "TimerWheel matches multiset: " << id << " timers" << endl;
+}
+
+// Times adding all timers at once, cancelling every other one (which only
+// the multiset and the wheel can do) and expiring the rest while the clock
+// moves on one ms at a time.
+void
+timeHeap(unsigned int numTimers)
+{
+   priority_queue<TestTimer, vector<TestTimer>, greater<TestTimer> > heap;
+   uint64_t now = 0;
+   seed = 1;
+
+   uint64_t start = Timer::getTimeMs();
+   for (unsigned int i = 0; i < numTimers; ++i)
+   {
+      heap.push(TestTimer(now + sipDelay(i), i));
+   }
+   uint64_t added = Timer::getTimeMs();
+
+   unsigned int fired = 0;
+   while (!heap.empty())
+   {
+      ++now;
+      while (!heap.empty() && heap.top().getWhen() <= now)
+      {
+         heap.pop();
+         ++fired;
+      }
+   }
+   uint64_t done = Timer::getTimeMs();
+
+   assert(fired == numTimers);
+   cerr << "heap:     add " << added - start << " ms, cancel n/a, expire "
+        << done - added << " ms" << endl;
+}
+
+void
+timeMultiset(unsigned int numTimers)
+{
+   multiset<TestTimer> timers;
+   vector<multiset<TestTimer>::iterator> handles;
+   handles.reserve(numTimers);
+   uint64_t now = 0;
+   seed = 1;
+
+   uint64_t start = Timer::getTimeMs();
+   for (unsigned int i = 0; i < numTimers; ++i)
+   {
+      handles.push_back(timers.insert(TestTimer(now + sipDelay(i), i)));
+   }
+   uint64_t added = Timer::getTimeMs();
+
+   for (unsigned int i = 0; i < numTimers; i += 2)
+   {
+      timers.erase(handles[i]);
+   }
+   uint64_t cancelled = Timer::getTimeMs();
+
+   unsigned int fired = 0;
+   while (!timers.empty())
+   {
+      ++now;
+      while (!timers.empty() && timers.begin()->getWhen() <= now)
+      {
+         timers.erase(timers.begin());
+         ++fired;
+      }
+   }
+   uint64_t done = Timer::getTimeMs();
+
+   assert(fired == numTimers/2);
+   cerr << "multiset: add " << added - start << " ms, cancel " << cancelled - added
+        << " ms, expire " << done - cancelled << " ms" << endl;
+}
+
+void
+timeWheel(unsigned int numTimers)
+{
+   uint64_t now = 0;
+   TimerWheel<TestTimer> wheel(now);
+   vector<TimerWheel<TestTimer>::Handle> handles;
+   handles.reserve(numTimers);
+   seed = 1;
+
+   uint64_t start = Timer::getTimeMs();
+   for (unsigned int i = 0; i < numTimers; ++i)
+   {
+      handles.push_back(wheel.push(TestTimer(now + sipDelay(i), i)));
+   }
+   uint64_t added = Timer::getTimeMs();
+
+   for (unsigned int i = 0; i < numTimers; i += 2)
+   {
+      wheel.cancel(handles[i]);
+   }
+   uint64_t cancelled = Timer::getTimeMs();
+
+   unsigned int fired = 0;
+   while (!wheel.empty())
+   {
+      wheel.advance(++now);
+      while (!wheel.empty() && wheel.top().getWhen() <= now)
+      {
+         wheel.pop();
+         ++fired;
+      }
+   }
+   uint64_t done = Timer::getTimeMs();
+
+   assert(fired == numTimers/2);
+   cerr << "wheel:    add " << added - start << " ms, cancel " << cancelled - added
+        << " ms, expire " << done - cancelled << " ms" << endl;
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   unsigned int numTimers = 10000000;
+   if (argc > 1)
+   {
+      numTimers = (unsigned int)atoi(argv[1]);
+   }
+
+   checkAgainstMultiset();
+
+   cerr << numTimers << " timers:" << endl;
+   timeHeap(numTimers);
+   timeWheel(numTimers);
+   // Random inserts into a tree this size take the better part of a minute.
+   if (numTimers <= 1000000 || argc > 2)
+   {
+      timeMultiset(numTimers);
+   }
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */